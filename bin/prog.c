@@ -170,12 +170,17 @@ prog_print_common_options (const struct prog *prog, FILE *out)
 "   -S opt=val  Socket options.  Supported options:\n"
 "                   sndbuf=12345    # Sets SO_SNDBUF\n"
 "                   rcvbuf=12345    # Sets SO_RCVBUF\n"
+#if HAVE_UDP_GRO
+"                   gro=1           # Sets UDP_GRO\n"
+#endif
 "   -W          Use stock PMI (malloc & free)\n"
 "   -A CC_ALGO  Congestion control algorithm.  The following algorithms are\n"
 "                 supported.\n"
 "                   1: Cubic\n"
 "                   2: BBRv1\n"
 "                   3: Adaptive congestion control (this is the default).\n"
+"                   4: BBRv2\n"
+"                   5: Prague (L4S)\n"
     );
 
 #if HAVE_SENDMMSG
@@ -334,6 +339,17 @@ prog_set_opt (struct prog *prog, int opt, const char *arg)
                 free(name);
                 return 0;
             }
+#if HAVE_UDP_GRO
+            else if (0 == strcasecmp(name, "gro"))
+            {
+                if (atoi(val))
+                    sport->sp_flags |= SPORT_GRO;
+                else
+                    sport->sp_flags &= ~SPORT_GRO;
+                free(name);
+                return 0;
+            }
+#endif
             else
             {
                 free(name);
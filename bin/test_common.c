@@ -31,6 +31,14 @@
 
 #include "test_config.h"
 
+#if HAVE_UDP_SEGMENT || HAVE_UDP_GRO
+#include <netinet/udp.h>
+#endif
+
+#if HAVE_SO_TXTIME
+#include <linux/net_tstamp.h>
+#endif
+
 #if HAVE_REGEX
 #ifndef WIN32
 #include <regex.h>
@@ -77,14 +85,22 @@
 #define ECN_SZ 0
 #endif
 
+#if HAVE_UDP_GRO
+#define GRO_SZ CMSG_SPACE(sizeof(int))
+#else
+#define GRO_SZ 0
+#endif
+
 #define MAX_PACKET_SZ 0xffff
 
 #define CTL_SZ (CMSG_SPACE(MAX(DST_MSG_SZ, \
-                        sizeof(struct in6_pktinfo))) + NDROPPED_SZ + ECN_SZ)
+                        sizeof(struct in6_pktinfo))) + NDROPPED_SZ + ECN_SZ \
+                                                                + GRO_SZ)
 
-/* There are `n_alloc' elements in `vecs', `local_addresses', and
- * `peer_addresses' arrays.  `ctlmsg_data' is n_alloc * CTL_SZ.  Each packets
- * gets a single `vecs' element that points somewhere into `packet_data'.
+/* There are `n_alloc' elements in `vecs', `local_addresses',
+ * `peer_addresses', and `specs' arrays.  `ctlmsg_data' is n_alloc * CTL_SZ.
+ * Each packets gets a single `vecs' element that points somewhere into
+ * `packet_data'.
  *
  * `n_alloc' is calculated at run-time based on the socket's receive buffer
  * size.
@@ -100,9 +116,13 @@ struct packets_in
 #endif
 #if ECN_SUPPORTED
     int                     *ecn;
+#endif
+#if HAVE_UDP_GRO
+    int                     *gro_size;  /* Zero if not a GRO buffer */
 #endif
     struct sockaddr_storage *local_addresses,
                             *peer_addresses;
+    struct lsquic_in_spec   *specs;
     unsigned                 n_alloc;
     unsigned                 data_sz;
 };
@@ -188,9 +208,13 @@ allocate_packets_in (SOCKET_TYPE fd)
     packs_in->vecs = malloc(n_alloc * sizeof(packs_in->vecs[0]));
     packs_in->local_addresses = malloc(n_alloc * sizeof(packs_in->local_addresses[0]));
     packs_in->peer_addresses = malloc(n_alloc * sizeof(packs_in->peer_addresses[0]));
+    packs_in->specs = malloc(n_alloc * sizeof(packs_in->specs[0]));
 #if ECN_SUPPORTED
     packs_in->ecn = malloc(n_alloc * sizeof(packs_in->ecn[0]));
 #endif
+#if HAVE_UDP_GRO
+    packs_in->gro_size = malloc(n_alloc * sizeof(packs_in->gro_size[0]));
+#endif
 
     return packs_in;
 }
@@ -202,6 +226,10 @@ free_packets_in (struct packets_in *packs_in)
 #if ECN_SUPPORTED
     free(packs_in->ecn);
 #endif
+#if HAVE_UDP_GRO
+    free(packs_in->gro_size);
+#endif
+    free(packs_in->specs);
     free(packs_in->peer_addresses);
     free(packs_in->local_addresses);
     free(packs_in->ctlmsg_data);
@@ -402,6 +430,9 @@ proc_ancillary (
 #endif
 #if ECN_SUPPORTED
                 , int *ecn
+#endif
+#if HAVE_UDP_GRO
+                , int *gro_size
 #endif
                 )
 {
@@ -469,6 +500,10 @@ proc_ancillary (
             *ecn = tos & IPTOS_ECN_MASK;
         }
 #endif
+#endif
+#if HAVE_UDP_GRO
+        else if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+            memcpy(gro_size, CMSG_DATA(cmsg), sizeof(*gro_size));
 #endif
     }
 }
@@ -570,6 +605,9 @@ read_one_packet (struct read_iter *iter)
 #endif
 #if ECN_SUPPORTED
     packs_in->ecn[iter->ri_idx] = 0;
+#endif
+#if HAVE_UDP_GRO
+    packs_in->gro_size[iter->ri_idx] = 0;
 #endif
     proc_ancillary(&msg, local_addr
 #if __linux__
@@ -577,6 +615,9 @@ read_one_packet (struct read_iter *iter)
 #endif
 #if ECN_SUPPORTED
         , &packs_in->ecn[iter->ri_idx]
+#endif
+#if HAVE_UDP_GRO
+        , &packs_in->gro_size[iter->ri_idx]
 #endif
     );
 #if LSQUIC_ECN_BLACK_HOLE && ECN_SUPPORTED
@@ -670,6 +711,9 @@ read_using_recvmmsg (struct read_iter *iter)
 #endif
 #if ECN_SUPPORTED
         packs_in->ecn[n] = 0;
+#endif
+#if HAVE_UDP_GRO
+        packs_in->gro_size[n] = 0;
 #endif
         proc_ancillary(&mmsghdrs[n].msg_hdr, local_addr
 #if __linux__
@@ -677,6 +721,9 @@ read_using_recvmmsg (struct read_iter *iter)
 #endif
 #if ECN_SUPPORTED
             , &packs_in->ecn[n]
+#endif
+#if HAVE_UDP_GRO
+            , &packs_in->gro_size[n]
 #endif
         );
 #if __linux__
@@ -749,24 +796,27 @@ read_handler (evutil_socket_t fd, short flags, void *ctx)
         n_batches += iter.ri_idx > 0;
 
         for (n = 0; n < iter.ri_idx; ++n)
-            if (0 > lsquic_engine_packet_in(engine,
+            packs_in->specs[n] = (struct lsquic_in_spec) {
 #ifndef WIN32
-                        packs_in->vecs[n].iov_base,
-                        packs_in->vecs[n].iov_len,
+                .buf        = packs_in->vecs[n].iov_base,
+                .bufsz      = packs_in->vecs[n].iov_len,
 #else
-                        (const unsigned char *) packs_in->vecs[n].buf,
-                        packs_in->vecs[n].len,
+                .buf        = (const unsigned char *) packs_in->vecs[n].buf,
+                .bufsz      = packs_in->vecs[n].len,
 #endif
-                        (struct sockaddr *) &packs_in->local_addresses[n],
-                        (struct sockaddr *) &packs_in->peer_addresses[n],
-                        sport,
+                .local_sa   = (struct sockaddr *) &packs_in->local_addresses[n],
+                .peer_sa    = (struct sockaddr *) &packs_in->peer_addresses[n],
+                .peer_ctx   = sport,
 #if ECN_SUPPORTED
-                        packs_in->ecn[n]
+                .ecn        = packs_in->ecn[n],
 #else
-                        0
+                .ecn        = 0,
 #endif
-                        ))
-                break;
+#if HAVE_UDP_GRO
+                .gso_size   = packs_in->gro_size[n],
+#endif
+            };
+        n = lsquic_engine_packets_in(engine, packs_in->specs, iter.ri_idx);
 
         if (n > 0)
             prog_process_conns(sport->sp_prog);
@@ -795,6 +845,23 @@ add_to_event_loop (struct service_port *sport, struct event_base *eb)
 }
 
 
+#if HAVE_SO_TXTIME
+/* Have the kernel hold each packet until the time given in SCM_TXTIME
+ * control message.  The library uses CLOCK_MONOTONIC, which is also the
+ * clock the fq qdisc expects.
+ */
+static int
+set_txtime (int sockfd)
+{
+    const struct sock_txtime txtime = { .clockid = CLOCK_MONOTONIC, };
+
+    return setsockopt(sockfd, SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime));
+}
+
+
+#endif
+
+
 int
 sport_init_server (struct service_port *sport, struct lsquic_engine *engine,
                    struct event_base *eb)
@@ -1037,6 +1104,35 @@ sport_init_server (struct service_port *sport, struct lsquic_engine *engine,
         }
     }
 
+#if HAVE_UDP_GRO
+    if (sport->sp_flags & SPORT_GRO)
+    {
+        on = 1;
+        s = setsockopt(sockfd, SOL_UDP, UDP_GRO, &on, sizeof(on));
+        if (0 != s)
+        {
+            saved_errno = errno;
+            close(sockfd);
+            errno = saved_errno;
+            return -1;
+        }
+    }
+#endif
+
+#if HAVE_SO_TXTIME
+    if (sport->sp_prog->prog_api.ea_settings->es_txtime)
+    {
+        s = set_txtime(sockfd);
+        if (0 != s)
+        {
+            saved_errno = errno;
+            close(sockfd);
+            errno = saved_errno;
+            return -1;
+        }
+    }
+#endif
+
     if (0 != getsockname(sockfd, (struct sockaddr *) sa_local, &socklen))
     {
         saved_errno = errno;
@@ -1251,6 +1347,35 @@ sport_init_client (struct service_port *sport, struct lsquic_engine *engine,
         }
     }
 
+#if HAVE_UDP_GRO
+    if (sport->sp_flags & SPORT_GRO)
+    {
+        int on = 1;
+        s = setsockopt(sockfd, SOL_UDP, UDP_GRO, &on, sizeof(on));
+        if (0 != s)
+        {
+            saved_errno = errno;
+            CLOSE_SOCKET(sockfd);
+            errno = saved_errno;
+            return -1;
+        }
+    }
+#endif
+
+#if HAVE_SO_TXTIME
+    if (sport->sp_prog->prog_api.ea_settings->es_txtime)
+    {
+        s = set_txtime(sockfd);
+        if (0 != s)
+        {
+            saved_errno = errno;
+            CLOSE_SOCKET(sockfd);
+            errno = saved_errno;
+            return -1;
+        }
+    }
+#endif
+
     if (0 != getsockname(sockfd, sa_local, &socklen))
     {
         saved_errno = errno;
@@ -1304,6 +1429,12 @@ enum ctl_what
 #if ECN_SUPPORTED
     CW_ECN          = 1 << 1,
 #endif
+#if HAVE_UDP_SEGMENT
+    CW_GSO          = 1 << 2,
+#endif
+#if HAVE_SO_TXTIME
+    CW_TXTIME       = 1 << 3,
+#endif
 };
 
 static void
@@ -1417,6 +1548,30 @@ setup_control_msg (
             }
             cw &= ~CW_ECN;
         }
+#endif
+#if HAVE_UDP_SEGMENT
+        else if (cw & CW_GSO)
+        {
+            const uint16_t gso_size = spec->gso_size;
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type  = UDP_SEGMENT;
+            cmsg->cmsg_len   = CMSG_LEN(sizeof(gso_size));
+            memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+            ctl_len += CMSG_SPACE(sizeof(gso_size));
+            cw &= ~CW_GSO;
+        }
+#endif
+#if HAVE_SO_TXTIME
+        else if (cw & CW_TXTIME)
+        {
+            const uint64_t txtime_ns = spec->txtime * 1000;
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type  = SCM_TXTIME;
+            cmsg->cmsg_len   = CMSG_LEN(sizeof(txtime_ns));
+            memcpy(CMSG_DATA(cmsg), &txtime_ns, sizeof(txtime_ns));
+            ctl_len += CMSG_SPACE(sizeof(txtime_ns));
+            cw &= ~CW_TXTIME;
+        }
 #endif
         else
             assert(0);
@@ -1470,6 +1625,9 @@ send_packets_using_sendmmsg (const struct lsquic_out_spec *specs,
                                                                   )
 #if ECN_SUPPORTED
             + CMSG_SPACE(sizeof(int))
+#endif
+#if HAVE_SO_TXTIME
+            + CMSG_SPACE(sizeof(uint64_t))
 #endif
                                                                     ];
         struct cmsghdr cmsg;
@@ -1503,7 +1661,15 @@ send_packets_using_sendmmsg (const struct lsquic_out_spec *specs,
             ancil_key |= specs[i].ecn;
         }
 #endif
-        if (cw && prev_ancil_key == ancil_key)
+#if HAVE_SO_TXTIME
+        if (specs[i].txtime)
+        {
+            /* Departure times differ: do not reuse ancillary message */
+            cw |= CW_TXTIME;
+            ancil_key = 0;
+        }
+#endif
+        if (cw && ancil_key && prev_ancil_key == ancil_key)
         {
             /* Reuse previous ancillary message */
             assert(i > 0);
@@ -1557,6 +1723,88 @@ send_packets_using_sendmmsg (const struct lsquic_out_spec *specs,
 #endif
 
 
+#if HAVE_UDP_SEGMENT
+/* Each spec is sent using a single sendmsg() call.  If the engine combined
+ * several packets into one spec (see es_gso), UDP_SEGMENT control message
+ * is used to have the kernel split it into separate datagrams.
+ */
+static int
+send_packets_using_gso (const struct lsquic_out_spec *specs, unsigned count)
+{
+    const struct service_port *sport;
+    enum ctl_what cw;
+    unsigned n;
+    int s, saved_errno;
+    struct msghdr msg;
+    union {
+        /* cmsg(3) recommends union for proper alignment */
+        unsigned char buf[
+            CMSG_SPACE(MAX(sizeof(struct in_pktinfo),
+                                                sizeof(struct in6_pktinfo)))
+#if ECN_SUPPORTED
+            + CMSG_SPACE(sizeof(int))
+#endif
+            + CMSG_SPACE(sizeof(uint16_t))
+#if HAVE_SO_TXTIME
+            + CMSG_SPACE(sizeof(uint64_t))
+#endif
+        ];
+        struct cmsghdr cmsg;
+    } ancil;
+
+    if (0 == count)
+        return 0;
+
+    for (n = 0; n < count; ++n)
+    {
+        sport = specs[n].peer_ctx;
+        msg.msg_name       = (void *) specs[n].dest_sa;
+        msg.msg_namelen    = (AF_INET == specs[n].dest_sa->sa_family ?
+                                            sizeof(struct sockaddr_in) :
+                                            sizeof(struct sockaddr_in6));
+        msg.msg_iov        = specs[n].iov;
+        msg.msg_iovlen     = specs[n].iovlen;
+        msg.msg_flags      = 0;
+        if ((sport->sp_flags & SPORT_SERVER) && specs[n].local_sa->sa_family)
+            cw = CW_SENDADDR;
+        else
+            cw = 0;
+#if ECN_SUPPORTED
+        if (sport->sp_prog->prog_api.ea_settings->es_ecn && specs[n].ecn)
+            cw |= CW_ECN;
+#endif
+        if (specs[n].gso_size)
+            cw |= CW_GSO;
+#if HAVE_SO_TXTIME
+        if (specs[n].txtime)
+            cw |= CW_TXTIME;
+#endif
+        if (cw)
+            setup_control_msg(&msg, cw, &specs[n], ancil.buf,
+                                                        sizeof(ancil.buf));
+        else
+        {
+            msg.msg_control    = NULL;
+            msg.msg_controllen = 0;
+        }
+        s = sendmsg(sport->fd, &msg, 0);
+        if (s < 0)
+        {
+            saved_errno = errno;
+            LSQ_INFO("sendmsg failed: %s", strerror(saved_errno));
+            prog_sport_cant_send(sport->sp_prog, sport->fd);
+            errno = saved_errno;
+            break;
+        }
+    }
+
+    return n > 0 ? (int) n : -1;
+}
+
+
+#endif
+
+
 #if LSQUIC_PREFERRED_ADDR
 static const struct service_port *
 find_sport (struct prog *prog, const struct sockaddr *local_sa)
@@ -1610,6 +1858,9 @@ send_packets_one_by_one (const struct lsquic_out_spec *specs, unsigned count)
             CMSG_SPACE(MAX(SIZE1, sizeof(struct in6_pktinfo)))
 #if ECN_SUPPORTED
             + CMSG_SPACE(sizeof(int))
+#endif
+#if HAVE_SO_TXTIME
+            + CMSG_SPACE(sizeof(uint64_t))
 #endif
         ];
         struct cmsghdr cmsg;
@@ -1699,7 +1950,15 @@ send_packets_one_by_one (const struct lsquic_out_spec *specs, unsigned count)
             ancil_key |= specs[n].ecn;
         }
 #endif
-        if (cw && prev_ancil_key == ancil_key)
+#if HAVE_SO_TXTIME
+        if (specs[n].txtime)
+        {
+            /* Departure times differ: do not reuse ancillary message */
+            cw |= CW_TXTIME;
+            ancil_key = 0;
+        }
+#endif
+        if (cw && ancil_key && prev_ancil_key == ancil_key)
         {
             /* Reuse previous ancillary message */
             ;
@@ -1769,8 +2028,15 @@ int
 sport_packets_out (void *ctx, const struct lsquic_out_spec *specs,
                    unsigned count)
 {
-#if HAVE_SENDMMSG
+#if HAVE_SENDMMSG || HAVE_UDP_SEGMENT
     const struct prog *prog = ctx;
+#endif
+#if HAVE_UDP_SEGMENT
+    if (prog->prog_api.ea_settings->es_gso)
+        return send_packets_using_gso(specs, count);
+    else
+#endif
+#if HAVE_SENDMMSG
     if (prog->prog_use_sendmmsg)
         return send_packets_using_sendmmsg(specs, count);
     else
@@ -1809,6 +2075,18 @@ set_engine_option (struct lsquic_engine_settings *settings,
                 LSQ_ERROR("ECN is not supported on this platform");
                 break;
             }
+#endif
+            return 0;
+        }
+        if (0 == strncmp(name, "gso", 3))
+        {
+            settings->es_gso = atoi(val);
+#if !HAVE_UDP_SEGMENT
+            if (settings->es_gso)
+            {
+                LSQ_ERROR("UDP GSO is not supported on this platform");
+                break;
+            }
 #endif
             return 0;
         }
@@ -1835,6 +2113,20 @@ set_engine_option (struct lsquic_engine_settings *settings,
             return 0;
         }
         break;
+    case 6:
+        if (0 == strncmp(name, "txtime", 6))
+        {
+            settings->es_txtime = atoi(val);
+#if !HAVE_SO_TXTIME
+            if (settings->es_txtime)
+            {
+                LSQ_ERROR("SO_TXTIME is not supported on this platform");
+                break;
+            }
+#endif
+            return 0;
+        }
+        break;
     case 7:
         if (0 == strncmp(name, "version", 7))
         {
@@ -1902,6 +2194,11 @@ set_engine_option (struct lsquic_engine_settings *settings,
         }
         break;
     case 10:
+        if (0 == strncmp(name, "max_memory", 10))
+        {
+            settings->es_max_memory = strtoull(val, NULL, 10);
+            return 0;
+        }
         if (0 == strncmp(name, "honor_prst", 10))
         {
             settings->es_honor_prst = atoi(val);
@@ -1924,6 +2221,11 @@ set_engine_option (struct lsquic_engine_settings *settings,
             settings->es_ping_period = atoi(val);
             return 0;
         }
+        if (0 == strncmp(name, "timer_wheel", 11))
+        {
+            settings->es_timer_wheel = atoi(val);
+            return 0;
+        }
         if (0 == strncmp(name, "base_plpmtu", 11))
         {
             settings->es_base_plpmtu = atoi(val);
@@ -2020,6 +2322,11 @@ set_engine_option (struct lsquic_engine_settings *settings,
             settings->es_max_streams_in = atoi(val);
             return 0;
         }
+        if (0 == strncmp(name, "path_cache_ttl", 14))
+        {
+            settings->es_path_cache_ttl = atoi(val);
+            return 0;
+        }
         if (0 == strncmp(name, "progress_check", 14))
         {
             settings->es_progress_check = atoi(val);
@@ -2102,6 +2409,13 @@ set_engine_option (struct lsquic_engine_settings *settings,
             return 0;
         }
         break;
+    case 19:
+        if (0 == strncmp(name, "mem_pressure_thresh", 19))
+        {
+            settings->es_mem_pressure_thresh = strtoull(val, NULL, 10);
+            return 0;
+        }
+        break;
     case 20:
         if (0 == strncmp(name, "max_header_list_size", 20))
         {
@@ -47,6 +47,9 @@ enum sport_flags
     SPORT_SET_RCVBUF        = (1 << 2), /* SO_RCVBUF */
     SPORT_SERVER            = (1 << 3),
     SPORT_CONNECT           = (1 << 4),
+#if HAVE_UDP_GRO
+    SPORT_GRO               = (1 << 5), /* UDP_GRO */
+#endif
 };
 
 struct service_port {
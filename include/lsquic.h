@@ -11,6 +11,7 @@
  */
 
 #include <stdarg.h>
+#include <sys/types.h>
 #include <lsquic_types.h>
 #ifndef WIN32
 #include <sys/uio.h>
@@ -452,6 +453,24 @@ typedef struct ssl_ctx_st * (*lsquic_lookup_cert_f)(
 /** Transport parameter sanity checks are performed by default. */
 #define LSQUIC_DF_CHECK_TP_SANITY 1
 
+/** By default, outgoing packets are not combined for UDP GSO. */
+#define LSQUIC_DF_GSO 0
+
+/** By default, the advisory tick queue is a binary heap. */
+#define LSQUIC_DF_TIMER_WHEEL 0
+
+/** By default, memory pressure callback is not used. */
+#define LSQUIC_DF_MEM_PRESSURE_THRESH 0
+
+/** By default, engine memory use is not limited. */
+#define LSQUIC_DF_MAX_MEMORY 0
+
+/** By default, outgoing packets do not carry departure time. */
+#define LSQUIC_DF_TXTIME 0
+
+/** By default, path state is not saved across connections. */
+#define LSQUIC_DF_PATH_CACHE_TTL 0
+
 struct lsquic_engine_settings {
     /**
      * This is a bit mask wherein each bit corresponds to a value in
@@ -704,6 +723,8 @@ struct lsquic_engine_settings {
      *  1:  Cubic
      *  2:  BBRv1
      *  3:  Adaptive (Cubic or BBRv1)
+     *  4:  BBRv2
+     *  5:  Prague (L4S).  Requires es_ecn.
      */
     unsigned        es_cc_algo;
 
@@ -1092,6 +1113,99 @@ struct lsquic_engine_settings {
      * Default value is @ref LSQUIC_DF_CHECK_TP_SANITY
      */
     int             es_check_tp_sanity;
+
+    /**
+     * When set to true, the engine combines consecutive packets of the same
+     * size that belong to the same connection and go to the same destination
+     * into a single @ref lsquic_out_spec, setting its `gso_size' field.  Such
+     * spec can be sent out using a single sendmsg(2) call with UDP_SEGMENT
+     * option (UDP Generic Segmentation Offload).  At most 64 packets are
+     * combined this way.  Packets with different departure times (see
+     * @ref es_txtime) are not combined.
+     *
+     * Only set this if @ref ea_packets_out() knows how to handle GSO specs.
+     *
+     * Default value is @ref LSQUIC_DF_GSO
+     */
+    int             es_gso;
+
+    /**
+     * When set to true, connections waiting to be ticked at a specific
+     * time are kept in a hierarchical timing wheel instead of a binary
+     * heap.  Scheduling a connection then takes constant time, which helps
+     * engines with a very large number of connections.  The wheel's tick is
+     * @ref es_clock_granularity microseconds long.
+     *
+     * Default value is @ref LSQUIC_DF_TIMER_WHEEL
+     */
+    int             es_timer_wheel;
+
+    /**
+     * Memory pressure threshold in bytes.  When memory used by the
+     * engine (see @ref es_max_memory) rises to this value, @ref ea_mem_pressure
+     * is called.  It is called again when memory use falls below 7/8 of
+     * the threshold.  Memory use is checked when connections are
+     * processed.  Zero disables the check.
+     *
+     * Default value is @ref LSQUIC_DF_MEM_PRESSURE_THRESH
+     */
+    size_t          es_mem_pressure_thresh;
+
+    /**
+     * Memory budget in bytes.  Memory use is the sum of memory owned by
+     * the engine's memory manager -- packets, frames, connection objects --
+     * and stream buffers.  As memory use approaches the budget, the engine
+     * degrades in stages:
+     *
+     *  - At 3/4 of the budget, flow control windows stop growing and are
+     *    halved each time they are updated;
+     *  - At 7/8, new incoming connections are not accepted;
+     *  - At the budget, peers are not given credit to open new streams.
+     *
+     * Memory use is checked when connections are processed.  This is not
+     * a hard limit: existing connections and streams proceed, but their
+     * peers are slowed down.  Zero means no budget.
+     *
+     * Default value is @ref LSQUIC_DF_MAX_MEMORY
+     */
+    size_t          es_max_memory;
+
+    /**
+     * If set to a non-zero value, the pacer does not hold packets back.
+     * Instead, each packet is assigned the time it should leave according
+     * to the pacer's schedule (see `txtime' in @ref lsquic_out_spec) and
+     * is released as soon as the congestion window allows it, as long as
+     * this time is no more than `es_txtime' microseconds in the future.
+     * This lets the engine hand a whole congestion window's worth of
+     * packets to the kernel in a few ticks, leaving the pacing to the
+     * kernel or the NIC.
+     *
+     * Only set this if @ref ea_packets_out() delays packets until their
+     * departure time, for example using the SO_TXTIME socket option and
+     * the fq qdisc on Linux.  The maximum value is 1000000 (one second).
+     * This setting has no effect if @ref es_pace_packets is false.
+     *
+     * Default value is @ref LSQUIC_DF_TXTIME
+     */
+    unsigned        es_txtime;
+
+    /**
+     * If set to a non-zero value, what a connection has learned about the
+     * path -- RTT, bandwidth, congestion window, and PLPMTU -- is saved
+     * in the shared hash (see @ref ea_shi) when the connection is destroyed.
+     * Entries are keyed by the peer address prefix (/24 for IPv4, /48 for
+     * IPv6) and expire after `es_path_cache_ttl' seconds.
+     *
+     * A new connection to the same destination probes the saved PLPMTU
+     * first and uses the saved RTT until it takes its own RTT sample.  If
+     * the first RTT sample is close to the saved one, the congestion window
+     * jumps to half of the saved window ("careful resume").  Loss before
+     * the jump is validated reduces the window to half of what was
+     * delivered since the jump.  The jump requires @ref es_pace_packets.
+     *
+     * Default value is @ref LSQUIC_DF_PATH_CACHE_TTL
+     */
+    unsigned        es_path_cache_ttl;
 };
 
 /* Initialize `settings' to default values */
@@ -1129,6 +1243,22 @@ struct lsquic_out_spec
     void                  *peer_ctx;
     lsquic_conn_ctx_t     *conn_ctx;  /* will be NULL when sending out the first batch of handshake packets */
     int                    ecn;       /* Valid values are 0 - 3.  See RFC 3168 */
+    /**
+     * If non-zero, each element of `iov' is a separate UDP datagram of this
+     * size, except for the last one, which may be smaller.  This is only
+     * set if @ref es_gso is true.  Otherwise, elements of `iov' make up a
+     * single datagram.
+     */
+    unsigned short         gso_size;
+    /**
+     * If non-zero, this is the time, in microseconds, before which the
+     * packet should not be sent.  The clock is the same one used by the
+     * library: CLOCK_MONOTONIC where available.  This is only set if
+     * @ref es_txtime is non-zero.  If the spec holds coalesced packets,
+     * this is the departure time of the first one.  Packets combined for
+     * GSO (see `gso_size') all have this departure time.
+     */
+    uint64_t               txtime;
 };
 
 /**
@@ -1185,6 +1315,32 @@ struct lsquic_shared_hash_if
                                      void **data, unsigned *data_sz);
 };
 
+/**
+ * Shared hash implementation that can be shared by engines running in
+ * different threads of the same process.  To use it, set @ref ea_shi to
+ * &lsquic_mt_shi and @ref ea_shi_ctx to the value returned by
+ * lsquic_mt_shi_new().
+ *
+ * The hash is split into `n_shards' shards (rounded up to a power of two),
+ * each with its own lock.  A good value is the number of threads.
+ *
+ * Inserting a key that already exists fails.  Lookup returns a pointer
+ * to the stored copy of the data; it remains valid for at least a minute
+ * after the element is deleted or expires.
+ *
+ * Returns NULL on failure.
+ */
+struct lsquic_mt_shi *
+lsquic_mt_shi_new (unsigned n_shards);
+
+/**
+ * Destroy the hash.  All engines using it must have been destroyed.
+ */
+void
+lsquic_mt_shi_destroy (struct lsquic_mt_shi *);
+
+extern const struct lsquic_shared_hash_if lsquic_mt_shi;
+
 /**
  * The packet out memory interface is used by LSQUIC to get buffers to
  * which outgoing packets will be written before they are passed to
@@ -1213,6 +1369,62 @@ struct lsquic_packout_mem_if
                                                                 char is_ipv6);
 };
 
+/**
+ * The page interface is used by the engine's memory manager to get memory
+ * for its object pools and buffers: packets, frame records, mini
+ * connections, and so on.  Memory is requested in multiples of 4 KB and
+ * must be aligned on a 4 KB boundary.  The functions are called from the
+ * engine's thread only.
+ *
+ * If not specified, the memory manager uses malloc() and friends.  The
+ * library provides a huge page arena: see @ref lsquic_page_arena_new().
+ */
+struct lsquic_page_if
+{
+    /**
+     * Allocate `size' bytes aligned on a 4 KB boundary.  `size' is a
+     * multiple of 4 KB.  Return NULL on failure.
+     */
+    void *  (*pgi_alloc) (void *pgi_ctx, size_t size);
+    /**
+     * Release memory allocated by pgi_alloc().  `size' is the same value
+     * that was passed to pgi_alloc().
+     */
+    void    (*pgi_free)  (void *pgi_ctx, void *mem, size_t size);
+};
+
+/**
+ * Page interface implemented by the huge page arena.  The context is
+ * returned by @ref lsquic_page_arena_new().
+ */
+extern const struct lsquic_page_if lsquic_page_arena_if;
+
+/**
+ * Create a page arena.  The arena carves memory from 2 MB chunks.  It
+ * tries to get huge pages (MAP_HUGETLB) first, then falls back to
+ * transparent huge pages.  Chunks are never returned to the system until
+ * the arena is destroyed: freed memory is reused by the arena.
+ *
+ * If `numa_node' is not negative, chunks are bound to this NUMA node.
+ * Otherwise, chunks are faulted in by the calling thread, which places
+ * them on the thread's node.  Thus, the arena should be used by the same
+ * thread that created it.
+ *
+ * The arena is not thread-safe: use one arena per engine.  It must
+ * outlive the engine that uses it.
+ */
+void *
+lsquic_page_arena_new (int numa_node);
+
+void
+lsquic_page_arena_destroy (void *arena);
+
+/**
+ * Return the number of bytes the arena obtained from the system.
+ */
+size_t
+lsquic_page_arena_mem_used (const void *arena);
+
 typedef void (*lsquic_cids_update_f)(void *ctx, void **peer_ctx,
                                 const lsquic_cid_t *cids, unsigned n_cids);
 
@@ -1374,12 +1586,35 @@ struct lsquic_engine_api
     const char                          *ea_alpn;
 
     /**
-     * Optional interface to control the creation of connection IDs
+     * Optional interface to control the creation of connection IDs.  The
+     * connection argument is always valid.  For this reason, the SCID of
+     * Retry packets, which are sent before there is a connection, is
+     * random, unless this is set to @ref lsquic_shard_generate_scid() or
+     * @ref lsquic_route_generate_scid().
      */
     void                               (*ea_generate_scid)(void *ctx,
                                 lsquic_conn_t *, lsquic_cid_t *, unsigned);
     /** Passed to ea_generate_scid() */
     void                                *ea_gen_scid_ctx;
+
+    /**
+     * Page interface is optional.  It is used by the engine's memory
+     * manager.  To keep engine's memory in huge pages, set it to
+     * @ref lsquic_page_arena_if and `ea_page_if_ctx' to a value returned
+     * by @ref lsquic_page_arena_new().
+     */
+    const struct lsquic_page_if         *ea_page_if;
+    void                                *ea_page_if_ctx;
+
+    /**
+     * Optional callback to be notified when memory used by the engine
+     * crosses @ref es_mem_pressure_thresh.  `above' is true when the
+     * threshold is reached and false when memory use falls back below it.
+     * The callback may call @ref lsquic_engine_shed_memory().
+     */
+    void                               (*ea_mem_pressure)(void *ctx,
+                                                size_t mem_used, int above);
+    void                                *ea_mem_pressure_ctx;
 };
 
 /**
@@ -1438,6 +1673,44 @@ lsquic_engine_packet_in (lsquic_engine_t *,
         const struct sockaddr *sa_local, const struct sockaddr *sa_peer,
         void *peer_ctx, int ecn);
 
+/**
+ * Incoming UDP datagram.  This structure is used to pass several datagrams
+ * to the engine at once using @ref lsquic_engine_packets_in().  The fields
+ * have the same meaning as the corresponding arguments of
+ * @ref lsquic_engine_packet_in().
+ */
+struct lsquic_in_spec
+{
+    const unsigned char   *buf;
+    size_t                 bufsz;
+    const struct sockaddr *local_sa;
+    const struct sockaddr *peer_sa;
+    void                  *peer_ctx;
+    int                    ecn;       /* Valid values are 0 - 3.  See RFC 3168 */
+    /**
+     * If non-zero, `buf' contains several UDP datagrams of this size, the
+     * last one possibly smaller.  This is what the kernel returns when
+     * UDP_GRO socket option is on: set this to the value of the UDP_GRO
+     * control message.  Each datagram is processed in place.
+     */
+    unsigned short         gso_size;
+};
+
+/**
+ * Pass several incoming datagrams to the QUIC engine.  This is equivalent
+ * to calling @ref lsquic_engine_packet_in() for each element of `specs',
+ * but is cheaper when many datagrams are available at once, for example
+ * after a call to recvmmsg(2): connection lookup is reused for consecutive
+ * datagrams that carry the same destination connection ID.
+ *
+ * Returns the number of datagrams processed.  If this value is smaller than
+ * `n_specs', an error occurred processing datagram at that index.  The
+ * errors are the same as those of @ref lsquic_engine_packet_in().
+ */
+unsigned
+lsquic_engine_packets_in (lsquic_engine_t *,
+                    const struct lsquic_in_spec *specs, unsigned n_specs);
+
 /**
  * Process tickable connections.  This function must be called often enough so
  * that packets and connections do not expire.
@@ -1565,6 +1838,48 @@ lsquic_stream_readf (lsquic_stream_t *s,
     size_t (*readf)(void *ctx, const unsigned char *buf, size_t len, int fin),
     void *ctx);
 
+/**
+ * A slice of stream data lent to the application by
+ * @ref lsquic_stream_lend().
+ */
+struct lsquic_slice
+{
+    const unsigned char    *buf;
+    size_t                  len;
+    /** Opaque reference to the memory backing the slice */
+    void                   *handle;
+};
+
+/**
+ * Read stream data without copying it.  Unlike @ref lsquic_stream_readf(),
+ * the data does not have to be consumed in a callback: the slices point
+ * into reference-counted incoming packet buffers and remain valid until
+ * they are released using @ref lsquic_engine_release_slices().  The
+ * stream is considered to have read the lent data: flow control credit
+ * is returned to the peer right away.
+ *
+ * On input, `n_slices' is the number of elements in the `slices' array.
+ * On output, it is set to the number of slices filled in.
+ *
+ * Data that is not stored in a packet buffer -- for example, when many
+ * out-of-order frames have been received -- is copied into a new buffer.
+ *
+ * Return value and errors are same as in @ref lsquic_stream_read().
+ */
+ssize_t
+lsquic_stream_lend (lsquic_stream_t *s, struct lsquic_slice *slices,
+                                                    unsigned *n_slices);
+
+/**
+ * Release slices obtained via @ref lsquic_stream_lend().  The slices may
+ * be released in any order, after the stream or the connection has been
+ * closed, but before the engine is destroyed.  This function must be
+ * called from the same thread as the rest of engine's functions.
+ */
+void
+lsquic_engine_release_slices (lsquic_engine_t *,
+                        const struct lsquic_slice *slices, unsigned n_slices);
+
 /**
  * Set whether you want to write to stream.  If @param is_want is true,
  * @ref on_write() will be called when it is possible to write data to
@@ -1599,6 +1914,27 @@ lsquic_stream_pwritev (lsquic_stream_t *s,
     ssize_t (*preadv)(void *user_data, const struct iovec *iov, int iovcnt),
     void *user_data, size_t n_to_write);
 
+/**
+ * Write up to `len' bytes from file descriptor `fd' starting at file offset
+ * `off'.  Data is read directly into packet buffers.  Once a packet that
+ * carries only this data is sent, its buffer is released: if the packet is
+ * lost, the data is read from the file again.  On HTTP/3 streams, only
+ * the DATA frame headers are kept.  A tail too short to fill a packet is
+ * buffered; on HTTP/3 streams, the packet it goes into is held in memory
+ * until it is acknowledged.
+ *
+ * The stream reads data back using its own duplicate of `fd', which is
+ * closed when the stream is destroyed: `fd' may be closed as soon as this
+ * function returns.  The file must not be modified until all data written
+ * from it is acknowledged.  Use es_delay_onclose to have on_close() called
+ * when this happens.
+ *
+ * Returns number of bytes written (which may be smaller than `len') or
+ * -1 on error.  Not supported on Windows.
+ */
+ssize_t
+lsquic_stream_write_file (lsquic_stream_t *s, int fd, off_t off, size_t len);
+
 /**
  * Used as argument to @ref lsquic_stream_writef()
  */
@@ -1628,6 +1964,33 @@ struct lsquic_reader
 ssize_t
 lsquic_stream_writef (lsquic_stream_t *, struct lsquic_reader *);
 
+/**
+ * Register application-owned buffer `buf' of `len' bytes to be written to
+ * the stream.  The buffer is not copied into the stream: the library copies
+ * it directly into outgoing packets as flow control and congestion window
+ * permit, without further calls to on_write().  Packets that have been
+ * sent do not keep a copy: if one is lost, its data is copied from the
+ * buffer again.  The buffer must therefore not be modified until `release'
+ * is called.  This happens once all of its contents have been acknowledged
+ * by the peer, or when the stream is destroyed.  If the stream is reset,
+ * buffers that have not been written to packets yet are released right
+ * away.  `release' may be NULL.  It must not call stream functions.
+ *
+ * Several buffers may be registered; they are written out in order.  Data
+ * is written in full packets, so that consecutive buffers share packets.
+ * What remains is written out when on_write() returns, when the stream is
+ * flushed or shut down, or the next time the connection is processed.
+ * Until all of them have been written out, on_write() is not called and
+ * other write functions return 0.  If the stream is shut down for writing,
+ * FIN is sent after the last registered buffer.
+ *
+ * @retval Number of bytes registered (`len') or zero if the stream cannot
+ *         be written to now.  -1 is returned on error.
+ */
+ssize_t
+lsquic_stream_write_ref (lsquic_stream_t *, const void *buf, size_t len,
+        void (*release)(void *ctx, const void *buf, size_t len), void *ctx);
+
 /**
  * Flush any buffered data.  This triggers packetizing even a single byte
  * into a separate frame.  Flushing a closed stream is an error.
@@ -2081,6 +2444,106 @@ int
 lsquic_dcid_from_packet (const unsigned char *, size_t bufsz,
                                 unsigned server_cid_len, unsigned *cid_len);
 
+/**
+ * Sharding: an engine is single-threaded.  To use several threads, create
+ * one engine per thread (a shard) and route each incoming datagram to the
+ * engine that owns its connection.  The shard is encoded in the first byte
+ * of the DCID: shard = DCID[0] % shc_count.
+ *
+ * Server-generated CIDs are made to map to the engine that generated them
+ * by setting @ref ea_generate_scid to @ref lsquic_shard_generate_scid() and
+ * @ref ea_gen_scid_ctx to a struct lsquic_shard_ctx unique to each engine.
+ * This covers all CIDs the server issues: those of the connection, the
+ * preferred address CID, and the SCID of Retry packets -- the client's
+ * next Initial goes to the shard that can validate its token.  The DCID
+ * of the client's first Initial packet is random, so that new connections
+ * are spread evenly among the shards.  Because the mapping depends only on
+ * the CID, packets keep going to the same shard after connection migration
+ * or NAT rebinding.
+ *
+ * The library provides the CID mapping only.  It does not start threads,
+ * and it has no dispatcher, no per-shard queues, and no per-shard send
+ * path.  These are up to the application: its receiving thread calls
+ * lsquic_shard_from_packet() and hands the datagram over to the shard's
+ * thread, which passes it to the engine using lsquic_engine_packets_in().
+ * Each engine sends using its own ea_packets_out() and peer_ctx, so it
+ * can be given its own socket.
+ */
+struct lsquic_shard_ctx
+{
+    unsigned    shc_id;         /* This engine's shard: [0, shc_count) */
+    unsigned    shc_count;      /* Number of shards, no more than 256 */
+};
+
+/**
+ * This function can be used as @ref ea_generate_scid.  The context
+ * argument is a pointer to struct lsquic_shard_ctx.  The generated CID
+ * is random, except its first byte encodes the shard.
+ */
+void
+lsquic_shard_generate_scid (void *shard_ctx, lsquic_conn_t *,
+                                            lsquic_cid_t *, unsigned len);
+
+/**
+ * Return shard that datagram `buf' should be given to.  This function uses
+ * @ref lsquic_dcid_from_packet() and has the same server perspective.
+ * The shards are expected to generate CIDs using
+ * @ref lsquic_shard_generate_scid().
+ *
+ * Returns a value in [0, n_shards) or -1 if DCID could not be parsed or
+ * if it is empty.
+ */
+int
+lsquic_shard_from_packet (const unsigned char *buf, size_t bufsz,
+                                unsigned server_cid_len, unsigned n_shards);
+
+/**
+ * Routable CIDs: when @ref ea_generate_scid is set to
+ * @ref lsquic_route_generate_scid(), the engine generates CIDs that
+ * encode the index of the connection in the engine's connection table.
+ * An incoming packet is then matched to its connection by decoding the
+ * CID instead of looking it up in the hash.  The index is obfuscated
+ * using a secret key, so that CIDs of the same connection cannot be
+ * linked by an observer.  For the index to fit, `es_scid_len' must be at
+ * least 8 bytes, plus 1 + rc_server_id_len bytes if the server ID is used.
+ *
+ * The server ID is placed at the beginning of the CID, after the first
+ * octet, in the manner of QUIC-LB plaintext CIDs.  This lets a load
+ * balancer route datagrams to the right server.
+ *
+ * @ref ea_gen_scid_ctx may be NULL or point to struct lsquic_route_ctx.
+ * The engine copies the context when it is created.
+ */
+struct lsquic_route_ctx
+{
+    /** Server ID.  May be empty. */
+    unsigned char   rc_server_id[11];
+    /** Length of the server ID: 0 to 11 bytes. */
+    unsigned char   rc_server_id_len;
+    /**
+     * Config rotation codepoint (0 - 6) placed in the top three bits
+     * of the first octet.  Only used if the server ID is not empty.
+     */
+    unsigned char   rc_config_id;
+};
+
+/**
+ * The engine recognizes this function when it is set as
+ * @ref ea_generate_scid and uses its own routable CID generator instead.
+ * The argument is a pointer to struct lsquic_route_ctx or NULL.
+ */
+void
+lsquic_route_generate_scid (void *route_ctx, lsquic_conn_t *,
+                                            lsquic_cid_t *, unsigned len);
+
+/**
+ * Release up to `n_bytes' of memory that the engine keeps cached for reuse:
+ * free packet buffers and pages.  Memory in use is not affected.  Returns
+ * the number of bytes released.
+ */
+size_t
+lsquic_engine_shed_memory (lsquic_engine_t *, size_t n_bytes);
+
 /**
  * Returns true if there are connections to be processed, false otherwise.
  * If true, `diff' is set to the difference between the earliest advisory
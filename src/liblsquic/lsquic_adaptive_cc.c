@@ -86,6 +86,15 @@ adaptive_cc_ack (void *cong_ctl, struct lsquic_packet_out *packet_out,
 }
 
 
+static void
+adaptive_cc_resume (void *cong_ctl, uint64_t cwnd, uint64_t bw)
+{
+    struct adaptive_cc *const acc = cong_ctl;
+
+    CALL_BOTH(cci_resume, cwnd, bw);
+}
+
+
 static void
 adaptive_cc_loss (void *cong_ctl)
 {
@@ -206,6 +215,7 @@ const struct cong_ctl_if lsquic_cong_adaptive_if =
     .cci_loss          = adaptive_cc_loss,
     .cci_lost          = adaptive_cc_lost,
     .cci_reinit        = adaptive_cc_reinit,
+    .cci_resume        = adaptive_cc_resume,
     .cci_timeout       = adaptive_cc_timeout,
     .cci_sent          = adaptive_cc_sent,
     .cci_was_quiet     = adaptive_cc_was_quiet,
@@ -6,9 +6,20 @@
  * element having the minimum advsory time.  To speed up removal, each
  * element has an index it has in the heap array.  The index is updated
  * as elements are moved around in the array when heap is updated.
+ *
+ * Alternatively, the connections can be kept in a hierarchical timing
+ * wheel.  Time is divided into ticks; each of AW_LEVELS levels has
+ * AW_SLOTS slots and each slot at level L spans AW_SLOTS^L ticks.  An
+ * element is placed at the lowest level at which its tick shares all
+ * higher-order bits with the current tick.  When all lower levels become
+ * empty, the earliest slot of the next level is cascaded down.  Elements
+ * that are too far in the future to fit into the wheel are kept on a
+ * separate list.  Bitmaps of occupied slots make finding the next element
+ * cheap.
  */
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #ifdef WIN32
 #include <vc_compat.h>
@@ -26,12 +37,35 @@
 #include "lsquic_conn.h"
 
 
+#define AW_SLOT_BITS 6
+#define AW_SLOTS (1u << AW_SLOT_BITS)
+#define AW_LEVELS 4
+/* Value of ae_heap_idx for elements that do not fit into the wheel: */
+#define AW_FAR (AW_LEVELS * AW_SLOTS)
+
+TAILQ_HEAD(attq_slot, attq_elem);
+
+struct attq_wheel
+{
+    /* Current tick.  It is never greater than the tick of any element
+     * except for those elements added with time in the past: these go into
+     * the slot that corresponds to the current tick.
+     */
+    uint64_t            aw_now;
+    lsquic_time_t       aw_granularity;
+    uint64_t            aw_occupied[AW_LEVELS];
+    struct attq_slot    aw_far;
+    struct attq_slot    aw_slots[AW_LEVELS][AW_SLOTS];
+};
+
+
 struct attq
 {
     struct malo        *aq_elem_malo;
     struct attq_elem  **aq_heap;
     unsigned            aq_nelem;
     unsigned            aq_nalloc;
+    struct attq_wheel  *aq_wheel;   /* NULL if binary heap is used */
 };
 
 
@@ -57,15 +91,278 @@ lsquic_attq_create (void)
 }
 
 
+struct attq *
+lsquic_attq_create_wheel (unsigned granularity)
+{
+    struct attq *q;
+    struct attq_wheel *w;
+    unsigned level, slot;
+
+    w = malloc(sizeof(*w));
+    if (!w)
+        return NULL;
+
+    q = lsquic_attq_create();
+    if (!q)
+    {
+        free(w);
+        return NULL;
+    }
+
+    w->aw_now = 0;
+    w->aw_granularity = granularity ? granularity : 1;
+    for (level = 0; level < AW_LEVELS; ++level)
+    {
+        w->aw_occupied[level] = 0;
+        for (slot = 0; slot < AW_SLOTS; ++slot)
+            TAILQ_INIT(&w->aw_slots[level][slot]);
+    }
+    TAILQ_INIT(&w->aw_far);
+    q->aq_wheel = w;
+    return q;
+}
+
+
 void
 lsquic_attq_destroy (struct attq *q)
 {
     lsquic_malo_destroy(q->aq_elem_malo);
     free(q->aq_heap);
+    free(q->aq_wheel);
     free(q);
 }
 
 
+#if __GNUC__
+#   define ctz __builtin_ctzll
+#else
+static unsigned
+ctz (unsigned long long x)
+{
+    unsigned n = 0;
+    if (0 == (x & ((1ULL << 32) - 1))) { n += 32; x >>= 32; }
+    if (0 == (x & ((1ULL << 16) - 1))) { n += 16; x >>= 16; }
+    if (0 == (x & ((1ULL <<  8) - 1))) { n +=  8; x >>=  8; }
+    if (0 == (x & ((1ULL <<  4) - 1))) { n +=  4; x >>=  4; }
+    if (0 == (x & ((1ULL <<  2) - 1))) { n +=  2; x >>=  2; }
+    if (0 == (x & ((1ULL <<  1) - 1))) { n +=  1; x >>=  1; }
+    return n;
+}
+#endif
+
+
+static void
+wheel_place (struct attq_wheel *w, struct attq_elem *el)
+{
+    uint64_t tick, diff;
+    unsigned level, slot;
+
+    tick = el->ae_adv_time / w->aw_granularity;
+    if (tick < w->aw_now)
+        tick = w->aw_now;
+
+    diff = tick ^ w->aw_now;
+    for (level = 0; level < AW_LEVELS; ++level)
+        if (0 == (diff >> (AW_SLOT_BITS * (level + 1))))
+            break;
+
+    if (level < AW_LEVELS)
+    {
+        slot = (tick >> (AW_SLOT_BITS * level)) & (AW_SLOTS - 1);
+        el->ae_heap_idx = level * AW_SLOTS + slot;
+        TAILQ_INSERT_TAIL(&w->aw_slots[level][slot], el, ae_next_slot);
+        w->aw_occupied[level] |= 1ULL << slot;
+    }
+    else
+    {
+        el->ae_heap_idx = AW_FAR;
+        TAILQ_INSERT_TAIL(&w->aw_far, el, ae_next_slot);
+    }
+}
+
+
+static void
+wheel_unplace (struct attq_wheel *w, struct attq_elem *el)
+{
+    unsigned level, slot;
+
+    if (el->ae_heap_idx < AW_FAR)
+    {
+        level = el->ae_heap_idx / AW_SLOTS;
+        slot = el->ae_heap_idx % AW_SLOTS;
+        TAILQ_REMOVE(&w->aw_slots[level][slot], el, ae_next_slot);
+        if (TAILQ_EMPTY(&w->aw_slots[level][slot]))
+            w->aw_occupied[level] &= ~(1ULL << slot);
+    }
+    else
+        TAILQ_REMOVE(&w->aw_far, el, ae_next_slot);
+}
+
+
+/* Advance current tick to the earliest element, cascading higher-level
+ * slots as necessary.  Return slot at level 0 that contains the earliest
+ * element or NULL if the queue is empty.
+ */
+static struct attq_slot *
+wheel_settle (struct attq *q)
+{
+    struct attq_wheel *const w = q->aq_wheel;
+    struct attq_elem *el, *next;
+    uint64_t bits, tick;
+    unsigned level, slot, shift;
+
+    if (q->aq_nelem == 0)
+        return NULL;
+
+    while (1)
+    {
+        slot = w->aw_now & (AW_SLOTS - 1);
+        bits = w->aw_occupied[0] & ~((1ULL << slot) - 1);
+        if (bits)
+        {
+            slot = ctz(bits);
+            w->aw_now = (w->aw_now & ~(uint64_t) (AW_SLOTS - 1)) | slot;
+            return &w->aw_slots[0][slot];
+        }
+        /* Level 0 is empty: all slots before the current one are empty by
+         * construction.
+         */
+        assert(0 == w->aw_occupied[0]);
+
+        for (level = 1; level < AW_LEVELS; ++level)
+            if (w->aw_occupied[level])
+                break;
+        if (level < AW_LEVELS)
+        {
+            /* Cascade: elements in the slot go to the lower levels */
+            shift = AW_SLOT_BITS * level;
+            slot = ctz(w->aw_occupied[level]);
+            assert(slot > ((w->aw_now >> shift) & (AW_SLOTS - 1)));
+            w->aw_now = (w->aw_now >> (shift + AW_SLOT_BITS)
+                                            << (shift + AW_SLOT_BITS))
+                      | ((uint64_t) slot << shift);
+            w->aw_occupied[level] &= ~(1ULL << slot);
+            while ((el = TAILQ_FIRST(&w->aw_slots[level][slot])))
+            {
+                TAILQ_REMOVE(&w->aw_slots[level][slot], el, ae_next_slot);
+                wheel_place(w, el);
+            }
+        }
+        else
+        {
+            /* Only far elements are left: move the wheel to the earliest
+             * of them and place those that now fit.
+             */
+            assert(!TAILQ_EMPTY(&w->aw_far));
+            w->aw_now = UINT64_MAX;
+            TAILQ_FOREACH(el, &w->aw_far, ae_next_slot)
+            {
+                tick = el->ae_adv_time / w->aw_granularity;
+                if (tick < w->aw_now)
+                    w->aw_now = tick;
+            }
+            for (el = TAILQ_FIRST(&w->aw_far); el; el = next)
+            {
+                next = TAILQ_NEXT(el, ae_next_slot);
+                tick = el->ae_adv_time / w->aw_granularity;
+                if (0 == ((tick ^ w->aw_now) >> (AW_SLOT_BITS * AW_LEVELS)))
+                {
+                    TAILQ_REMOVE(&w->aw_far, el, ae_next_slot);
+                    wheel_place(w, el);
+                }
+            }
+        }
+    }
+}
+
+
+static struct attq_elem *
+wheel_slot_min (struct attq_slot *slot)
+{
+    struct attq_elem *el, *min;
+
+    min = TAILQ_FIRST(slot);
+    for (el = TAILQ_NEXT(min, ae_next_slot); el;
+                                        el = TAILQ_NEXT(el, ae_next_slot))
+        if (el->ae_adv_time < min->ae_adv_time)
+            min = el;
+
+    return min;
+}
+
+
+static int
+wheel_add (struct attq *q, struct attq_elem *el)
+{
+    struct attq_wheel *const w = q->aq_wheel;
+
+    if (q->aq_nelem == 0)
+        w->aw_now = el->ae_adv_time / w->aw_granularity;
+    wheel_place(w, el);
+    ++q->aq_nelem;
+    return 0;
+}
+
+
+static struct lsquic_conn *
+wheel_pop (struct attq *q, lsquic_time_t cutoff)
+{
+    struct attq_slot *slot;
+    struct attq_elem *el;
+
+    slot = wheel_settle(q);
+    if (!slot)
+        return NULL;
+
+    /* If cutoff is past the current tick, every element in the slot is
+     * due: avoid looking for the minimum.
+     */
+    if (cutoff / q->aq_wheel->aw_granularity > q->aq_wheel->aw_now)
+        el = TAILQ_FIRST(slot);
+    else
+    {
+        el = wheel_slot_min(slot);
+        if (el->ae_adv_time >= cutoff)
+            return NULL;
+    }
+
+    return el->ae_conn;
+}
+
+
+static unsigned
+wheel_count_before (struct attq *q, lsquic_time_t cutoff)
+{
+    const struct attq_wheel *const w = q->aq_wheel;
+    const struct attq_elem *el;
+    uint64_t bits, cutoff_tick, start;
+    unsigned level, slot, shift, count;
+
+    count = 0;
+    cutoff_tick = cutoff / w->aw_granularity;
+    for (level = 0; level < AW_LEVELS; ++level)
+    {
+        shift = AW_SLOT_BITS * level;
+        for (bits = w->aw_occupied[level]; bits; bits &= bits - 1)
+        {
+            slot = ctz(bits);
+            start = (w->aw_now >> (shift + AW_SLOT_BITS)
+                                            << (shift + AW_SLOT_BITS))
+                  | ((uint64_t) slot << shift);
+            /* The current slot may contain elements from the past */
+            if (start > cutoff_tick && !(level == 0 && start == w->aw_now))
+                break;
+            TAILQ_FOREACH(el, &w->aw_slots[level][slot], ae_next_slot)
+                count += el->ae_adv_time < cutoff;
+        }
+    }
+    TAILQ_FOREACH(el, &w->aw_far, ae_next_slot)
+        count += el->ae_adv_time < cutoff;
+
+    return count;
+}
+
+
 
 #define AE_PARENT(i) ((i - 1) / 2)
 #define AE_LCHILD(i) (2 * i + 1)
@@ -114,7 +411,7 @@ lsquic_attq_add (struct attq *q, struct lsquic_conn *conn,
     struct attq_elem *el, **heap;
     unsigned n, i;
 
-    if (q->aq_nelem >= q->aq_nalloc)
+    if (!q->aq_wheel && q->aq_nelem >= q->aq_nalloc)
     {
         if (q->aq_nalloc > 0)
             n = q->aq_nalloc * 2;
@@ -137,6 +434,9 @@ lsquic_attq_add (struct attq *q, struct lsquic_conn *conn,
     el->ae_conn = conn;
     conn->cn_attq_elem = el;
 
+    if (q->aq_wheel)
+        return wheel_add(q, el);
+
     el->ae_heap_idx = q->aq_nelem;
     q->aq_heap[ q->aq_nelem++ ] = el;
 
@@ -160,6 +460,14 @@ lsquic_attq_pop (struct attq *q, lsquic_time_t cutoff)
     struct lsquic_conn *conn;
     struct attq_elem *el;
 
+    if (q->aq_wheel)
+    {
+        conn = wheel_pop(q, cutoff);
+        if (conn)
+            lsquic_attq_remove(q, conn);
+        return conn;
+    }
+
     if (q->aq_nelem == 0)
         return NULL;
 
@@ -210,6 +518,17 @@ lsquic_attq_remove (struct attq *q, struct lsquic_conn *conn)
     unsigned idx;
 
     el = conn->cn_attq_elem;
+
+    if (q->aq_wheel)
+    {
+        assert(q->aq_nelem > 0);
+        wheel_unplace(q->aq_wheel, el);
+        --q->aq_nelem;
+        conn->cn_attq_elem = NULL;
+        lsquic_malo_put(el);
+        return;
+    }
+
     idx = el->ae_heap_idx;
 
     assert(q->aq_nelem > 0);
@@ -243,6 +562,9 @@ lsquic_attq_count_before (struct attq *q, lsquic_time_t cutoff)
 {
     unsigned level, total_count, level_count, i, level_max;
 
+    if (q->aq_wheel)
+        return wheel_count_before(q, cutoff);
+
     total_count = 0;
     for (i = 0, level = 0;; ++level)
     {
@@ -262,6 +584,17 @@ lsquic_attq_count_before (struct attq *q, lsquic_time_t cutoff)
 const struct attq_elem *
 lsquic_attq_next (struct attq *q)
 {
+    struct attq_slot *slot;
+
+    if (q->aq_wheel)
+    {
+        slot = wheel_settle(q);
+        if (slot)
+            return wheel_slot_min(slot);
+        else
+            return NULL;
+    }
+
     if (q->aq_nelem > 0)
         return q->aq_heap[0];
     else
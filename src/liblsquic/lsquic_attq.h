@@ -17,7 +17,10 @@ struct attq_elem
 {
     struct lsquic_conn  *ae_conn;
     lsquic_time_t        ae_adv_time;
+    /* When the timing wheel is used, this is the slot index instead */
     unsigned             ae_heap_idx;
+    TAILQ_ENTRY(attq_elem)
+                         ae_next_slot;  /* Used by the timing wheel */
     /* The "why" describes why the connection is in the Advisory Tick Time
      * Queue.  Values past the range describe different alarm types (see
      * enum alarm_id).
@@ -33,6 +36,16 @@ struct attq_elem
 struct attq *
 lsquic_attq_create (void);
 
+/* Create queue backed by a hierarchical timing wheel instead of a binary
+ * heap.  Adding and removing a connection take constant time.  Advisory
+ * times are bucketed into ticks of `granularity' microseconds:
+ * lsquic_attq_next() still returns the earliest connection, but
+ * lsquic_attq_pop() may return connections whose times fall into the same
+ * tick in any order.
+ */
+struct attq *
+lsquic_attq_create_wheel (unsigned granularity);
+
 void
 lsquic_attq_destroy (struct attq *);
 
@@ -1060,6 +1060,37 @@ lsquic_bbr_cleanup (void *cong_ctl)
 }
 
 
+/* Careful resume.  Seeding the bandwidth filter makes pacing follow the
+ * jump.  Unless confirmed by measurements, the seeded value ages out of
+ * the filter like any other sample.
+ */
+static void
+lsquic_bbr_resume (void *cong_ctl, uint64_t cwnd, uint64_t bw)
+{
+    struct lsquic_bbr *const bbr = cong_ctl;
+    struct bandwidth bandwidth;
+
+    if (bw)
+    {
+        bandwidth = (struct bandwidth) { .value = bw * 8, };
+        minmax_upmax(&bbr->bbr_max_bandwidth, bbr->bbr_round_count,
+                                                    BW_VALUE(&bandwidth));
+        bandwidth = BW_TIMES(&bandwidth, bbr->bbr_pacing_gain);
+        if (BW_VALUE(&bbr->bbr_pacing_rate) < BW_VALUE(&bandwidth))
+            bbr->bbr_pacing_rate = bandwidth;
+    }
+    else
+    {
+        minmax_reset(&bbr->bbr_max_bandwidth,
+                        ((struct minmax_sample) { bbr->bbr_round_count, 0, }));
+        bbr->bbr_pacing_rate = BW_ZERO();
+    }
+    bbr->bbr_cwnd = MIN(MAX(cwnd, bbr->bbr_min_cwnd), bbr->bbr_max_cwnd);
+    LSQ_INFO("%s: cwnd %"PRIu64"; bw %"PRIu64" bytes/sec",
+                            bw ? "resume" : "retreat", bbr->bbr_cwnd, bw);
+}
+
+
 static void
 lsquic_bbr_loss (void *cong_ctl) {   /* Noop */   }
 
@@ -1080,6 +1111,7 @@ const struct cong_ctl_if lsquic_cong_bbr_if =
     .cci_loss          = lsquic_bbr_loss,
     .cci_lost          = lsquic_bbr_lost,
     .cci_reinit        = lsquic_bbr_reinit,
+    .cci_resume        = lsquic_bbr_resume,
     .cci_timeout       = lsquic_bbr_timeout,
     .cci_sent          = lsquic_bbr_sent,
     .cci_was_quiet     = lsquic_bbr_was_quiet,
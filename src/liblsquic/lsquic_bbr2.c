@@ -0,0 +1,1483 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_bbr2.c -- BBRv2 congestion controller
+ *
+ * See lsquic_bbr2.h for an overview.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+
+#include "lsquic.h"
+#include "lsquic_int_types.h"
+#include "lsquic_cong_ctl.h"
+#include "lsquic_minmax.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_packet_out.h"
+#include "lsquic_bw_sampler.h"
+#include "lsquic_bbr2.h"
+#include "lsquic_hash.h"
+#include "lsquic_conn.h"
+#include "lsquic_sfcw.h"
+#include "lsquic_conn_flow.h"
+#include "lsquic_varint.h"
+#include "lsquic_hq.h"
+#include "lsquic_stream.h"
+#include "lsquic_rtt.h"
+#include "lsquic_conn_public.h"
+#include "lsquic_util.h"
+#include "lsquic_malo.h"
+#include "lsquic_crand.h"
+#include "lsquic_mm.h"
+#include "lsquic_engine_public.h"
+
+#define LSQUIC_LOGGER_MODULE LSQLM_BBR2
+#define LSQUIC_LOG_CONN_ID lsquic_conn_log_cid(bbr2->bbr2_conn_pub->lconn)
+#include "lsquic_logger.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define ms(val_) ((val_) * 1000)
+#define sec(val_) ((val_) * 1000 * 1000)
+
+/* Same segment size, initial, and maximum congestion window as in our
+ * BBRv1 and Cubic, so that the three can be compared directly.
+ */
+#define kMaxSegmentSize 1460
+#define kInitialCwnd (32 * kMaxSegmentSize)
+#define kMaxCwnd (2000 * kMaxSegmentSize)
+
+/*
+ " BBR.MinPipeCwnd: The minimal cwnd value BBR targets, to allow pipelining
+ " with endpoints that follow an "ACK every other packet" delayed-ACK
+ " policy: 4 * SMSS.
+ */
+#define kMinPipeCwnd (4 * kMaxSegmentSize)
+
+#define kStartupPacingGain 2.77f
+#define kStartupCwndGain 2.0f
+#define kDrainPacingGain 0.35f
+#define kDefaultCwndGain 2.0f
+#define kProbeBwDownPacingGain 0.9f
+#define kProbeBwUpPacingGain 1.25f
+#define kProbeBwUpCwndGain 2.25f
+#define kProbeRttCwndGain 0.5f
+#define kPacingMarginPercent 1
+
+/*
+ " BBRLossThresh: The maximum tolerated per-round-trip packet loss rate
+ " when probing for bandwidth (the default is 2%).
+ */
+#define kLossThresh 0.02f
+
+/*
+ " BBRBeta: The default multiplicative decrease to make upon each round
+ " trip during which the connection detects packet loss (the value is 0.7).
+ */
+#define kBeta 0.7f
+
+/*
+ " BBRHeadroom: The multiplicative factor to apply to BBR.inflight_hi
+ " when calculating a volume of free headroom to try to leave unused in
+ " the path (the value is 0.15).
+ */
+#define kHeadroom 0.15f
+
+#define kFullBwThresh 1.25f
+#define kFullBwCount 3
+#define kStartupFullLossCount 6
+
+/* Windows of the max filters: max_bw is tracked over the current and the
+ * previous PROBE_BW cycles; extra ACKed, over ten round trips.
+ */
+#define kMaxBwFilterLen 2
+#define kExtraAckedFilterLen 10
+
+#define kMinRttFilterLen sec(10)
+#define kProbeRttInterval sec(5)
+#define kProbeRttDuration ms(200)
+
+#define kMaxProbeUpRounds 30
+#define kMaxRenoRounds 63
+
+/* ECN parameters are from Linux BBRv2.  The fraction of CE-marked packets
+ * in a round above kEcnThresh means that inflight is too high; the EWMA
+ * of the CE fraction, scaled by kEcnFactor, is used to cut inflight_lo.
+ */
+#define BBR2_ECN_SCALE 1024
+#define kEcnThresh 0.5f
+#define kEcnFactor 0.333f
+#define kEcnAlphaGainShift 4    /* Gain is 1/16 */
+#define kEcnMinPackets 4
+#define kStartupEcnRounds 2
+
+
+static const char *const mode2str[] =
+{
+    [BBR2_MODE_STARTUP]         = "STARTUP",
+    [BBR2_MODE_DRAIN]           = "DRAIN",
+    [BBR2_MODE_PROBE_BW_DOWN]   = "PROBE_BW_DOWN",
+    [BBR2_MODE_PROBE_BW_CRUISE] = "PROBE_BW_CRUISE",
+    [BBR2_MODE_PROBE_BW_REFILL] = "PROBE_BW_REFILL",
+    [BBR2_MODE_PROBE_BW_UP]     = "PROBE_BW_UP",
+    [BBR2_MODE_PROBE_RTT]       = "PROBE_RTT",
+};
+
+
+/* Per-ACK rate sample.  This is what the draft calls `rs'. */
+struct rate_sample
+{
+    uint64_t        delivery_rate;      /* Bytes per second */
+    uint64_t        delivered;
+    uint64_t        prior_delivered;
+    uint64_t        tx_in_flight;
+    uint64_t        lost;
+    uint64_t        newly_acked;
+    uint64_t        newly_lost;
+    lsquic_time_t   rtt;
+    int             is_app_limited;
+};
+
+
+static void
+set_mode (struct lsquic_bbr2 *bbr2, enum bbr2_mode mode, float pacing_gain,
+                                                            float cwnd_gain)
+{
+    if (bbr2->bbr2_mode != mode)
+        LSQ_DEBUG("mode change %s -> %s", mode2str[bbr2->bbr2_mode],
+                                                            mode2str[mode]);
+    bbr2->bbr2_mode = mode;
+    bbr2->bbr2_pacing_gain = pacing_gain;
+    bbr2->bbr2_cwnd_gain = cwnd_gain;
+}
+
+
+static uint64_t
+delivered (const struct lsquic_bbr2 *bbr2)
+{
+    return lsquic_bw_sampler_total_acked(&bbr2->bbr2_bw_sampler);
+}
+
+
+static int
+in_probe_bw (const struct lsquic_bbr2 *bbr2)
+{
+    return bbr2->bbr2_mode >= BBR2_MODE_PROBE_BW_DOWN
+        && bbr2->bbr2_mode <= BBR2_MODE_PROBE_BW_UP;
+}
+
+
+/*
+ " BBRIsProbingBW(): the states in which BBR is probing for bandwidth
+ " and does not adapt its lower bounds.
+ */
+static int
+is_probing_bw (const struct lsquic_bbr2 *bbr2)
+{
+    return bbr2->bbr2_mode == BBR2_MODE_STARTUP
+        || bbr2->bbr2_mode == BBR2_MODE_PROBE_BW_REFILL
+        || bbr2->bbr2_mode == BBR2_MODE_PROBE_BW_UP;
+}
+
+
+static void
+start_round (struct lsquic_bbr2 *bbr2)
+{
+    bbr2->bbr2_next_round_delivered = delivered(bbr2);
+}
+
+
+static void
+reset_congestion_signals (struct lsquic_bbr2 *bbr2)
+{
+    bbr2->bbr2_flags &= ~(BBR2_FLAG_LOSS_IN_ROUND|BBR2_FLAG_ECN_IN_ROUND);
+    bbr2->bbr2_bw_latest = 0;
+    bbr2->bbr2_inflight_latest = 0;
+}
+
+
+static void
+reset_short_term_model (struct lsquic_bbr2 *bbr2)
+{
+    bbr2->bbr2_bw_lo = UINT64_MAX;
+    bbr2->bbr2_inflight_lo = UINT64_MAX;
+}
+
+
+static void
+reset_full_bw (struct lsquic_bbr2 *bbr2)
+{
+    bbr2->bbr2_full_bw = 0;
+    bbr2->bbr2_full_bw_count = 0;
+    bbr2->bbr2_flags &= ~BBR2_FLAG_FULL_BW_NOW;
+}
+
+
+static void
+enter_startup (struct lsquic_bbr2 *bbr2)
+{
+    set_mode(bbr2, BBR2_MODE_STARTUP, kStartupPacingGain, kStartupCwndGain);
+}
+
+
+static void
+init_bbr2 (struct lsquic_bbr2 *bbr2)
+{
+    lsquic_time_t srtt;
+
+    bbr2->bbr2_mode = BBR2_MODE_STARTUP;
+    bbr2->bbr2_ack_phase = BBR2_ACKS_INIT;
+    bbr2->bbr2_flags &= BBR2_FLAG_IN_ACK;
+    minmax_init(&bbr2->bbr2_max_bw_filter, kMaxBwFilterLen - 1);
+    minmax_init(&bbr2->bbr2_extra_acked_filter, kExtraAckedFilterLen);
+    bbr2->bbr2_cycle_count = 0;
+    bbr2->bbr2_extra_acked_interval_start = 0;
+    bbr2->bbr2_extra_acked_delivered = 0;
+    bbr2->bbr2_max_bw = 0;
+    bbr2->bbr2_bw = 0;
+    bbr2->bbr2_inflight_hi = UINT64_MAX;
+    bbr2->bbr2_init_cwnd = kInitialCwnd;
+    bbr2->bbr2_cwnd = kInitialCwnd;
+    bbr2->bbr2_prior_cwnd = 0;
+    bbr2->bbr2_round_count = 0;
+    bbr2->bbr2_next_round_delivered = 0;
+    bbr2->bbr2_loss_round_delivered = 0;
+    bbr2->bbr2_rounds_since_bw_probe = 0;
+    bbr2->bbr2_loss_events_in_round = 0;
+    bbr2->bbr2_bw_probe_up_rounds = 0;
+    bbr2->bbr2_bw_probe_up_acks = 0;
+    bbr2->bbr2_probe_up_cnt = UINT64_MAX;
+    bbr2->bbr2_min_rtt = UINT64_MAX;
+    bbr2->bbr2_min_rtt_stamp = 0;
+    bbr2->bbr2_probe_rtt_min_delay = UINT64_MAX;
+    bbr2->bbr2_probe_rtt_min_stamp = 0;
+    bbr2->bbr2_probe_rtt_done_stamp = 0;
+    bbr2->bbr2_cycle_stamp = 0;
+    bbr2->bbr2_bw_probe_wait = 0;
+    bbr2->bbr2_end_recovery_at = 0;
+    bbr2->bbr2_ecn_ce_in_round = 0;
+    bbr2->bbr2_ecn_ect_in_round = 0;
+    bbr2->bbr2_ecn_alpha = BBR2_ECN_SCALE;
+    bbr2->bbr2_startup_ecn_rounds = 0;
+    bbr2->bbr2_lost_bytes = 0;
+    reset_congestion_signals(bbr2);
+    reset_short_term_model(bbr2);
+    reset_full_bw(bbr2);
+
+    /*
+     " BBRInitPacingRate():
+     "   nominal_bandwidth = InitialCwnd / (SRTT ? SRTT : 1ms)
+     "   BBR.pacing_rate =  BBRStartupPacingGain * nominal_bandwidth
+     */
+    srtt = lsquic_rtt_stats_get_srtt(bbr2->bbr2_rtt_stats);
+    if (srtt == 0)
+        srtt = ms(1);
+    bbr2->bbr2_pacing_rate = (uint64_t) (kStartupPacingGain
+                        * ((uint64_t) kInitialCwnd * 1000000 / srtt));
+
+    enter_startup(bbr2);
+}
+
+
+static void
+lsquic_bbr2_init (void *cong_ctl, const struct lsquic_conn_public *conn_pub,
+                                                enum quic_ft_bit retx_frames)
+{
+    struct lsquic_bbr2 *const bbr2 = cong_ctl;
+    bbr2->bbr2_conn_pub = conn_pub;
+    lsquic_bw_sampler_init(&bbr2->bbr2_bw_sampler, conn_pub->lconn,
+                                                                retx_frames);
+    bbr2->bbr2_rtt_stats = &conn_pub->rtt_stats;
+    bbr2->bbr2_last_sent_packno = 0;
+
+    init_bbr2(bbr2);
+
+    LSQ_DEBUG("initialized");
+}
+
+
+static void
+lsquic_bbr2_reinit (void *cong_ctl)
+{
+    struct lsquic_bbr2 *const bbr2 = cong_ctl;
+
+    init_bbr2(bbr2);
+
+    LSQ_DEBUG("re-initialized");
+}
+
+
+/*
+ " BBRBDPMultiple(bw, gain):
+ "   if (BBR.min_rtt == Inf)
+ "       return InitialCwnd  (no valid RTT samples yet)
+ "   BBR.bdp = bw * BBR.min_rtt
+ "   return gain * BBR.bdp
+ */
+static uint64_t
+bdp_multiple (const struct lsquic_bbr2 *bbr2, uint64_t bw, float gain)
+{
+    if (bbr2->bbr2_min_rtt == UINT64_MAX)
+        return bbr2->bbr2_init_cwnd;
+    return gain * (bw * bbr2->bbr2_min_rtt / 1000000);
+}
+
+
+static uint64_t
+send_quantum (const struct lsquic_bbr2 *bbr2)
+{
+    uint64_t quantum;
+
+    quantum = bbr2->bbr2_pacing_rate / 1000;    /* One millisecond worth */
+    quantum = MAX(quantum, 2 * kMaxSegmentSize);
+    return MIN(quantum, 64 * 1024);
+}
+
+
+static uint64_t
+quantization_budget (const struct lsquic_bbr2 *bbr2, uint64_t inflight)
+{
+    inflight = MAX(inflight, 3 * send_quantum(bbr2));
+    inflight = MAX(inflight, kMinPipeCwnd);
+    if (bbr2->bbr2_mode == BBR2_MODE_PROBE_BW_UP)
+        inflight += 2 * kMaxSegmentSize;
+    return inflight;
+}
+
+
+static uint64_t
+inflight_at_gain (const struct lsquic_bbr2 *bbr2, float gain)
+{
+    return quantization_budget(bbr2,
+                            bdp_multiple(bbr2, bbr2->bbr2_max_bw, gain));
+}
+
+
+static uint64_t
+inflight_with_headroom (const struct lsquic_bbr2 *bbr2)
+{
+    uint64_t headroom;
+
+    if (bbr2->bbr2_inflight_hi == UINT64_MAX)
+        return UINT64_MAX;
+    headroom = MAX(kMaxSegmentSize, kHeadroom * bbr2->bbr2_inflight_hi);
+    if (bbr2->bbr2_inflight_hi > headroom + kMinPipeCwnd)
+        return bbr2->bbr2_inflight_hi - headroom;
+    else
+        return kMinPipeCwnd;
+}
+
+
+static uint64_t
+target_inflight (const struct lsquic_bbr2 *bbr2)
+{
+    return MIN(bdp_multiple(bbr2, bbr2->bbr2_bw, 1.0), bbr2->bbr2_cwnd);
+}
+
+
+static uint64_t
+probe_rtt_cwnd (const struct lsquic_bbr2 *bbr2)
+{
+    return MAX(bdp_multiple(bbr2, bbr2->bbr2_bw, kProbeRttCwndGain),
+                                                                kMinPipeCwnd);
+}
+
+
+static uint64_t
+save_cwnd (const struct lsquic_bbr2 *bbr2)
+{
+    if (!(bbr2->bbr2_flags & BBR2_FLAG_IN_RECOVERY)
+                                && bbr2->bbr2_mode != BBR2_MODE_PROBE_RTT)
+        return bbr2->bbr2_cwnd;
+    else
+        return MAX(bbr2->bbr2_prior_cwnd, bbr2->bbr2_cwnd);
+}
+
+
+static void
+restore_cwnd (struct lsquic_bbr2 *bbr2)
+{
+    bbr2->bbr2_cwnd = MAX(bbr2->bbr2_cwnd, bbr2->bbr2_prior_cwnd);
+}
+
+
+/* Inflight is too high if loss rate or CE-mark rate are over threshold */
+static int
+is_inflight_too_high (const struct lsquic_bbr2 *bbr2,
+                                            const struct rate_sample *rs)
+{
+    if (rs->lost > rs->tx_in_flight * kLossThresh)
+    {
+        LSQ_DEBUG("inflight too high: lost %"PRIu64" out of %"PRIu64,
+                                                rs->lost, rs->tx_in_flight);
+        return 1;
+    }
+
+    if (bbr2->bbr2_ecn_ect_in_round >= kEcnMinPackets
+            && bbr2->bbr2_ecn_ce_in_round
+                            > bbr2->bbr2_ecn_ect_in_round * kEcnThresh)
+    {
+        LSQ_DEBUG("inflight too high: %"PRIu64" out of %"PRIu64" packets "
+            "CE-marked", bbr2->bbr2_ecn_ce_in_round,
+            bbr2->bbr2_ecn_ect_in_round);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+static void
+update_round (struct lsquic_bbr2 *bbr2, const struct rate_sample *rs)
+{
+    if (rs->prior_delivered >= bbr2->bbr2_next_round_delivered)
+    {
+        start_round(bbr2);
+        ++bbr2->bbr2_round_count;
+        ++bbr2->bbr2_rounds_since_bw_probe;
+        bbr2->bbr2_flags |= BBR2_FLAG_ROUND_START;
+        LSQ_DEBUG("round %"PRIu64" starts", bbr2->bbr2_round_count);
+    }
+    else
+        bbr2->bbr2_flags &= ~BBR2_FLAG_ROUND_START;
+}
+
+
+static void
+update_max_bw (struct lsquic_bbr2 *bbr2, const struct rate_sample *rs)
+{
+    update_round(bbr2, rs);
+    if (rs->delivery_rate >= bbr2->bbr2_max_bw || !rs->is_app_limited)
+    {
+        minmax_upmax(&bbr2->bbr2_max_bw_filter, bbr2->bbr2_cycle_count,
+                                                        rs->delivery_rate);
+        bbr2->bbr2_max_bw = minmax_get(&bbr2->bbr2_max_bw_filter);
+    }
+}
+
+
+static void
+update_latest_delivery_signals (struct lsquic_bbr2 *bbr2,
+                                            const struct rate_sample *rs)
+{
+    bbr2->bbr2_flags &= ~BBR2_FLAG_LOSS_ROUND_START;
+    bbr2->bbr2_bw_latest = MAX(bbr2->bbr2_bw_latest, rs->delivery_rate);
+    bbr2->bbr2_inflight_latest = MAX(bbr2->bbr2_inflight_latest,
+                                                            rs->delivered);
+    if (rs->prior_delivered >= bbr2->bbr2_loss_round_delivered)
+    {
+        bbr2->bbr2_loss_round_delivered = delivered(bbr2);
+        bbr2->bbr2_flags |= BBR2_FLAG_LOSS_ROUND_START;
+    }
+}
+
+
+static void
+advance_latest_delivery_signals (struct lsquic_bbr2 *bbr2,
+                                            const struct rate_sample *rs)
+{
+    if (bbr2->bbr2_flags & BBR2_FLAG_LOSS_ROUND_START)
+    {
+        bbr2->bbr2_bw_latest = rs->delivery_rate;
+        bbr2->bbr2_inflight_latest = rs->delivered;
+        bbr2->bbr2_loss_events_in_round = 0;
+        bbr2->bbr2_ecn_ce_in_round = 0;
+        bbr2->bbr2_ecn_ect_in_round = 0;
+    }
+}
+
+
+/* Called at the end of each round with ECN feedback */
+static void
+update_ecn_alpha (struct lsquic_bbr2 *bbr2)
+{
+    unsigned ce_ratio;
+
+    if (bbr2->bbr2_ecn_ect_in_round == 0)
+        return;
+
+    ce_ratio = bbr2->bbr2_ecn_ce_in_round * BBR2_ECN_SCALE
+                                            / bbr2->bbr2_ecn_ect_in_round;
+    bbr2->bbr2_ecn_alpha = bbr2->bbr2_ecn_alpha
+        - (bbr2->bbr2_ecn_alpha >> kEcnAlphaGainShift)
+        + (ce_ratio >> kEcnAlphaGainShift);
+    LSQ_DEBUG("CE ratio in round: %u/%u; ECN alpha: %u", ce_ratio,
+                                    BBR2_ECN_SCALE, bbr2->bbr2_ecn_alpha);
+}
+
+
+static void
+init_lower_bounds (struct lsquic_bbr2 *bbr2)
+{
+    if (bbr2->bbr2_bw_lo == UINT64_MAX)
+        bbr2->bbr2_bw_lo = bbr2->bbr2_max_bw;
+    if (bbr2->bbr2_inflight_lo == UINT64_MAX)
+        bbr2->bbr2_inflight_lo = bbr2->bbr2_cwnd;
+}
+
+
+/* Once per round, cut bw_lo and inflight_lo in response to loss and cut
+ * inflight_lo in proportion to ECN alpha in response to CE marks.
+ */
+static void
+adapt_lower_bounds_from_congestion (struct lsquic_bbr2 *bbr2)
+{
+    uint64_t loss_inflight_lo, ecn_inflight_lo;
+
+    if (is_probing_bw(bbr2))
+        return;
+
+    if (!(bbr2->bbr2_flags & (BBR2_FLAG_LOSS_IN_ROUND|BBR2_FLAG_ECN_IN_ROUND)))
+        return;
+
+    init_lower_bounds(bbr2);
+
+    if (bbr2->bbr2_flags & BBR2_FLAG_LOSS_IN_ROUND)
+    {
+        bbr2->bbr2_bw_lo = MAX(bbr2->bbr2_bw_latest,
+                                            kBeta * bbr2->bbr2_bw_lo);
+        loss_inflight_lo = MAX(bbr2->bbr2_inflight_latest,
+                                            kBeta * bbr2->bbr2_inflight_lo);
+    }
+    else
+        loss_inflight_lo = UINT64_MAX;
+
+    if ((bbr2->bbr2_flags & BBR2_FLAG_ECN_IN_ROUND) && bbr2->bbr2_ecn_alpha)
+        ecn_inflight_lo = bbr2->bbr2_inflight_lo
+            * (1.0f - kEcnFactor * bbr2->bbr2_ecn_alpha / BBR2_ECN_SCALE);
+    else
+        ecn_inflight_lo = UINT64_MAX;
+
+    bbr2->bbr2_inflight_lo = MIN(loss_inflight_lo, ecn_inflight_lo);
+    LSQ_DEBUG("lower bounds: bw_lo: %"PRIu64"; inflight_lo: %"PRIu64,
+                                bbr2->bbr2_bw_lo, bbr2->bbr2_inflight_lo);
+}
+
+
+static void
+update_congestion_signals (struct lsquic_bbr2 *bbr2,
+                                            const struct rate_sample *rs)
+{
+    update_max_bw(bbr2, rs);
+    if (rs->newly_lost)
+    {
+        bbr2->bbr2_flags |= BBR2_FLAG_LOSS_IN_ROUND;
+        ++bbr2->bbr2_loss_events_in_round;
+    }
+    if (!(bbr2->bbr2_flags & BBR2_FLAG_LOSS_ROUND_START))
+        return;
+    update_ecn_alpha(bbr2);
+    adapt_lower_bounds_from_congestion(bbr2);
+    bbr2->bbr2_flags &= ~(BBR2_FLAG_LOSS_IN_ROUND|BBR2_FLAG_ECN_IN_ROUND);
+}
+
+
+static void
+update_ack_aggregation (struct lsquic_bbr2 *bbr2,
+                        const struct rate_sample *rs, lsquic_time_t now)
+{
+    uint64_t expected_delivered, extra;
+    lsquic_time_t interval;
+
+    interval = now - bbr2->bbr2_extra_acked_interval_start;
+    expected_delivered = bbr2->bbr2_bw * interval / 1000000;
+    /*
+     " Reset interval if ACK rate is below expected rate:
+     */
+    if (bbr2->bbr2_extra_acked_delivered <= expected_delivered)
+    {
+        bbr2->bbr2_extra_acked_delivered = 0;
+        bbr2->bbr2_extra_acked_interval_start = now;
+        expected_delivered = 0;
+    }
+    bbr2->bbr2_extra_acked_delivered += rs->newly_acked;
+    extra = bbr2->bbr2_extra_acked_delivered - expected_delivered;
+    extra = MIN(extra, bbr2->bbr2_cwnd);
+    minmax_upmax(&bbr2->bbr2_extra_acked_filter, bbr2->bbr2_round_count,
+                                                                    extra);
+}
+
+
+static void
+check_full_bw_reached (struct lsquic_bbr2 *bbr2, const struct rate_sample *rs)
+{
+    if ((bbr2->bbr2_flags & BBR2_FLAG_FULL_BW_NOW) || rs->is_app_limited)
+        return;
+    if (rs->delivery_rate >= bbr2->bbr2_full_bw * kFullBwThresh)
+    {
+        reset_full_bw(bbr2);
+        bbr2->bbr2_full_bw = rs->delivery_rate;
+        return;
+    }
+    if (!(bbr2->bbr2_flags & BBR2_FLAG_ROUND_START))
+        return;
+    ++bbr2->bbr2_full_bw_count;
+    if (bbr2->bbr2_full_bw_count >= kFullBwCount)
+    {
+        bbr2->bbr2_flags |= BBR2_FLAG_FULL_BW_NOW|BBR2_FLAG_FULL_BW_REACHED;
+        LSQ_DEBUG("full bandwidth reached: %"PRIu64" bytes/sec",
+                                                        bbr2->bbr2_full_bw);
+    }
+}
+
+
+static void
+handle_queue_too_high_in_startup (struct lsquic_bbr2 *bbr2)
+{
+    bbr2->bbr2_flags |= BBR2_FLAG_FULL_BW_REACHED;
+    bbr2->bbr2_inflight_hi = MAX(bdp_multiple(bbr2, bbr2->bbr2_max_bw, 1.0),
+                                                bbr2->bbr2_inflight_latest);
+    LSQ_DEBUG("queue too high in startup: set inflight_hi to %"PRIu64,
+                                                    bbr2->bbr2_inflight_hi);
+}
+
+
+/* Exit STARTUP on persistent loss or, like Linux BBRv2, on high CE-mark
+ * rate for several rounds in a row.
+ */
+static void
+check_startup_high_loss (struct lsquic_bbr2 *bbr2,
+                                            const struct rate_sample *rs)
+{
+    if (bbr2->bbr2_flags & BBR2_FLAG_FULL_BW_REACHED)
+        return;
+    if (!(bbr2->bbr2_flags & BBR2_FLAG_LOSS_ROUND_START))
+        return;
+
+    if ((bbr2->bbr2_flags & BBR2_FLAG_IN_RECOVERY)
+            && bbr2->bbr2_loss_events_in_round >= kStartupFullLossCount
+            && is_inflight_too_high(bbr2, rs))
+    {
+        handle_queue_too_high_in_startup(bbr2);
+        return;
+    }
+
+    if (bbr2->bbr2_ecn_ect_in_round >= kEcnMinPackets
+            && bbr2->bbr2_ecn_ce_in_round
+                            > bbr2->bbr2_ecn_ect_in_round * kEcnThresh)
+    {
+        if (++bbr2->bbr2_startup_ecn_rounds >= kStartupEcnRounds)
+            handle_queue_too_high_in_startup(bbr2);
+    }
+    else
+        bbr2->bbr2_startup_ecn_rounds = 0;
+}
+
+
+static void
+enter_drain (struct lsquic_bbr2 *bbr2)
+{
+    set_mode(bbr2, BBR2_MODE_DRAIN, kDrainPacingGain, kStartupCwndGain);
+}
+
+
+static void
+pick_probe_wait (struct lsquic_bbr2 *bbr2)
+{
+    uint8_t rand;
+
+    rand = lsquic_crand_get_byte(bbr2->bbr2_conn_pub->enpub->enp_crand);
+    /*
+     " BBR.rounds_since_bw_probe = random_int_between(0, 1)
+     " BBR.bw_probe_wait = 2 sec + random_float_between(0.0, 1.0) sec
+     */
+    bbr2->bbr2_rounds_since_bw_probe = rand & 1;
+    bbr2->bbr2_bw_probe_wait = sec(2) + sec(1) * (rand >> 1) / 128;
+}
+
+
+static void
+start_probe_bw_down (struct lsquic_bbr2 *bbr2, lsquic_time_t now)
+{
+    reset_congestion_signals(bbr2);
+    bbr2->bbr2_probe_up_cnt = UINT64_MAX;
+    pick_probe_wait(bbr2);
+    bbr2->bbr2_cycle_stamp = now;
+    bbr2->bbr2_ack_phase = BBR2_ACKS_PROBE_STOPPING;
+    start_round(bbr2);
+    set_mode(bbr2, BBR2_MODE_PROBE_BW_DOWN, kProbeBwDownPacingGain,
+                                                        kDefaultCwndGain);
+}
+
+
+static void
+start_probe_bw_cruise (struct lsquic_bbr2 *bbr2)
+{
+    set_mode(bbr2, BBR2_MODE_PROBE_BW_CRUISE, 1.0, kDefaultCwndGain);
+}
+
+
+static void
+start_probe_bw_refill (struct lsquic_bbr2 *bbr2)
+{
+    reset_short_term_model(bbr2);
+    bbr2->bbr2_bw_probe_up_rounds = 0;
+    bbr2->bbr2_bw_probe_up_acks = 0;
+    bbr2->bbr2_ack_phase = BBR2_ACKS_REFILLING;
+    start_round(bbr2);
+    set_mode(bbr2, BBR2_MODE_PROBE_BW_REFILL, 1.0, kDefaultCwndGain);
+}
+
+
+static void
+raise_inflight_hi_slope (struct lsquic_bbr2 *bbr2)
+{
+    uint64_t growth_this_round;
+
+    growth_this_round = (uint64_t) kMaxSegmentSize
+                                        << bbr2->bbr2_bw_probe_up_rounds;
+    bbr2->bbr2_bw_probe_up_rounds = MIN(bbr2->bbr2_bw_probe_up_rounds + 1,
+                                                        kMaxProbeUpRounds);
+    bbr2->bbr2_probe_up_cnt = MAX(bbr2->bbr2_cwnd / growth_this_round, 1);
+}
+
+
+static void
+start_probe_bw_up (struct lsquic_bbr2 *bbr2, const struct rate_sample *rs)
+{
+    bbr2->bbr2_ack_phase = BBR2_ACKS_PROBE_STARTING;
+    start_round(bbr2);
+    reset_full_bw(bbr2);
+    bbr2->bbr2_full_bw = rs->delivery_rate;
+    set_mode(bbr2, BBR2_MODE_PROBE_BW_UP, kProbeBwUpPacingGain,
+                                                        kProbeBwUpCwndGain);
+    raise_inflight_hi_slope(bbr2);
+}
+
+
+static void
+enter_probe_bw (struct lsquic_bbr2 *bbr2, lsquic_time_t now)
+{
+    bbr2->bbr2_cwnd_gain = kDefaultCwndGain;
+    start_probe_bw_down(bbr2, now);
+}
+
+
+static void
+check_startup_and_drain_done (struct lsquic_bbr2 *bbr2, uint64_t in_flight,
+                                                        lsquic_time_t now)
+{
+    if (bbr2->bbr2_mode == BBR2_MODE_STARTUP
+                        && (bbr2->bbr2_flags & BBR2_FLAG_FULL_BW_REACHED))
+        enter_drain(bbr2);
+    if (bbr2->bbr2_mode == BBR2_MODE_DRAIN
+                                    && in_flight <= inflight_at_gain(bbr2, 1.0))
+        enter_probe_bw(bbr2, now);
+}
+
+
+static void
+handle_inflight_too_high (struct lsquic_bbr2 *bbr2,
+                        const struct rate_sample *rs, lsquic_time_t now)
+{
+    bbr2->bbr2_flags &= ~BBR2_FLAG_BW_PROBE_SAMPLES;
+    if (!rs->is_app_limited)
+        bbr2->bbr2_inflight_hi = MAX(rs->tx_in_flight,
+                                        target_inflight(bbr2) * kBeta);
+    LSQ_DEBUG("inflight too high: set inflight_hi to %"PRIu64,
+                                                    bbr2->bbr2_inflight_hi);
+    if (bbr2->bbr2_mode == BBR2_MODE_PROBE_BW_UP)
+        start_probe_bw_down(bbr2, now);
+}
+
+
+static int
+check_inflight_too_high (struct lsquic_bbr2 *bbr2,
+                        const struct rate_sample *rs, lsquic_time_t now)
+{
+    if (is_inflight_too_high(bbr2, rs))
+    {
+        if (bbr2->bbr2_flags & BBR2_FLAG_BW_PROBE_SAMPLES)
+            handle_inflight_too_high(bbr2, rs, now);
+        return 1;
+    }
+    else
+        return 0;
+}
+
+
+static void
+probe_inflight_hi_upward (struct lsquic_bbr2 *bbr2,
+                                            const struct rate_sample *rs)
+{
+    uint64_t delta;
+
+    if (!(bbr2->bbr2_flags & BBR2_FLAG_CWND_LIMITED)
+                            || bbr2->bbr2_cwnd < bbr2->bbr2_inflight_hi)
+        return;
+    bbr2->bbr2_bw_probe_up_acks += rs->newly_acked;
+    if (bbr2->bbr2_bw_probe_up_acks >= bbr2->bbr2_probe_up_cnt)
+    {
+        delta = bbr2->bbr2_bw_probe_up_acks / bbr2->bbr2_probe_up_cnt;
+        bbr2->bbr2_bw_probe_up_acks -= delta * bbr2->bbr2_probe_up_cnt;
+        bbr2->bbr2_inflight_hi += delta;
+    }
+    if (bbr2->bbr2_flags & BBR2_FLAG_ROUND_START)
+        raise_inflight_hi_slope(bbr2);
+}
+
+
+static void
+adapt_upper_bounds (struct lsquic_bbr2 *bbr2, const struct rate_sample *rs,
+                                                        lsquic_time_t now)
+{
+    if (bbr2->bbr2_ack_phase == BBR2_ACKS_PROBE_STARTING
+                                && (bbr2->bbr2_flags & BBR2_FLAG_ROUND_START))
+        /*
+         " starting to get bw probing samples
+         */
+        bbr2->bbr2_ack_phase = BBR2_ACKS_PROBE_FEEDBACK;
+    if (bbr2->bbr2_ack_phase == BBR2_ACKS_PROBE_STOPPING
+                                && (bbr2->bbr2_flags & BBR2_FLAG_ROUND_START))
+    {
+        /*
+         " end of samples from bw probing phase
+         *
+         * The draft leaves ack_phase alone here, which makes the filter
+         * advance every round until the next probe.  Like Linux, reset it.
+         */
+        bbr2->bbr2_flags &= ~BBR2_FLAG_BW_PROBE_SAMPLES;
+        bbr2->bbr2_ack_phase = BBR2_ACKS_INIT;
+        if (in_probe_bw(bbr2) && !rs->is_app_limited)
+            ++bbr2->bbr2_cycle_count;
+    }
+
+    if (!check_inflight_too_high(bbr2, rs, now))
+    {
+        if (bbr2->bbr2_inflight_hi == UINT64_MAX)
+            return;
+        if (rs->tx_in_flight > bbr2->bbr2_inflight_hi)
+            bbr2->bbr2_inflight_hi = rs->tx_in_flight;
+        if (bbr2->bbr2_mode == BBR2_MODE_PROBE_BW_UP)
+            probe_inflight_hi_upward(bbr2, rs);
+    }
+}
+
+
+static int
+has_elapsed_in_phase (const struct lsquic_bbr2 *bbr2, lsquic_time_t interval,
+                                                        lsquic_time_t now)
+{
+    return now > bbr2->bbr2_cycle_stamp + interval;
+}
+
+
+/*
+ " Randomized decision about how long to wait until probing for bandwidth,
+ " using round count and wall clock.
+ *
+ * The round count part is the Reno coexistence check: probe no later than
+ * Reno would fill the pipe, up to 63 rounds.
+ */
+static int
+is_time_to_probe_bw (struct lsquic_bbr2 *bbr2, lsquic_time_t now)
+{
+    uint64_t reno_rounds;
+
+    reno_rounds = target_inflight(bbr2) / kMaxSegmentSize;
+    if (has_elapsed_in_phase(bbr2, bbr2->bbr2_bw_probe_wait, now)
+            || bbr2->bbr2_rounds_since_bw_probe
+                                    >= MIN(reno_rounds, kMaxRenoRounds))
+    {
+        start_probe_bw_refill(bbr2);
+        return 1;
+    }
+    else
+        return 0;
+}
+
+
+static int
+is_time_to_cruise (const struct lsquic_bbr2 *bbr2, uint64_t in_flight)
+{
+    if (in_flight > inflight_with_headroom(bbr2))
+        return 0;   /* Not enough headroom */
+    if (in_flight <= inflight_at_gain(bbr2, 1.0))
+        return 1;   /* Inflight <= estimated BDP */
+    return 0;
+}
+
+
+static int
+is_time_to_go_down (struct lsquic_bbr2 *bbr2, const struct rate_sample *rs)
+{
+    if ((bbr2->bbr2_flags & BBR2_FLAG_CWND_LIMITED)
+                                && bbr2->bbr2_cwnd >= bbr2->bbr2_inflight_hi)
+    {
+        reset_full_bw(bbr2);    /* Bw is limited by inflight_hi */
+        bbr2->bbr2_full_bw = rs->delivery_rate;
+    }
+    else if (bbr2->bbr2_flags & BBR2_FLAG_FULL_BW_NOW)
+        return 1;   /* We estimate we've fully used path bw */
+    return 0;
+}
+
+
+static void
+update_probe_bw_cycle_phase (struct lsquic_bbr2 *bbr2,
+        const struct rate_sample *rs, uint64_t in_flight, lsquic_time_t now)
+{
+    if (!(bbr2->bbr2_flags & BBR2_FLAG_FULL_BW_REACHED))
+        return;
+    adapt_upper_bounds(bbr2, rs, now);
+    if (!in_probe_bw(bbr2))
+        return;
+
+    switch (bbr2->bbr2_mode)
+    {
+    case BBR2_MODE_PROBE_BW_DOWN:
+        if (is_time_to_probe_bw(bbr2, now))
+            return;
+        if (is_time_to_cruise(bbr2, in_flight))
+            start_probe_bw_cruise(bbr2);
+        break;
+    case BBR2_MODE_PROBE_BW_CRUISE:
+        (void) is_time_to_probe_bw(bbr2, now);
+        break;
+    case BBR2_MODE_PROBE_BW_REFILL:
+        /*
+         " After one round of REFILL, start UP
+         */
+        if (bbr2->bbr2_flags & BBR2_FLAG_ROUND_START)
+        {
+            bbr2->bbr2_flags |= BBR2_FLAG_BW_PROBE_SAMPLES;
+            start_probe_bw_up(bbr2, rs);
+        }
+        break;
+    case BBR2_MODE_PROBE_BW_UP:
+        if (is_time_to_go_down(bbr2, rs))
+            start_probe_bw_down(bbr2, now);
+        break;
+    default:
+        break;
+    }
+}
+
+
+static void
+update_min_rtt (struct lsquic_bbr2 *bbr2, const struct rate_sample *rs,
+                                                        lsquic_time_t now)
+{
+    int min_rtt_expired;
+
+    if (bbr2->bbr2_probe_rtt_min_stamp
+                    && now > bbr2->bbr2_probe_rtt_min_stamp + kProbeRttInterval)
+        bbr2->bbr2_flags |= BBR2_FLAG_PROBE_RTT_EXPIRED;
+    else
+        bbr2->bbr2_flags &= ~BBR2_FLAG_PROBE_RTT_EXPIRED;
+    if (rs->rtt && (rs->rtt < bbr2->bbr2_probe_rtt_min_delay
+                        || (bbr2->bbr2_flags & BBR2_FLAG_PROBE_RTT_EXPIRED)))
+    {
+        bbr2->bbr2_probe_rtt_min_delay = rs->rtt;
+        bbr2->bbr2_probe_rtt_min_stamp = now;
+    }
+
+    min_rtt_expired = now > bbr2->bbr2_min_rtt_stamp + kMinRttFilterLen;
+    if (bbr2->bbr2_probe_rtt_min_delay < bbr2->bbr2_min_rtt
+                                                        || min_rtt_expired)
+    {
+        bbr2->bbr2_min_rtt = bbr2->bbr2_probe_rtt_min_delay;
+        bbr2->bbr2_min_rtt_stamp = bbr2->bbr2_probe_rtt_min_stamp;
+    }
+}
+
+
+static void
+exit_probe_rtt (struct lsquic_bbr2 *bbr2, lsquic_time_t now)
+{
+    reset_short_term_model(bbr2);
+    if (bbr2->bbr2_flags & BBR2_FLAG_FULL_BW_REACHED)
+    {
+        start_probe_bw_down(bbr2, now);
+        start_probe_bw_cruise(bbr2);
+    }
+    else
+        enter_startup(bbr2);
+}
+
+
+static void
+check_probe_rtt_done (struct lsquic_bbr2 *bbr2, lsquic_time_t now)
+{
+    if (bbr2->bbr2_probe_rtt_done_stamp != 0
+                                && now > bbr2->bbr2_probe_rtt_done_stamp)
+    {
+        /*
+         " schedule next ProbeRTT:
+         */
+        bbr2->bbr2_probe_rtt_min_stamp = now;
+        restore_cwnd(bbr2);
+        exit_probe_rtt(bbr2, now);
+    }
+}
+
+
+static void
+handle_probe_rtt (struct lsquic_bbr2 *bbr2, uint64_t in_flight,
+                                                        lsquic_time_t now)
+{
+    /*
+     " Ignore low rate samples during ProbeRTT:
+     */
+    lsquic_bw_sampler_app_limited(&bbr2->bbr2_bw_sampler);
+
+    if (bbr2->bbr2_probe_rtt_done_stamp == 0
+                                    && in_flight <= probe_rtt_cwnd(bbr2))
+    {
+        /*
+         " Wait for at least ProbeRTTDuration to elapse:
+         */
+        bbr2->bbr2_probe_rtt_done_stamp = now + kProbeRttDuration;
+        /*
+         " Wait for at least one round to elapse:
+         */
+        bbr2->bbr2_flags &= ~BBR2_FLAG_PROBE_RTT_ROUND_DONE;
+        start_round(bbr2);
+    }
+    else if (bbr2->bbr2_probe_rtt_done_stamp != 0)
+    {
+        if (bbr2->bbr2_flags & BBR2_FLAG_ROUND_START)
+            bbr2->bbr2_flags |= BBR2_FLAG_PROBE_RTT_ROUND_DONE;
+        if (bbr2->bbr2_flags & BBR2_FLAG_PROBE_RTT_ROUND_DONE)
+            check_probe_rtt_done(bbr2, now);
+    }
+}
+
+
+static void
+check_probe_rtt (struct lsquic_bbr2 *bbr2, const struct rate_sample *rs,
+                                    uint64_t in_flight, lsquic_time_t now)
+{
+    if (bbr2->bbr2_mode != BBR2_MODE_PROBE_RTT
+            && (bbr2->bbr2_flags & BBR2_FLAG_PROBE_RTT_EXPIRED)
+            && !(bbr2->bbr2_flags & BBR2_FLAG_IDLE_RESTART))
+    {
+        bbr2->bbr2_prior_cwnd = save_cwnd(bbr2);
+        set_mode(bbr2, BBR2_MODE_PROBE_RTT, 1.0, kProbeRttCwndGain);
+        bbr2->bbr2_probe_rtt_done_stamp = 0;
+        bbr2->bbr2_ack_phase = BBR2_ACKS_PROBE_STOPPING;
+        start_round(bbr2);
+    }
+    if (bbr2->bbr2_mode == BBR2_MODE_PROBE_RTT)
+        handle_probe_rtt(bbr2, in_flight, now);
+    if (rs->delivered > 0)
+        bbr2->bbr2_flags &= ~BBR2_FLAG_IDLE_RESTART;
+}
+
+
+static void
+bound_bw_for_model (struct lsquic_bbr2 *bbr2)
+{
+    bbr2->bbr2_bw = MIN(bbr2->bbr2_max_bw, bbr2->bbr2_bw_lo);
+}
+
+
+static void
+update_model_and_state (struct lsquic_bbr2 *bbr2,
+        const struct rate_sample *rs, uint64_t in_flight, lsquic_time_t now)
+{
+    update_latest_delivery_signals(bbr2, rs);
+    update_congestion_signals(bbr2, rs);
+    update_ack_aggregation(bbr2, rs, now);
+    check_full_bw_reached(bbr2, rs);
+    check_startup_high_loss(bbr2, rs);
+    check_startup_and_drain_done(bbr2, in_flight, now);
+    update_probe_bw_cycle_phase(bbr2, rs, in_flight, now);
+    update_min_rtt(bbr2, rs, now);
+    check_probe_rtt(bbr2, rs, in_flight, now);
+    advance_latest_delivery_signals(bbr2, rs);
+    bound_bw_for_model(bbr2);
+    if (bbr2->bbr2_flags & BBR2_FLAG_ROUND_START)
+        bbr2->bbr2_flags &= ~BBR2_FLAG_CWND_LIMITED;
+}
+
+
+static void
+set_pacing_rate (struct lsquic_bbr2 *bbr2)
+{
+    uint64_t rate;
+
+    rate = bbr2->bbr2_pacing_gain * bbr2->bbr2_bw
+                                    * (100 - kPacingMarginPercent) / 100;
+    if ((bbr2->bbr2_flags & BBR2_FLAG_FULL_BW_REACHED)
+                                            || rate > bbr2->bbr2_pacing_rate)
+        bbr2->bbr2_pacing_rate = rate;
+}
+
+
+/* Cap cwnd by inflight_hi when probing and by inflight_lo always */
+static void
+bound_cwnd_for_model (struct lsquic_bbr2 *bbr2)
+{
+    uint64_t cap;
+
+    if (in_probe_bw(bbr2) && bbr2->bbr2_mode != BBR2_MODE_PROBE_BW_CRUISE)
+        cap = bbr2->bbr2_inflight_hi;
+    else if (bbr2->bbr2_mode == BBR2_MODE_PROBE_RTT
+                            || bbr2->bbr2_mode == BBR2_MODE_PROBE_BW_CRUISE)
+        cap = inflight_with_headroom(bbr2);
+    else
+        cap = UINT64_MAX;
+
+    cap = MIN(cap, bbr2->bbr2_inflight_lo);
+    cap = MAX(cap, kMinPipeCwnd);
+    bbr2->bbr2_cwnd = MIN(bbr2->bbr2_cwnd, cap);
+}
+
+
+static void
+set_cwnd (struct lsquic_bbr2 *bbr2, const struct rate_sample *rs,
+                                        uint64_t in_flight, int in_fast_rec)
+{
+    uint64_t max_inflight;
+
+    max_inflight = bdp_multiple(bbr2, bbr2->bbr2_bw, bbr2->bbr2_cwnd_gain);
+    max_inflight += minmax_get(&bbr2->bbr2_extra_acked_filter);
+    max_inflight = quantization_budget(bbr2, max_inflight);
+
+    /* Modulate cwnd for recovery.  On the ACK that starts recovery, cwnd
+     * has already been set from in_flight, which excludes lost packets.
+     */
+    if (rs->newly_lost && !in_fast_rec)
+    {
+        if (bbr2->bbr2_cwnd > rs->newly_lost + kMaxSegmentSize)
+            bbr2->bbr2_cwnd -= rs->newly_lost;
+        else
+            bbr2->bbr2_cwnd = kMaxSegmentSize;
+    }
+    if (bbr2->bbr2_flags & BBR2_FLAG_PACKET_CONSERVATION)
+        bbr2->bbr2_cwnd = MAX(bbr2->bbr2_cwnd, in_flight + rs->newly_acked);
+    else if (bbr2->bbr2_flags & BBR2_FLAG_FULL_BW_REACHED)
+        bbr2->bbr2_cwnd = MIN(bbr2->bbr2_cwnd + rs->newly_acked,
+                                                            max_inflight);
+    else if (bbr2->bbr2_cwnd < max_inflight
+                                        || delivered(bbr2) < kInitialCwnd)
+        bbr2->bbr2_cwnd += rs->newly_acked;
+    bbr2->bbr2_cwnd = MAX(bbr2->bbr2_cwnd, kMinPipeCwnd);
+
+    if (bbr2->bbr2_mode == BBR2_MODE_PROBE_RTT)
+        bbr2->bbr2_cwnd = MIN(bbr2->bbr2_cwnd, probe_rtt_cwnd(bbr2));
+    bound_cwnd_for_model(bbr2);
+    bbr2->bbr2_cwnd = MIN(bbr2->bbr2_cwnd, kMaxCwnd);
+}
+
+
+/* Returns true if fast recovery was entered on this ACK */
+static int
+update_recovery (struct lsquic_bbr2 *bbr2, const struct rate_sample *rs,
+                                                        uint64_t in_flight)
+{
+    if (bbr2->bbr2_flags & BBR2_FLAG_IN_RECOVERY)
+    {
+        if (is_valid_packno(bbr2->bbr2_ack_state.max_packno)
+                && bbr2->bbr2_ack_state.max_packno > bbr2->bbr2_end_recovery_at
+                && !rs->newly_lost)
+        {
+            bbr2->bbr2_flags &= ~(BBR2_FLAG_IN_RECOVERY
+                                            |BBR2_FLAG_PACKET_CONSERVATION);
+            restore_cwnd(bbr2);
+            LSQ_DEBUG("exit recovery; cwnd: %"PRIu64, bbr2->bbr2_cwnd);
+        }
+        else if ((bbr2->bbr2_flags & BBR2_FLAG_PACKET_CONSERVATION)
+                                && rs->prior_delivered
+                                        >= bbr2->bbr2_next_round_delivered)
+            /*
+             " After one round trip in Fast Recovery:
+             "   BBR.packet_conservation = false
+             */
+            bbr2->bbr2_flags &= ~BBR2_FLAG_PACKET_CONSERVATION;
+        return 0;
+    }
+    else if (rs->newly_lost)
+    {
+        bbr2->bbr2_prior_cwnd = save_cwnd(bbr2);
+        bbr2->bbr2_cwnd = in_flight + MAX(rs->newly_acked, kMaxSegmentSize);
+        bbr2->bbr2_flags |= BBR2_FLAG_IN_RECOVERY
+                                            |BBR2_FLAG_PACKET_CONSERVATION;
+        bbr2->bbr2_end_recovery_at = bbr2->bbr2_last_sent_packno;
+        start_round(bbr2);
+        LSQ_DEBUG("enter recovery until packet %"PRIu64"; cwnd: %"PRIu64,
+                            bbr2->bbr2_end_recovery_at, bbr2->bbr2_cwnd);
+        return 1;
+    }
+    else
+        return 0;
+}
+
+
+static void
+lsquic_bbr2_begin_ack (void *cong_ctl, lsquic_time_t ack_time,
+                                                        uint64_t in_flight)
+{
+    struct lsquic_bbr2 *const bbr2 = cong_ctl;
+
+    assert(!(bbr2->bbr2_flags & BBR2_FLAG_IN_ACK));
+    bbr2->bbr2_flags |= BBR2_FLAG_IN_ACK;
+    memset(&bbr2->bbr2_ack_state, 0, sizeof(bbr2->bbr2_ack_state));
+    bbr2->bbr2_ack_state.ack_time = ack_time;
+    bbr2->bbr2_ack_state.max_packno = UINT64_MAX;
+    bbr2->bbr2_ack_state.in_flight = in_flight;
+}
+
+
+static void
+lsquic_bbr2_ack (void *cong_ctl, struct lsquic_packet_out *packet_out,
+                  unsigned packet_sz, lsquic_time_t now_time, int app_limited)
+{
+    struct lsquic_bbr2 *const bbr2 = cong_ctl;
+    struct bw_sample *sample;
+
+    assert(bbr2->bbr2_flags & BBR2_FLAG_IN_ACK);
+
+    sample = lsquic_bw_sampler_packet_acked(&bbr2->bbr2_bw_sampler,
+                                packet_out, bbr2->bbr2_ack_state.ack_time);
+    if (sample)
+    {
+        /* Keep the sample of the most recently sent packet */
+        if (bbr2->bbr2_ack_state.sample
+                && bbr2->bbr2_ack_state.sample->prior_delivered
+                                                > sample->prior_delivered)
+            lsquic_malo_put(sample);
+        else
+        {
+            if (bbr2->bbr2_ack_state.sample)
+                lsquic_malo_put(bbr2->bbr2_ack_state.sample);
+            bbr2->bbr2_ack_state.sample = sample;
+        }
+    }
+
+    if (!is_valid_packno(bbr2->bbr2_ack_state.max_packno)
+            || packet_out->po_packno > bbr2->bbr2_ack_state.max_packno)
+        bbr2->bbr2_ack_state.max_packno = packet_out->po_packno;
+    bbr2->bbr2_ack_state.acked_bytes += packet_sz;
+}
+
+
+static void
+lsquic_bbr2_ecn (void *cong_ctl, uint64_t n_ce, uint64_t n_ect)
+{
+    struct lsquic_bbr2 *const bbr2 = cong_ctl;
+
+    bbr2->bbr2_ecn_ce_in_round += n_ce;
+    bbr2->bbr2_ecn_ect_in_round += n_ect;
+    if (n_ce)
+    {
+        bbr2->bbr2_flags |= BBR2_FLAG_ECN_IN_ROUND;
+        LSQ_DEBUG("%"PRIu64" packets CE-marked out of %"PRIu64, n_ce, n_ect);
+    }
+}
+
+
+static void
+lsquic_bbr2_end_ack (void *cong_ctl, uint64_t in_flight)
+{
+    struct lsquic_bbr2 *const bbr2 = cong_ctl;
+    struct bw_sample *const sample = bbr2->bbr2_ack_state.sample;
+    const lsquic_time_t now = bbr2->bbr2_ack_state.ack_time;
+    struct rate_sample rs;
+    int in_fast_rec;
+
+    assert(bbr2->bbr2_flags & BBR2_FLAG_IN_ACK);
+    bbr2->bbr2_flags &= ~BBR2_FLAG_IN_ACK;
+
+    memset(&rs, 0, sizeof(rs));
+    rs.newly_acked = bbr2->bbr2_ack_state.acked_bytes;
+    rs.newly_lost = bbr2->bbr2_lost_bytes;
+    bbr2->bbr2_lost_bytes = 0;
+    if (sample)
+    {
+        rs.delivery_rate = BW_TO_BYTES_PER_SEC(&sample->bandwidth);
+        rs.prior_delivered = sample->prior_delivered;
+        rs.delivered = delivered(bbr2) - sample->prior_delivered;
+        rs.tx_in_flight = sample->tx_in_flight;
+        rs.lost = sample->lost;
+        rs.rtt = sample->rtt;
+        rs.is_app_limited = sample->is_app_limited;
+        lsquic_malo_put(sample);
+    }
+    else
+    {
+        rs.is_app_limited = 1;
+        rs.prior_delivered = 0;
+    }
+
+    LSQ_DEBUG("end_ack; mode: %s; in_flight: %"PRIu64"; acked: %"PRIu64
+        "; lost: %"PRIu64, mode2str[bbr2->bbr2_mode], in_flight,
+        rs.newly_acked, rs.newly_lost);
+
+    in_fast_rec = update_recovery(bbr2, &rs, in_flight);
+    if (sample)
+        update_model_and_state(bbr2, &rs, in_flight, now);
+    set_pacing_rate(bbr2);
+    set_cwnd(bbr2, &rs, in_flight, in_fast_rec);
+
+    LSQ_DEBUG("bw: %"PRIu64"; max_bw: %"PRIu64"; min_rtt: %"PRIu64
+        "; pacing rate: %"PRIu64"; cwnd: %"PRIu64"; inflight_hi: %"PRIu64
+        "; inflight_lo: %"PRIu64, bbr2->bbr2_bw, bbr2->bbr2_max_bw,
+        bbr2->bbr2_min_rtt, bbr2->bbr2_pacing_rate, bbr2->bbr2_cwnd,
+        bbr2->bbr2_inflight_hi, bbr2->bbr2_inflight_lo);
+}
+
+
+static void
+lsquic_bbr2_sent (void *cong_ctl, struct lsquic_packet_out *packet_out,
+                                        uint64_t in_flight, int app_limited)
+{
+    struct lsquic_bbr2 *const bbr2 = cong_ctl;
+
+    if (!(packet_out->po_flags & PO_MINI))
+        lsquic_bw_sampler_packet_sent(&bbr2->bbr2_bw_sampler, packet_out,
+                                                                in_flight);
+
+    bbr2->bbr2_last_sent_packno = packet_out->po_packno;
+
+    if (in_flight + kMaxSegmentSize >= bbr2->bbr2_cwnd)
+        bbr2->bbr2_flags |= BBR2_FLAG_CWND_LIMITED;
+    else if (app_limited)
+        lsquic_bw_sampler_app_limited(&bbr2->bbr2_bw_sampler);
+}
+
+
+static void
+lsquic_bbr2_lost (void *cong_ctl, struct lsquic_packet_out *packet_out,
+                                                        unsigned packet_sz)
+{
+    struct lsquic_bbr2 *const bbr2 = cong_ctl;
+
+    lsquic_bw_sampler_packet_lost(&bbr2->bbr2_bw_sampler, packet_out);
+    bbr2->bbr2_lost_bytes += packet_sz;
+}
+
+
+static void
+lsquic_bbr2_was_quiet (void *cong_ctl, lsquic_time_t now, uint64_t in_flight)
+{
+    struct lsquic_bbr2 *const bbr2 = cong_ctl;
+
+    LSQ_DEBUG("was quiet");
+    bbr2->bbr2_flags |= BBR2_FLAG_IDLE_RESTART;
+    bbr2->bbr2_extra_acked_interval_start = now;
+    bbr2->bbr2_extra_acked_delivered = 0;
+    if (in_probe_bw(bbr2))
+    {
+        /*
+         " BBRHandleRestartFromIdle(): if in ProbeBW, pace at 1.0 * bw
+         */
+        bbr2->bbr2_pacing_rate = bbr2->bbr2_bw
+                                    * (100 - kPacingMarginPercent) / 100;
+    }
+    else if (bbr2->bbr2_mode == BBR2_MODE_PROBE_RTT)
+        check_probe_rtt_done(bbr2, now);
+}
+
+
+static uint64_t
+lsquic_bbr2_get_cwnd (void *cong_ctl)
+{
+    struct lsquic_bbr2 *const bbr2 = cong_ctl;
+
+    return bbr2->bbr2_cwnd;
+}
+
+
+static uint64_t
+lsquic_bbr2_pacing_rate (void *cong_ctl, int in_recovery)
+{
+    struct lsquic_bbr2 *const bbr2 = cong_ctl;
+
+    return bbr2->bbr2_pacing_rate;
+}
+
+
+/* Careful resume.  The jump seeds the max bandwidth filter, which drives
+ * pacing and bounds the window.  On retreat, the seeded value is dropped
+ * and pacing restarts from the new window.
+ */
+static void
+lsquic_bbr2_resume (void *cong_ctl, uint64_t cwnd, uint64_t bw)
+{
+    struct lsquic_bbr2 *const bbr2 = cong_ctl;
+    lsquic_time_t srtt;
+
+    bbr2->bbr2_cwnd = MIN(MAX(cwnd, kMinPipeCwnd), kMaxCwnd);
+    if (bw)
+    {
+        minmax_upmax(&bbr2->bbr2_max_bw_filter, bbr2->bbr2_cycle_count, bw);
+        bbr2->bbr2_max_bw = minmax_get(&bbr2->bbr2_max_bw_filter);
+        bound_bw_for_model(bbr2);
+        set_pacing_rate(bbr2);
+    }
+    else
+    {
+        minmax_reset(&bbr2->bbr2_max_bw_filter,
+                    ((struct minmax_sample) { bbr2->bbr2_cycle_count, 0, }));
+        bbr2->bbr2_max_bw = 0;
+        bound_bw_for_model(bbr2);
+        srtt = lsquic_rtt_stats_get_srtt(bbr2->bbr2_rtt_stats);
+        if (srtt == 0)
+            srtt = ms(1);
+        bbr2->bbr2_pacing_rate = (uint64_t) (bbr2->bbr2_pacing_gain
+                                    * (bbr2->bbr2_cwnd * 1000000 / srtt));
+    }
+    LSQ_INFO("%s: cwnd %"PRIu64"; pacing rate %"PRIu64" bytes/sec",
+        bw ? "resume" : "retreat", bbr2->bbr2_cwnd, bbr2->bbr2_pacing_rate);
+}
+
+
+/* Loss events are processed per ACK in cci_end_ack(); CE marks are passed
+ * via cci_ecn().
+ */
+static void
+lsquic_bbr2_loss (void *cong_ctl) {   /* Noop */   }
+
+
+/* On retransmission timeout, save cwnd and drop it to the minimum.  It is
+ * restored when recovery ends.
+ */
+static void
+lsquic_bbr2_timeout (void *cong_ctl)
+{
+    struct lsquic_bbr2 *const bbr2 = cong_ctl;
+
+    bbr2->bbr2_prior_cwnd = save_cwnd(bbr2);
+    bbr2->bbr2_cwnd = kMinPipeCwnd;
+    bbr2->bbr2_flags |= BBR2_FLAG_IN_RECOVERY;
+    bbr2->bbr2_flags &= ~BBR2_FLAG_PACKET_CONSERVATION;
+    bbr2->bbr2_end_recovery_at = bbr2->bbr2_last_sent_packno;
+    LSQ_DEBUG("timeout: cwnd drops to %"PRIu64, bbr2->bbr2_cwnd);
+}
+
+
+static void
+lsquic_bbr2_cleanup (void *cong_ctl)
+{
+    struct lsquic_bbr2 *const bbr2 = cong_ctl;
+
+    lsquic_bw_sampler_cleanup(&bbr2->bbr2_bw_sampler);
+    LSQ_DEBUG("cleanup");
+}
+
+
+const struct cong_ctl_if lsquic_cong_bbr2_if =
+{
+    .cci_ack           = lsquic_bbr2_ack,
+    .cci_begin_ack     = lsquic_bbr2_begin_ack,
+    .cci_end_ack       = lsquic_bbr2_end_ack,
+    .cci_cleanup       = lsquic_bbr2_cleanup,
+    .cci_ecn           = lsquic_bbr2_ecn,
+    .cci_get_cwnd      = lsquic_bbr2_get_cwnd,
+    .cci_init          = lsquic_bbr2_init,
+    .cci_pacing_rate   = lsquic_bbr2_pacing_rate,
+    .cci_loss          = lsquic_bbr2_loss,
+    .cci_lost          = lsquic_bbr2_lost,
+    .cci_reinit        = lsquic_bbr2_reinit,
+    .cci_resume        = lsquic_bbr2_resume,
+    .cci_timeout       = lsquic_bbr2_timeout,
+    .cci_sent          = lsquic_bbr2_sent,
+    .cci_was_quiet     = lsquic_bbr2_was_quiet,
+};
@@ -0,0 +1,163 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+#ifndef LSQUIC_BBR2_H
+#define LSQUIC_BBR2_H
+
+/* BBRv2 congestion controller.
+ *
+ * Unlike BBRv1 (lsquic_bbr.c), BBRv2 reacts to loss and ECN: it keeps
+ * short-term lower bounds on bandwidth and inflight (bw_lo and inflight_lo)
+ * and a long-term upper bound on inflight (inflight_hi), which is probed
+ * for carefully instead of being overshot each gain cycle.
+ *
+ * The code follows the state machine and parameter values of BBRv3 as
+ * described in
+ *  https://datatracker.ietf.org/doc/draft-ietf-ccwg-bbr/
+ * In this file and in lsquic_bbr2.c, quoted comments are from the draft.
+ *
+ * The ECN response is modeled on the Linux TCP BBRv2 code: when the
+ * fraction of CE-marked packets in a round exceeds a threshold, inflight
+ * is treated as too high, same as with excessive loss.
+ *
+ * Like our BBRv1, ACK information is accumulated using cci_begin_ack(),
+ * cci_ack(), and cci_end_ack() and the model is updated once per ACK frame,
+ * using the sample of the most recently sent acknowledged packet.
+ */
+
+struct lsquic_bbr2
+{
+    const struct lsquic_conn_public  *bbr2_conn_pub;
+
+    enum bbr2_mode
+    {
+        BBR2_MODE_STARTUP,
+        BBR2_MODE_DRAIN,
+        BBR2_MODE_PROBE_BW_DOWN,
+        BBR2_MODE_PROBE_BW_CRUISE,
+        BBR2_MODE_PROBE_BW_REFILL,
+        BBR2_MODE_PROBE_BW_UP,
+        BBR2_MODE_PROBE_RTT,
+    }                           bbr2_mode;
+
+    enum
+    {
+        BBR2_ACKS_INIT,
+        BBR2_ACKS_REFILLING,
+        BBR2_ACKS_PROBE_STARTING,
+        BBR2_ACKS_PROBE_FEEDBACK,
+        BBR2_ACKS_PROBE_STOPPING,
+    }                           bbr2_ack_phase;
+
+    enum
+    {
+        BBR2_FLAG_IN_ACK            = 1 << 0,   /* cci_begin_ack() has been called */
+        BBR2_FLAG_ROUND_START       = 1 << 1,
+        BBR2_FLAG_LOSS_ROUND_START  = 1 << 2,
+        BBR2_FLAG_LOSS_IN_ROUND     = 1 << 3,
+        BBR2_FLAG_ECN_IN_ROUND      = 1 << 4,
+        BBR2_FLAG_FULL_BW_REACHED   = 1 << 5,
+        BBR2_FLAG_FULL_BW_NOW       = 1 << 6,
+        BBR2_FLAG_CWND_LIMITED      = 1 << 7,   /* Cwnd-limited this round */
+        BBR2_FLAG_IN_RECOVERY       = 1 << 8,
+        BBR2_FLAG_PACKET_CONSERVATION
+                                    = 1 << 9,
+        BBR2_FLAG_PROBE_RTT_EXPIRED = 1 << 10,
+        BBR2_FLAG_PROBE_RTT_ROUND_DONE
+                                    = 1 << 11,
+        BBR2_FLAG_IDLE_RESTART      = 1 << 12,
+        BBR2_FLAG_BW_PROBE_SAMPLES  = 1 << 13,
+    }                           bbr2_flags;
+
+    const struct lsquic_rtt_stats
+                               *bbr2_rtt_stats;
+
+    struct bw_sampler           bbr2_bw_sampler;
+
+    /*
+     " BBR.MaxBwFilter: The filter for tracking the maximum recent
+     " rs.delivery_rate sample, for estimating BBR.max_bw.
+     *
+     * The time axis of this filter is bbr2_cycle_count.
+     */
+    struct minmax               bbr2_max_bw_filter;
+    uint64_t                    bbr2_cycle_count;
+
+    /*
+     " BBR.ExtraACKedFilter: the max filter tracking the recent maximum
+     " degree of aggregation in the path.
+     *
+     * The time axis of this filter is bbr2_round_count.
+     */
+    struct minmax               bbr2_extra_acked_filter;
+    lsquic_time_t               bbr2_extra_acked_interval_start;
+    uint64_t                    bbr2_extra_acked_delivered;
+
+    /* Bandwidth values are in bytes per second */
+    uint64_t                    bbr2_max_bw;
+    uint64_t                    bbr2_bw;        /* min(max_bw, bw_lo) */
+    uint64_t                    bbr2_bw_lo;
+    uint64_t                    bbr2_bw_latest;
+    uint64_t                    bbr2_full_bw;
+    uint64_t                    bbr2_pacing_rate;
+
+    /* Inflight values are in bytes */
+    uint64_t                    bbr2_inflight_hi;
+    uint64_t                    bbr2_inflight_lo;
+    uint64_t                    bbr2_inflight_latest;
+    uint64_t                    bbr2_cwnd;
+    uint64_t                    bbr2_prior_cwnd;
+    uint64_t                    bbr2_init_cwnd;
+
+    uint64_t                    bbr2_round_count;
+    uint64_t                    bbr2_next_round_delivered;
+    uint64_t                    bbr2_loss_round_delivered;
+    uint64_t                    bbr2_rounds_since_bw_probe;
+    unsigned                    bbr2_full_bw_count;
+    unsigned                    bbr2_loss_events_in_round;
+    unsigned                    bbr2_bw_probe_up_rounds;
+    uint64_t                    bbr2_bw_probe_up_acks;
+    uint64_t                    bbr2_probe_up_cnt;
+
+    float                       bbr2_pacing_gain;
+    float                       bbr2_cwnd_gain;
+
+    lsquic_time_t               bbr2_min_rtt;
+    lsquic_time_t               bbr2_min_rtt_stamp;
+    lsquic_time_t               bbr2_probe_rtt_min_delay;
+    lsquic_time_t               bbr2_probe_rtt_min_stamp;
+    lsquic_time_t               bbr2_probe_rtt_done_stamp;
+    lsquic_time_t               bbr2_cycle_stamp;
+    lsquic_time_t               bbr2_bw_probe_wait;
+
+    lsquic_packno_t             bbr2_last_sent_packno;
+    lsquic_packno_t             bbr2_end_recovery_at;
+
+    /* ECN: CE-marked and ECN-capable packets acknowledged in this round
+     * and EWMA of CE ratio, scaled by BBR2_ECN_SCALE.
+     */
+    uint64_t                    bbr2_ecn_ce_in_round;
+    uint64_t                    bbr2_ecn_ect_in_round;
+    unsigned                    bbr2_ecn_alpha;
+    unsigned                    bbr2_startup_ecn_rounds;
+
+    /* Lost bytes are accumulated both during and between ACKs: losses
+     * may be detected when the retransmission alarm fires.
+     */
+    uint64_t                    bbr2_lost_bytes;
+
+    /* Accumulate information from a single ACK.  Gets processed when
+     * cci_end_ack() is called.
+     */
+    struct
+    {
+        lsquic_time_t       ack_time;
+        lsquic_packno_t     max_packno;
+        uint64_t            acked_bytes;
+        uint64_t            in_flight;
+        /* Sample from the most recently sent acknowledged packet */
+        struct bw_sample   *sample;
+    }                           bbr2_ack_state;
+};
+
+extern const struct cong_ctl_if lsquic_cong_bbr2_if;
+
+#endif
@@ -144,6 +144,7 @@ lsquic_bw_sampler_packet_sent (struct bw_sampler *sampler,
     state->bwps_sent_at_last_ack = sampler->bws_last_acked_total_sent;
     state->bwps_last_ack_sent_time = sampler->bws_last_acked_sent_time;
     state->bwps_last_ack_ack_time = sampler->bws_last_acked_packet_time;
+    state->bwps_tx_in_flight = in_flight + sent_sz;
     state->bwps_packet_size = sent_sz;
 
     packet_out->po_bwp_state = state;
@@ -167,6 +168,10 @@ lsquic_bw_sampler_packet_lost (struct bw_sampler *sampler,
 }
 
 
+/* Sample is placed into the memory occupied by the packet state */
+typedef char sample_fits_into_state[
+            sizeof(struct bw_sample) <= sizeof(struct bwp_state) ? 1 : -1];
+
 struct bw_sample *
 lsquic_bw_sampler_packet_acked (struct bw_sampler *sampler,
                 struct lsquic_packet_out *packet_out, lsquic_time_t ack_time)
@@ -175,6 +180,7 @@ lsquic_bw_sampler_packet_acked (struct bw_sampler *sampler,
     struct bw_sample *sample;
     struct bandwidth send_rate, ack_rate;
     lsquic_time_t rtt;
+    uint64_t prior_delivered, lost, tx_in_flight;
     unsigned short sent_sz;
     int is_app_limited;
 
@@ -237,6 +243,9 @@ lsquic_bw_sampler_packet_acked (struct bw_sampler *sampler,
     // especially on low bandwidth connections.
     rtt = ack_time - packet_out->po_sent;
     is_app_limited = state->bwps_send_state.is_app_limited;
+    prior_delivered = state->bwps_send_state.total_bytes_acked;
+    lost = sampler->bws_total_lost - state->bwps_send_state.total_bytes_lost;
+    tx_in_flight = state->bwps_tx_in_flight;
 
     /* After this point, we switch `sample' to point to `state' and don't
      * reference `state' anymore.
@@ -248,6 +257,9 @@ lsquic_bw_sampler_packet_acked (struct bw_sampler *sampler,
     else
         sample->bandwidth = ack_rate;
     sample->rtt = rtt;
+    sample->prior_delivered = prior_delivered;
+    sample->lost = lost;
+    sample->tx_in_flight = tx_in_flight;
     sample->is_app_limited = is_app_limited;
 
     LSQ_DEBUG("packet %"PRIu64" acked, bandwidth: %"PRIu64" bps",
@@ -58,6 +58,17 @@ struct bw_sample
     TAILQ_ENTRY(bw_sample)      next;
     struct bandwidth            bandwidth;
     lsquic_time_t               rtt;
+    /* The following three fields are used by BBRv2: */
+    uint64_t                    prior_delivered;    /* Total bytes acked when
+                                                     * packet was sent.
+                                                     */
+    uint64_t                    lost;               /* Bytes lost while packet
+                                                     * was in flight.
+                                                     */
+    uint64_t                    tx_in_flight;       /* Bytes in flight when
+                                                     * packet was sent,
+                                                     * including the packet.
+                                                     */
     int                         is_app_limited;
 };
 
@@ -105,6 +116,7 @@ struct bwp_state    /* BWP State stands for Bandwidth Packet State */
     uint64_t                    bwps_sent_at_last_ack;
     lsquic_time_t               bwps_last_ack_sent_time;
     lsquic_time_t               bwps_last_ack_ack_time;
+    uint64_t                    bwps_tx_in_flight;
     unsigned short              bwps_packet_size;
 };
 
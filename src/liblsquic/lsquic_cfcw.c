@@ -64,6 +64,27 @@ cfcw_maybe_increase_max_window (struct lsquic_cfcw *fc)
 }
 
 
+static void
+cfcw_shrink_max_window (struct lsquic_cfcw *fc)
+{
+    unsigned new_max_window;
+
+    new_max_window = fc->cf_max_recv_win / 2;
+    if (new_max_window < MIN_SHRUNK_FCW)
+        new_max_window = MIN_SHRUNK_FCW;
+
+    if (new_max_window < fc->cf_max_recv_win)
+    {
+        LSQ_DEBUG("low on memory: max window decrease %u -> %u",
+                                    fc->cf_max_recv_win, new_max_window);
+        EV_LOG_CONN_EVENT(LSQUIC_LOG_CONN_ID,
+            "max CFCW decrease %u -> %u", fc->cf_max_recv_win,
+                                                            new_max_window);
+        fc->cf_max_recv_win = new_max_window;
+    }
+}
+
+
 int
 lsquic_cfcw_fc_offsets_changed (struct lsquic_cfcw *fc)
 {
@@ -77,7 +98,9 @@ lsquic_cfcw_fc_offsets_changed (struct lsquic_cfcw *fc)
     fc->cf_last_updated = now;
 
     srtt = lsquic_rtt_stats_get_srtt(&fc->cf_conn_pub->rtt_stats);
-    if (since_last_update < srtt * 2)
+    if (fc->cf_conn_pub->enpub->enp_mem_level >= MEM_SHRINK_FC)
+        cfcw_shrink_max_window(fc);
+    else if (since_last_update < srtt * 2)
         cfcw_maybe_increase_max_window(fc);
 
     fc->cf_recv_off = fc->cf_read_off + fc->cf_max_recv_win;
@@ -0,0 +1,534 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_cid_hash.c -- Connection ID hash
+ *
+ * The table is split into groups of GROUP_WIDTH slots.  Each slot has a
+ * control byte: it is either EMPTY, DELETED, or contains seven bits of the
+ * hash value ("tag").  A lookup loads control bytes of a whole group and
+ * compares them with the tag in a few instructions (SSE2, NEON, or plain
+ * 64-bit arithmetic), after which only slots with matching tags need to
+ * be examined.  The CID is stored in the slot, so that a lookup touches
+ * one cache line of control bytes and, usually, one cache line of slots.
+ * Groups are probed in triangular sequence, which visits every group when
+ * the number of groups is a power of two.
+ *
+ * When the table becomes too full, a new table is allocated and becomes
+ * current.  Elements are moved from the old table MIGRATE_GROUPS groups
+ * at a time on each insertion.  Until the old table is empty, lookups
+ * check both tables.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN32
+#include <vc_compat.h>
+#endif
+#include <sys/queue.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CIDH_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CIDH_NEON 1
+#endif
+
+#include "lsquic.h"
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_hash.h"
+#include "lsquic_conn.h"
+#include "lsquic_cid_hash.h"
+#include "lsquic_xxhash.h"
+
+
+#if CIDH_SSE2
+#define GROUP_WIDTH 16
+/* One bit per slot */
+typedef unsigned match_t;
+#define MATCH_IDX(m) ctz(m)
+#else
+#define GROUP_WIDTH 8
+/* High bit of each byte */
+typedef uint64_t match_t;
+#define MATCH_IDX(m) (ctz(m) >> 3)
+#define LSBS 0x0101010101010101ULL
+#define MSBS 0x8080808080808080ULL
+#endif
+
+#define CTRL_EMPTY   0x80
+#define CTRL_DELETED 0xFE
+
+#define MIGRATE_GROUPS 2
+#define MIN_NBITS 2
+
+struct cidh_slot
+{
+    lsquic_cid_t            cs_cid;
+    struct lsquic_conn     *cs_conn;
+};
+
+struct cidh_table
+{
+    unsigned char          *ct_ctrl;
+    struct cidh_slot       *ct_slots;
+    unsigned                ct_nbits;       /* log2 of number of groups */
+    unsigned                ct_count;       /* Number of full slots */
+    unsigned                ct_growth_left; /* EMPTY slots we may still fill */
+};
+
+struct cid_hash
+{
+    /* Table 0 is the current table.  Table 1, if allocated, is being
+     * migrated into table 0.
+     */
+    struct cidh_table       ch_tables[2];
+    unsigned                ch_migrate_group;
+    unsigned                ch_iter_table;
+    unsigned                ch_iter_idx;
+};
+
+
+#define N_GROUPS(t) (1u << (t)->ct_nbits)
+#define N_SLOTS(t) (N_GROUPS(t) * GROUP_WIDTH)
+
+
+#if __GNUC__
+#   define ctz __builtin_ctzll
+#else
+static unsigned
+ctz (unsigned long long x)
+{
+    unsigned n = 0;
+    if (0 == (x & ((1ULL << 32) - 1))) { n += 32; x >>= 32; }
+    if (0 == (x & ((1ULL << 16) - 1))) { n += 16; x >>= 16; }
+    if (0 == (x & ((1ULL <<  8) - 1))) { n +=  8; x >>=  8; }
+    if (0 == (x & ((1ULL <<  4) - 1))) { n +=  4; x >>=  4; }
+    if (0 == (x & ((1ULL <<  2) - 1))) { n +=  2; x >>=  2; }
+    if (0 == (x & ((1ULL <<  1) - 1))) { n +=  1; x >>=  1; }
+    return n;
+}
+#endif
+
+
+#if CIDH_SSE2
+
+static match_t
+match_tag (const unsigned char *ctrl, unsigned char tag)
+{
+    const __m128i group = _mm_loadu_si128((const __m128i *) ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(tag)));
+}
+
+
+static match_t
+match_empty (const unsigned char *ctrl)
+{
+    return match_tag(ctrl, CTRL_EMPTY);
+}
+
+
+/* Both EMPTY and DELETED have high bit set */
+static match_t
+match_free (const unsigned char *ctrl)
+{
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) ctrl));
+}
+
+#else
+
+static uint64_t
+load_group (const unsigned char *ctrl)
+{
+    uint64_t group;
+    memcpy(&group, ctrl, sizeof(group));
+    return group;
+}
+
+
+static match_t
+match_tag (const unsigned char *ctrl, unsigned char tag)
+{
+#if CIDH_NEON
+    uint8x8_t eq;
+    eq = vceq_u8(vld1_u8(ctrl), vdup_n_u8(tag));
+    return vget_lane_u64(vreinterpret_u64_u8(eq), 0) & MSBS;
+#else
+    /* May return false positives, which are weeded out by comparing
+     * CIDs.
+     */
+    const uint64_t x = load_group(ctrl) ^ (LSBS * tag);
+    return (x - LSBS) & ~x & MSBS;
+#endif
+}
+
+
+/* EMPTY is the only control byte with high bit set and bit 1 clear */
+static match_t
+match_empty (const unsigned char *ctrl)
+{
+    const uint64_t group = load_group(ctrl);
+    return group & ~(group << 6) & MSBS;
+}
+
+
+static match_t
+match_free (const unsigned char *ctrl)
+{
+    return load_group(ctrl) & MSBS;
+}
+
+#endif
+
+
+static uint64_t
+hash_cid (const struct cid_hash *hash, const lsquic_cid_t *cid)
+{
+    return XXH64(cid->idbuf, cid->len, (uintptr_t) hash);
+}
+
+
+#define HASH_TAG(h) ((unsigned char) ((h) & 0x7F))
+#define HASH_GROUP(t, h) (((h) >> 7) & (N_GROUPS(t) - 1))
+
+
+static int
+table_init (struct cidh_table *table, unsigned nbits)
+{
+    table->ct_nbits = nbits;
+    table->ct_ctrl = malloc(N_SLOTS(table));
+    if (!table->ct_ctrl)
+        return -1;
+    table->ct_slots = malloc(N_SLOTS(table) * sizeof(table->ct_slots[0]));
+    if (!table->ct_slots)
+    {
+        free(table->ct_ctrl);
+        table->ct_ctrl = NULL;
+        return -1;
+    }
+    memset(table->ct_ctrl, CTRL_EMPTY, N_SLOTS(table));
+    table->ct_count = 0;
+    /* Maximum load factor is 7/8 */
+    table->ct_growth_left = N_SLOTS(table) - N_SLOTS(table) / 8;
+    return 0;
+}
+
+
+static void
+table_cleanup (struct cidh_table *table)
+{
+    free(table->ct_ctrl);
+    free(table->ct_slots);
+    table->ct_ctrl = NULL;
+    table->ct_slots = NULL;
+}
+
+
+static struct cidh_slot *
+table_find (const struct cidh_table *table, const lsquic_cid_t *cid,
+                            const struct lsquic_conn *conn, uint64_t hash_val)
+{
+    const unsigned char tag = HASH_TAG(hash_val);
+    const unsigned char *ctrl;
+    struct cidh_slot *slot;
+    unsigned group, step;
+    match_t match;
+
+    group = HASH_GROUP(table, hash_val);
+    step = 0;
+    while (1)
+    {
+        ctrl = &table->ct_ctrl[group * GROUP_WIDTH];
+        for (match = match_tag(ctrl, tag); match; match &= match - 1)
+        {
+            slot = &table->ct_slots[group * GROUP_WIDTH + MATCH_IDX(match)];
+            if (LSQUIC_CIDS_EQ(&slot->cs_cid, cid)
+                                        && (!conn || conn == slot->cs_conn))
+                return slot;
+        }
+        if (match_empty(ctrl))
+            return NULL;
+        group = (group + ++step) & (N_GROUPS(table) - 1);
+        /* Table is never full: */
+        assert(step < N_GROUPS(table));
+    }
+}
+
+
+static void
+table_insert (struct cidh_table *table, const lsquic_cid_t *cid,
+                                struct lsquic_conn *conn, uint64_t hash_val)
+{
+    unsigned char *ctrl;
+    unsigned group, step, idx;
+    match_t match;
+
+    group = HASH_GROUP(table, hash_val);
+    step = 0;
+    while (1)
+    {
+        ctrl = &table->ct_ctrl[group * GROUP_WIDTH];
+        match = match_free(ctrl);
+        if (match)
+            break;
+        group = (group + ++step) & (N_GROUPS(table) - 1);
+        assert(step < N_GROUPS(table));
+    }
+
+    idx = group * GROUP_WIDTH + MATCH_IDX(match);
+    if (table->ct_ctrl[idx] == CTRL_EMPTY)
+    {
+        assert(table->ct_growth_left > 0);
+        --table->ct_growth_left;
+    }
+    table->ct_ctrl[idx] = HASH_TAG(hash_val);
+    table->ct_slots[idx].cs_cid = *cid;
+    table->ct_slots[idx].cs_conn = conn;
+    ++table->ct_count;
+}
+
+
+static void
+table_erase (struct cidh_table *table, struct cidh_slot *slot)
+{
+    unsigned idx, group;
+
+    idx = slot - table->ct_slots;
+    group = idx / GROUP_WIDTH;
+    /* If the group has an empty slot, it has never been full and no probe
+     * sequence has gone past it: the slot can be marked EMPTY.
+     */
+    if (match_empty(&table->ct_ctrl[group * GROUP_WIDTH]))
+    {
+        table->ct_ctrl[idx] = CTRL_EMPTY;
+        ++table->ct_growth_left;
+    }
+    else
+        table->ct_ctrl[idx] = CTRL_DELETED;
+    --table->ct_count;
+}
+
+
+static void
+migrate_group (struct cid_hash *hash)
+{
+    struct cidh_table *const new = &hash->ch_tables[0],
+                      *const old = &hash->ch_tables[1];
+    struct cidh_slot *slot;
+    unsigned idx, end;
+
+    idx = hash->ch_migrate_group * GROUP_WIDTH;
+    for (end = idx + GROUP_WIDTH; idx < end; ++idx)
+        if (!(old->ct_ctrl[idx] & 0x80))
+        {
+            slot = &old->ct_slots[idx];
+            table_insert(new, &slot->cs_cid, slot->cs_conn,
+                                            hash_cid(hash, &slot->cs_cid));
+            old->ct_ctrl[idx] = CTRL_DELETED;
+            --old->ct_count;
+        }
+
+    if (++hash->ch_migrate_group == N_GROUPS(old) || old->ct_count == 0)
+        table_cleanup(old);
+}
+
+
+#define MIGRATING(hash) ((hash)->ch_tables[1].ct_ctrl != NULL)
+
+
+static void
+migrate (struct cid_hash *hash, unsigned n_groups)
+{
+    while (n_groups-- > 0 && MIGRATING(hash))
+        migrate_group(hash);
+}
+
+
+/* Replace current table with a new one.  Its size depends on how many
+ * elements there are: if there are many deleted slots, size may stay the
+ * same.
+ */
+static int
+start_migration (struct cid_hash *hash)
+{
+    struct cidh_table *const cur = &hash->ch_tables[0];
+    struct cidh_table new;
+    unsigned nbits;
+
+    /* Previous migration must be finished first */
+    migrate(hash, ~0u);
+
+    nbits = cur->ct_nbits;
+    if (cur->ct_count >= N_SLOTS(cur) / 2)
+        ++nbits;
+    if (0 != table_init(&new, nbits))
+        return -1;
+
+    hash->ch_tables[1] = *cur;
+    hash->ch_tables[0] = new;
+    hash->ch_migrate_group = 0;
+    return 0;
+}
+
+
+struct cid_hash *
+lsquic_cidh_create (void)
+{
+    struct cid_hash *hash;
+
+    hash = calloc(1, sizeof(*hash));
+    if (!hash)
+        return NULL;
+
+    if (0 != table_init(&hash->ch_tables[0], MIN_NBITS))
+    {
+        free(hash);
+        return NULL;
+    }
+
+    return hash;
+}
+
+
+void
+lsquic_cidh_destroy (struct cid_hash *hash)
+{
+    table_cleanup(&hash->ch_tables[0]);
+    table_cleanup(&hash->ch_tables[1]);
+    free(hash);
+}
+
+
+void
+lsquic_cidh_port2key (unsigned short port, lsquic_cid_t *key)
+{
+    memcpy(key->idbuf, &port, sizeof(port));
+    key->len = sizeof(port);
+}
+
+
+static const lsquic_cid_t *
+cce2key (const struct conn_cid_elem *cce, lsquic_cid_t *buf)
+{
+    if (cce->cce_flags & CCE_PORT)
+    {
+        lsquic_cidh_port2key(cce->cce_port, buf);
+        return buf;
+    }
+    else
+        return &cce->cce_cid;
+}
+
+
+int
+lsquic_cidh_insert (struct cid_hash *hash, struct lsquic_conn *conn,
+                                                struct conn_cid_elem *cce)
+{
+    const lsquic_cid_t *key;
+    lsquic_cid_t buf;
+
+    assert(!cce->cce_hashed);
+
+    if (hash->ch_tables[0].ct_growth_left == 0
+                                        && 0 != start_migration(hash))
+        return -1;
+
+    key = cce2key(cce, &buf);
+    table_insert(&hash->ch_tables[0], key, conn, hash_cid(hash, key));
+    cce->cce_hashed = 1;
+    migrate(hash, MIGRATE_GROUPS);
+    return 0;
+}
+
+
+struct lsquic_conn *
+lsquic_cidh_find (struct cid_hash *hash, const lsquic_cid_t *cid)
+{
+    const uint64_t hash_val = hash_cid(hash, cid);
+    const struct cidh_slot *slot;
+
+    slot = table_find(&hash->ch_tables[0], cid, NULL, hash_val);
+    if (!slot && MIGRATING(hash))
+        slot = table_find(&hash->ch_tables[1], cid, NULL, hash_val);
+
+    return slot ? slot->cs_conn : NULL;
+}
+
+
+void
+lsquic_cidh_erase (struct cid_hash *hash, struct lsquic_conn *conn,
+                                                struct conn_cid_elem *cce)
+{
+    const lsquic_cid_t *key;
+    struct cidh_slot *slot;
+    uint64_t hash_val;
+    lsquic_cid_t buf;
+
+    assert(cce->cce_hashed);
+    key = cce2key(cce, &buf);
+    hash_val = hash_cid(hash, key);
+    slot = table_find(&hash->ch_tables[0], key, conn, hash_val);
+    if (slot)
+        table_erase(&hash->ch_tables[0], slot);
+    else
+    {
+        assert(MIGRATING(hash));
+        slot = table_find(&hash->ch_tables[1], key, conn, hash_val);
+        assert(slot);
+        table_erase(&hash->ch_tables[1], slot);
+    }
+    cce->cce_hashed = 0;
+}
+
+
+struct lsquic_conn *
+lsquic_cidh_next (struct cid_hash *hash)
+{
+    const struct cidh_table *table;
+
+    for ( ; hash->ch_iter_table < 2; ++hash->ch_iter_table,
+                                                    hash->ch_iter_idx = 0)
+    {
+        table = &hash->ch_tables[hash->ch_iter_table];
+        if (!table->ct_ctrl)
+            continue;
+        for ( ; hash->ch_iter_idx < N_SLOTS(table); ++hash->ch_iter_idx)
+            if (!(table->ct_ctrl[hash->ch_iter_idx] & 0x80))
+                return table->ct_slots[hash->ch_iter_idx++].cs_conn;
+    }
+
+    return NULL;
+}
+
+
+struct lsquic_conn *
+lsquic_cidh_first (struct cid_hash *hash)
+{
+    hash->ch_iter_table = 0;
+    hash->ch_iter_idx = 0;
+    return lsquic_cidh_next(hash);
+}
+
+
+unsigned
+lsquic_cidh_count (const struct cid_hash *hash)
+{
+    return hash->ch_tables[0].ct_count + hash->ch_tables[1].ct_count;
+}
+
+
+size_t
+lsquic_cidh_mem_used (const struct cid_hash *hash)
+{
+    const struct cidh_table *table;
+    size_t size;
+
+    size = sizeof(*hash);
+    for (table = hash->ch_tables; table < hash->ch_tables + 2; ++table)
+        if (table->ct_ctrl)
+            size += N_SLOTS(table) * (1 + sizeof(table->ct_slots[0]));
+
+    return size;
+}
@@ -0,0 +1,57 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_cid_hash.h -- Connection ID hash
+ *
+ * The engine looks up connections by CID for every incoming packet.  This
+ * is an open-addressing hash specialized for this: CIDs are stored in the
+ * table itself and a group of control bytes is matched at once.  When the
+ * table grows, elements are moved to the new table a few at a time.
+ *
+ * Connection CID elements with CCE_PORT flag set are keyed by the port
+ * number: see lsquic_cidh_port2key().
+ */
+
+#ifndef LSQUIC_CID_HASH_H
+#define LSQUIC_CID_HASH_H 1
+
+struct cid_hash;
+struct conn_cid_elem;
+struct lsquic_conn;
+
+struct cid_hash *
+lsquic_cidh_create (void);
+
+void
+lsquic_cidh_destroy (struct cid_hash *);
+
+/* Return 0 on success, -1 on failure (malloc) */
+int
+lsquic_cidh_insert (struct cid_hash *, struct lsquic_conn *,
+                                                    struct conn_cid_elem *);
+
+struct lsquic_conn *
+lsquic_cidh_find (struct cid_hash *, const lsquic_cid_t *);
+
+void
+lsquic_cidh_erase (struct cid_hash *, struct lsquic_conn *,
+                                                    struct conn_cid_elem *);
+
+/* Connection with N CIDs in the hash is returned N times.  Elements may be
+ * erased while iterating, but not inserted.
+ */
+struct lsquic_conn *
+lsquic_cidh_first (struct cid_hash *);
+
+struct lsquic_conn *
+lsquic_cidh_next (struct cid_hash *);
+
+unsigned
+lsquic_cidh_count (const struct cid_hash *);
+
+size_t
+lsquic_cidh_mem_used (const struct cid_hash *);
+
+void
+lsquic_cidh_port2key (unsigned short port, lsquic_cid_t *);
+
+#endif
@@ -0,0 +1,325 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_cid_route.c -- Routable connection IDs
+ *
+ * CID layout:
+ *
+ *  [ first octet | server ID ] [ 8-byte block ] [ random ]
+ *
+ * The first octet and the server ID are only present if the server ID
+ * is configured.  The first octet carries the config rotation codepoint
+ * in its top three bits, as in QUIC-LB, which lets a load balancer find
+ * the server ID in a fixed place.
+ *
+ * The block is a 32-bit slot index, 16-bit slot generation, and a 16-bit
+ * random nonce permuted using a four-round Feistel network keyed with a
+ * random secret.  The network is not meant to be cryptographically strong:
+ * its purpose is to keep observers from correlating CIDs and to make
+ * forged CIDs unlikely to decode into a live slot.  Whatever decodes is
+ * verified against the connection's CIDs anyway.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN32
+#include <vc_compat.h>
+#endif
+#include <sys/queue.h>
+
+#include <openssl/rand.h>
+
+#include "lsquic.h"
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_hash.h"
+#include "lsquic_conn.h"
+#include "lsquic_cid_route.h"
+
+
+#define BLOCK_SZ 8
+#define N_ROUNDS 4
+#define INIT_SLOTS 64
+#define MAX_SLOTS (1u << 24)
+#define GEN_MASK 0xFFFFu
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+
+struct route_slot
+{
+    struct lsquic_conn         *rs_conn;        /* NULL if slot is free */
+    unsigned                    rs_gen;         /* Incremented on release */
+    unsigned                    rs_next_free;   /* Index + 1 */
+};
+
+
+struct cid_route
+{
+    struct route_slot          *cr_slots;
+    unsigned                    cr_n_alloc,
+                                cr_n_used,      /* Slots ever handed out */
+                                cr_free;        /* Free list: index + 1 */
+    unsigned                    cr_block_off;   /* Offset of the block */
+    uint64_t                    cr_keys[N_ROUNDS];
+    unsigned char               cr_prefix[1 + sizeof(
+                                    ((struct lsquic_route_ctx *) 0)->rc_server_id)];
+};
+
+
+static uint32_t
+round_func (uint32_t x, uint64_t key)
+{
+    uint64_t h;
+
+    h = x ^ key;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return (uint32_t) h;
+}
+
+
+static uint64_t
+encrypt_block (const struct cid_route *route, uint64_t block)
+{
+    uint32_t left, right, tmp;
+    unsigned i;
+
+    left = block >> 32;
+    right = (uint32_t) block;
+    for (i = 0; i < N_ROUNDS; ++i)
+    {
+        tmp = left ^ round_func(right, route->cr_keys[i]);
+        left = right;
+        right = tmp;
+    }
+    return (uint64_t) left << 32 | right;
+}
+
+
+static uint64_t
+decrypt_block (const struct cid_route *route, uint64_t block)
+{
+    uint32_t left, right, tmp;
+    unsigned i;
+
+    left = block >> 32;
+    right = (uint32_t) block;
+    for (i = N_ROUNDS; i > 0; --i)
+    {
+        tmp = right ^ round_func(left, route->cr_keys[i - 1]);
+        right = left;
+        left = tmp;
+    }
+    return (uint64_t) left << 32 | right;
+}
+
+
+struct cid_route *
+lsquic_cidr_new (const struct lsquic_route_ctx *ctx)
+{
+    struct cid_route *route;
+
+    if (ctx && (ctx->rc_server_id_len > sizeof(ctx->rc_server_id)
+                                                    || ctx->rc_config_id > 6))
+        return NULL;
+
+    route = calloc(1, sizeof(*route));
+    if (!route)
+        return NULL;
+
+    RAND_bytes((unsigned char *) route->cr_keys, sizeof(route->cr_keys));
+    if (ctx && ctx->rc_server_id_len)
+    {
+        route->cr_prefix[0] = ctx->rc_config_id << 5;
+        memcpy(route->cr_prefix + 1, ctx->rc_server_id,
+                                                    ctx->rc_server_id_len);
+        route->cr_block_off = 1 + ctx->rc_server_id_len;
+    }
+    return route;
+}
+
+
+void
+lsquic_cidr_destroy (struct cid_route *route)
+{
+    free(route->cr_slots);
+    free(route);
+}
+
+
+/* Returns slot index + 1 or 0 on failure */
+static unsigned
+alloc_slot (struct cid_route *route, struct lsquic_conn *conn)
+{
+    struct route_slot *slots;
+    unsigned idx, n_alloc;
+
+    if (route->cr_free)
+    {
+        idx = route->cr_free - 1;
+        route->cr_free = route->cr_slots[idx].rs_next_free;
+    }
+    else
+    {
+        if (route->cr_n_used >= route->cr_n_alloc)
+        {
+            if (route->cr_n_alloc >= MAX_SLOTS)
+                return 0;
+            n_alloc = route->cr_n_alloc ? route->cr_n_alloc * 2 : INIT_SLOTS;
+            slots = realloc(route->cr_slots, n_alloc * sizeof(slots[0]));
+            if (!slots)
+                return 0;
+            memset(slots + route->cr_n_alloc, 0,
+                        (n_alloc - route->cr_n_alloc) * sizeof(slots[0]));
+            route->cr_slots = slots;
+            route->cr_n_alloc = n_alloc;
+        }
+        idx = route->cr_n_used++;
+    }
+
+    route->cr_slots[idx].rs_conn = conn;
+    return idx + 1;
+}
+
+
+void
+lsquic_cidr_generate (void *ctx, struct lsquic_conn *conn,
+                                            lsquic_cid_t *scid, unsigned len)
+{
+    struct cid_route *const route = ctx;
+    const struct route_slot *slot;
+    uint64_t block;
+
+    lsquic_generate_scid(NULL, conn, scid, len);
+    if (scid->len == 0)
+        return;
+
+    if (route->cr_block_off)
+    {
+        memcpy(scid->idbuf + 1, route->cr_prefix + 1,
+                MIN(route->cr_block_off, scid->len) - 1);
+        scid->idbuf[0] = route->cr_prefix[0] | (scid->idbuf[0] & 0x1F);
+    }
+
+    /* CIDs that are too short are left unroutable: they are found using
+     * the CID hash.  So is the Retry SCID, which has no connection.
+     */
+    if (scid->len < route->cr_block_off + BLOCK_SZ || !conn)
+        return;
+
+    if (!conn->cn_route_slot)
+        conn->cn_route_slot = alloc_slot(route, conn);
+    if (!conn->cn_route_slot)
+        return;
+
+    slot = &route->cr_slots[conn->cn_route_slot - 1];
+    memcpy(&block, scid->idbuf + route->cr_block_off, sizeof(block));
+    block = (uint64_t) (conn->cn_route_slot - 1) << 32
+          | (uint64_t) (slot->rs_gen & GEN_MASK) << 16
+          | (block & 0xFFFF);
+    block = encrypt_block(route, block);
+    memcpy(scid->idbuf + route->cr_block_off, &block, sizeof(block));
+}
+
+
+struct lsquic_conn *
+lsquic_cidr_find (const struct cid_route *route, const lsquic_cid_t *cid)
+{
+    const struct route_slot *slot;
+    struct lsquic_conn *conn;
+    const struct conn_cid_elem *cce;
+    uint64_t block;
+    unsigned idx;
+
+    if (cid->len < route->cr_block_off + BLOCK_SZ)
+        return NULL;
+
+    if (route->cr_block_off && (cid->idbuf[0] & 0xE0) != route->cr_prefix[0])
+        return NULL;
+
+    memcpy(&block, cid->idbuf + route->cr_block_off, sizeof(block));
+    block = decrypt_block(route, block);
+    idx = block >> 32;
+    if (idx >= route->cr_n_used)
+        return NULL;
+    slot = &route->cr_slots[idx];
+    conn = slot->rs_conn;
+    if (!conn || (slot->rs_gen & GEN_MASK) != ((block >> 16) & GEN_MASK))
+        return NULL;
+
+    /* The CID must still be in use: retired CIDs are no longer hashed */
+    cce = &conn->cn_cces[conn->cn_cur_cce_idx];
+    if (cce->cce_hashed && LSQUIC_CIDS_EQ(&cce->cce_cid, cid))
+        return conn;
+    for (cce = conn->cn_cces; cce < END_OF_CCES(conn); ++cce)
+        if ((conn->cn_cces_mask & (1 << (cce - conn->cn_cces)))
+                && cce->cce_hashed && LSQUIC_CIDS_EQ(&cce->cce_cid, cid))
+            return conn;
+
+    return NULL;
+}
+
+
+void
+lsquic_cidr_move (struct cid_route *route, struct lsquic_conn *from,
+                                                    struct lsquic_conn *to)
+{
+    if (from->cn_route_slot)
+    {
+        assert(route->cr_slots[from->cn_route_slot - 1].rs_conn == from);
+        assert(!to->cn_route_slot);
+        route->cr_slots[from->cn_route_slot - 1].rs_conn = to;
+        to->cn_route_slot = from->cn_route_slot;
+        from->cn_route_slot = 0;
+    }
+}
+
+
+void
+lsquic_cidr_release (struct cid_route *route, struct lsquic_conn *conn)
+{
+    struct route_slot *slot;
+
+    if (conn->cn_route_slot)
+    {
+        slot = &route->cr_slots[conn->cn_route_slot - 1];
+        assert(slot->rs_conn == conn);
+        slot->rs_conn = NULL;
+        ++slot->rs_gen;
+        slot->rs_next_free = route->cr_free;
+        route->cr_free = conn->cn_route_slot;
+        conn->cn_route_slot = 0;
+    }
+}
+
+
+size_t
+lsquic_cidr_mem_used (const struct cid_route *route)
+{
+    return sizeof(*route) + route->cr_n_alloc * sizeof(route->cr_slots[0]);
+}
+
+
+void
+lsquic_route_generate_scid (void *ctx, struct lsquic_conn *conn,
+                                            lsquic_cid_t *scid, unsigned len)
+{
+    const struct lsquic_route_ctx *const route_ctx = ctx;
+
+    /* The engine replaces this function with lsquic_cidr_generate().  If
+     * it is called directly, the CID has the same prefix, but it cannot
+     * be routed.
+     */
+    lsquic_generate_scid(NULL, conn, scid, len);
+    if (scid->len && route_ctx && route_ctx->rc_server_id_len)
+    {
+        memcpy(scid->idbuf + 1, route_ctx->rc_server_id,
+                    MIN(route_ctx->rc_server_id_len, scid->len - 1u));
+        scid->idbuf[0] = route_ctx->rc_config_id << 5
+                                                | (scid->idbuf[0] & 0x1F);
+    }
+}
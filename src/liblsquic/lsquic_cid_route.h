@@ -0,0 +1,56 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_cid_route.h -- Routable connection IDs
+ *
+ * When the user sets ea_generate_scid to lsquic_route_generate_scid(),
+ * the engine generates CIDs that carry the index of a connection slot
+ * and the slot's generation.  The two are obfuscated together with a
+ * random nonce using a secret key, so that CIDs of the same connection
+ * cannot be linked.  A connection is then looked up by decoding the CID
+ * and indexing the slot array.  CIDs that do not decode to a live slot
+ * are looked up in the CID hash as usual.
+ */
+
+#ifndef LSQUIC_CID_ROUTE_H
+#define LSQUIC_CID_ROUTE_H 1
+
+struct cid_route;
+struct lsquic_conn;
+struct lsquic_route_ctx;
+
+struct cid_route *
+lsquic_cidr_new (const struct lsquic_route_ctx *);
+
+void
+lsquic_cidr_destroy (struct cid_route *);
+
+/* Signature matches that of ea_generate_scid, the first argument is
+ * struct cid_route.  A slot is allocated for the connection the first
+ * time it is seen.
+ */
+void
+lsquic_cidr_generate (void *cid_route, struct lsquic_conn *,
+                                                lsquic_cid_t *, unsigned len);
+
+/* Return connection that has `cid' in the CID hash or NULL if the CID
+ * does not decode to a live slot.  NULL does not mean that the CID is
+ * unknown: it still needs to be looked up in the CID hash.
+ */
+struct lsquic_conn *
+lsquic_cidr_find (const struct cid_route *, const lsquic_cid_t *cid);
+
+/* Hand the slot over to a new connection object when a mini connection
+ * is promoted: CIDs generated for the former remain valid.
+ */
+void
+lsquic_cidr_move (struct cid_route *, struct lsquic_conn *from,
+                                                    struct lsquic_conn *to);
+
+/* Free connection's slot.  Called when the connection is destroyed. */
+void
+lsquic_cidr_release (struct cid_route *, struct lsquic_conn *);
+
+size_t
+lsquic_cidr_mem_used (const struct cid_route *);
+
+#endif
@@ -52,6 +52,31 @@ struct cong_ctl_if
     (*cci_lost) (void *cong_ctl, struct lsquic_packet_out *,
                                                         unsigned packet_sz);
 
+    /* Optional method.  Called between cci_begin_ack() and cci_end_ack()
+     * when the ACK frame carries ECN counts.  `n_ce' is the number of
+     * packets newly reported as CE-marked; `n_ect' is the number of
+     * packets whose ECN codepoint is newly reported, CE included.
+     */
+    void
+    (*cci_ecn) (void *cong_ctl, uint64_t n_ce, uint64_t n_ect);
+
+    /* Optional method.  Called when the path remarks ECT(1) packets sent
+     * for L4S.  From then on, packets are marked ECT(0) and CE marks are
+     * also reported via cci_loss().
+     */
+    void
+    (*cci_l4s_fallback) (void *cong_ctl);
+
+    /* Optional method.  Careful resume: set the congestion window using
+     * path state saved by an earlier connection.  If `bw' (bytes per
+     * second) is not zero, this is a jump: the window is raised to `cwnd'
+     * and slow start goes on.  If `bw' is zero, the jump caused loss: the
+     * window is reduced to `cwnd', slow start ends, and the bandwidth
+     * estimate from the jump is dropped.
+     */
+    void
+    (*cci_resume) (void *cong_ctl, uint64_t cwnd, uint64_t bw);
+
     void
     (*cci_timeout) (void *cong_ctl);
 
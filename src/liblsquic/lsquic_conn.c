@@ -249,6 +249,26 @@ lsquic_generate_scid (void *ctx, struct lsquic_conn *lconn, lsquic_cid_t *scid,
 }
 
 
+void
+lsquic_shard_generate_scid (void *ctx, struct lsquic_conn *lconn,
+                                            lsquic_cid_t *scid, unsigned len)
+{
+    const struct lsquic_shard_ctx *const shard = ctx;
+    unsigned n_choices;
+
+    lsquic_generate_scid(NULL, lconn, scid, len);
+    if (scid->len == 0)
+        return;
+
+    assert(shard->shc_count > 0 && shard->shc_count <= 256);
+    assert(shard->shc_id < shard->shc_count);
+    /* Pick a random first byte that maps to our shard */
+    n_choices = (255 - shard->shc_id) / shard->shc_count + 1;
+    scid->idbuf[0] = shard->shc_id
+                        + shard->shc_count * (scid->idbuf[0] % n_choices);
+}
+
+
 void
 lsquic_generate_cid_gquic (lsquic_cid_t *cid)
 {
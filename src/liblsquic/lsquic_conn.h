@@ -300,7 +300,6 @@ struct conn_iface
 
 struct conn_cid_elem
 {
-    struct lsquic_hash_elem     cce_hash_el;    /* Must be first element */
     lsquic_cid_t                cce_cid;
     union {
         unsigned            seqno;
@@ -318,6 +317,7 @@ struct conn_cid_elem
                                          * cce_port is the hash value.
                                          */
     }                           cce_flags;
+    unsigned char               cce_hashed;     /* In engine's CID hash */
 };
 
 struct lsquic_conn
@@ -351,6 +351,7 @@ struct lsquic_conn
     unsigned char                cn_cces_mask;  /* Those that are set */
     unsigned char                cn_n_cces; /* Number of CCEs in cn_cces */
     unsigned char                cn_cur_cce_idx;
+    unsigned                     cn_route_slot; /* See lsquic_cid_route.h */
 #if LSQUIC_TEST
     struct conn_cid_elem         cn_cces_buf[8];
 #define LSCONN_INITIALIZER_CID(lsconn_, cid_) { \
@@ -8,6 +8,11 @@
 
 struct lsquic_conn_public;
 
+/* When the engine is low on memory, flow control windows are shrunk, but
+ * not below this value.
+ */
+#define MIN_SHRUNK_FCW (16 * 1024)
+
 typedef struct lsquic_cfcw {
     struct lsquic_conn_public
                  *cf_conn_pub;
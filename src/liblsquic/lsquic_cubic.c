@@ -235,6 +235,27 @@ lsquic_cubic_timeout (void *cong_ctl)
 }
 
 
+static void
+lsquic_cubic_resume (void *cong_ctl, uint64_t cwnd, uint64_t bw)
+{
+    struct lsquic_cubic *const cubic = cong_ctl;
+
+    LSQ_DEBUG("%s(cubic, %"PRIu64", %"PRIu64")", __func__, cwnd, bw);
+    if (cwnd < 2 * TCP_MSS)
+        cwnd = 2 * TCP_MSS;
+    cubic->cu_epoch_start = 0;
+    cubic->cu_cwnd = cwnd;
+    cubic->cu_tcp_cwnd = cwnd;
+    if (!bw)
+    {
+        cubic->cu_last_max_cwnd = cwnd;
+        cubic->cu_ssthresh = cwnd;
+    }
+    LSQ_INFO("%s, cwnd: %lu", bw ? "resume" : "retreat", cubic->cu_cwnd);
+    LOG_CWND(cubic);
+}
+
+
 static void
 lsquic_cubic_cleanup (void *cong_ctl)
 {
@@ -289,6 +310,7 @@ const struct cong_ctl_if lsquic_cong_cubic_if =
     .cci_pacing_rate   = lsquic_cubic_pacing_rate,
     .cci_loss          = lsquic_cubic_loss,
     .cci_reinit        = lsquic_cubic_reinit,
+    .cci_resume        = lsquic_cubic_resume,
     .cci_timeout       = lsquic_cubic_timeout,
     .cci_was_quiet     = lsquic_cubic_was_quiet,
 };
@@ -10,6 +10,7 @@
 struct data_frame;
 struct data_in;
 struct lsquic_conn_public;
+struct lsquic_packet_in;
 struct stream_frame;
 
 
@@ -65,6 +66,13 @@ struct data_in_iface
     uint64_t
     (*di_readable_bytes) (struct data_in *, uint64_t read_offset);
 
+    /* Optional: return packet whose payload holds data of the data frame
+     * returned by di_get_frame().  If the implementation copies data into
+     * its own buffers, this function is not set.
+     */
+    struct lsquic_packet_in *
+    (*di_frame_packet) (struct data_in *, struct data_frame *);
+
     /* If set, this means that when di_insert_frame() returns INS_FRAME_OK,
      * the data_in handler has taken ownership of the frame.  Otherwise, it
      * is up to the caller to free it.
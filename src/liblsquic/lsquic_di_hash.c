@@ -34,6 +34,7 @@
 #include "lsquic_malo.h"
 #include "lsquic_conn.h"
 #include "lsquic_conn_public.h"
+#include "lsquic_engine_public.h"
 #include "lsquic_data_in_if.h"
 
 
@@ -164,6 +165,7 @@ hash_di_destroy (struct data_in *data_in)
         {
             TAILQ_REMOVE(&hdi->hdi_buckets[n], block, db_next);
             free(block);
+            hdi->hdi_conn_pub->enpub->enp_stream_mem -= sizeof(*block);
         }
     }
     free(hdi->hdi_buckets);
@@ -266,6 +268,7 @@ new_block (struct hash_data_in *hdi, uint64_t off)
         free(block);
         return NULL;
     }
+    hdi->hdi_conn_pub->enpub->enp_stream_mem += sizeof(*block);
 
     memset(block->db_set, 0, sizeof(block->db_set));
     return block;
@@ -588,6 +591,7 @@ hash_di_frame_done (struct data_in *data_in, struct data_frame *data_frame)
         {
             hash_remove(hdi, block);
             free(block);
+            hdi->hdi_conn_pub->enpub->enp_stream_mem -= sizeof(*block);
             if (0 == hdi->hdi_count && 0 == (hdi->hdi_flags & HDI_FIN))
             {
                 LSQ_DEBUG("hash empty, want to switch");
@@ -543,11 +543,20 @@ nocopy_di_readable_bytes (struct data_in *data_in, uint64_t read_offset)
 }
 
 
+static struct lsquic_packet_in *
+nocopy_di_frame_packet (struct data_in *data_in, struct data_frame *data_frame)
+{
+    struct stream_frame *const frame = STREAM_FRAME_PTR(data_frame);
+    return frame->packet_in;
+}
+
+
 static const struct data_in_iface di_if_nocopy = {
     .di_destroy      = nocopy_di_destroy,
     .di_dump_state   = nocopy_di_dump_state,
     .di_empty        = nocopy_di_empty,
     .di_frame_done   = nocopy_di_frame_done,
+    .di_frame_packet = nocopy_di_frame_packet,
     .di_get_frame    = nocopy_di_get_frame,
     .di_insert_frame = nocopy_di_insert_frame,
     .di_mem_used     = nocopy_di_mem_used,
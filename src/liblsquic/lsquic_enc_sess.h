@@ -130,6 +130,15 @@ struct enc_session_funcs_common
     void
     (*esf_set_conn) (enc_session_t *, struct lsquic_conn *);
 
+    /* Optional.  This function gets called with a run of packets destined
+     * for this connection before they are passed to the connection one by
+     * one.  Work common to all of them -- such as computing header
+     * protection masks -- can be done here in a single pass.
+     */
+    void
+    (*esf_prepare_decrypt) (enc_session_t *, struct lsquic_packet_in **,
+                                                                    unsigned);
+
     /* Optional.  This function gets called after packets are encrypted,
      * batched, and are about to be sent.
      */
@@ -218,7 +218,36 @@ cleanup_crypto_ctx (struct crypto_ctx *crypto_ctx)
 }
 
 
-#define HP_BATCH_SIZE 8
+/* 1-RTT packets are sealed and header-protected in batches.  Sealing is
+ * deferred until the batch is full or until the engine is about to send
+ * packets out; this way, all packets in the batch are sealed in a tight
+ * loop using the same AEAD context and the header protection masks for
+ * all of them are computed in a single call.
+ */
+#define ENC_BATCH_SIZE 8
+
+struct enc_batch_elem
+{
+    struct lsquic_packet_out   *ebe_packet;
+    const struct crypto_ctx    *ebe_crypto_ctx;
+    unsigned short              ebe_header_sz;
+    unsigned short              ebe_packno_off;
+    unsigned char               ebe_packno_len;
+    unsigned char               ebe_nonce[EVP_MAX_IV_LENGTH];
+};
+
+/* When the engine hands several packets to a connection at once, header
+ * protection masks for the 1-RTT packets among them are computed in a
+ * single pass before the packets are decrypted.  Packets that have a mask
+ * waiting for them here are marked with PI_HP_MASK.
+ */
+#define DEC_BATCH_SIZE 16
+
+struct dec_batch_elem
+{
+    const struct lsquic_packet_in  *dbe_packet;
+    unsigned char                   dbe_mask[5];
+};
 
 struct enc_sess_iquic
 {
@@ -291,12 +320,12 @@ struct enc_sess_iquic
     struct lsquic_alarmset
                         *esi_alset;
     unsigned             esi_max_streams_uni;
-    unsigned             esi_hp_batch_idx;
-    unsigned             esi_hp_batch_packno_len[HP_BATCH_SIZE];
-    unsigned             esi_hp_batch_packno_off[HP_BATCH_SIZE];
-    struct lsquic_packet_out *
-                         esi_hp_batch_packets[HP_BATCH_SIZE];
-    unsigned char        esi_hp_batch_samples[HP_BATCH_SIZE][SAMPLE_SZ];
+    unsigned             esi_enc_batch_idx;
+    struct enc_batch_elem
+                         esi_enc_batch[ENC_BATCH_SIZE];
+    unsigned             esi_dec_batch_count;
+    struct dec_batch_elem
+                         esi_dec_batch[DEC_BATCH_SIZE];
     unsigned char        esi_grease;
     signed char          esi_have_forw;
 };
@@ -388,43 +417,92 @@ apply_hp_immediately (struct enc_sess_iquic *enc_sess,
 
 
 static void
-flush_hp_batch (struct enc_sess_iquic *enc_sess)
+flush_enc_batch (struct enc_sess_iquic *enc_sess)
 {
-    unsigned i;
-    unsigned char mask[HP_BATCH_SIZE][SAMPLE_SZ];
-
-    enc_sess->esi_hp.hp_gen_mask(enc_sess, &enc_sess->esi_hp, 1,
-                        (unsigned char *) enc_sess->esi_hp_batch_samples,
-                        (unsigned char *) mask,
-                        enc_sess->esi_hp_batch_idx * SAMPLE_SZ);
-    for (i = 0; i < enc_sess->esi_hp_batch_idx; ++i)
-    {
-        apply_hp(enc_sess, &enc_sess->esi_hp,
-            enc_sess->esi_hp_batch_packets[i]->po_enc_data,
-            mask[i],
-            enc_sess->esi_hp_batch_packno_off[i],
-            enc_sess->esi_hp_batch_packno_len[i]);
+    struct lsquic_conn *const lconn = enc_sess->esi_conn;
+    struct header_prot *const hp = &enc_sess->esi_hp;
+    const struct enc_batch_elem *ebe;
+    struct lsquic_packet_out *packet_out;
+    size_t out_sz;
+    unsigned i, n_failed;
+    unsigned char sample[ENC_BATCH_SIZE][SAMPLE_SZ];
+    unsigned char mask[ENC_BATCH_SIZE][SAMPLE_SZ];
+    char errbuf[ERR_ERROR_STRING_BUF_LEN];
+
+    n_failed = 0;
+    for (i = 0; i < enc_sess->esi_enc_batch_idx; ++i)
+    {
+        ebe = &enc_sess->esi_enc_batch[i];
+        packet_out = ebe->ebe_packet;
+        if (!EVP_AEAD_CTX_seal(&ebe->ebe_crypto_ctx->yk_aead_ctx,
+                packet_out->po_enc_data + ebe->ebe_header_sz, &out_sz,
+                packet_out->po_enc_data_sz - ebe->ebe_header_sz,
+                ebe->ebe_nonce, ebe->ebe_crypto_ctx->yk_iv_sz,
+                packet_out->po_data, packet_out->po_data_sz,
+                packet_out->po_enc_data, ebe->ebe_header_sz))
+        {
+            /* Packet has already been handed to the engine: there is no
+             * going back.  Whatever is in the output buffer must not go
+             * out, so zero it: the peer will drop the packet as one it
+             * cannot decrypt.  The connection is aborted below.
+             */
+            LSQ_WARN("cannot seal packet #%"PRIu64": %s",
+                packet_out->po_packno,
+                ERR_error_string(ERR_get_error(), errbuf));
+            memset(packet_out->po_enc_data + ebe->ebe_header_sz, 0,
+                        packet_out->po_enc_data_sz - ebe->ebe_header_sz);
+            ++n_failed;
+        }
+        else
+            assert(out_sz == (size_t) (packet_out->po_enc_data_sz
+                                                    - ebe->ebe_header_sz));
+        memcpy(sample[i], packet_out->po_enc_data + ebe->ebe_packno_off + 4,
+                                                                SAMPLE_SZ);
+    }
+
+    if (hp->hp_gen_mask == gen_hp_mask_aes)
+        /* AES-ECB processes all samples in one call */
+        hp->hp_gen_mask(enc_sess, hp, 1, (unsigned char *) sample,
+                (unsigned char *) mask, enc_sess->esi_enc_batch_idx * SAMPLE_SZ);
+    else
+        for (i = 0; i < enc_sess->esi_enc_batch_idx; ++i)
+            hp->hp_gen_mask(enc_sess, hp, 1, sample[i], mask[i], SAMPLE_SZ);
+
+    for (i = 0; i < enc_sess->esi_enc_batch_idx; ++i)
+    {
+        ebe = &enc_sess->esi_enc_batch[i];
+        apply_hp(enc_sess, hp, ebe->ebe_packet->po_enc_data, mask[i],
+                                ebe->ebe_packno_off, ebe->ebe_packno_len);
 #ifndef NDEBUG
-            enc_sess->esi_hp_batch_packets[i]->po_lflags |= POL_HEADER_PROT;
+        ebe->ebe_packet->po_lflags |= POL_HEADER_PROT;
 #endif
     }
-    enc_sess->esi_hp_batch_idx = 0;
+    enc_sess->esi_enc_batch_idx = 0;
+
+    if (n_failed)
+        lconn->cn_if->ci_internal_error(lconn, "cannot seal %u packet%.*s",
+                                        n_failed, n_failed != 1, "s");
 }
 
 
 static void
-apply_hp_batch (struct enc_sess_iquic *enc_sess,
-        struct header_prot *hp, struct lsquic_packet_out *packet_out,
+add_to_enc_batch (struct enc_sess_iquic *enc_sess,
+        const struct crypto_ctx *crypto_ctx, const unsigned char *nonce,
+        struct lsquic_packet_out *packet_out, unsigned header_sz,
         unsigned packno_off, unsigned packno_len)
 {
-    memcpy(enc_sess->esi_hp_batch_samples[enc_sess->esi_hp_batch_idx],
-                        packet_out->po_enc_data + packno_off + 4, SAMPLE_SZ);
-    enc_sess->esi_hp_batch_packno_off[enc_sess->esi_hp_batch_idx] = packno_off;
-    enc_sess->esi_hp_batch_packno_len[enc_sess->esi_hp_batch_idx] = packno_len;
-    enc_sess->esi_hp_batch_packets[enc_sess->esi_hp_batch_idx] = packet_out;
-    ++enc_sess->esi_hp_batch_idx;
-    if (enc_sess->esi_hp_batch_idx == HP_BATCH_SIZE)
-        flush_hp_batch(enc_sess);
+    struct enc_batch_elem *const ebe
+                        = &enc_sess->esi_enc_batch[enc_sess->esi_enc_batch_idx];
+
+    ebe->ebe_packet     = packet_out;
+    ebe->ebe_crypto_ctx = crypto_ctx;
+    ebe->ebe_header_sz  = header_sz;
+    ebe->ebe_packno_off = packno_off;
+    ebe->ebe_packno_len = packno_len;
+    memcpy(ebe->ebe_nonce, nonce, crypto_ctx->yk_iv_sz);
+    ++enc_sess->esi_enc_batch_idx;
+    if (enc_sess->esi_enc_batch_idx == ENC_BATCH_SIZE)
+        flush_enc_batch(enc_sess);
 }
 
 
@@ -455,7 +533,7 @@ decode_packno (lsquic_packno_t max_packno, lsquic_packno_t packno,
 
 static lsquic_packno_t
 strip_hp (struct enc_sess_iquic *enc_sess,
-        struct header_prot *hp,
+        struct header_prot *hp, const unsigned char *batch_mask,
         const unsigned char *iv, unsigned char *dst, unsigned packno_off,
         unsigned *packno_len)
 {
@@ -465,7 +543,10 @@ strip_hp (struct enc_sess_iquic *enc_sess,
     unsigned char mask[SAMPLE_SZ];
     char mask_str[5 * 2 + 1];
 
-    hp->hp_gen_mask(enc_sess, hp, 0, iv, mask, SAMPLE_SZ);
+    if (batch_mask)
+        memcpy(mask, batch_mask, 5);
+    else
+        hp->hp_gen_mask(enc_sess, hp, 0, iv, mask, SAMPLE_SZ);
     LSQ_DEBUG("strip header protection using mask %s",
                                                 HEXSTR(mask, 5, mask_str));
     if (enc_sess->esi_flags & ESI_RECV_QL_BITS)
@@ -2250,15 +2331,19 @@ iquic_esf_encrypt_packet (enc_session_t *enc_session_p,
         LSQ_DEBUG("seal: in (%u bytes): %s", packet_out->po_data_sz,
             HEXSTR(packet_out->po_data, packet_out->po_data_sz, s_str));
     }
-    if (!EVP_AEAD_CTX_seal(&crypto_ctx->yk_aead_ctx, dst + header_sz, &out_sz,
-                dst_sz - header_sz, nonce, crypto_ctx->yk_iv_sz, packet_out->po_data,
-                packet_out->po_data_sz, dst, header_sz))
+    if (enc_level != ENC_LEV_APP)
     {
-        LSQ_WARN("cannot seal packet #%"PRIu64": %s", packet_out->po_packno,
-            ERR_error_string(ERR_get_error(), errbuf));
-        goto err;
+        if (!EVP_AEAD_CTX_seal(&crypto_ctx->yk_aead_ctx, dst + header_sz,
+                &out_sz, dst_sz - header_sz, nonce, crypto_ctx->yk_iv_sz,
+                packet_out->po_data, packet_out->po_data_sz, dst, header_sz))
+        {
+            LSQ_WARN("cannot seal packet #%"PRIu64": %s",
+                packet_out->po_packno,
+                ERR_error_string(ERR_get_error(), errbuf));
+            goto err;
+        }
+        assert(out_sz == dst_sz - header_sz);
     }
-    assert(out_sz == dst_sz - header_sz);
 
 #ifndef NDEBUG
     const unsigned sample_off = packno_off + 4;
@@ -2274,8 +2359,9 @@ iquic_esf_encrypt_packet (enc_session_t *enc_session_p,
     lsquic_packet_out_set_enc_level(packet_out, enc_level);
     lsquic_packet_out_set_kp(packet_out, enc_sess->esi_key_phase);
 
-    if (enc_level == ENC_LEV_APP && hp->hp_gen_mask != gen_hp_mask_chacha20)
-        apply_hp_batch(enc_sess, hp, packet_out, packno_off, packno_len);
+    if (enc_level == ENC_LEV_APP)
+        add_to_enc_batch(enc_sess, crypto_ctx, nonce, packet_out, header_sz,
+                                                    packno_off, packno_len);
     else
         apply_hp_immediately(enc_sess, hp, packet_out, packno_off, packno_len);
 
@@ -2293,12 +2379,78 @@ iquic_esf_flush_encryption (enc_session_t *enc_session_p)
 {
     struct enc_sess_iquic *const enc_sess = enc_session_p;
 
-    if (enc_sess->esi_hp_batch_idx)
+    if (enc_sess->esi_enc_batch_idx)
+    {
+        LSQ_DEBUG("flush encryption batch, count: %u",
+            enc_sess->esi_enc_batch_idx);
+        flush_enc_batch(enc_sess);
+    }
+}
+
+
+static void
+iquic_esf_prepare_decrypt (enc_session_t *enc_session_p,
+                        struct lsquic_packet_in **packets_in, unsigned count)
+{
+    struct enc_sess_iquic *const enc_sess = enc_session_p;
+    struct header_prot *const hp = &enc_sess->esi_hp;
+    struct lsquic_packet_in *packet_in;
+    unsigned i, n, sample_off;
+    unsigned char sample[DEC_BATCH_SIZE][SAMPLE_SZ];
+    unsigned char mask[DEC_BATCH_SIZE][SAMPLE_SZ];
+
+    n = 0;
+    if (!header_prot_inited(hp, 0))
+        goto end;
+
+    for (i = 0; i < count && n < DEC_BATCH_SIZE; ++i)
     {
-        LSQ_DEBUG("flush header protection application, count: %u",
-            enc_sess->esi_hp_batch_idx);
-        flush_hp_batch(enc_sess);
+        packet_in = packets_in[i];
+        if (hety2el[packet_in->pi_header_type] != ENC_LEV_APP)
+            continue;
+        sample_off = packet_in->pi_header_sz + 4;
+        if (sample_off + IQUIC_TAG_LEN > packet_in->pi_data_sz)
+            continue;   /* iquic_esf_decrypt_packet() will complain */
+        memcpy(sample[n], packet_in->pi_data + sample_off, SAMPLE_SZ);
+        enc_sess->esi_dec_batch[n].dbe_packet = packet_in;
+        packet_in->pi_flags |= PI_HP_MASK;
+        ++n;
     }
+
+    if (n == 0)
+        goto end;
+
+    if (hp->hp_gen_mask == gen_hp_mask_aes)
+        /* AES-ECB processes all samples in one call */
+        hp->hp_gen_mask(enc_sess, hp, 0, (unsigned char *) sample,
+                                    (unsigned char *) mask, n * SAMPLE_SZ);
+    else
+        for (i = 0; i < n; ++i)
+            hp->hp_gen_mask(enc_sess, hp, 0, sample[i], mask[i], SAMPLE_SZ);
+
+    for (i = 0; i < n; ++i)
+        memcpy(enc_sess->esi_dec_batch[i].dbe_mask, mask[i],
+                                sizeof(enc_sess->esi_dec_batch[i].dbe_mask));
+    LSQ_DEBUG("prepared header protection masks for %u of %u packets",
+                                                                    n, count);
+
+  end:
+    enc_sess->esi_dec_batch_count = n;
+}
+
+
+static const unsigned char *
+find_dec_batch_mask (struct enc_sess_iquic *enc_sess,
+                                        struct lsquic_packet_in *packet_in)
+{
+    unsigned i;
+
+    packet_in->pi_flags &= ~PI_HP_MASK;
+    for (i = 0; i < enc_sess->esi_dec_batch_count; ++i)
+        if (enc_sess->esi_dec_batch[i].dbe_packet == packet_in)
+            return enc_sess->esi_dec_batch[i].dbe_mask;
+
+    return NULL;
 }
 
 
@@ -2392,6 +2544,8 @@ iquic_esf_decrypt_packet (enc_session_t *enc_session_p,
     memcpy(dst, packet_in->pi_data, sample_off);
     packet_in->pi_packno =
     packno = strip_hp(enc_sess, hp,
+        packet_in->pi_flags & PI_HP_MASK
+                            ? find_dec_batch_mask(enc_sess, packet_in) : NULL,
         packet_in->pi_data + sample_off,
         dst, packet_in->pi_header_sz, &packno_len);
 
@@ -2872,6 +3026,7 @@ const struct enc_session_funcs_common lsquic_enc_session_common_ietf_v1 =
 {
     .esf_encrypt_packet  = iquic_esf_encrypt_packet,
     .esf_decrypt_packet  = iquic_esf_decrypt_packet,
+    .esf_prepare_decrypt = iquic_esf_prepare_decrypt,
     .esf_flush_encryption= iquic_esf_flush_encryption,
     .esf_global_cleanup  = iquic_esf_global_cleanup,
     .esf_global_init     = iquic_esf_global_init,
@@ -2892,6 +3047,7 @@ const struct enc_session_funcs_common lsquic_enc_session_common_ietf_v1_no_flush
 {
     .esf_encrypt_packet  = iquic_esf_encrypt_packet,
     .esf_decrypt_packet  = iquic_esf_decrypt_packet,
+    .esf_prepare_decrypt = iquic_esf_prepare_decrypt,
     .esf_global_cleanup  = iquic_esf_global_cleanup,
     .esf_global_init     = iquic_esf_global_init,
     .esf_tag_len         = IQUIC_TAG_LEN,
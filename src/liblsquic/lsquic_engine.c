@@ -59,6 +59,8 @@
 #include "lsquic_bw_sampler.h"
 #include "lsquic_minmax.h"
 #include "lsquic_bbr.h"
+#include "lsquic_bbr2.h"
+#include "lsquic_prague.h"
 #include "lsquic_adaptive_cc.h"
 #include "lsquic_set.h"
 #include "lsquic_conn_flow.h"
@@ -82,6 +84,9 @@
 #include "lsquic_purga.h"
 #include "lsquic_tokgen.h"
 #include "lsquic_attq.h"
+#include "lsquic_cid_hash.h"
+#include "lsquic_cid_route.h"
+#include "lsquic_gso.h"
 #include "lsquic_min_heap.h"
 #include "lsquic_http1x_if.h"
 #include "lsquic_handshake.h"
@@ -117,6 +122,16 @@ struct out_batch
     struct iovec             iov    [MAX_OUT_BATCH_SIZE * 2];
 };
 
+/* If es_gso is set, elements of out_batch.outs are combined into `outs'
+ * before being passed to ea_packets_out().  `idx' maps each element of
+ * `outs' to its first element in out_batch.outs.
+ */
+struct gso_batch
+{
+    struct lsquic_out_spec   outs   [MAX_OUT_BATCH_SIZE];
+    unsigned                 idx    [MAX_OUT_BATCH_SIZE];
+};
+
 typedef struct lsquic_conn * (*conn_iter_f)(struct lsquic_engine *);
 
 static void
@@ -213,6 +228,11 @@ static void
 cub_init (struct cid_update_batch *, lsquic_cids_update_f, void *);
 
 
+/* Maximum number of packets queued for a single connection while
+ * processing lsquic_engine_packets_in().
+ */
+#define PIN_BATCH_SIZE 16
+
 struct lsquic_engine
 {
     struct lsquic_engine_public        pub;
@@ -227,6 +247,8 @@ struct lsquic_engine
         ENG_CONNS_BY_ADDR
                         = (1 <<  9),    /* Connections are hashed by address */
         ENG_FORCE_RETRY = (1 << 10),    /* Will force retry packets to be sent */
+        ENG_BATCH_IN    = (1 << 11),    /* In lsquic_engine_packets_in() */
+        ENG_MEM_PRESSURE= (1 << 12),    /* Memory use is above threshold */
 #ifndef NDEBUG
         ENG_COALESCE    = (1 << 24),    /* Packet coalescing is enabled */
 #endif
@@ -243,13 +265,34 @@ struct lsquic_engine
     lsquic_cids_update_f               report_live_scids;
     lsquic_cids_update_f               report_old_scids;
     void                              *scids_ctx;
-    struct lsquic_hash                *conns_hash;
+    struct cid_hash                   *conns_hash;
     struct min_heap                    conns_tickable;
     struct min_heap                    conns_out;
     struct eng_hist                    history;
     unsigned                           batch_size;
     unsigned                           min_batch_size, max_batch_size;
     struct lsquic_conn                *curr_conn;
+    /* When a batch of packets is passed to the engine using
+     * lsquic_engine_packets_in(), the result of the last connection lookup
+     * by CID is saved here.  Consecutive packets destined for the same
+     * connection can then skip the hash lookup.
+     */
+    struct {
+        struct lsquic_conn            *conn;
+        lsquic_cid_t                   cid;
+    }                                  last_pin;
+    /* Consecutive packets for the same full IETF connection are queued
+     * here during lsquic_engine_packets_in() and are handed to the
+     * connection together.  This lets the encryption session prepare all
+     * of them for decryption at once.
+     */
+    struct {
+        struct lsquic_conn            *conn;
+        unsigned                       count;
+        struct lsquic_packet_in       *packets[PIN_BATCH_SIZE];
+        const unsigned char           *data[PIN_BATCH_SIZE];
+        unsigned short                 size[PIN_BATCH_SIZE];
+    }                                  pin_batch;
     struct pr_queue                   *pr_queue;
     struct attq                       *attq;
     /* Track time last time a packet was sent to give new connections
@@ -264,6 +307,8 @@ struct lsquic_engine
     lsquic_time_t                      deadline;
     lsquic_time_t                      resume_sending_at;
     lsquic_time_t                      mem_logged_last;
+    void                             (*mem_pressure)(void *, size_t, int);
+    void                              *mem_pressure_ctx;
     unsigned                           mini_conns_count;
     struct lsquic_purga               *purga;
 #if LSQUIC_CONN_STATS
@@ -275,6 +320,7 @@ struct lsquic_engine
 #endif
     struct cid_update_batch            new_scids;
     struct out_batch                   out_batch;
+    struct gso_batch                   gso_batch;
 #if LSQUIC_COUNT_ENGINE_CALLS
     unsigned long                      n_engine_calls;
 #endif
@@ -398,6 +444,12 @@ lsquic_engine_init_settings (struct lsquic_engine_settings *settings,
     settings->es_ptpc_err_divisor= LSQUIC_DF_PTPC_ERR_DIVISOR;
     settings->es_delay_onclose   = LSQUIC_DF_DELAY_ONCLOSE;
     settings->es_check_tp_sanity = LSQUIC_DF_CHECK_TP_SANITY;
+    settings->es_gso             = LSQUIC_DF_GSO;
+    settings->es_timer_wheel     = LSQUIC_DF_TIMER_WHEEL;
+    settings->es_mem_pressure_thresh = LSQUIC_DF_MEM_PRESSURE_THRESH;
+    settings->es_max_memory      = LSQUIC_DF_MAX_MEMORY;
+    settings->es_txtime          = LSQUIC_DF_TXTIME;
+    settings->es_path_cache_ttl  = LSQUIC_DF_PATH_CACHE_TTL;
 }
 
 
@@ -457,7 +509,7 @@ lsquic_engine_check_settings (const struct lsquic_engine_settings *settings,
         return -1;
     }
 
-    if (settings->es_cc_algo > 3)
+    if (settings->es_cc_algo > 5)
     {
         if (err_buf)
             snprintf(err_buf, err_buf_sz, "Invalid congestion control "
@@ -497,6 +549,15 @@ lsquic_engine_check_settings (const struct lsquic_engine_settings *settings,
         return -1;
     }
 
+    if (settings->es_txtime > 1000000)
+    {
+        if (err_buf)
+            snprintf(err_buf, err_buf_sz, "txtime horizon of %u usec is "
+                "greater than the allowed maximum of one second",
+                settings->es_txtime);
+        return -1;
+    }
+
     return 0;
 }
 
@@ -581,7 +642,8 @@ lsquic_engine_new (unsigned flags,
     engine = calloc(1, sizeof(*engine));
     if (!engine)
         return NULL;
-    if (0 != lsquic_mm_init(&engine->pub.enp_mm))
+    if (0 != lsquic_mm_init_pages(&engine->pub.enp_mm, api->ea_page_if,
+                                                        api->ea_page_if_ctx))
     {
         free(engine);
         return NULL;
@@ -620,10 +682,26 @@ lsquic_engine_new (unsigned flags,
     engine->pub.enp_cert_lu_ctx  = api->ea_cert_lu_ctx;
     engine->pub.enp_get_ssl_ctx  = api->ea_get_ssl_ctx;
 
-    if (api->ea_generate_scid)
+    if (api->ea_generate_scid == lsquic_route_generate_scid)
+    {
+        engine->pub.enp_cid_route = lsquic_cidr_new(api->ea_gen_scid_ctx);
+        if (!engine->pub.enp_cid_route)
+        {
+            LSQ_ERROR("cannot create CID route: bad server ID length?");
+            free(engine);
+            return NULL;
+        }
+        engine->pub.enp_generate_scid = lsquic_cidr_generate;
+        engine->pub.enp_gen_scid_ctx  = engine->pub.enp_cid_route;
+        engine->pub.enp_flags |= ENPUB_RETRY_SCID;
+    }
+    else if (api->ea_generate_scid)
     {
         engine->pub.enp_generate_scid = api->ea_generate_scid;
         engine->pub.enp_gen_scid_ctx  = api->ea_gen_scid_ctx;
+        /* Other callbacks may expect a connection */
+        if (api->ea_generate_scid == lsquic_shard_generate_scid)
+            engine->pub.enp_flags |= ENPUB_RETRY_SCID;
     }
     else
         engine->pub.enp_generate_scid = lsquic_generate_scid;
@@ -668,7 +746,7 @@ lsquic_engine_new (unsigned flags,
     engine->pub.enp_engine = engine;
     if (hash_conns_by_addr(engine))
         engine->flags |= ENG_CONNS_BY_ADDR;
-    engine->conns_hash = lsquic_hash_create();
+    engine->conns_hash = lsquic_cidh_create();
     engine->pub.enp_tokgen = lsquic_tg_new(&engine->pub);
     if (!engine->pub.enp_tokgen)
         return NULL;
@@ -715,7 +793,11 @@ lsquic_engine_new (unsigned flags,
             return NULL;
         }
     }
-    engine->attq = lsquic_attq_create();
+    if (engine->pub.enp_settings.es_timer_wheel)
+        engine->attq = lsquic_attq_create_wheel(
+                            engine->pub.enp_settings.es_clock_granularity);
+    else
+        engine->attq = lsquic_attq_create();
     eng_hist_init(&engine->history);
     if (engine->pub.enp_settings.es_max_batch_size)
     {
@@ -805,6 +887,8 @@ lsquic_engine_new (unsigned flags,
 #if LSQUIC_CONN_STATS
     engine->stats_fh = api->ea_stats_fh;
 #endif
+    engine->mem_pressure = api->ea_mem_pressure;
+    engine->mem_pressure_ctx = api->ea_mem_pressure_ctx;
     for (i = 0; i < sizeof(engine->retry_aead_ctx)
                                     / sizeof(engine->retry_aead_ctx[0]); ++i)
         if (1 != EVP_AEAD_CTX_init(&engine->retry_aead_ctx[i],
@@ -973,6 +1057,8 @@ destroy_conn (struct lsquic_engine *engine, struct lsquic_conn *conn,
         engine->busy.pin_conn = NULL;
 #endif
     --engine->n_conns;
+    if (engine->pub.enp_cid_route)
+        lsquic_cidr_release(engine->pub.enp_cid_route, conn);
     conn->cn_flags |= LSCONN_NEVER_TICKABLE;
     conn->cn_if->ci_destroy(conn);
 
@@ -1059,20 +1145,19 @@ maybe_grow_conn_heaps (struct lsquic_engine *engine)
 
 
 static void
-remove_cces_from_hash (struct lsquic_hash *hash, struct lsquic_conn *conn,
+remove_cces_from_hash (struct cid_hash *hash, struct lsquic_conn *conn,
                                                                 unsigned todo)
 {
     unsigned n;
 
     for (n = 0; todo; todo &= ~(1 << n++))
-        if ((todo & (1 << n)) &&
-                        (conn->cn_cces[n].cce_hash_el.qhe_flags & QHE_HASHED))
-            lsquic_hash_erase(hash, &conn->cn_cces[n].cce_hash_el);
+        if ((todo & (1 << n)) && conn->cn_cces[n].cce_hashed)
+            lsquic_cidh_erase(hash, conn, &conn->cn_cces[n]);
 }
 
 
 static void
-remove_all_cces_from_hash (struct lsquic_hash *hash, struct lsquic_conn *conn)
+remove_all_cces_from_hash (struct cid_hash *hash, struct lsquic_conn *conn)
 {
     remove_cces_from_hash(hash, conn, conn->cn_cces_mask);
 }
@@ -1093,9 +1178,7 @@ insert_conn_into_hash (struct lsquic_engine *engine, struct lsquic_conn *conn,
         if (todo & (1 << n))
         {
             cce = &conn->cn_cces[n];
-            assert(!(cce->cce_hash_el.qhe_flags & QHE_HASHED));
-            if (lsquic_hash_insert(engine->conns_hash, cce->cce_cid.idbuf,
-                                    cce->cce_cid.len, conn, &cce->cce_hash_el))
+            if (0 == lsquic_cidh_insert(engine->conns_hash, conn, cce))
                 done |= 1 << n;
             else
                 goto err;
@@ -1144,6 +1227,9 @@ new_full_conn_server (lsquic_engine_t *engine, lsquic_conn_t *mini_conn,
         return NULL;
     }
     ++engine->n_conns;
+    /* The full connection inherits mini connection's CIDs */
+    if (engine->pub.enp_cid_route)
+        lsquic_cidr_move(engine->pub.enp_cid_route, mini_conn, conn);
     if (0 != insert_conn_into_hash(engine, conn, lsquic_conn_get_peer_ctx(conn, NULL)))
     {
         cid = lsquic_conn_log_cid(conn);
@@ -1308,13 +1394,13 @@ sa2port (const struct sockaddr *sa)
 }
 
 
-static struct lsquic_hash_elem *
-find_conn_by_addr (struct lsquic_hash *hash, const struct sockaddr *sa)
+static struct lsquic_conn *
+find_conn_by_addr (struct cid_hash *hash, const struct sockaddr *sa)
 {
-    unsigned short port;
+    lsquic_cid_t key;
 
-    port = sa2port(sa);
-    return lsquic_hash_find(hash, &port, sizeof(port));
+    lsquic_cidh_port2key(sa2port(sa), &key);
+    return lsquic_cidh_find(hash, &key);
 }
 
 
@@ -1346,19 +1432,53 @@ dcid_checks_out (const struct lsquic_conn *conn, const lsquic_cid_t *dcid)
 }
 
 
+static struct lsquic_conn *
+find_conn_by_cid (struct lsquic_engine *engine, const lsquic_cid_t *cid)
+{
+    struct lsquic_conn *conn;
+
+    if ((engine->flags & ENG_BATCH_IN) && engine->last_pin.conn
+                            && LSQUIC_CIDS_EQ(&engine->last_pin.cid, cid))
+        return engine->last_pin.conn;
+
+    if (!(engine->pub.enp_cid_route
+                && (conn = lsquic_cidr_find(engine->pub.enp_cid_route, cid))))
+        conn = lsquic_cidh_find(engine->conns_hash, cid);
+    if (!conn)
+        return NULL;
+
+    if (engine->flags & ENG_BATCH_IN)
+    {
+        engine->last_pin.conn = conn;
+        engine->last_pin.cid = *cid;
+    }
+    return conn;
+}
+
+
+/* Invalidate cached connection lookup.  This must be done when CIDs are
+ * removed from the connections hash.
+ */
+static void
+forget_last_pin (struct lsquic_engine *engine)
+{
+    engine->last_pin.conn = NULL;
+}
+
+
 static lsquic_conn_t *
 find_conn (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
          struct packin_parse_state *ppstate, const struct sockaddr *sa_local)
 {
-    struct lsquic_hash_elem *el;
     lsquic_conn_t *conn;
 
     if (engine->flags & ENG_CONNS_BY_ADDR)
     {
-        el = find_conn_by_addr(engine->conns_hash, sa_local);
+        conn = find_conn_by_addr(engine->conns_hash, sa_local);
+        if (!conn)
+            return NULL;
         if ((packet_in->pi_flags & PI_CONN_ID)
-                && !dcid_checks_out(lsquic_hashelem_getdata(el),
-                                                    &packet_in->pi_conn_id))
+                && !dcid_checks_out(conn, &packet_in->pi_conn_id))
         {
             LSQ_DEBUGC("DCID matches no SCID in connection %"CID_FMT": drop it",
                 CID_BITS(&packet_in->pi_conn_id));
@@ -1366,18 +1486,17 @@ find_conn (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
         }
     }
     else if (packet_in->pi_flags & PI_CONN_ID)
-        el = lsquic_hash_find(engine->conns_hash,
-                    packet_in->pi_conn_id.idbuf, packet_in->pi_conn_id.len);
+    {
+        conn = find_conn_by_cid(engine, &packet_in->pi_conn_id);
+        if (!conn)
+            return NULL;
+    }
     else
     {
         LSQ_DEBUG("packet header does not have connection ID: discarding");
         return NULL;
     }
 
-    if (!el)
-        return NULL;
-
-    conn = lsquic_hashelem_getdata(el);
     conn->cn_pf->pf_parse_packet_in_finish(packet_in, ppstate);
     if ((engine->flags & ENG_CONNS_BY_ADDR)
         && !(conn->cn_flags & LSCONN_IETF)
@@ -1404,7 +1523,6 @@ find_or_create_conn (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
          struct packin_parse_state *ppstate, const struct sockaddr *sa_local,
          const struct sockaddr *sa_peer, void *peer_ctx, size_t packet_in_size)
 {
-    struct lsquic_hash_elem *el;
     struct purga_el *puel;
     lsquic_conn_t *conn;
 
@@ -1413,12 +1531,9 @@ find_or_create_conn (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
         LSQ_DEBUG("packet header does not have connection ID: discarding");
         return NULL;
     }
-    el = lsquic_hash_find(engine->conns_hash,
-                    packet_in->pi_conn_id.idbuf, packet_in->pi_conn_id.len);
-
-    if (el)
+    conn = find_conn_by_cid(engine, &packet_in->pi_conn_id);
+    if (conn)
     {
-        conn = lsquic_hashelem_getdata(el);
         conn->cn_pf->pf_parse_packet_in_finish(packet_in, ppstate);
         return conn;
     }
@@ -1436,6 +1551,13 @@ find_or_create_conn (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
         return NULL;
     }
 
+    if (engine->pub.enp_mem_level >= MEM_NO_CONNS)
+    {
+        LSQ_DEBUG("memory budget is nearly exhausted: do not create new "
+                                                                "connection");
+        return NULL;
+    }
+
 
     if (engine->purga
         && (puel = lsquic_purga_contains(engine->purga,
@@ -1595,13 +1717,12 @@ lsquic_conn_t *
 lsquic_engine_find_conn (const struct lsquic_engine_public *engine, 
                          const lsquic_cid_t *cid)
 {
-    struct lsquic_hash_elem *el;
-    lsquic_conn_t *conn = NULL;
-    el = lsquic_hash_find(engine->enp_engine->conns_hash, cid->idbuf, cid->len);
+    struct lsquic_conn *conn;
 
-    if (el)
-        conn = lsquic_hashelem_getdata(el);
-    return conn;
+    if (engine->enp_cid_route
+            && (conn = lsquic_cidr_find(engine->enp_cid_route, cid)))
+        return conn;
+    return lsquic_cidh_find(engine->enp_engine->conns_hash, cid);
 }
 
 
@@ -1670,6 +1791,82 @@ find_conn_by_srst (struct lsquic_engine *engine,
 }
 
 
+static void
+deliver_packet_in (struct lsquic_engine *engine, struct lsquic_conn *conn,
+            struct lsquic_packet_in *packet_in,
+            const unsigned char *packet_in_data, size_t packet_in_size)
+{
+    conn->cn_if->ci_packet_in(conn, packet_in);
+#if LSQUIC_CONN_STATS
+    engine->busy.pin_conn = conn;
+#endif
+    QLOG_PACKET_RX(lsquic_conn_log_cid(conn), packet_in, packet_in_data, packet_in_size);
+    lsquic_packet_in_put(&engine->pub.enp_mm, packet_in);
+    if ((conn->cn_flags & (LSCONN_MINI | LSCONN_HANDSHAKE_DONE | LSCONN_IETF))
+                    == (LSCONN_MINI | LSCONN_HANDSHAKE_DONE | LSCONN_IETF))
+    {
+        if (promote_mini_conn(engine, conn, lsquic_time_now()) == -1)
+            conn->cn_flags |= LSCONN_PROMOTE_FAIL;
+    }
+}
+
+
+static void
+flush_pin_batch (struct lsquic_engine *engine)
+{
+    struct lsquic_conn *const conn = engine->pin_batch.conn;
+    unsigned i;
+
+    if (!conn)
+        return;
+
+    LSQ_DEBUGC("deliver batch of %u packet%.*s to connection %"CID_FMT,
+        engine->pin_batch.count, engine->pin_batch.count != 1, "s",
+        CID_BITS(lsquic_conn_log_cid(conn)));
+    conn->cn_esf_c->esf_prepare_decrypt(conn->cn_enc_session,
+                            engine->pin_batch.packets, engine->pin_batch.count);
+    for (i = 0; i < engine->pin_batch.count; ++i)
+        deliver_packet_in(engine, conn, engine->pin_batch.packets[i],
+                    engine->pin_batch.data[i], engine->pin_batch.size[i]);
+    engine->pin_batch.conn = NULL;
+    engine->pin_batch.count = 0;
+}
+
+
+/* Only full IETF connections whose encryption session knows how to prepare
+ * a batch of packets have their packets queued.
+ */
+static int
+can_batch_packets_in (const struct lsquic_conn *conn)
+{
+    return !(conn->cn_flags & LSCONN_MINI)
+        && conn->cn_enc_session
+        && conn->cn_esf_c->esf_prepare_decrypt;
+}
+
+
+static void
+queue_packet_in (struct lsquic_engine *engine, struct lsquic_conn *conn,
+                                        struct lsquic_packet_in *packet_in)
+{
+    unsigned idx;
+
+    if (engine->pin_batch.conn != conn)
+    {
+        flush_pin_batch(engine);
+        engine->pin_batch.conn = conn;
+    }
+
+    idx = engine->pin_batch.count++;
+    engine->pin_batch.packets[idx] = packet_in;
+    engine->pin_batch.data[idx] = packet_in->pi_data;
+    engine->pin_batch.size[idx] = packet_in->pi_data_sz;
+
+    if (engine->pin_batch.count == PIN_BATCH_SIZE)
+        flush_pin_batch(engine);
+}
+
+
 /* Return 0 if packet is being processed by a real connection (mini or full),
  * otherwise return 1.
  */
@@ -1679,7 +1876,6 @@ process_packet_in (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
        const struct sockaddr *sa_peer, void *peer_ctx, size_t packet_in_size)
 {
     lsquic_conn_t *conn;
-    const unsigned char *packet_in_data;
 
     if (lsquic_packet_in_is_gquic_prst(packet_in)
                                 && !engine->pub.enp_settings.es_honor_prst)
@@ -1701,6 +1897,7 @@ process_packet_in (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
 
     if (!conn)
     {
+        flush_pin_batch(engine);
         if (engine->pub.enp_settings.es_honor_prst
                 && packet_in_size == packet_in->pi_data_sz /* Full UDP packet */
                 && !(packet_in->pi_flags & PI_GQUIC)
@@ -1754,20 +1951,15 @@ process_packet_in (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
      * ordering of QLog events, be sure to process the QLogs downstream.
      * (Hint: Use the qlog_parser.py tool in tools/ for full QLog processing.)
      */
-    packet_in_data = packet_in->pi_data;
-    packet_in_size = packet_in->pi_data_sz;
-    conn->cn_if->ci_packet_in(conn, packet_in);
-#if LSQUIC_CONN_STATS
-    engine->busy.pin_conn = conn;
-#endif
-    QLOG_PACKET_RX(lsquic_conn_log_cid(conn), packet_in, packet_in_data, packet_in_size);
-    lsquic_packet_in_put(&engine->pub.enp_mm, packet_in);
-    if ((conn->cn_flags & (LSCONN_MINI | LSCONN_HANDSHAKE_DONE | LSCONN_IETF))
-                    == (LSCONN_MINI | LSCONN_HANDSHAKE_DONE | LSCONN_IETF))
+    if ((engine->flags & ENG_BATCH_IN) && can_batch_packets_in(conn))
     {
-        if (promote_mini_conn(engine, conn, lsquic_time_now()) == -1)
-            conn->cn_flags |= LSCONN_PROMOTE_FAIL;
+        queue_packet_in(engine, conn, packet_in);
+        return 0;
     }
+    /* Preserve order of packets: */
+    flush_pin_batch(engine);
+    deliver_packet_in(engine, conn, packet_in, packet_in->pi_data,
+                                                    packet_in->pi_data_sz);
     return 0;
 }
 
@@ -1775,7 +1967,6 @@ process_packet_in (lsquic_engine_t *engine, lsquic_packet_in_t *packet_in,
 void
 lsquic_engine_destroy (lsquic_engine_t *engine)
 {
-    struct lsquic_hash_elem *el;
     lsquic_conn_t *conn;
     unsigned i;
 
@@ -1796,13 +1987,12 @@ lsquic_engine_destroy (lsquic_engine_t *engine)
         (void) engine_decref_conn(engine, conn, LSCONN_TICKABLE);
     }
 
-    for (el = lsquic_hash_first(engine->conns_hash); el;
-                                el = lsquic_hash_next(engine->conns_hash))
+    for (conn = lsquic_cidh_first(engine->conns_hash); conn;
+                                conn = lsquic_cidh_next(engine->conns_hash))
     {
-        conn = lsquic_hashelem_getdata(el);
         force_close_conn(engine, conn);
     }
-    lsquic_hash_destroy(engine->conns_hash);
+    lsquic_cidh_destroy(engine->conns_hash);
 
     while ((conn = lsquic_attq_pop(engine->attq, UINT64_MAX)))
         (void) engine_decref_conn(engine, conn, LSCONN_ATTQ);
@@ -1813,6 +2003,8 @@ lsquic_engine_destroy (lsquic_engine_t *engine)
         lsquic_prq_destroy(engine->pr_queue);
     if (engine->purga)
         lsquic_purga_destroy(engine->purga);
+    if (engine->pub.enp_cid_route)
+        lsquic_cidr_destroy(engine->pub.enp_cid_route);
     lsquic_attq_destroy(engine->attq);
 
     assert(0 == lsquic_mh_count(&engine->conns_out));
@@ -1910,8 +2102,7 @@ add_conn_to_hash (struct lsquic_engine *engine, struct lsquic_conn *conn,
         }
         cce->cce_port = sa2port(local_sa);
         cce->cce_flags = CCE_PORT;
-        if (lsquic_hash_insert(engine->conns_hash, &cce->cce_port,
-                                sizeof(cce->cce_port), conn, &cce->cce_hash_el))
+        if (0 == lsquic_cidh_insert(engine->conns_hash, conn, cce))
         {
             conn->cn_cces_mask |= 1 << (cce - conn->cn_cces);
             return 0;
@@ -2022,6 +2213,7 @@ lsquic_engine_connect (lsquic_engine_t *engine, enum lsquic_version version,
 static void
 remove_conn_from_hash (lsquic_engine_t *engine, lsquic_conn_t *conn)
 {
+    forget_last_pin(engine);
     remove_all_cces_from_hash(engine->conns_hash, conn);
     (void) engine_decref_conn(engine, conn, LSCONN_HASHED);
 }
@@ -2190,16 +2382,14 @@ cub_add_cids_from_cces (struct cid_update_batch *cub, struct lsquic_conn *conn)
 static void
 drop_all_mini_conns (lsquic_engine_t *engine)
 {
-    struct lsquic_hash_elem *el;
     lsquic_conn_t *conn;
     struct cid_update_batch cub;
 
     cub_init(&cub, engine->report_old_scids, engine->scids_ctx);
 
-    for (el = lsquic_hash_first(engine->conns_hash); el;
-                                el = lsquic_hash_next(engine->conns_hash))
+    for (conn = lsquic_cidh_first(engine->conns_hash); conn;
+                                conn = lsquic_cidh_next(engine->conns_hash))
     {
-        conn = lsquic_hashelem_getdata(el);
         if (conn->cn_flags & LSCONN_MINI)
         {
             /* If promoted, why is it still in this hash? */
@@ -2214,6 +2404,103 @@ drop_all_mini_conns (lsquic_engine_t *engine)
 }
 
 
+static size_t
+engine_mem_used (const struct lsquic_engine *engine)
+{
+    return lsquic_mm_mem_used(&engine->pub.enp_mm)
+         + engine->pub.enp_stream_mem;
+}
+
+
+/* Connections and streams check the memory level to decide whether to
+ * shrink flow control windows and to give peer more streams.  Before the
+ * level goes up, memory cached by the memory manager is released.
+ */
+static size_t
+update_mem_level (struct lsquic_engine *engine, size_t mem_used)
+{
+    const size_t max = engine->pub.enp_settings.es_max_memory;
+    enum mem_level level;
+
+    if (mem_used >= max - max / 4)
+        mem_used -= lsquic_mm_shed(&engine->pub.enp_mm,
+                                            mem_used - (max - max / 4) + 1);
+
+    if (mem_used >= max)
+        level = MEM_NO_STREAMS;
+    else if (mem_used >= max - max / 8)
+        level = MEM_NO_CONNS;
+    else if (mem_used >= max - max / 4)
+        level = MEM_SHRINK_FC;
+    else
+        level = MEM_OK;
+
+    if (level != engine->pub.enp_mem_level)
+    {
+        LSQ_INFO("memory use %zu out of %zu: level changes from %d to %d",
+                    mem_used, max, engine->pub.enp_mem_level, level);
+        engine->pub.enp_mem_level = level;
+    }
+
+    return mem_used;
+}
+
+
+/* Trim memory manager pools, update memory level, and notify the user
+ * when memory use crosses the threshold.  The callback is called again
+ * only after memory use falls below 7/8 of the threshold, so that it is
+ * not called on every tick when memory use hovers around the threshold.
+ */
+static void
+check_mem_pressure (struct lsquic_engine *engine, lsquic_time_t now)
+{
+    size_t mem_used, thresh;
+
+    lsquic_mm_trim(&engine->pub.enp_mm, now);
+
+    thresh = engine->pub.enp_settings.es_mem_pressure_thresh;
+    if (!engine->mem_pressure)
+        thresh = 0;
+    if (!(thresh || engine->pub.enp_settings.es_max_memory))
+        return;
+
+    mem_used = engine_mem_used(engine);
+    if (engine->pub.enp_settings.es_max_memory)
+        mem_used = update_mem_level(engine, mem_used);
+    if (!thresh)
+        return;
+
+    if (!(engine->flags & ENG_MEM_PRESSURE))
+    {
+        if (mem_used >= thresh)
+        {
+            LSQ_INFO("memory use %zu is above threshold %zu", mem_used,
+                                                                    thresh);
+            engine->flags |= ENG_MEM_PRESSURE;
+            engine->mem_pressure(engine->mem_pressure_ctx, mem_used, 1);
+        }
+    }
+    else if (mem_used < thresh - thresh / 8)
+    {
+        LSQ_INFO("memory use %zu is below threshold %zu", mem_used, thresh);
+        engine->flags &= ~ENG_MEM_PRESSURE;
+        engine->mem_pressure(engine->mem_pressure_ctx, mem_used, 0);
+    }
+}
+
+
+size_t
+lsquic_engine_shed_memory (lsquic_engine_t *engine, size_t n_bytes)
+{
+    size_t shed;
+
+    ENGINE_CALLS_INCR(engine);
+    shed = lsquic_mm_shed(&engine->pub.enp_mm, n_bytes);
+    LSQ_DEBUG("shed %zu bytes out of %zu requested", shed, n_bytes);
+    return shed;
+}
+
+
 void
 lsquic_engine_process_conns (lsquic_engine_t *engine)
 {
@@ -2242,6 +2529,7 @@ lsquic_engine_process_conns (lsquic_engine_t *engine)
     }
 
     process_connections(engine, conn_iter_next_tickable, now);
+    check_mem_pressure(engine, now);
     ENGINE_OUT(engine);
 }
 
@@ -2475,6 +2763,7 @@ struct send_batch_ctx {
     struct conns_tailq                  *ticked_conns;
     struct conns_out_iter               *conns_iter;
     CONST_BATCH struct out_batch        *batch;
+    struct gso_batch                    *gso_batch;
 };
 
 
@@ -2562,9 +2851,10 @@ send_batch (lsquic_engine_t *engine, const struct send_batch_ctx *sb_ctx,
 {
     int n_sent, i, e_val;
     lsquic_time_t now;
-    unsigned off, skip;
+    unsigned off, skip, n_gso, n_specs, unmerged_end, failed_end;
     size_t count;
     CONST_BATCH struct out_batch *const batch = sb_ctx->batch;
+    struct gso_batch *const gso_batch = sb_ctx->gso_batch;
     struct lsquic_packet_out *CONST_BATCH *packet_out, *CONST_BATCH *end;
 
 #if LSQUIC_CONN_STATS
@@ -2577,6 +2867,7 @@ send_batch (lsquic_engine_t *engine, const struct send_batch_ctx *sb_ctx,
         lose_matching_packets(engine, batch, n_to_send);
 #endif
     skip = 0;
+    unmerged_end = 0;
   restart_batch:
     /* Set sent time before the write to avoid underestimating RTT */
     now = lsquic_time_now();
@@ -2588,12 +2879,37 @@ send_batch (lsquic_engine_t *engine, const struct send_batch_ctx *sb_ctx,
         packet_out = &batch->packets[off];
         end = packet_out + count;
         do
-            (*packet_out)->po_sent = now;
+            /* Packet with departure time is sent when it is due */
+            if (!((*packet_out)->po_flags & PO_TXTIME)
+                                            || (*packet_out)->po_sent < now)
+                (*packet_out)->po_sent = now;
         while (++packet_out < end);
     }
-    n_sent = engine->packets_out(engine->packets_out_ctx, batch->outs + skip,
-                                                            n_to_send - skip);
-    e_val = errno;
+    failed_end = 0;
+    if (engine->pub.enp_settings.es_gso)
+    {
+        n_gso = lsquic_gso_combine(batch->outs, batch->conns, skip,
+                    n_to_send, unmerged_end, gso_batch->outs, gso_batch->idx);
+        n_sent = engine->packets_out(engine->packets_out_ctx, gso_batch->outs,
+                                                                        n_gso);
+        e_val = errno;
+        /* If a combined spec failed, remember where its datagrams end */
+        n_specs = n_sent > 0 ? (unsigned) n_sent : 0;
+        if (n_specs < n_gso && gso_batch->outs[n_specs].iovlen
+                            > batch->outs[ gso_batch->idx[n_specs] ].iovlen)
+            failed_end = n_specs + 1 < n_gso
+                                    ? gso_batch->idx[n_specs + 1] : n_to_send;
+        /* Convert number of GSO specs sent to number of regular specs */
+        if (n_sent > 0)
+            n_sent = (n_specs < n_gso ? gso_batch->idx[n_specs]
+                                                        : n_to_send) - skip;
+    }
+    else
+    {
+        n_sent = engine->packets_out(engine->packets_out_ctx,
+                                    batch->outs + skip, n_to_send - skip);
+        e_val = errno;
+    }
     if (n_sent < (int) (n_to_send - skip) && e_val != EMSGSIZE)
     {
         engine->pub.enp_flags &= ~ENPUB_CAN_SEND;
@@ -2646,6 +2962,18 @@ send_batch (lsquic_engine_t *engine, const struct send_batch_ctx *sb_ctx,
         }
         while (++packet_out < end);
     }
+    if (i < (int) n_to_send && e_val == EMSGSIZE && failed_end)
+    {
+        /* The datagrams may each be fine: it is the combination that the
+         * kernel rejected.  Send them again one by one.
+         */
+        LSQ_DEBUG("GSO spec starting at packet #%d could not be sent out "
+            "for being too large, restart batch without combining packets "
+            "#%d-#%u", i, i, failed_end - 1);
+        skip = i;
+        unmerged_end = failed_end;
+        goto restart_batch;
+    }
     if (i < (int) n_to_send && e_val == EMSGSIZE)
     {
         LSQ_DEBUG("packet #%d could not be sent out for being too large", i);
@@ -2753,6 +3081,7 @@ send_packets_out (struct lsquic_engine *engine,
         ticked_conns,
         &conns_iter,
         &engine->out_batch,
+        &engine->gso_batch,
     };
 
     coi_init(&conns_iter, engine);
@@ -2831,6 +3160,9 @@ send_packets_out (struct lsquic_engine *engine,
             batch->outs   [n].local_sa = NP_LOCAL_SA(packet_out->po_path);
             batch->outs   [n].dest_sa  = NP_PEER_SA(packet_out->po_path);
             batch->outs   [n].conn_ctx = conn->cn_conn_ctx;
+            batch->outs   [n].gso_size = 0;
+            batch->outs   [n].txtime   = packet_out->po_flags & PO_TXTIME
+                                                ? packet_out->po_sent : 0;
             batch->conns  [n]          = conn;
         }
         *packet = packet_out;
@@ -2882,6 +3214,11 @@ send_packets_out (struct lsquic_engine *engine,
         shrink = w < n;
         ++n_batches_sent;
     }
+    else
+        /* Packets may have been encrypted without making it into a batch.
+         * Their encryption must not be deferred past this point.
+         */
+        apply_hp(&conns_iter);
 
     if (shrink)
         shrink_batch_size(engine);
@@ -2918,15 +3255,13 @@ reset_deadline (lsquic_engine_t *engine, lsquic_time_t now)
 static void
 check_tickable_conns_again (struct lsquic_engine *engine)
 {
-    struct lsquic_hash_elem *el;
     struct lsquic_conn *conn;
     unsigned count;
 
     count = 0;
-    for (el = lsquic_hash_first(engine->conns_hash); el;
-                                el = lsquic_hash_next(engine->conns_hash))
+    for (conn = lsquic_cidh_first(engine->conns_hash); conn;
+                                conn = lsquic_cidh_next(engine->conns_hash))
     {
-        conn = lsquic_hashelem_getdata(el);
         if (!(conn->cn_flags & LSCONN_TICKABLE)
             && conn->cn_if->ci_is_tickable(conn))
         {
@@ -3193,12 +3528,10 @@ lsquic_engine_packet_in (lsquic_engine_t *engine,
         parse_packet_in_begin = lsquic_parse_packet_in_server_begin;
     else if (engine->flags & ENG_CONNS_BY_ADDR)
     {
-        struct lsquic_hash_elem *el;
         const struct lsquic_conn *conn;
-        el = find_conn_by_addr(engine->conns_hash, sa_local);
-        if (!el)
+        conn = find_conn_by_addr(engine->conns_hash, sa_local);
+        if (!conn)
             return -1;
-        conn = lsquic_hashelem_getdata(el);
         if ((1 << conn->cn_version) & LSQUIC_GQUIC_HEADER_VERSIONS)
             parse_packet_in_begin = lsquic_gquic_parse_packet_in_begin;
         else if ((1 << conn->cn_version) & LSQUIC_IETF_VERSIONS)
@@ -3228,7 +3561,8 @@ lsquic_engine_packet_in (lsquic_engine_t *engine,
         if (!packet_in)
             return -1;
         /* Library does not modify packet_in_data, it is not referenced after
-         * this function returns and subsequent release of pi_data is guarded
+         * this function (or lsquic_engine_packets_in(), if the packet is
+         * batched) returns and subsequent release of pi_data is guarded
          * by PI_OWN_DATA flag.
          */
         packet_in->pi_data = (unsigned char *) packet_in_data;
@@ -3281,6 +3615,58 @@ lsquic_engine_packet_in (lsquic_engine_t *engine,
 }
 
 
+static int
+engine_gro_packet_in (void *engine, const unsigned char *buf, size_t bufsz,
+                                            const struct lsquic_in_spec *spec)
+{
+    return lsquic_engine_packet_in(engine, buf, bufsz, spec->local_sa,
+                                    spec->peer_sa, spec->peer_ctx, spec->ecn);
+}
+
+
+unsigned
+lsquic_engine_packets_in (lsquic_engine_t *engine,
+                        const struct lsquic_in_spec *specs, unsigned n_specs)
+{
+    unsigned n;
+    int s;
+
+    engine->flags |= ENG_BATCH_IN;
+    forget_last_pin(engine);
+    for (n = 0; n < n_specs; ++n)
+    {
+        if (specs[n].gso_size && specs[n].gso_size < specs[n].bufsz)
+            s = lsquic_gro_packets_in(&specs[n], engine_gro_packet_in, engine);
+        else
+            s = lsquic_engine_packet_in(engine, specs[n].buf, specs[n].bufsz,
+                                specs[n].local_sa, specs[n].peer_sa,
+                                specs[n].peer_ctx, specs[n].ecn);
+        if (s < 0)
+            break;
+    }
+    flush_pin_batch(engine);
+    forget_last_pin(engine);
+    engine->flags &= ~ENG_BATCH_IN;
+
+    return n;
+}
+
+
+void
+lsquic_engine_release_slices (lsquic_engine_t *engine,
+                        const struct lsquic_slice *slices, unsigned n_slices)
+{
+    struct lsquic_packet_in *packet_in;
+    unsigned n;
+
+    for (n = 0; n < n_slices; ++n)
+    {
+        packet_in = slices[n].handle;
+        lsquic_packet_in_put(&engine->pub.enp_mm, packet_in);
+    }
+}
+
+
 #if __GNUC__ && !defined(NDEBUG)
 __attribute__((weak))
 #endif
@@ -3294,7 +3680,6 @@ lsquic_engine_quic_versions (const lsquic_engine_t *engine)
 void
 lsquic_engine_cooldown (lsquic_engine_t *engine)
 {
-    struct lsquic_hash_elem *el;
     lsquic_conn_t *conn;
 
     if (engine->flags & ENG_COOLDOWN)
@@ -3306,10 +3691,9 @@ lsquic_engine_cooldown (lsquic_engine_t *engine)
     LSQ_INFO("entering cooldown mode");
     if (engine->flags & ENG_SERVER)
         drop_all_mini_conns(engine);
-    for (el = lsquic_hash_first(engine->conns_hash); el;
-                                el = lsquic_hash_next(engine->conns_hash))
+    for (conn = lsquic_cidh_first(engine->conns_hash); conn;
+                                conn = lsquic_cidh_next(engine->conns_hash))
     {
-        conn = lsquic_hashelem_getdata(el);
         lsquic_conn_going_away(conn);
     }
 }
@@ -3523,10 +3907,9 @@ lsquic_engine_add_cid (struct lsquic_engine_public *enpub,
 
     assert(cce_idx < conn->cn_n_cces);
     assert(conn->cn_cces_mask & (1 << cce_idx));
-    assert(!(cce->cce_hash_el.qhe_flags & QHE_HASHED));
+    assert(!cce->cce_hashed);
 
-    if (lsquic_hash_insert(engine->conns_hash, cce->cce_cid.idbuf,
-                                    cce->cce_cid.len, conn, &cce->cce_hash_el))
+    if (0 == lsquic_cidh_insert(engine->conns_hash, conn, cce))
     {
         LSQ_DEBUGC("add %"CID_FMT" to the list of SCIDs",
                                                     CID_BITS(&cce->cce_cid));
@@ -3556,8 +3939,11 @@ lsquic_engine_retire_cid (struct lsquic_engine_public *enpub,
 
     assert(cce_idx < conn->cn_n_cces);
 
-    if (cce->cce_hash_el.qhe_flags & QHE_HASHED)
-        lsquic_hash_erase(engine->conns_hash, &cce->cce_hash_el);
+    if (cce->cce_hashed)
+    {
+        forget_last_pin(engine);
+        lsquic_cidh_erase(engine->conns_hash, conn, cce);
+    }
 
     if (engine->purga)
     {
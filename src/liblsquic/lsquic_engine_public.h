@@ -19,6 +19,7 @@ struct lsquic_stream_if;
 struct ssl_ctx_st;
 struct crand;
 struct evp_aead_ctx_st;
+struct cid_route;
 struct lsquic_server_config;
 struct sockaddr;
 
@@ -32,6 +33,15 @@ enum warning_type
 
 #define WARNING_INTERVAL (24ULL * 3600ULL * 1000000ULL)
 
+/* Engine memory use relative to es_max_memory, from least to most severe */
+enum mem_level
+{
+    MEM_OK,
+    MEM_SHRINK_FC,      /* Shrink flow control windows */
+    MEM_NO_CONNS,       /* Do not accept new connections */
+    MEM_NO_STREAMS,     /* Do not let peer open new streams */
+};
+
 struct lsquic_engine_public {
     struct lsquic_mm                enp_mm;
     struct lsquic_engine_settings   enp_settings;
@@ -51,6 +61,8 @@ struct lsquic_engine_public {
     void                          (*enp_generate_scid)(void *,
                         struct lsquic_conn *, struct lsquic_cid *, unsigned);
     void                           *enp_gen_scid_ctx;
+    /* Set if ea_generate_scid is lsquic_route_generate_scid() */
+    struct cid_route               *enp_cid_route;
     int                           (*enp_verify_cert)(void *verify_ctx,
                                             struct stack_st_X509 *chain);
     void                           *enp_verify_ctx;
@@ -65,6 +77,7 @@ struct lsquic_engine_public {
                                  */
         ENPUB_CAN_SEND = (1 << 1),
         ENPUB_HTTP  = (1 << 2), /* Engine in HTTP mode */
+        ENPUB_RETRY_SCID = (1 << 3), /* enp_generate_scid() takes NULL conn */
     }                               enp_flags;
     unsigned char                   enp_ver_tags_buf[ sizeof(lsquic_ver_tag_t) * N_LSQVER ];
     unsigned                        enp_ver_tags_len;
@@ -74,6 +87,9 @@ struct lsquic_engine_public {
     /* es_noprogress_timeout converted to microseconds for speed */
     lsquic_time_t                   enp_noprog_timeout;
     lsquic_time_t                   enp_mtu_probe_timer;
+    /* Memory allocated for stream buffers outside of the memory manager */
+    size_t                          enp_stream_mem;
+    enum mem_level                  enp_mem_level;
     /* Certs used by gQUIC server: */
     struct lsquic_hash             *enp_compressed_server_certs;
     struct lsquic_hash             *enp_server_certs;
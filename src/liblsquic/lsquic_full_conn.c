@@ -42,6 +42,8 @@
 #include "lsquic_bw_sampler.h"
 #include "lsquic_minmax.h"
 #include "lsquic_bbr.h"
+#include "lsquic_bbr2.h"
+#include "lsquic_prague.h"
 #include "lsquic_adaptive_cc.h"
 #include "lsquic_set.h"
 #include "lsquic_malo.h"
@@ -627,8 +629,8 @@ new_conn_common (lsquic_cid_t cid, struct lsquic_engine_public *enpub,
 #if LSQUIC_CONN_STATS
     conn->fc_pub.conn_stats = &conn->fc_stats;
 #endif
-    conn->fc_pub.packet_out_malo =
-                        lsquic_malo_create(sizeof(struct lsquic_packet_out));
+    conn->fc_pub.packet_out_malo = lsquic_mm_malo_create(conn->fc_pub.mm,
+                                        sizeof(struct lsquic_packet_out));
     conn->fc_pub.path = &conn->fc_path;
     conn->fc_pub.max_peer_ack_usec = ACK_TIMEOUT;
     conn->fc_stream_ifs[STREAM_IF_STD].stream_if     = enpub->enp_stream_if;
@@ -1672,6 +1674,15 @@ process_stream_frame (struct full_conn *conn, lsquic_packet_in_t *packet_in,
                 lsquic_malo_put(stream_frame);
                 return parsed_len;
             }
+            if (conn->fc_enpub->enp_mem_level >= MEM_NO_STREAMS &&
+                stream_frame->stream_id > conn->fc_max_peer_stream_id)
+            {
+                LSQ_DEBUG("low on memory: reset new incoming stream %"PRIu64,
+                                                    stream_frame->stream_id);
+                maybe_schedule_reset_for_stream(conn, stream_frame->stream_id);
+                lsquic_malo_put(stream_frame);
+                return parsed_len;
+            }
         }
         else
         {
@@ -3905,6 +3916,14 @@ find_stream_on_non_stream_frame (struct full_conn *conn,
         LSQ_DEBUG("going away: reset new incoming stream %"PRIu64, stream_id);
         return NULL;
     }
+    if (conn->fc_enpub->enp_mem_level >= MEM_NO_STREAMS &&
+        stream_id > conn->fc_max_peer_stream_id)
+    {
+        maybe_schedule_reset_for_stream(conn, stream_id);
+        LSQ_DEBUG("low on memory: reset new incoming stream %"PRIu64,
+                                                                stream_id);
+        return NULL;
+    }
 
     stream = new_stream(conn, stream_id, stream_ctor_flags);
     if (!stream)
@@ -4421,7 +4440,7 @@ lsquic_gquic_full_conn_srej (struct lsquic_conn *lconn)
     LSQ_DEBUG("reinitialize CID and other state due to SREJ");
 
     /* Generate new CID and update connections hash */
-    if (cce->cce_hash_el.qhe_flags & QHE_HASHED)
+    if (cce->cce_hashed)
     {
         lsquic_engine_retire_cid(conn->fc_enpub, lconn, cce_idx,
                                         0 /* OK to omit the `now' value */, 0);
@@ -44,8 +44,11 @@
 #include "lsquic_bw_sampler.h"
 #include "lsquic_minmax.h"
 #include "lsquic_bbr.h"
+#include "lsquic_bbr2.h"
+#include "lsquic_prague.h"
 #include "lsquic_adaptive_cc.h"
 #include "lsquic_send_ctl.h"
+#include "lsquic_path_cache.h"
 #include "lsquic_alarmset.h"
 #include "lsquic_ver_neg.h"
 #include "lsquic_mm.h"
@@ -160,6 +163,9 @@ enum more_flags
     MF_WANT_DATAGRAM_WRITE  = 1 << 6,
     MF_DOING_0RTT       = 1 << 7,
     MF_HAVE_HCSI        = 1 << 8,   /* Have HTTP Control Stream Incoming */
+    /* MAX_STREAMS frame is withheld because the engine is low on memory: */
+    MF_MEM_DELAY_BIDI   = 1 << 9,
+    MF_MEM_DELAY_UNI    = 1 << 10,
 };
 
 
@@ -311,7 +317,8 @@ struct dplpmtud_state
         DS_PROBE_SENT   = 1 << 0,
     }                   ds_flags;
     unsigned short      ds_probed_size,
-                        ds_failed_size; /* If non-zero, defines ceiling */
+                        ds_failed_size, /* If non-zero, defines ceiling */
+                        ds_cached_size; /* If non-zero, probe this first */
     unsigned char       ds_probe_count;
 };
 
@@ -1249,6 +1256,55 @@ maybe_enable_spin (struct ietf_full_conn *conn, struct conn_path *cpath)
 }
 
 
+/* Use what an earlier connection to this destination has learned about
+ * the path.  Called once the peer address of the first path is known.
+ */
+static void
+maybe_resume_path_state (struct ietf_full_conn *conn)
+{
+    struct conn_path *const cpath = CUR_CPATH(conn);
+    struct path_state state;
+
+    if (0 != lsquic_path_cache_lookup(conn->ifc_enpub,
+                                    NP_PEER_SA(&cpath->cop_path), &state))
+    {
+        LSQ_DEBUG("no saved path state");
+        return;
+    }
+
+    LSQ_DEBUG("found saved path state: min RTT %"PRIu64" usec; srtt %"PRIu64
+        " usec; cwnd %"PRIu64" bytes; bandwidth %"PRIu64" bytes/sec; "
+        "PLPMTU %hu bytes", state.ps_min_rtt, state.ps_srtt, state.ps_cwnd,
+        state.ps_bw, state.ps_plpmtu);
+    lsquic_send_ctl_resume(&conn->ifc_send_ctl, &state);
+    if (state.ps_plpmtu > cpath->cop_path.np_pack_size)
+        cpath->cop_dplpmtud.ds_cached_size = state.ps_plpmtu;
+}
+
+
+static void
+save_path_state (struct ietf_full_conn *conn)
+{
+    struct conn_path *const cpath = CUR_CPATH(conn);
+    struct path_state state;
+
+    if (0 != lsquic_send_ctl_get_path_state(&conn->ifc_send_ctl, &state))
+    {
+        LSQ_DEBUG("path state is not worth saving");
+        return;
+    }
+
+    state.ps_plpmtu = cpath->cop_path.np_pack_size;
+    if (0 == lsquic_path_cache_save(conn->ifc_enpub,
+                                    NP_PEER_SA(&cpath->cop_path), &state))
+        LSQ_DEBUG("saved path state: min RTT %"PRIu64" usec; srtt %"PRIu64
+            " usec; cwnd %"PRIu64" bytes; PLPMTU %hu bytes",
+            state.ps_min_rtt, state.ps_srtt, state.ps_cwnd, state.ps_plpmtu);
+    else
+        LSQ_INFO("could not save path state");
+}
+
+
 static int
 ietf_full_conn_init (struct ietf_full_conn *conn,
            struct lsquic_engine_public *enpub, unsigned flags, int ecn)
@@ -1450,8 +1506,8 @@ lsquic_ietf_full_conn_client_new (struct lsquic_engine_public *enpub,
         goto err3;
     if (!lsquic_stream_get_ctx(conn->ifc_u.cli.crypto_streams[ENC_LEV_INIT]))
         goto err4;
-    conn->ifc_pub.packet_out_malo =
-                        lsquic_malo_create(sizeof(struct lsquic_packet_out));
+    conn->ifc_pub.packet_out_malo = lsquic_mm_malo_create(conn->ifc_pub.mm,
+                                        sizeof(struct lsquic_packet_out));
     if (!conn->ifc_pub.packet_out_malo)
         goto err4;
     conn->ifc_flags |= IFC_PROC_CRYPTO;
@@ -1547,8 +1603,8 @@ lsquic_ietf_full_conn_server_new (struct lsquic_engine_public *enpub,
     if (0 != ietf_full_conn_init(conn, enpub, flags,
                                         lsquic_mini_conn_ietf_ecn_ok(imc)))
         goto err1;
-    conn->ifc_pub.packet_out_malo =
-                        lsquic_malo_create(sizeof(struct lsquic_packet_out));
+    conn->ifc_pub.packet_out_malo = lsquic_mm_malo_create(conn->ifc_pub.mm,
+                                        sizeof(struct lsquic_packet_out));
     if (!conn->ifc_pub.packet_out_malo)
         goto err1;
     if (imc->imc_flags & IMC_IGNORE_INIT)
@@ -1616,6 +1672,8 @@ lsquic_ietf_full_conn_server_new (struct lsquic_engine_public *enpub,
     conn->ifc_send_ctl.sc_cur_packno = imc->imc_next_packno - 1;
     conn->ifc_incoming_ecn = imc->imc_incoming_ecn;
     conn->ifc_pub.rtt_stats = imc->imc_rtt_stats;
+    if (conn->ifc_settings->es_path_cache_ttl)
+        maybe_resume_path_state(conn);
 
     conn->ifc_last_live_update = now;
 
@@ -2659,7 +2717,15 @@ sched_max_bidi_streams (void *conn_p)
 static int
 can_give_peer_streams_credit (struct ietf_full_conn *conn, enum stream_dir sd)
 {
-    /* This logic only applies to HTTP servers. */
+    if (conn->ifc_enpub->enp_mem_level >= MEM_NO_STREAMS)
+    {
+        LSQ_DEBUG("delay sending more %sdirectional streams credit to peer "
+            "until engine memory use goes down", sd == SD_UNI ? "uni" : "bi");
+        conn->ifc_mflags |= MF_MEM_DELAY_BIDI << sd;
+        return 0;
+    }
+
+    /* The rest of the logic only applies to HTTP servers. */
     if ((conn->ifc_flags & (IFC_SERVER|IFC_HTTP)) != (IFC_SERVER|IFC_HTTP))
         return 1;
     /* HTTP client does not open unidirectional streams (other than the
@@ -2681,6 +2747,25 @@ can_give_peer_streams_credit (struct ietf_full_conn *conn, enum stream_dir sd)
 }
 
 
+static void
+resume_peer_streams_credit (struct ietf_full_conn *conn)
+{
+    enum stream_dir sd;
+
+    for (sd = 0; sd < N_SDS; ++sd)
+        if (conn->ifc_mflags & (MF_MEM_DELAY_BIDI << sd))
+        {
+            conn->ifc_mflags &= ~(MF_MEM_DELAY_BIDI << sd);
+            if (can_give_peer_streams_credit(conn, sd))
+            {
+                LSQ_DEBUG("schedule MAX_STREAMS frame for %sdirectional "
+                    "streams (was delayed)", sd == SD_UNI ? "uni" : "bi");
+                conn->ifc_send_flags |= SF_SEND_MAX_STREAMS << sd;
+            }
+        }
+}
+
+
 /* Because stream IDs are distributed unevenly, it is more efficient to
  * maintain four sets of closed stream IDs.
  */
@@ -3124,6 +3209,11 @@ ietf_full_conn_ci_destroy (struct lsquic_conn *lconn)
     struct lsquic_hash_elem *el;
     unsigned i;
 
+    if (conn->ifc_settings->es_path_cache_ttl
+            && (conn->ifc_flags & IFC_CREATED_OK)
+            && (conn->ifc_conn.cn_flags & LSCONN_HANDSHAKE_DONE)
+            && (CUR_CPATH(conn)->cop_flags & COP_VALIDATED))
+        save_path_state(conn);
     if (!(conn->ifc_flags & IFC_SERVER))
     {
         for (streamp = conn->ifc_u.cli.crypto_streams; streamp <
@@ -8031,6 +8121,8 @@ check_or_schedule_mtu_probe (struct ietf_full_conn *conn, lsquic_time_t now)
         LSQ_DEBUG("MTU probe of %hu bytes lost", ds->ds_probed_size);
         ds->ds_flags &= ~DS_PROBE_SENT;
         conn->ifc_mflags |= MF_CHECK_MTU_PROBE;
+        /* The saved size gets one try: after that, search as usual */
+        ds->ds_cached_size = 0;
         if (ds->ds_probe_count >= 3)
         {
             LSQ_DEBUG("MTU probe of %hu bytes lost after %hhu tries",
@@ -8087,7 +8179,11 @@ check_or_schedule_mtu_probe (struct ietf_full_conn *conn, lsquic_time_t now)
         cpath->cop_path.np_pack_size, mtu_ceiling,
         (float) cpath->cop_path.np_pack_size / (float) mtu_ceiling);
 
-    if (!ds->ds_failed_size && mtu_ceiling < 1500)
+    if (ds->ds_cached_size > cpath->cop_path.np_pack_size
+                                        && ds->ds_cached_size <= mtu_ceiling)
+        /* Got through on an earlier connection to this destination */
+        probe_sz = ds->ds_cached_size;
+    else if (!ds->ds_failed_size && mtu_ceiling < 1500)
         /* Try the largest ethernet MTU immediately */
         probe_sz = mtu_ceiling;
     else if (cpath->cop_path.np_pack_size * 2 >= mtu_ceiling)
@@ -8450,6 +8546,10 @@ ietf_full_conn_ci_tick (struct lsquic_conn *lconn, lsquic_time_t now)
         CLOSE_IF_NECESSARY();
     }
 
+    if ((conn->ifc_mflags & (MF_MEM_DELAY_BIDI|MF_MEM_DELAY_UNI))
+                && conn->ifc_enpub->enp_mem_level < MEM_NO_STREAMS)
+        resume_peer_streams_credit(conn);
+
     if (conn->ifc_send_flags & SEND_WITH_FUNCS)
     {
         enum send send;
@@ -8887,6 +8987,8 @@ ietf_full_conn_ci_record_addrs (struct lsquic_conn *lconn, void *peer_ctx,
             /* First path is considered valid immediately */
             first_unused->cop_flags |= COP_VALIDATED;
             maybe_enable_spin(conn, first_unused);
+            if (conn->ifc_settings->es_path_cache_ttl)
+                maybe_resume_path_state(conn);
         }
         LSQ_DEBUG("record new path ID %d",
                                     (int) (first_unused - conn->ifc_paths));
@@ -0,0 +1,109 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_gso.c -- UDP segmentation offload.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lsquic.h"
+#include "lsquic_gso.h"
+
+
+/* Combine consecutive datagrams of the same connection that go out using
+ * the same path into a single spec suitable for UDP GSO.  All segments
+ * must be of the same size, except for the last one, which may be smaller.
+ * Coalesced datagrams (specs with more than one packet) are never combined.
+ * Neither are datagrams before `unmerged_end': see send_batch().
+ *
+ * The kernel sends all segments at the spec's departure time, so only
+ * datagrams with the same departure time are combined.  Otherwise, with
+ * es_txtime on, up to MAX_GSO_SEGS packets would leave in a single burst.
+ */
+unsigned
+lsquic_gso_combine (const struct lsquic_out_spec *outs,
+            struct lsquic_conn *const *conns, unsigned first,
+            unsigned n_to_send, unsigned unmerged_end,
+            struct lsquic_out_spec *gso_outs, unsigned *gso_idx)
+{
+    struct lsquic_out_spec *gso;
+    const struct lsquic_out_spec *out;
+    unsigned i, n, n_segs;
+    size_t seg_sz, total;
+    int is_open;
+
+    n = 0;
+    gso = NULL;
+    is_open = 0;
+    seg_sz = 0;
+    total = 0;
+    n_segs = 0;
+    for (i = first; i < n_to_send; ++i)
+    {
+        out = &outs[i];
+        if (is_open
+            && out->iovlen == 1
+            && n_segs < MAX_GSO_SEGS
+            && conns[i] == conns[ gso_idx[n - 1] ]
+            && out->iov == gso->iov + gso->iovlen
+            && out->local_sa == gso->local_sa
+            && out->dest_sa == gso->dest_sa
+            && out->peer_ctx == gso->peer_ctx
+            && out->ecn == gso->ecn
+            && out->txtime == gso->txtime
+            && out->iov[0].iov_len <= seg_sz
+            && total + out->iov[0].iov_len <= MAX_GSO_BYTES)
+        {
+            gso->iovlen += 1;
+            gso->gso_size = seg_sz;
+            total += out->iov[0].iov_len;
+            ++n_segs;
+            /* Only the last segment may be smaller */
+            is_open = out->iov[0].iov_len == seg_sz;
+        }
+        else
+        {
+            gso = &gso_outs[n];
+            *gso = *out;
+            gso->gso_size = 0;
+            gso_idx[n] = i;
+            ++n;
+            is_open = out->iovlen == 1 && i >= unmerged_end;
+            seg_sz = out->iov[0].iov_len;
+            total = seg_sz;
+            n_segs = 1;
+        }
+    }
+
+    return n;
+}
+
+
+/* A GRO buffer is a sequence of UDP datagrams of `gso_size' bytes each,
+ * except for the last one, which may be smaller.  Each segment is passed
+ * on in place, without copying.
+ */
+int
+lsquic_gro_packets_in (const struct lsquic_in_spec *spec,
+                                    gro_packet_in_f packet_in, void *ctx)
+{
+    const unsigned char *p, *const end = spec->buf + spec->bufsz;
+    size_t seg_sz;
+    unsigned n_zeroes;
+    int s;
+
+    n_zeroes = 0;
+    s = 1;
+    for (p = spec->buf; p < end; p += seg_sz)
+    {
+        seg_sz = spec->gso_size;
+        if (seg_sz > (size_t) (end - p))
+            seg_sz = end - p;
+        s = packet_in(ctx, p, seg_sz, spec);
+        if (s < 0)
+            return -1;
+        n_zeroes += s == 0;
+    }
+
+    return n_zeroes > 0 ? 0 : s;
+}
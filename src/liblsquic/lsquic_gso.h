@@ -0,0 +1,45 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_gso.h -- UDP segmentation offload.
+ *
+ * On the way out, consecutive datagrams are combined into a single
+ * lsquic_out_spec, which the kernel splits back into datagrams (GSO).  On
+ * the way in, a buffer the kernel filled with several datagrams (GRO) is
+ * split into datagrams.
+ */
+
+#ifndef LSQUIC_GSO_H
+#define LSQUIC_GSO_H 1
+
+struct lsquic_conn;
+struct lsquic_in_spec;
+struct lsquic_out_spec;
+
+/* Limits imposed by the kernel on UDP GSO sends */
+#define MAX_GSO_SEGS 64
+#define MAX_GSO_BYTES (UINT16_MAX - 8 /* UDP header */ - 40 /* IPv6 header */)
+
+/* Combine consecutive elements of `outs' in [first, n_to_send) into
+ * `gso_outs'.  See the comment in lsquic_gso.c for the rules.  `gso_idx'
+ * maps each element of `gso_outs' to its first element in `outs'.
+ *
+ * Returns number of elements placed into `gso_outs'.
+ */
+unsigned
+lsquic_gso_combine (const struct lsquic_out_spec *outs,
+            struct lsquic_conn *const *conns, unsigned first,
+            unsigned n_to_send, unsigned unmerged_end,
+            struct lsquic_out_spec *gso_outs, unsigned *gso_idx);
+
+typedef int (*gro_packet_in_f)(void *ctx, const unsigned char *buf,
+                            size_t bufsz, const struct lsquic_in_spec *);
+
+/* Call `packet_in' for each datagram in GRO buffer `spec'.  The return
+ * value follows that of lsquic_engine_packet_in(): -1 if `packet_in'
+ * failed, 0 if at least one datagram was processed, and 1 otherwise.
+ */
+int
+lsquic_gro_packets_in (const struct lsquic_in_spec *spec,
+                                    gro_packet_in_f packet_in, void *ctx);
+
+#endif
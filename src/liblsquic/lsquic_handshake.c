@@ -4063,7 +4063,7 @@ gquic2_esf_encrypt_packet (enc_session_t *enc_session_p,
     }
     assert(out_sz == dst_sz - header_sz);
 
-    if (!packet_out->po_nonce)
+    if (!lsquic_packet_out_nonce(packet_out))
         divers_nonce_len = 0;
     else
     {
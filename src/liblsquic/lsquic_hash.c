@@ -1,6 +1,13 @@
 /* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
 /*
  * lsquic_hash.c
+ *
+ * When the hash grows, the number of buckets doubles.  To avoid stalls
+ * when there are many elements, they are not all moved at once: the old
+ * bucket array is kept until every old bucket has been migrated.  Each
+ * insertion and lookup migrates up to MIGRATE_BUCKETS buckets.  Buckets
+ * in the old array with index smaller than qh_migrate_idx have been
+ * migrated already; the rest are still in use.
  */
 
 #include <assert.h>
@@ -20,15 +27,19 @@ TAILQ_HEAD(hels_head, lsquic_hash_elem);
 #define N_BUCKETS(n_bits) (1U << (n_bits))
 #define BUCKNO(n_bits, hash) ((hash) & (N_BUCKETS(n_bits) - 1))
 
+#define MIGRATE_BUCKETS 4
+
 struct lsquic_hash
 {
     struct hels_head        *qh_buckets,
+                            *qh_old_buckets,    /* Non-NULL when migrating */
                              qh_all;
     struct lsquic_hash_elem *qh_iter_next;
     int                    (*qh_cmp)(const void *, const void *, size_t);
     unsigned               (*qh_hash)(const void *, size_t, unsigned seed);
     unsigned                 qh_count;
     unsigned                 qh_nbits;
+    unsigned                 qh_migrate_idx;
 };
 
 
@@ -59,7 +70,9 @@ lsquic_hash_create_ext (int (*cmp)(const void *, const void *, size_t),
     hash->qh_cmp       = cmp;
     hash->qh_hash      = hashf;
     hash->qh_buckets   = buckets;
+    hash->qh_old_buckets = NULL;
     hash->qh_nbits     = nbits;
+    hash->qh_migrate_idx = 0;
     hash->qh_iter_next = NULL;
     hash->qh_count     = 0;
     return hash;
@@ -77,17 +90,63 @@ void
 lsquic_hash_destroy (struct lsquic_hash *hash)
 {
     free(hash->qh_buckets);
+    free(hash->qh_old_buckets);
     free(hash);
 }
 
 
+/* Move elements from old bucket `n' into the two new buckets it splits
+ * into.
+ */
+static void
+lsquic_hash_migrate_bucket (struct lsquic_hash *hash, unsigned n)
+{
+    struct hels_head *old, *new[2];
+    struct lsquic_hash_elem *el;
+    unsigned old_nbits;
+    int idx;
+
+    old_nbits = hash->qh_nbits - 1;
+    old = &hash->qh_old_buckets[n];
+    new[0] = &hash->qh_buckets[n];
+    new[1] = &hash->qh_buckets[n + N_BUCKETS(old_nbits)];
+    while ((el = TAILQ_FIRST(old)))
+    {
+        TAILQ_REMOVE(old, el, qhe_next_bucket);
+        idx = (BUCKNO(old_nbits + 1, el->qhe_hash_val) >> old_nbits) & 1;
+        TAILQ_INSERT_TAIL(new[idx], el, qhe_next_bucket);
+    }
+}
+
+
+static void
+lsquic_hash_migrate (struct lsquic_hash *hash, unsigned max_buckets)
+{
+    const unsigned n_old = N_BUCKETS(hash->qh_nbits - 1);
+
+    for ( ; max_buckets > 0 && hash->qh_migrate_idx < n_old; --max_buckets)
+        lsquic_hash_migrate_bucket(hash, hash->qh_migrate_idx++);
+
+    if (hash->qh_migrate_idx == n_old)
+    {
+        free(hash->qh_old_buckets);
+        hash->qh_old_buckets = NULL;
+    }
+}
+
+
+/* Double the number of buckets.  Elements stay in the old buckets until
+ * they are migrated.
+ */
 static int
 lsquic_hash_grow (struct lsquic_hash *hash)
 {
-    struct hels_head *new_buckets, *new[2];
-    struct lsquic_hash_elem *el;
+    struct hels_head *new_buckets;
     unsigned n, old_nbits;
-    int idx;
+
+    if (hash->qh_old_buckets)
+        /* Inserts outpaced migration: finish it now */
+        lsquic_hash_migrate(hash, ~0u);
 
     old_nbits = hash->qh_nbits;
     new_buckets = malloc(sizeof(hash->qh_buckets[0])
@@ -95,31 +154,39 @@ lsquic_hash_grow (struct lsquic_hash *hash)
     if (!new_buckets)
         return -1;
 
-    for (n = 0; n < N_BUCKETS(old_nbits); ++n)
-    {
-        new[0] = &new_buckets[n];
-        new[1] = &new_buckets[n + N_BUCKETS(old_nbits)];
-        TAILQ_INIT(new[0]);
-        TAILQ_INIT(new[1]);
-        while ((el = TAILQ_FIRST(&hash->qh_buckets[n])))
-        {
-            TAILQ_REMOVE(&hash->qh_buckets[n], el, qhe_next_bucket);
-            idx = (BUCKNO(old_nbits + 1, el->qhe_hash_val) >> old_nbits) & 1;
-            TAILQ_INSERT_TAIL(new[idx], el, qhe_next_bucket);
-        }
-    }
-    free(hash->qh_buckets);
+    for (n = 0; n < N_BUCKETS(old_nbits + 1); ++n)
+        TAILQ_INIT(&new_buckets[n]);
+
+    hash->qh_old_buckets = hash->qh_buckets;
+    hash->qh_migrate_idx = 0;
     hash->qh_nbits   = old_nbits + 1;
     hash->qh_buckets = new_buckets;
     return 0;
 }
 
 
+/* Return bucket where element with hash value `hash_val' is or should go */
+static struct hels_head *
+lsquic_hash_bucket (const struct lsquic_hash *hash, unsigned hash_val)
+{
+    unsigned buckno;
+
+    if (hash->qh_old_buckets)
+    {
+        buckno = BUCKNO(hash->qh_nbits - 1, hash_val);
+        if (buckno >= hash->qh_migrate_idx)
+            return &hash->qh_old_buckets[buckno];
+    }
+
+    return &hash->qh_buckets[BUCKNO(hash->qh_nbits, hash_val)];
+}
+
+
 struct lsquic_hash_elem *
 lsquic_hash_insert (struct lsquic_hash *hash, const void *key,
                     unsigned key_sz, void *value, struct lsquic_hash_elem *el)
 {
-    unsigned buckno, hash_val;
+    unsigned hash_val;
 
     if (el->qhe_flags & QHE_HASHED)
         return NULL;
@@ -128,10 +195,13 @@ lsquic_hash_insert (struct lsquic_hash *hash, const void *key,
                                             0 != lsquic_hash_grow(hash))
         return NULL;
 
+    if (hash->qh_old_buckets)
+        lsquic_hash_migrate(hash, MIGRATE_BUCKETS);
+
     hash_val = hash->qh_hash(key, key_sz, (uintptr_t) hash);
-    buckno = BUCKNO(hash->qh_nbits, hash_val);
     TAILQ_INSERT_TAIL(&hash->qh_all, el, qhe_next_all);
-    TAILQ_INSERT_TAIL(&hash->qh_buckets[buckno], el, qhe_next_bucket);
+    TAILQ_INSERT_TAIL(lsquic_hash_bucket(hash, hash_val), el,
+                                                            qhe_next_bucket);
     el->qhe_key_data = key;
     el->qhe_key_len  = key_sz;
     el->qhe_value    = value;
@@ -145,12 +215,14 @@ lsquic_hash_insert (struct lsquic_hash *hash, const void *key,
 struct lsquic_hash_elem *
 lsquic_hash_find (struct lsquic_hash *hash, const void *key, unsigned key_sz)
 {
-    unsigned buckno, hash_val;
+    unsigned hash_val;
     struct lsquic_hash_elem *el;
 
+    if (hash->qh_old_buckets)
+        lsquic_hash_migrate(hash, MIGRATE_BUCKETS);
+
     hash_val = hash->qh_hash(key, key_sz, (uintptr_t) hash);
-    buckno = BUCKNO(hash->qh_nbits, hash_val);
-    TAILQ_FOREACH(el, &hash->qh_buckets[buckno], qhe_next_bucket)
+    TAILQ_FOREACH(el, lsquic_hash_bucket(hash, hash_val), qhe_next_bucket)
         if (hash_val == el->qhe_hash_val &&
             key_sz   == el->qhe_key_len &&
             0 == hash->qh_cmp(key, el->qhe_key_data, key_sz))
@@ -165,13 +237,11 @@ lsquic_hash_find (struct lsquic_hash *hash, const void *key, unsigned key_sz)
 void
 lsquic_hash_erase (struct lsquic_hash *hash, struct lsquic_hash_elem *el)
 {
-    unsigned buckno;
-
     assert(el->qhe_flags & QHE_HASHED);
-    buckno = BUCKNO(hash->qh_nbits, el->qhe_hash_val);
     if (hash->qh_iter_next == el)
         hash->qh_iter_next = TAILQ_NEXT(el, qhe_next_all);
-    TAILQ_REMOVE(&hash->qh_buckets[buckno], el, qhe_next_bucket);
+    TAILQ_REMOVE(lsquic_hash_bucket(hash, el->qhe_hash_val), el,
+                                                            qhe_next_bucket);
     TAILQ_REMOVE(&hash->qh_all, el, qhe_next_all);
     el->qhe_flags &= ~QHE_HASHED;
     --hash->qh_count;
@@ -214,6 +284,11 @@ lsquic_hash_count (struct lsquic_hash *hash)
 size_t
 lsquic_hash_mem_used (const struct lsquic_hash *hash)
 {
-    return sizeof(*hash)
+    size_t size;
+
+    size = sizeof(*hash)
          + N_BUCKETS(hash->qh_nbits) * sizeof(hash->qh_buckets[0]);
+    if (hash->qh_old_buckets)
+        size += N_BUCKETS(hash->qh_nbits - 1) * sizeof(hash->qh_buckets[0]);
+    return size;
 }
@@ -97,6 +97,8 @@ enum lsq_log_level lsq_log_levels[N_LSQUIC_LOGGER_MODULES] = {
     [LSQLM_BW_SAMPLER]  = LSQ_LOG_WARN,
     [LSQLM_PACKET_RESIZE] = LSQ_LOG_WARN,
     [LSQLM_CONN_STATS]  = LSQ_LOG_WARN,
+    [LSQLM_BBR2]        = LSQ_LOG_WARN,
+    [LSQLM_PRAGUE]      = LSQ_LOG_WARN,
 };
 
 const char *const lsqlm_to_str[N_LSQUIC_LOGGER_MODULES] = {
@@ -142,6 +144,8 @@ const char *const lsqlm_to_str[N_LSQUIC_LOGGER_MODULES] = {
     [LSQLM_BW_SAMPLER]  = "bw-sampler",
     [LSQLM_PACKET_RESIZE] = "packet-resize",
     [LSQLM_CONN_STATS]  = "conn-stats",
+    [LSQLM_BBR2]        = "bbr2",
+    [LSQLM_PRAGUE]      = "prague",
 };
 
 const char *const lsq_loglevel2str[N_LSQUIC_LOG_LEVELS] = {
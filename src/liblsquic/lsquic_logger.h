@@ -90,6 +90,8 @@ enum lsquic_logger_module {
     LSQLM_BW_SAMPLER,
     LSQLM_PACKET_RESIZE,
     LSQLM_CONN_STATS,
+    LSQLM_BBR2,
+    LSQLM_PRAGUE,
     N_LSQUIC_LOGGER_MODULES
 };
 
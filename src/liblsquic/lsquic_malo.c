@@ -38,6 +38,9 @@
  *  2. 4 KB pages are not freed until the malo allocator is destroyed.
  *     This is something to keep in mind.
  *
+ * The pages come from posix_memalign() or, if one is specified, from
+ * the page provider.
+ *
  * P.S. In Russian, "malo" (мало) means "little" or "few".  Thus, the
  *      malo allocator aims to perform its job in as few CPU cycles as
  *      possible.
@@ -54,6 +57,7 @@
 #endif
 
 #include "fiu-local.h"
+#include "lsquic.h"
 #include "lsquic_malo.h"
 
 #ifndef LSQUIC_USE_POOLS
@@ -103,6 +107,10 @@ struct malo {
 #if LSQUIC_USE_POOLS
     struct malo_page        page_header;
     SLIST_HEAD(, malo_page) all_pages;
+    const struct lsquic_page_if
+                           *pgi;
+    void                   *pgi_ctx;
+    unsigned                n_pages;
     LIST_HEAD(, malo_page)  free_pages;
     struct {
         struct malo_page   *cur_page;
@@ -116,8 +124,46 @@ struct malo {
 #endif
 };
 
+#if LSQUIC_USE_POOLS
+static void *
+alloc_4k (const struct lsquic_page_if *pgi, void *pgi_ctx)
+{
+    void *page;
+
+    if (pgi)
+        return pgi->pgi_alloc(pgi_ctx, 0x1000);
+    else if (0 == posix_memalign(&page, 0x1000, 0x1000))
+        return page;
+    else
+        return NULL;
+}
+
+
+static void
+free_4k (const struct lsquic_page_if *pgi, void *pgi_ctx, void *page)
+{
+    if (pgi)
+        pgi->pgi_free(pgi_ctx, page, 0x1000);
+    else
+#ifndef WIN32
+        free(page);
+#else
+        _aligned_free(page);
+#endif
+}
+#endif
+
+
 struct malo *
 lsquic_malo_create (size_t obj_size)
+{
+    return lsquic_malo_create_pages(obj_size, NULL, NULL);
+}
+
+
+struct malo *
+lsquic_malo_create_pages (size_t obj_size, const struct lsquic_page_if *pgi,
+                                                            void *pgi_ctx)
 {
 #if LSQUIC_USE_POOLS
     int pow, n_slots;
@@ -137,10 +183,14 @@ lsquic_malo_create (size_t obj_size)
           || (float) obj_size / (1 << nbits) > ROUNDUP_THRESH;
 
     struct malo *malo;
-    if (0 != posix_memalign((void **) &malo, 0x1000, 0x1000))
+    malo = alloc_4k(pgi, pgi_ctx);
+    if (!malo)
         return NULL;
 
     SLIST_INIT(&malo->all_pages);
+    malo->pgi = pgi;
+    malo->pgi_ctx = pgi_ctx;
+    malo->n_pages = 1;
     LIST_INIT(&malo->free_pages);
     malo->iter.cur_page = &malo->page_header;
     malo->iter.next_slot = 0;
@@ -196,7 +246,8 @@ static struct malo_page *
 allocate_page (struct malo *malo)
 {
     struct malo_page *page;
-    if (0 != posix_memalign((void **) &page, 0x1000, 0x1000))
+    page = alloc_4k(malo->pgi, malo->pgi_ctx);
+    if (!page)
         return NULL;
     SLIST_INSERT_HEAD(&malo->all_pages, page, next_page);
     LIST_INSERT_HEAD(&malo->free_pages, page, next_free_page);
@@ -206,6 +257,7 @@ allocate_page (struct malo *malo)
     page->pow = malo->page_header.pow;
     page->malo = malo;
     page->initial_slot = 1;
+    ++malo->n_pages;
     return page;
 }
 #endif
@@ -279,23 +331,17 @@ void
 lsquic_malo_destroy (struct malo *malo)
 {
 #if LSQUIC_USE_POOLS
+    const struct lsquic_page_if *const pgi = malo->pgi;
+    void *const pgi_ctx = malo->pgi_ctx;
     struct malo_page *page, *next;
     page = SLIST_FIRST(&malo->all_pages);
     while (page != &malo->page_header)
     {
         next = SLIST_NEXT(page, next_page);
-#ifndef WIN32
-        free(page);
-#else
-        _aligned_free(page);
-#endif
+        free_4k(pgi, pgi_ctx, page);
         page = next;
     }
-#ifndef WIN32
-    free(page);
-#else
-        _aligned_free(page);
-#endif
+    free_4k(pgi, pgi_ctx, page);
 #else
     struct nopool_elem *el, *next_el;
     for (el = TAILQ_FIRST(&malo->elems); el; el = next_el)
@@ -442,14 +488,7 @@ size_t
 lsquic_malo_mem_used (const struct malo *malo)
 {
 #if LSQUIC_USE_POOLS
-    const struct malo_page *page;
-    size_t size;
-
-    size = 0;
-    SLIST_FOREACH(page, &malo->all_pages, next_page)
-        size += sizeof(*page);
-
-    return size;
+    return (size_t) malo->n_pages * 0x1000;
 #else
     return 0;
 #endif
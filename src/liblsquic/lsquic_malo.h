@@ -11,11 +11,19 @@
 #endif
 
 struct malo;
+struct lsquic_page_if;
 
 /* Create a malo allocator for objects of size `obj_size'. */
 struct malo *
 lsquic_malo_create (size_t obj_size);
 
+/* Same as lsquic_malo_create(), but 4 KB pages are obtained from the page
+ * provider `pgi'.  If `pgi' is NULL, posix_memalign() is used.
+ */
+struct malo *
+lsquic_malo_create_pages (size_t obj_size, const struct lsquic_page_if *pgi,
+                                                            void *pgi_ctx);
+
 /* Get a new object. */
 void *
 lsquic_malo_get (struct malo *);
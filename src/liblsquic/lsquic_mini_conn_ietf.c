@@ -13,6 +13,8 @@
 #include <sys/queue.h>
 #include <stdlib.h>
 
+#include "fiu-local.h"
+
 #include "lsquic.h"
 #include "lsquic_int_types.h"
 #include "lsquic_sizes.h"
@@ -37,6 +39,7 @@
 #include "lsquic_attq.h"
 #include "lsquic_alarmset.h"
 #include "lsquic_crand.h"
+#include "lsquic_cid_route.h"
 
 #define LSQUIC_LOGGER_MODULE LSQLM_MINI_CONN
 #define LSQUIC_LOG_CONN_ID lsquic_conn_log_cid(&conn->imc_conn)
@@ -126,6 +129,14 @@ imico_get_packet_out (struct ietf_mini_conn *conn,
         return NULL;
     }
 
+    /* Mini connection keeps retransmission state in the cold part */
+    if (!lsquic_packet_out_get_cold(&conn->imc_enpub->enp_mm, packet_out))
+    {
+        LSQ_WARN("could not allocate packet: %s", strerror(errno));
+        lsquic_packet_out_destroy(packet_out, conn->imc_enpub, NULL);
+        return NULL;
+    }
+
     packet_out->po_header_type = header_type;
     packet_out->po_packno = conn->imc_next_packno++;
     packet_out->po_flags |= PO_MINI;
@@ -601,16 +612,21 @@ lsquic_mini_conn_ietf_new (struct lsquic_engine_public *enpub,
          */
         LSQ_DEBUG("using trechist");
         conn->imc_flags |= IMC_TRECHIST;
+        fiu_do_on("mini_conn_ietf/trechist", goto trechist_alloc_failed);
         conn->imc_recvd_packnos.trechist.hist_elems
                                     = malloc(TRECHIST_SIZE * IMICO_N_PNS);
+#if FIU_ENABLE
+  trechist_alloc_failed:
+#endif
         if (!conn->imc_recvd_packnos.trechist.hist_elems)
         {
             LSQ_WARN("cannot allocate trechist elems");
-            return NULL;
+            goto err;
         }
     }
 
     esfi = select_esf_iquic_by_ver(version);
+    fiu_do_on("mini_conn_ietf/enc_sess", goto err);
     if (version > LSQVER_ID27)
         enc_sess = esfi->esfi_create_server(enpub, &conn->imc_conn,
                     &packet_in->pi_dcid, conn->imc_stream_ps, &crypto_stream_if,
@@ -622,10 +638,7 @@ lsquic_mini_conn_ietf_new (struct lsquic_engine_public *enpub,
                     &packet_in->pi_dcid, conn->imc_stream_ps, &crypto_stream_if,
                     odcid, &conn->imc_path.np_dcid, NULL);
     if (!enc_sess)
-    {
-        lsquic_malo_put(conn);
-        return NULL;
-    }
+        goto err;
 
     conn->imc_enpub = enpub;
     conn->imc_expire = packet_in->pi_received +
@@ -673,6 +686,15 @@ lsquic_mini_conn_ietf_new (struct lsquic_engine_public *enpub,
     LSQ_DEBUG("created mini connection object %p; max packet size=%hu",
                                      conn, conn->imc_path.np_pack_size);
     return &conn->imc_conn;
+
+  err:
+    /* Generating the SCID may have given the connection a route slot */
+    if (enpub->enp_cid_route)
+        lsquic_cidr_release(enpub->enp_cid_route, &conn->imc_conn);
+    if (conn->imc_flags & IMC_TRECHIST)
+        free(conn->imc_recvd_packnos.trechist.hist_elems);
+    lsquic_malo_put(conn);
+    return NULL;
 }
 
 
@@ -855,11 +877,11 @@ remove_ack_frame (struct ietf_mini_conn *conn,
         return;
 
     int l = packet_out->po_data_sz - packet_out->po_regen_sz
-            - packet_out->po_padding_sz;
+            - packet_out->po_cold->pc_padding_sz;
     memmove(packet_out->po_data ,
             packet_out->po_data + packet_out->po_regen_sz, l);
     memset(packet_out->po_data + l, 0, packet_out->po_regen_sz);
-    packet_out->po_padding_sz += packet_out->po_regen_sz;
+    packet_out->po_cold->pc_padding_sz += packet_out->po_regen_sz;
     packet_out->po_regen_sz = 0;
 }
 
@@ -926,12 +948,12 @@ ietf_mini_conn_ci_next_packet_to_send (struct lsquic_conn *lconn,
         if (packet_out->po_header_type == HETY_INITIAL)
         {
             if (packet_out->po_frame_types & (1 << QUIC_FRAME_ACK)
-                && packet_out->po_retx_cnt > 0)
+                && packet_out->po_cold->pc_retx_cnt > 0)
             {
                 remove_ack_frame(conn, packet_out);
             }
 
-            if (packet_out->po_retx_cnt > 0
+            if (packet_out->po_cold->pc_retx_cnt > 0
                 && !imico_can_send(conn, IQUIC_MAX_IPv4_PACKET_SZ))
             {
                 conn->imc_flags |= IMC_AMP_CAPPED;
@@ -1010,7 +1032,7 @@ ietf_mini_conn_ci_next_tick_time (struct lsquic_conn *lconn, unsigned *why)
         if (packet_out->po_flags & PO_SENT)
         {
             retx_time = packet_out->po_sent + (imico_calc_retx_timeout(conn)
-                                            << (packet_out->po_retx_cnt >> 1));
+                                << (packet_out->po_cold->pc_retx_cnt >> 1));
             if (retx_time < exp_time)
             {
                 *why = N_AEWS + AL_RETX_HSK;
@@ -1861,7 +1883,7 @@ imico_repackage_packet (struct ietf_mini_conn *conn,
                       "#%"PRIu64" -> #%"PRIu64, oldno, packno);
     packet_out->po_packno = packno;
     packet_out->po_flags &= ~PO_SENT;
-    ++packet_out->po_retx_cnt;
+    ++packet_out->po_cold->pc_retx_cnt;
     lsquic_packet_out_set_ecn(packet_out, imico_get_ecn(conn));
     if (packet_out->po_flags & PO_ENCRYPTED)
         imico_return_enc_data(conn, packet_out);
@@ -1893,13 +1915,14 @@ imico_handle_losses_and_have_unsent (struct ietf_mini_conn *conn,
                 if (0 == retx_to)
                     retx_to = imico_calc_retx_timeout(conn);
                 if (conn->imc_hsk_count == 0)
-                    packet_out->po_retx_cnt = 0;
+                    packet_out->po_cold->pc_retx_cnt = 0;
                 if (packet_out->po_sent
-                    + (retx_to << (packet_out->po_retx_cnt >> 1)) < now)
+                        + (retx_to << (packet_out->po_cold->pc_retx_cnt >> 1))
+                                                                        < now)
                 {
                     LSQ_DEBUG("packet %"PRIu64" has been lost (rto: %"PRIu64")",
                               packet_out->po_packno,
-                              retx_to << (packet_out->po_retx_cnt >> 1));
+                        retx_to << (packet_out->po_cold->pc_retx_cnt >> 1));
                     TAILQ_REMOVE(&conn->imc_packets_out, packet_out, po_next);
                     TAILQ_INSERT_TAIL(&lost_packets, packet_out, po_next);
                 }
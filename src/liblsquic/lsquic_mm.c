@@ -50,6 +50,9 @@
 
 #define FAIL_NOMEM do { errno = ENOMEM; return NULL; } while (0)
 
+/* When page interface is used, packet buffers are carved out of slabs */
+#define SLAB_SZ 0x10000
+
 
 struct packet_in_buf
 {
@@ -72,23 +75,94 @@ struct sixteen_k_page
 };
 
 
+#if LSQUIC_USE_POOLS
+static void *
+mm_alloc_pages (struct lsquic_mm *mm, size_t size)
+{
+    if (mm->pgi)
+        return mm->pgi->pgi_alloc(mm->pgi_ctx, size);
+    else
+        return malloc(size);
+}
+
+
+static void
+mm_free_pages (struct lsquic_mm *mm, void *mem, size_t size)
+{
+    if (mm->pgi)
+        mm->pgi->pgi_free(mm->pgi_ctx, mem, size);
+    else
+        free(mem);
+}
+
+
+/* Allocate a slab for packet buffers.  Slabs are released on cleanup. */
+static unsigned char *
+mm_alloc_slab (struct lsquic_mm *mm)
+{
+    unsigned char *slab;
+    unsigned n_alloc;
+    void **slabs;
+
+    if (mm->n_slabs >= mm->n_slabs_alloc)
+    {
+        n_alloc = mm->n_slabs_alloc ? mm->n_slabs_alloc * 2 : 16;
+        slabs = realloc(mm->slabs, n_alloc * sizeof(slabs[0]));
+        if (!slabs)
+            return NULL;
+        mm->slabs = slabs;
+        mm->n_slabs_alloc = n_alloc;
+    }
+
+    slab = mm->pgi->pgi_alloc(mm->pgi_ctx, SLAB_SZ);
+    if (slab)
+        mm->slabs[mm->n_slabs++] = slab;
+    return slab;
+}
+
+
+/* Buffers are 16-byte aligned within the slab */
+#define SLAB_STRIDE(size) (((size) + 15) & ~15u)
+#endif
+
+
 int
 lsquic_mm_init (struct lsquic_mm *mm)
+{
+    return lsquic_mm_init_pages(mm, NULL, NULL);
+}
+
+
+int
+lsquic_mm_init_pages (struct lsquic_mm *mm, const struct lsquic_page_if *pgi,
+                                                                void *pgi_ctx)
 {
 #if LSQUIC_USE_POOLS
     int i;
 #endif
 
+    mm->pgi = pgi;
+    mm->pgi_ctx = pgi_ctx;
+    mm->slabs = NULL;
+    mm->n_slabs = 0;
+    mm->n_slabs_alloc = 0;
     mm->acki = malloc(sizeof(*mm->acki));
-    mm->malo.stream_frame = lsquic_malo_create(sizeof(struct stream_frame));
-    mm->malo.frame_rec_arr = lsquic_malo_create(sizeof(struct frame_rec_arr));
-    mm->malo.mini_conn = lsquic_malo_create(sizeof(struct mini_conn));
-    mm->malo.mini_conn_ietf = lsquic_malo_create(sizeof(struct ietf_mini_conn));
-    mm->malo.packet_in = lsquic_malo_create(sizeof(struct lsquic_packet_in));
-    mm->malo.packet_out = lsquic_malo_create(sizeof(struct lsquic_packet_out));
-    mm->malo.dcid_elem = lsquic_malo_create(sizeof(struct dcid_elem));
-    mm->malo.stream_hq_frame
-                        = lsquic_malo_create(sizeof(struct stream_hq_frame));
+    mm->malo.stream_frame = lsquic_mm_malo_create(mm,
+                                                sizeof(struct stream_frame));
+    mm->malo.frame_rec_arr = lsquic_mm_malo_create(mm,
+                                                sizeof(struct frame_rec_arr));
+    mm->malo.mini_conn = lsquic_mm_malo_create(mm, sizeof(struct mini_conn));
+    mm->malo.mini_conn_ietf = lsquic_mm_malo_create(mm,
+                                                sizeof(struct ietf_mini_conn));
+    mm->malo.packet_in = lsquic_mm_malo_create(mm,
+                                            sizeof(struct lsquic_packet_in));
+    mm->malo.packet_out = lsquic_mm_malo_create(mm,
+                                            sizeof(struct lsquic_packet_out));
+    mm->malo.packet_out_cold = lsquic_mm_malo_create(mm,
+                                            sizeof(struct packet_out_cold));
+    mm->malo.dcid_elem = lsquic_mm_malo_create(mm, sizeof(struct dcid_elem));
+    mm->malo.stream_hq_frame = lsquic_mm_malo_create(mm,
+                                            sizeof(struct stream_hq_frame));
     mm->ack_str = malloc(MAX_ACKI_STR_SZ);
 #if LSQUIC_USE_POOLS
     TAILQ_INIT(&mm->free_packets_in);
@@ -98,10 +172,16 @@ lsquic_mm_init (struct lsquic_mm *mm)
         SLIST_INIT(&mm->packet_in_bufs[i]);
     SLIST_INIT(&mm->four_k_pages);
     SLIST_INIT(&mm->sixteen_k_pages);
+    memset(mm->packet_out_bstats, 0, sizeof(mm->packet_out_bstats));
+    memset(mm->packet_in_bstats, 0, sizeof(mm->packet_in_bstats));
+    memset(&mm->four_k_stats, 0, sizeof(mm->four_k_stats));
+    memset(&mm->sixteen_k_stats, 0, sizeof(mm->sixteen_k_stats));
+    mm->last_trim = 0;
 #endif
     if (mm->acki && mm->malo.stream_frame && mm->malo.frame_rec_arr
         && mm->malo.mini_conn && mm->malo.mini_conn_ietf && mm->malo.packet_in
-        && mm->malo.packet_out && mm->malo.dcid_elem
+        && mm->malo.packet_out && mm->malo.packet_out_cold
+        && mm->malo.dcid_elem
         && mm->malo.stream_hq_frame && mm->ack_str)
     {
         return 0;
@@ -120,12 +200,14 @@ lsquic_mm_cleanup (struct lsquic_mm *mm)
     struct packet_in_buf *pib;
     struct four_k_page *fkp;
     struct sixteen_k_page *skp;
+    unsigned n;
 #endif
 
     free(mm->acki);
     lsquic_malo_destroy(mm->malo.stream_hq_frame);
     lsquic_malo_destroy(mm->malo.dcid_elem);
     lsquic_malo_destroy(mm->malo.packet_in);
+    lsquic_malo_destroy(mm->malo.packet_out_cold);
     lsquic_malo_destroy(mm->malo.packet_out);
     lsquic_malo_destroy(mm->malo.stream_frame);
     lsquic_malo_destroy(mm->malo.frame_rec_arr);
@@ -134,35 +216,52 @@ lsquic_mm_cleanup (struct lsquic_mm *mm)
     free(mm->ack_str);
 
 #if LSQUIC_USE_POOLS
-    for (i = 0; i < MM_N_OUT_BUCKETS; ++i)
-        while ((pob = SLIST_FIRST(&mm->packet_out_bufs[i])))
-        {
-            SLIST_REMOVE_HEAD(&mm->packet_out_bufs[i], next_pob);
-            free(pob);
-        }
-
-    for (i = 0; i < MM_N_IN_BUCKETS; ++i)
-        while ((pib = SLIST_FIRST(&mm->packet_in_bufs[i])))
-        {
-            SLIST_REMOVE_HEAD(&mm->packet_in_bufs[i], next_pib);
-            free(pib);
-        }
+    if (mm->pgi)
+    {
+        /* Packet buffers live in slabs */
+        for (n = 0; n < mm->n_slabs; ++n)
+            mm->pgi->pgi_free(mm->pgi_ctx, mm->slabs[n], SLAB_SZ);
+        free(mm->slabs);
+    }
+    else
+    {
+        for (i = 0; i < MM_N_OUT_BUCKETS; ++i)
+            while ((pob = SLIST_FIRST(&mm->packet_out_bufs[i])))
+            {
+                SLIST_REMOVE_HEAD(&mm->packet_out_bufs[i], next_pob);
+                free(pob);
+            }
+
+        for (i = 0; i < MM_N_IN_BUCKETS; ++i)
+            while ((pib = SLIST_FIRST(&mm->packet_in_bufs[i])))
+            {
+                SLIST_REMOVE_HEAD(&mm->packet_in_bufs[i], next_pib);
+                free(pib);
+            }
+    }
 
     while ((fkp = SLIST_FIRST(&mm->four_k_pages)))
     {
         SLIST_REMOVE_HEAD(&mm->four_k_pages, next_fkp);
-        free(fkp);
+        mm_free_pages(mm, fkp, 0x1000);
     }
 
     while ((skp = SLIST_FIRST(&mm->sixteen_k_pages)))
     {
         SLIST_REMOVE_HEAD(&mm->sixteen_k_pages, next_skp);
-        free(skp);
+        mm_free_pages(mm, skp, 0x4000);
     }
 #endif
 }
 
 
+struct malo *
+lsquic_mm_malo_create (struct lsquic_mm *mm, size_t obj_size)
+{
+    return lsquic_malo_create_pages(obj_size, mm->pgi, mm->pgi_ctx);
+}
+
+
 #if LSQUIC_USE_POOLS
 enum {
     PACKET_IN_PAYLOAD_0 = 1370,     /* common QUIC payload size upperbound */
@@ -339,6 +438,9 @@ maybe_shrink_packet_out_bufs (struct lsquic_mm *mm, unsigned idx)
     struct packet_out_buf *pob;
     unsigned n_to_leave;
 
+    if (mm->pgi)
+        return;     /* Buffers are released with their slabs */
+
     poolst = &mm->packet_out_bstats[idx];
     if (poolst->ps_max_avg * 4 < poolst->ps_objs_all)
     {
@@ -375,6 +477,9 @@ maybe_shrink_packet_in_bufs (struct lsquic_mm *mm, unsigned idx)
     struct packet_in_buf *pib;
     unsigned n_to_leave;
 
+    if (mm->pgi)
+        return;     /* Buffers are released with their slabs */
+
     poolst = &mm->packet_in_bstats[idx];
     if (poolst->ps_max_avg * 4 < poolst->ps_objs_all)
     {
@@ -403,44 +508,45 @@ maybe_shrink_packet_in_bufs (struct lsquic_mm *mm, unsigned idx)
 
 
 void
-lsquic_mm_put_packet_out (struct lsquic_mm *mm,
-                          struct lsquic_packet_out *packet_out)
+lsquic_mm_put_packet_out_buf (struct lsquic_mm *mm, void *buf,
+                              unsigned short n_alloc)
 {
 #if LSQUIC_USE_POOLS
     struct packet_out_buf *pob;
     unsigned idx;
 
-    assert(packet_out->po_data);
-    pob = (struct packet_out_buf *) packet_out->po_data;
-    idx = packet_out_index(packet_out->po_n_alloc);
+    assert(buf);
+    pob = buf;
+    idx = packet_out_index(n_alloc);
     SLIST_INSERT_HEAD(&mm->packet_out_bufs[idx], pob, next_pob);
     poolst_freed(&mm->packet_out_bstats[idx]);
     if (poolst_has_new_sample(&mm->packet_out_bstats[idx]))
         maybe_shrink_packet_out_bufs(mm, idx);
 #else
-    free(packet_out->po_data);
+    free(buf);
 #endif
+}
+
+
+void
+lsquic_mm_put_packet_out (struct lsquic_mm *mm,
+                          struct lsquic_packet_out *packet_out)
+{
+    assert(packet_out->po_data);
+    lsquic_mm_put_packet_out_buf(mm, packet_out->po_data,
+                                                    packet_out->po_n_alloc);
     lsquic_malo_put(packet_out);
 }
 
 
-struct lsquic_packet_out *
-lsquic_mm_get_packet_out (struct lsquic_mm *mm, struct malo *malo,
-                          unsigned short size)
+void *
+lsquic_mm_get_packet_out_buf (struct lsquic_mm *mm, unsigned short size)
 {
-    struct lsquic_packet_out *packet_out;
     struct packet_out_buf *pob;
 #if LSQUIC_USE_POOLS
-    unsigned idx;
-#endif
-
-    fiu_do_on("mm/packet_out", FAIL_NOMEM);
-
-    packet_out = lsquic_malo_get(malo ? malo : mm->malo.packet_out);
-    if (!packet_out)
-        return NULL;
+    unsigned idx, n_bufs, stride;
+    unsigned char *slab;
 
-#if LSQUIC_USE_POOLS
     idx = packet_out_index(size);
     pob = SLIST_FIRST(&mm->packet_out_bufs[idx]);
     if (pob)
@@ -448,30 +554,58 @@ lsquic_mm_get_packet_out (struct lsquic_mm *mm, struct malo *malo,
         SLIST_REMOVE_HEAD(&mm->packet_out_bufs[idx], next_pob);
         poolst_allocated(&mm->packet_out_bstats[idx], 0);
     }
+    else if (mm->pgi)
+    {
+        /* Use the first buffer, place the rest onto the free list */
+        slab = mm_alloc_slab(mm);
+        if (!slab)
+            return NULL;
+        pob = (void *) slab;
+        stride = SLAB_STRIDE(packet_out_sizes[idx]);
+        for (n_bufs = 1; (n_bufs + 1) * stride <= SLAB_SZ; ++n_bufs)
+            SLIST_INSERT_HEAD(&mm->packet_out_bufs[idx],
+                    (struct packet_out_buf *) (slab + n_bufs * stride), next_pob);
+        poolst_allocated(&mm->packet_out_bstats[idx], n_bufs);
+    }
     else
     {
         pob = malloc(packet_out_sizes[idx]);
         if (!pob)
-        {
-            lsquic_malo_put(packet_out);
             return NULL;
-        }
         poolst_allocated(&mm->packet_out_bstats[idx], 1);
     }
     if (poolst_has_new_sample(&mm->packet_out_bstats[idx]))
         maybe_shrink_packet_out_bufs(mm, idx);
 #else
     pob = malloc(size);
-    if (!pob)
+#endif
+    return pob;
+}
+
+
+struct lsquic_packet_out *
+lsquic_mm_get_packet_out (struct lsquic_mm *mm, struct malo *malo,
+                          unsigned short size)
+{
+    struct lsquic_packet_out *packet_out;
+    unsigned char *buf;
+
+    fiu_do_on("mm/packet_out", FAIL_NOMEM);
+
+    packet_out = lsquic_malo_get(malo ? malo : mm->malo.packet_out);
+    if (!packet_out)
+        return NULL;
+
+    buf = lsquic_mm_get_packet_out_buf(mm, size);
+    if (!buf)
     {
         lsquic_malo_put(packet_out);
         return NULL;
     }
-#endif
 
     memset(packet_out, 0, sizeof(*packet_out));
     packet_out->po_n_alloc = size;
-    packet_out->po_data = (unsigned char *) pob;
+    packet_out->po_data = buf;
 
     return packet_out;
 }
@@ -482,7 +616,8 @@ lsquic_mm_get_packet_in_buf (struct lsquic_mm *mm, size_t size)
 {
     struct packet_in_buf *pib;
 #if LSQUIC_USE_POOLS
-    unsigned idx;
+    unsigned idx, n_bufs, stride;
+    unsigned char *slab;
 
     idx = packet_in_index(size);
     pib = SLIST_FIRST(&mm->packet_in_bufs[idx]);
@@ -492,6 +627,19 @@ lsquic_mm_get_packet_in_buf (struct lsquic_mm *mm, size_t size)
         SLIST_REMOVE_HEAD(&mm->packet_in_bufs[idx], next_pib);
         poolst_allocated(&mm->packet_in_bstats[idx], 0);
     }
+    else if (mm->pgi)
+    {
+        /* Use the first buffer, place the rest onto the free list */
+        slab = mm_alloc_slab(mm);
+        if (!slab)
+            return NULL;
+        pib = (void *) slab;
+        stride = SLAB_STRIDE(packet_in_sizes[idx]);
+        for (n_bufs = 1; (n_bufs + 1) * stride <= SLAB_SZ; ++n_bufs)
+            SLIST_INSERT_HEAD(&mm->packet_in_bufs[idx],
+                    (struct packet_in_buf *) (slab + n_bufs * stride), next_pib);
+        poolst_allocated(&mm->packet_in_bstats[idx], n_bufs);
+    }
     else
     {
         pib = malloc(packet_in_sizes[idx]);
@@ -536,6 +684,53 @@ lsquic_mm_put_packet_in_buf (struct lsquic_mm *mm, void *mem, size_t size)
 }
 
 
+#if LSQUIC_USE_POOLS
+/* If average maximum falls under 1/4 of all pages allocated, release
+ * half of the pages allocated.
+ */
+static void
+maybe_shrink_4k (struct lsquic_mm *mm)
+{
+    struct pool_stats *const poolst = &mm->four_k_stats;
+    struct four_k_page *fkp;
+    unsigned n_to_leave;
+
+    if (poolst->ps_max_avg * 4 < poolst->ps_objs_all)
+    {
+        n_to_leave = poolst->ps_objs_all / 2;
+        while (poolst->ps_objs_all > n_to_leave
+                            && (fkp = SLIST_FIRST(&mm->four_k_pages)))
+        {
+            SLIST_REMOVE_HEAD(&mm->four_k_pages, next_fkp);
+            mm_free_pages(mm, fkp, 0x1000);
+            --poolst->ps_objs_all;
+        }
+    }
+}
+
+
+static void
+maybe_shrink_16k (struct lsquic_mm *mm)
+{
+    struct pool_stats *const poolst = &mm->sixteen_k_stats;
+    struct sixteen_k_page *skp;
+    unsigned n_to_leave;
+
+    if (poolst->ps_max_avg * 4 < poolst->ps_objs_all)
+    {
+        n_to_leave = poolst->ps_objs_all / 2;
+        while (poolst->ps_objs_all > n_to_leave
+                            && (skp = SLIST_FIRST(&mm->sixteen_k_pages)))
+        {
+            SLIST_REMOVE_HEAD(&mm->sixteen_k_pages, next_skp);
+            mm_free_pages(mm, skp, 0x4000);
+            --poolst->ps_objs_all;
+        }
+    }
+}
+#endif
+
+
 void *
 lsquic_mm_get_4k (struct lsquic_mm *mm)
 {
@@ -543,9 +738,19 @@ lsquic_mm_get_4k (struct lsquic_mm *mm)
     struct four_k_page *fkp = SLIST_FIRST(&mm->four_k_pages);
     fiu_do_on("mm/4k", FAIL_NOMEM);
     if (fkp)
+    {
         SLIST_REMOVE_HEAD(&mm->four_k_pages, next_fkp);
+        poolst_allocated(&mm->four_k_stats, 0);
+    }
     else
-        fkp = malloc(0x1000);
+    {
+        fkp = mm_alloc_pages(mm, 0x1000);
+        if (!fkp)
+            return NULL;
+        poolst_allocated(&mm->four_k_stats, 1);
+    }
+    if (poolst_has_new_sample(&mm->four_k_stats))
+        maybe_shrink_4k(mm);
     return fkp;
 #else
     return malloc(0x1000);
@@ -559,6 +764,9 @@ lsquic_mm_put_4k (struct lsquic_mm *mm, void *mem)
 #if LSQUIC_USE_POOLS
     struct four_k_page *fkp = mem;
     SLIST_INSERT_HEAD(&mm->four_k_pages, fkp, next_fkp);
+    poolst_freed(&mm->four_k_stats);
+    if (poolst_has_new_sample(&mm->four_k_stats))
+        maybe_shrink_4k(mm);
 #else
     free(mem);
 #endif
@@ -572,9 +780,19 @@ lsquic_mm_get_16k (struct lsquic_mm *mm)
     struct sixteen_k_page *skp = SLIST_FIRST(&mm->sixteen_k_pages);
     fiu_do_on("mm/16k", FAIL_NOMEM);
     if (skp)
+    {
         SLIST_REMOVE_HEAD(&mm->sixteen_k_pages, next_skp);
+        poolst_allocated(&mm->sixteen_k_stats, 0);
+    }
     else
-        skp = malloc(16 * 1024);
+    {
+        skp = mm_alloc_pages(mm, 16 * 1024);
+        if (!skp)
+            return NULL;
+        poolst_allocated(&mm->sixteen_k_stats, 1);
+    }
+    if (poolst_has_new_sample(&mm->sixteen_k_stats))
+        maybe_shrink_16k(mm);
     return skp;
 #else
     return malloc(16 * 1024);
@@ -588,45 +806,136 @@ lsquic_mm_put_16k (struct lsquic_mm *mm, void *mem)
 #if LSQUIC_USE_POOLS
     struct sixteen_k_page *skp = mem;
     SLIST_INSERT_HEAD(&mm->sixteen_k_pages, skp, next_skp);
+    poolst_freed(&mm->sixteen_k_stats);
+    if (poolst_has_new_sample(&mm->sixteen_k_stats))
+        maybe_shrink_16k(mm);
 #else
     free(mem);
 #endif
 }
 
 
+void
+lsquic_mm_trim (struct lsquic_mm *mm, lsquic_time_t now)
+{
+#if LSQUIC_USE_POOLS
+    unsigned i;
+
+    if (mm->last_trim + MM_TRIM_PERIOD > now)
+        return;
+    mm->last_trim = now;
+
+    /* A sample is normally taken every POOL_SAMPLE_PERIOD calls.  When
+     * the pool is idle, this never happens and the average maximum stays
+     * high.  An extra sample each period makes it decay.
+     */
+    for (i = 0; i < MM_N_OUT_BUCKETS; ++i)
+    {
+        poolst_sample_max(&mm->packet_out_bstats[i]);
+        maybe_shrink_packet_out_bufs(mm, i);
+    }
+    for (i = 0; i < MM_N_IN_BUCKETS; ++i)
+    {
+        poolst_sample_max(&mm->packet_in_bstats[i]);
+        maybe_shrink_packet_in_bufs(mm, i);
+    }
+    poolst_sample_max(&mm->four_k_stats);
+    maybe_shrink_4k(mm);
+    poolst_sample_max(&mm->sixteen_k_stats);
+    maybe_shrink_16k(mm);
+#endif
+}
+
+
+size_t
+lsquic_mm_shed (struct lsquic_mm *mm, size_t n_bytes)
+{
+    size_t freed = 0;
+#if LSQUIC_USE_POOLS
+    struct packet_out_buf *pob;
+    struct packet_in_buf *pib;
+    struct four_k_page *fkp;
+    struct sixteen_k_page *skp;
+    unsigned i;
+
+    /* Slab buffers cannot be released one by one */
+    if (!mm->pgi)
+    {
+        for (i = MM_N_IN_BUCKETS; i > 0 && freed < n_bytes; --i)
+            while (freed < n_bytes
+                            && (pib = SLIST_FIRST(&mm->packet_in_bufs[i - 1])))
+            {
+                SLIST_REMOVE_HEAD(&mm->packet_in_bufs[i - 1], next_pib);
+                free(pib);
+                --mm->packet_in_bstats[i - 1].ps_objs_all;
+                freed += packet_in_sizes[i - 1];
+            }
+        for (i = MM_N_OUT_BUCKETS; i > 0 && freed < n_bytes; --i)
+            while (freed < n_bytes
+                        && (pob = SLIST_FIRST(&mm->packet_out_bufs[i - 1])))
+            {
+                SLIST_REMOVE_HEAD(&mm->packet_out_bufs[i - 1], next_pob);
+                free(pob);
+                --mm->packet_out_bstats[i - 1].ps_objs_all;
+                freed += packet_out_sizes[i - 1];
+            }
+    }
+
+    while (freed < n_bytes && (skp = SLIST_FIRST(&mm->sixteen_k_pages)))
+    {
+        SLIST_REMOVE_HEAD(&mm->sixteen_k_pages, next_skp);
+        mm_free_pages(mm, skp, 0x4000);
+        --mm->sixteen_k_stats.ps_objs_all;
+        freed += 0x4000;
+    }
+
+    while (freed < n_bytes && (fkp = SLIST_FIRST(&mm->four_k_pages)))
+    {
+        SLIST_REMOVE_HEAD(&mm->four_k_pages, next_fkp);
+        mm_free_pages(mm, fkp, 0x1000);
+        --mm->four_k_stats.ps_objs_all;
+        freed += 0x1000;
+    }
+#endif
+    return freed;
+}
+
+
 size_t
 lsquic_mm_mem_used (const struct lsquic_mm *mm)
 {
 #if LSQUIC_USE_POOLS
-    const struct packet_out_buf *pob;
-    const struct packet_in_buf *pib;
-    const struct four_k_page *fkp;
-    const struct sixteen_k_page *skp;
     unsigned i;
     size_t size;
 
     size = sizeof(*mm);
     size += sizeof(*mm->acki);
+    size += MAX_ACKI_STR_SZ;
     size += lsquic_malo_mem_used(mm->malo.stream_frame);
     size += lsquic_malo_mem_used(mm->malo.frame_rec_arr);
     size += lsquic_malo_mem_used(mm->malo.mini_conn);
     size += lsquic_malo_mem_used(mm->malo.mini_conn_ietf);
     size += lsquic_malo_mem_used(mm->malo.packet_in);
     size += lsquic_malo_mem_used(mm->malo.packet_out);
+    size += lsquic_malo_mem_used(mm->malo.packet_out_cold);
+    size += lsquic_malo_mem_used(mm->malo.dcid_elem);
+    size += lsquic_malo_mem_used(mm->malo.stream_hq_frame);
 
-    for (i = 0; i < MM_N_OUT_BUCKETS; ++i)
-        SLIST_FOREACH(pob, &mm->packet_out_bufs[i], next_pob)
-            size += packet_out_sizes[i];
-
-    for (i = 0; i < MM_N_IN_BUCKETS; ++i)
-        SLIST_FOREACH(pib, &mm->packet_in_bufs[i], next_pib)
-            size += packet_in_sizes[i];
-
-    SLIST_FOREACH(fkp, &mm->four_k_pages, next_fkp)
-        size += 0x1000;
+    if (mm->pgi)
+        size += (size_t) mm->n_slabs * SLAB_SZ
+              + mm->n_slabs_alloc * sizeof(mm->slabs[0]);
+    else
+    {
+        for (i = 0; i < MM_N_OUT_BUCKETS; ++i)
+            size += (size_t) mm->packet_out_bstats[i].ps_objs_all
+                                                    * packet_out_sizes[i];
+        for (i = 0; i < MM_N_IN_BUCKETS; ++i)
+            size += (size_t) mm->packet_in_bstats[i].ps_objs_all
+                                                    * packet_in_sizes[i];
+    }
 
-    SLIST_FOREACH(skp, &mm->sixteen_k_pages, next_skp)
-        size += 0x4000;
+    size += (size_t) mm->four_k_stats.ps_objs_all * 0x1000;
+    size += (size_t) mm->sixteen_k_stats.ps_objs_all * 0x4000;
 
     return size;
 #else
@@ -9,12 +9,15 @@
 #ifndef LSQUIC_MM_H
 #define LSQUIC_MM_H 1
 
+#include "lsquic_int_types.h"
+
 struct lsquic_engine_public;
 struct lsquic_packet_in;
 struct lsquic_packet_out;
 struct ack_info;
 struct malo;
 struct mini_conn;
+struct lsquic_page_if;
 
 struct pool_stats
 {
@@ -38,6 +41,7 @@ struct lsquic_mm {
         struct malo     *mini_conn_ietf;/* For struct ietf_mini_conn */
         struct malo     *packet_in;     /* For struct lsquic_packet_in */
         struct malo     *packet_out;    /* For struct lsquic_packet_out */
+        struct malo     *packet_out_cold;   /* For struct packet_out_cold */
         struct malo     *dcid_elem;     /* For struct dcid_elem */
         struct malo     *stream_hq_frame;   /* For struct stream_hq_frame */
     }                    malo;
@@ -48,12 +52,26 @@ struct lsquic_mm {
     SLIST_HEAD(, packet_in_buf)     packet_in_bufs[MM_N_IN_BUCKETS];
     SLIST_HEAD(, four_k_page)       four_k_pages;
     SLIST_HEAD(, sixteen_k_page)    sixteen_k_pages;
+    struct pool_stats               four_k_stats;
+    struct pool_stats               sixteen_k_stats;
+    lsquic_time_t                   last_trim;
     char                *ack_str;
+    /* If page interface is set, all memory comes from it.  Packet buffers
+     * are carved out of slabs, which are only released on cleanup.
+     */
+    const struct lsquic_page_if    *pgi;
+    void                           *pgi_ctx;
+    void                          **slabs;
+    unsigned                        n_slabs, n_slabs_alloc;
 };
 
 int
 lsquic_mm_init (struct lsquic_mm *);
 
+int
+lsquic_mm_init_pages (struct lsquic_mm *, const struct lsquic_page_if *,
+                                                            void *pgi_ctx);
+
 void
 lsquic_mm_cleanup (struct lsquic_mm *);
 
@@ -76,6 +94,13 @@ lsquic_mm_get_packet_out (struct lsquic_mm *, struct malo *,
 void
 lsquic_mm_put_packet_out (struct lsquic_mm *, struct lsquic_packet_out *);
 
+void *
+lsquic_mm_get_packet_out_buf (struct lsquic_mm *, unsigned short size);
+
+void
+lsquic_mm_put_packet_out_buf (struct lsquic_mm *, void *,
+                                                unsigned short n_alloc);
+
 void *
 lsquic_mm_get_packet_in_buf (struct lsquic_mm *, size_t);
 
@@ -94,7 +119,30 @@ lsquic_mm_get_16k (struct lsquic_mm *);
 void
 lsquic_mm_put_16k (struct lsquic_mm *, void *);
 
+/* Return number of bytes owned by the memory manager: objects in use as
+ * well as those cached for reuse.
+ */
 size_t
 lsquic_mm_mem_used (const struct lsquic_mm *mm);
 
+/* Take a time-based sample of pool statistics and release cached objects
+ * that have not been needed lately.  This lets the pools shrink after a
+ * traffic burst even if they are not used afterwards.  It is safe to call
+ * this function often: it does work at most once per MM_TRIM_PERIOD.
+ */
+void
+lsquic_mm_trim (struct lsquic_mm *, lsquic_time_t now);
+
+#define MM_TRIM_PERIOD 1000000  /* Microseconds */
+
+/* Release up to `n_bytes' of cached objects, largest first.  Returns the
+ * number of bytes released, which may be slightly larger than `n_bytes'.
+ */
+size_t
+lsquic_mm_shed (struct lsquic_mm *, size_t n_bytes);
+
+/* Create malo allocator that uses the same pages as the memory manager */
+struct malo *
+lsquic_mm_malo_create (struct lsquic_mm *, size_t obj_size);
+
 #endif
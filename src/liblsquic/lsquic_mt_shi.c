@@ -0,0 +1,362 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_mt_shi.c -- Shared hash interface implementation that can be
+ * shared by engines running in different threads.
+ *
+ * Elements are spread over shards by key hash.  Each shard has its own
+ * lock, hash, and expiry wheel, so that threads working with different
+ * keys rarely contend.
+ *
+ * The expiry wheel has one slot per second.  An element whose expiry is
+ * E is placed into slot E modulo the number of slots.  As the clock
+ * advances, the slots that correspond to the seconds that have passed are
+ * swept.  Elements that expire further out than the wheel covers stay in
+ * their slot until the wheel comes around again.  Lookups check expiry
+ * themselves, so the wheel only reclaims memory and never affects results.
+ *
+ * Lookup returns a pointer into the element.  Another thread may delete
+ * the element right after the lookup, so elements that are deleted or
+ * expire are not freed right away: they are put on the shard's graveyard
+ * and freed MT_SHI_GRACE seconds later.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <time.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "lsquic.h"
+#include "lsquic_hash.h"
+#include "lsquic_xxhash.h"
+
+#ifdef WIN32
+#define shard_lock_init(l_) (InitializeCriticalSection(l_), 0)
+#define shard_lock_destroy(l_) DeleteCriticalSection(l_)
+#define shard_lock(l_) EnterCriticalSection(l_)
+#define shard_unlock(l_) LeaveCriticalSection(l_)
+typedef CRITICAL_SECTION shard_lock_t;
+#else
+#define shard_lock_init(l_) pthread_mutex_init(l_, NULL)
+#define shard_lock_destroy(l_) pthread_mutex_destroy(l_)
+#define shard_lock(l_) pthread_mutex_lock(l_)
+#define shard_unlock(l_) pthread_mutex_unlock(l_)
+typedef pthread_mutex_t shard_lock_t;
+#endif
+
+#define N_WHEEL_SLOTS 64
+
+/* Number of seconds elements stay allocated after they are deleted */
+#define MT_SHI_GRACE 60
+
+#define MAX_SHARDS 1024
+
+#define SHARD_SEED 0x3DA6A17Eu
+
+
+struct mt_shi_elem
+{
+    struct lsquic_hash_elem     mse_hash_elem;
+    TAILQ_ENTRY(mt_shi_elem)    mse_next;       /* Wheel slot or graveyard */
+    time_t                      mse_expiry;     /* If not 0, element is on
+                                                 * the wheel.
+                                                 */
+    time_t                      mse_free_time;  /* Set when in graveyard */
+    unsigned                    mse_key_sz;
+    unsigned                    mse_data_sz;
+    /* Key, NUL byte, and data follow */
+    unsigned char               mse_buf[0];
+};
+
+TAILQ_HEAD(mt_shi_elems, mt_shi_elem);
+
+
+struct mt_shi_shard
+{
+    shard_lock_t                mss_lock;
+    struct lsquic_hash         *mss_hash;
+    struct mt_shi_elems         mss_wheel[N_WHEEL_SLOTS];
+    struct mt_shi_elems         mss_graveyard;
+    time_t                      mss_next_tick;  /* Next second to sweep */
+};
+
+
+struct lsquic_mt_shi
+{
+    unsigned                    msh_n_shards;   /* Power of two */
+    struct mt_shi_shard        *msh_shards;
+};
+
+
+#define ELEM_DATA(el_) (&(el_)->mse_buf[(el_)->mse_key_sz + 1])
+
+
+static void
+mt_shi_bury (struct mt_shi_shard *shard, struct mt_shi_elem *el, time_t now)
+{
+    lsquic_hash_erase(shard->mss_hash, &el->mse_hash_elem);
+    if (el->mse_expiry)
+        TAILQ_REMOVE(&shard->mss_wheel[el->mse_expiry % N_WHEEL_SLOTS], el,
+                                                                    mse_next);
+    el->mse_free_time = now + MT_SHI_GRACE;
+    TAILQ_INSERT_TAIL(&shard->mss_graveyard, el, mse_next);
+}
+
+
+/* Sweep wheel slots for the seconds that have passed and free elements
+ * whose grace period is over.
+ */
+static void
+mt_shi_tick (struct mt_shi_shard *shard, time_t now)
+{
+    struct mt_shi_elem *el, *next;
+    struct mt_shi_elems *slot;
+    unsigned n;
+
+    for (n = 0; shard->mss_next_tick < now && n < N_WHEEL_SLOTS; ++n)
+    {
+        slot = &shard->mss_wheel[shard->mss_next_tick % N_WHEEL_SLOTS];
+        for (el = TAILQ_FIRST(slot); el; el = next)
+        {
+            next = TAILQ_NEXT(el, mse_next);
+            if (el->mse_expiry < now)
+                mt_shi_bury(shard, el, now);
+        }
+        ++shard->mss_next_tick;
+    }
+    if (shard->mss_next_tick < now)
+        shard->mss_next_tick = now;
+
+    while ((el = TAILQ_FIRST(&shard->mss_graveyard))
+                                            && el->mse_free_time <= now)
+    {
+        TAILQ_REMOVE(&shard->mss_graveyard, el, mse_next);
+        free(el);
+    }
+}
+
+
+static struct mt_shi_shard *
+mt_shi_get_shard (struct lsquic_mt_shi *shi, const void *key, unsigned key_sz)
+{
+    unsigned idx;
+
+    if (shi->msh_n_shards > 1)
+        idx = XXH32(key, key_sz, SHARD_SEED) & (shi->msh_n_shards - 1);
+    else
+        idx = 0;
+    return &shi->msh_shards[idx];
+}
+
+
+/* Returns element if found and not expired.  Expired element is buried. */
+static struct mt_shi_elem *
+mt_shi_find (struct mt_shi_shard *shard, const void *key, unsigned key_sz,
+                                                                time_t now)
+{
+    struct lsquic_hash_elem *hash_el;
+    struct mt_shi_elem *el;
+
+    hash_el = lsquic_hash_find(shard->mss_hash, key, key_sz);
+    if (!hash_el)
+        return NULL;
+
+    el = lsquic_hashelem_getdata(hash_el);
+    if (el->mse_expiry && el->mse_expiry < now)
+    {
+        mt_shi_bury(shard, el, now);
+        return NULL;
+    }
+
+    return el;
+}
+
+
+static int
+mt_shi_insert (void *shi_ctx, void *key, unsigned key_sz,
+                  void *data, unsigned data_sz, time_t expiry)
+{
+    struct lsquic_mt_shi *const shi = shi_ctx;
+    struct mt_shi_shard *shard;
+    struct mt_shi_elem *el;
+    time_t now;
+
+    el = malloc(sizeof(*el) + key_sz + 1 + data_sz);
+    if (!el)
+        return -1;
+
+    memset(&el->mse_hash_elem, 0, sizeof(el->mse_hash_elem));
+    el->mse_expiry = expiry;
+    el->mse_key_sz = key_sz;
+    el->mse_data_sz = data_sz;
+    memcpy(el->mse_buf, key, key_sz);
+    el->mse_buf[key_sz] = 0;
+    memcpy(ELEM_DATA(el), data, data_sz);
+
+    now = time(NULL);
+    shard = mt_shi_get_shard(shi, key, key_sz);
+    shard_lock(&shard->mss_lock);
+    mt_shi_tick(shard, now);
+    if (!mt_shi_find(shard, key, key_sz, now)
+            && lsquic_hash_insert(shard->mss_hash, el->mse_buf, key_sz, el,
+                                                        &el->mse_hash_elem))
+    {
+        if (expiry)
+            TAILQ_INSERT_TAIL(&shard->mss_wheel[expiry % N_WHEEL_SLOTS], el,
+                                                                    mse_next);
+        shard_unlock(&shard->mss_lock);
+        return 0;
+    }
+    else
+    {
+        shard_unlock(&shard->mss_lock);
+        free(el);
+        return -1;
+    }
+}
+
+
+static int
+mt_shi_lookup (void *shi_ctx, const void *key, unsigned key_sz,
+                                  void **data, unsigned *data_sz)
+{
+    struct lsquic_mt_shi *const shi = shi_ctx;
+    struct mt_shi_shard *shard;
+    struct mt_shi_elem *el;
+    time_t now;
+
+    now = time(NULL);
+    shard = mt_shi_get_shard(shi, key, key_sz);
+    shard_lock(&shard->mss_lock);
+    mt_shi_tick(shard, now);
+    el = mt_shi_find(shard, key, key_sz, now);
+    if (el)
+    {
+        *data    = ELEM_DATA(el);
+        *data_sz = el->mse_data_sz;
+    }
+    shard_unlock(&shard->mss_lock);
+
+    return el != NULL;
+}
+
+
+static int
+mt_shi_delete (void *shi_ctx, const void *key, unsigned key_sz)
+{
+    struct lsquic_mt_shi *const shi = shi_ctx;
+    struct mt_shi_shard *shard;
+    struct mt_shi_elem *el;
+    time_t now;
+
+    now = time(NULL);
+    shard = mt_shi_get_shard(shi, key, key_sz);
+    shard_lock(&shard->mss_lock);
+    mt_shi_tick(shard, now);
+    el = mt_shi_find(shard, key, key_sz, now);
+    if (el)
+        mt_shi_bury(shard, el, now);
+    shard_unlock(&shard->mss_lock);
+
+    return el ? 0 : -1;
+}
+
+
+const struct lsquic_shared_hash_if lsquic_mt_shi =
+{
+    .shi_insert = mt_shi_insert,
+    .shi_delete = mt_shi_delete,
+    .shi_lookup = mt_shi_lookup,
+};
+
+
+static void
+mt_shi_shard_cleanup (struct mt_shi_shard *shard)
+{
+    struct lsquic_hash_elem *hash_el;
+    struct mt_shi_elem *el;
+
+    while ((hash_el = lsquic_hash_first(shard->mss_hash)))
+    {
+        el = lsquic_hashelem_getdata(hash_el);
+        lsquic_hash_erase(shard->mss_hash, hash_el);
+        free(el);
+    }
+    while ((el = TAILQ_FIRST(&shard->mss_graveyard)))
+    {
+        TAILQ_REMOVE(&shard->mss_graveyard, el, mse_next);
+        free(el);
+    }
+    lsquic_hash_destroy(shard->mss_hash);
+    shard_lock_destroy(&shard->mss_lock);
+}
+
+
+struct lsquic_mt_shi *
+lsquic_mt_shi_new (unsigned n_shards)
+{
+    struct lsquic_mt_shi *shi;
+    struct mt_shi_shard *shard;
+    unsigned n, i;
+
+    if (n_shards == 0 || n_shards > MAX_SHARDS)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    for (n = 1; n < n_shards; n <<= 1)
+        ;
+
+    shi = malloc(sizeof(*shi));
+    if (!shi)
+        return NULL;
+    shi->msh_shards = calloc(n, sizeof(shi->msh_shards[0]));
+    if (!shi->msh_shards)
+    {
+        free(shi);
+        return NULL;
+    }
+
+    for (shi->msh_n_shards = 0; shi->msh_n_shards < n; ++shi->msh_n_shards)
+    {
+        shard = &shi->msh_shards[shi->msh_n_shards];
+        shard->mss_hash = lsquic_hash_create();
+        if (!shard->mss_hash)
+            goto err;
+        if (0 != shard_lock_init(&shard->mss_lock))
+        {
+            lsquic_hash_destroy(shard->mss_hash);
+            goto err;
+        }
+        for (i = 0; i < N_WHEEL_SLOTS; ++i)
+            TAILQ_INIT(&shard->mss_wheel[i]);
+        TAILQ_INIT(&shard->mss_graveyard);
+        shard->mss_next_tick = time(NULL);
+    }
+
+    return shi;
+
+  err:
+    lsquic_mt_shi_destroy(shi);
+    return NULL;
+}
+
+
+void
+lsquic_mt_shi_destroy (struct lsquic_mt_shi *shi)
+{
+    unsigned n;
+
+    for (n = 0; n < shi->msh_n_shards; ++n)
+        mt_shi_shard_cleanup(&shi->msh_shards[n]);
+    free(shi->msh_shards);
+    free(shi);
+}
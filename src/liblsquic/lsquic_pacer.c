@@ -26,12 +26,13 @@
 
 void
 lsquic_pacer_init (struct pacer *pacer, const struct lsquic_conn *conn,
-                                                unsigned clock_granularity)
+                                unsigned clock_granularity, unsigned horizon)
 {
     memset(pacer, 0, sizeof(*pacer));
     pacer->pa_burst_tokens = 10;
     pacer->pa_conn = conn;
     pacer->pa_clock_granularity = clock_granularity;
+    pacer->pa_horizon = horizon;
 }
 
 
@@ -44,11 +45,11 @@ lsquic_pacer_cleanup (struct pacer *pacer)
 }
 
 
-void
+lsquic_time_t
 lsquic_pacer_packet_scheduled (struct pacer *pacer, unsigned n_in_flight,
                             int in_recovery, tx_time_f tx_time, void *tx_ctx)
 {
-    lsquic_time_t delay, sched_time;
+    lsquic_time_t delay, sched_time, departure;
     int app_limited, making_up;
 
 #ifndef NDEBUG
@@ -69,9 +70,11 @@ lsquic_pacer_packet_scheduled (struct pacer *pacer, unsigned n_in_flight,
         pacer->pa_next_sched = 0;
         pacer->pa_last_delayed = 0;
         LSQ_DEBUG("%s: tokens: %u", __func__, pacer->pa_burst_tokens);
-        return;
+        return pacer->pa_now;
     }
 
+    /* This packet leaves when the previous packet's delay has passed */
+    departure = MAX(pacer->pa_next_sched, pacer->pa_now);
     sched_time = pacer->pa_now;
     delay = tx_time(tx_ctx);
     if (pacer->pa_flags & PA_LAST_SCHED_DELAYED)
@@ -94,6 +97,7 @@ lsquic_pacer_packet_scheduled (struct pacer *pacer, unsigned n_in_flight,
                                                     sched_time + delay);
     LSQ_DEBUG("next_sched is set to %"PRIu64" usec from now",
                                 pacer->pa_next_sched - pacer->pa_now);
+    return departure;
 }
 
 
@@ -112,7 +116,8 @@ lsquic_pacer_can_schedule (struct pacer *pacer, unsigned n_in_flight)
 
     if (pacer->pa_burst_tokens > 0 || n_in_flight == 0)
         can = 1;
-    else if (pacer->pa_next_sched > pacer->pa_now + pacer->pa_clock_granularity)
+    else if (pacer->pa_next_sched > pacer->pa_now
+                    + MAX(pacer->pa_clock_granularity, pacer->pa_horizon))
     {
         pacer->pa_flags |= PA_LAST_SCHED_DELAYED;
         can = 0;
@@ -15,6 +15,9 @@ struct pacer
     /* All tick times are in microseconds */
 
     unsigned        pa_clock_granularity;
+    unsigned        pa_horizon;         /* Non-zero if packets carry
+                                         * departure time: see es_txtime.
+                                         */
 
     unsigned        pa_burst_tokens;
     unsigned        pa_n_scheduled;     /* Within single tick */
@@ -34,7 +37,7 @@ typedef lsquic_time_t (*tx_time_f)(void *ctx);
 
 void
 lsquic_pacer_init (struct pacer *, const struct lsquic_conn *,
-                                            unsigned clock_granularity);
+                            unsigned clock_granularity, unsigned horizon);
 
 void
 lsquic_pacer_cleanup (struct pacer *);
@@ -48,7 +51,8 @@ lsquic_pacer_tick_out (struct pacer *);
 int
 lsquic_pacer_can_schedule (struct pacer *, unsigned n_in_flight);
 
-void
+/* Returns time at which the packet should be sent */
+lsquic_time_t
 lsquic_pacer_packet_scheduled (struct pacer *pacer, unsigned n_in_flight,
                         int in_recovery, tx_time_f tx_time, void *tx_ctx);
 
@@ -57,7 +61,11 @@ lsquic_pacer_loss_event (struct pacer *);
 
 #define lsquic_pacer_delayed(pacer) ((pacer)->pa_flags & PA_LAST_SCHED_DELAYED)
 
-#define lsquic_pacer_next_sched(pacer) (+(pacer)->pa_next_sched)
+/* When packets carry departure time, the next packet may be scheduled
+ * `pa_horizon' microseconds before it is due to leave.
+ */
+#define lsquic_pacer_next_sched(pacer) \
+                            ((pacer)->pa_next_sched - (pacer)->pa_horizon)
 
 int
 lsquic_pacer_can_schedule_probe (const struct pacer *,
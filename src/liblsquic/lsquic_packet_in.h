@@ -75,7 +75,7 @@ typedef struct lsquic_packet_in
         PI_ENC_LEV_BIT_0= (1 << 5),                /* Encodes encryption level */
         PI_ENC_LEV_BIT_1= (1 << 6),                /*  (see enum enc_level). */
         PI_GQUIC        = (1 << 7),
-        PI_UNUSED_8     = (1 << 8),                /* <-- hole, reuse me! */
+        PI_HP_MASK      = (1 << 8),                /* HP mask was precomputed */
 #define PIBIT_ECN_SHIFT 9
         PI_ECN_BIT_0    = (1 << 9),
         PI_ECN_BIT_1    = (1 <<10),
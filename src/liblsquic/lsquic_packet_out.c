@@ -5,6 +5,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/queue.h>
@@ -32,6 +33,9 @@
 typedef char _stream_rec_arr_is_at_most_64bytes[
                                 (sizeof(struct frame_rec_arr) <= 64)? 1: - 1];
 
+typedef char _packet_out_hot_fields_fit_in_64bytes[
+            (offsetof(struct lsquic_packet_out, po_enc_data_sz) <= 64)? 1: - 1];
+
 static struct frame_rec *
 frec_one_pofi_first (struct packet_out_frec_iter *pofi,
                      struct lsquic_packet_out *packet_out)
@@ -207,6 +211,7 @@ lsquic_packet_out_new (struct lsquic_mm *mm, struct malo *malo, int use_cid,
                 const struct network_path *path, enum header_type header_type)
 {
     lsquic_packet_out_t *packet_out;
+    struct packet_out_cold *cold;
     enum packet_out_flags flags;
     size_t header_size, tag_len, max_size;
 
@@ -239,20 +244,30 @@ lsquic_packet_out_new (struct lsquic_mm *mm, struct malo *malo, int use_cid,
     packet_out->po_flags = flags;
     if ((1 << lconn->cn_version) & LSQUIC_GQUIC_HEADER_VERSIONS)
         packet_out->po_lflags = POL_GQUIC;
-    if (ver_tag)
-        packet_out->po_ver_tag = *ver_tag;
-    if (nonce)
+    if (ver_tag || nonce)
     {
-        /* Nonces are allocated for a very small number of packets.  This
-         * memory is too expensive to carry in every packet.
-         */
-        packet_out->po_nonce = malloc(32);
-        if (!packet_out->po_nonce)
+        cold = lsquic_packet_out_get_cold(mm, packet_out);
+        if (!cold)
         {
             lsquic_mm_put_packet_out(mm, packet_out);
             return NULL;
         }
-        memcpy(packet_out->po_nonce, nonce, 32);
+        if (ver_tag)
+            cold->pc_ver_tag = *ver_tag;
+        if (nonce)
+        {
+            /* Nonces are allocated for a very small number of packets.  This
+             * memory is too expensive to carry in every packet.
+             */
+            cold->pc_nonce = malloc(32);
+            if (!cold->pc_nonce)
+            {
+                lsquic_malo_put(cold);
+                lsquic_mm_put_packet_out(mm, packet_out);
+                return NULL;
+            }
+            memcpy(cold->pc_nonce, nonce, 32);
+        }
     }
     if (flags & PO_LONGHEAD)
     {
@@ -272,6 +287,20 @@ lsquic_packet_out_new (struct lsquic_mm *mm, struct malo *malo, int use_cid,
 }
 
 
+struct packet_out_cold *
+lsquic_packet_out_get_cold (struct lsquic_mm *mm,
+                                        struct lsquic_packet_out *packet_out)
+{
+    if (!packet_out->po_cold)
+    {
+        packet_out->po_cold = lsquic_malo_get(mm->malo.packet_out_cold);
+        if (packet_out->po_cold)
+            memset(packet_out->po_cold, 0, sizeof(*packet_out->po_cold));
+    }
+    return packet_out->po_cold;
+}
+
+
 void
 lsquic_packet_out_destroy (lsquic_packet_out_t *packet_out,
                            struct lsquic_engine_public *enpub, void *peer_ctx)
@@ -289,14 +318,54 @@ lsquic_packet_out_destroy (lsquic_packet_out_t *packet_out,
     if (packet_out->po_flags & PO_ENCRYPTED)
         enpub->enp_pmi->pmi_release(enpub->enp_pmi_ctx, peer_ctx,
                 packet_out->po_enc_data, lsquic_packet_out_ipv6(packet_out));
-    if (packet_out->po_nonce)
-        free(packet_out->po_nonce);
+    if (packet_out->po_cold)
+    {
+        if (packet_out->po_cold->pc_nonce)
+            free(packet_out->po_cold->pc_nonce);
+        lsquic_malo_put(packet_out->po_cold);
+    }
     if (packet_out->po_bwp_state)
         lsquic_malo_put(packet_out->po_bwp_state);
-    lsquic_mm_put_packet_out(&enpub->enp_mm, packet_out);
+    if (packet_out->po_flags & PO_PAGED_OUT)
+    {
+        free(packet_out->po_data);
+        lsquic_malo_put(packet_out);
+    }
+    else
+        lsquic_mm_put_packet_out(&enpub->enp_mm, packet_out);
 }
 
 
+/* Frame data that cannot be read back from its source -- for example,
+ * HTTP/3 frame headers -- is kept when packet is paged out.
+ */
+struct paged_out_lit
+{
+    unsigned short  pol_off;            /* Offset into STREAM frame data */
+    unsigned short  pol_len;
+};
+
+
+/* When a packet is paged out, `po_data' points to this structure instead
+ * of the packet buffer.
+ */
+struct paged_out_hdr
+{
+    uint64_t        poh_stream_off;     /* Offset of STREAM frame data */
+    unsigned short  poh_hdr_sz;         /* Size of STREAM frame header */
+    unsigned short  poh_n_lits;
+    unsigned short  poh_lit_sz;         /* Sum of all pol_len */
+    /* Followed by STREAM frame header and literal bytes: */
+    struct paged_out_lit
+                    poh_lits[0];
+};
+
+
+#define PAGED_OUT_HDR_SIZE(poh_) (sizeof(*(poh_)) \
+    + sizeof((poh_)->poh_lits[0]) * (poh_)->poh_n_lits \
+    + (poh_)->poh_hdr_sz + (poh_)->poh_lit_sz)
+
+
 /* If `stream_id' is UINT64_MAX, stream frames from all reset streams are elided.
  * Otherwise, elision is limited to the specified stream.
  */
@@ -335,11 +404,15 @@ lsquic_packet_out_elide_reset_stream_frames (lsquic_packet_out_t *packet_out,
             {
                 ++n_elided;
 
-                /* Move the data and adjust sizes */
+                /* Move the data and adjust sizes.  A paged-out packet
+                 * carries a single STREAM frame: there is nothing to move.
+                 */
                 adj += frec->fe_len;
-                memmove(packet_out->po_data + frec->fe_off,
-                        packet_out->po_data + frec->fe_off + frec->fe_len,
-                        packet_out->po_data_sz - frec->fe_off - frec->fe_len);
+                if (!(packet_out->po_flags & PO_PAGED_OUT))
+                    memmove(packet_out->po_data + frec->fe_off,
+                            packet_out->po_data + frec->fe_off + frec->fe_len,
+                            packet_out->po_data_sz - frec->fe_off
+                                                            - frec->fe_len);
                 packet_out->po_data_sz -= frec->fe_len;
 
                 lsquic_stream_acked(frec->fe_stream, frec->fe_frame_type);
@@ -388,8 +461,29 @@ lsquic_packet_out_chop_regen (lsquic_packet_out_t *packet_out)
 }
 
 
+static void
+ack_src_data (const struct lsquic_packet_out *packet_out,
+                const struct frame_rec *frec, const struct parse_funcs *pf)
+{
+    const struct paged_out_hdr *poh;
+    struct stream_frame stream_frame;
+
+    if (packet_out->po_flags & PO_PAGED_OUT)
+    {
+        poh = (void *) packet_out->po_data;
+        lsquic_stream_src_data_acked(frec->fe_stream, poh->poh_stream_off,
+                                    packet_out->po_data_sz - poh->poh_hdr_sz);
+    }
+    else if (pf->pf_parse_stream_frame(packet_out->po_data + frec->fe_off,
+                                            frec->fe_len, &stream_frame) > 0)
+        lsquic_stream_src_data_acked(frec->fe_stream,
+            stream_frame.data_frame.df_offset, stream_frame.data_frame.df_size);
+}
+
+
 void
-lsquic_packet_out_ack_streams (lsquic_packet_out_t *packet_out)
+lsquic_packet_out_ack_streams (lsquic_packet_out_t *packet_out,
+                                                const struct parse_funcs *pf)
 {
     struct packet_out_frec_iter pofi;
     struct frame_rec *frec;
@@ -397,7 +491,12 @@ lsquic_packet_out_ack_streams (lsquic_packet_out_t *packet_out)
                                                 frec = lsquic_pofi_next(&pofi))
         if ((1 << frec->fe_frame_type)
                 & (QUIC_FTBIT_STREAM|QUIC_FTBIT_CRYPTO|QUIC_FTBIT_RST_STREAM))
+        {
+            if (frec->fe_frame_type == QUIC_FRAME_STREAM
+                                && lsquic_stream_has_src_regs(frec->fe_stream))
+                ack_src_data(packet_out, frec, pf);
             lsquic_stream_acked(frec->fe_stream, frec->fe_frame_type);
+        }
 }
 
 
@@ -423,10 +522,18 @@ lsquic_packet_out_mem_used (const struct lsquic_packet_out *packet_out)
     size = 0;   /* The struct is allocated using malo */
     if (packet_out->po_enc_data)
         size += packet_out->po_enc_data_sz;
-    if (packet_out->po_data)
+    if (packet_out->po_flags & PO_PAGED_OUT)
+        size += PAGED_OUT_HDR_SIZE((struct paged_out_hdr *)
+                                                        packet_out->po_data);
+    else if (packet_out->po_data)
         size += packet_out->po_n_alloc;
-    if (packet_out->po_nonce)
-        size += 32;
+    if (packet_out->po_cold)
+    {
+        size += sizeof(*packet_out->po_cold);
+        if (packet_out->po_cold->pc_nonce)
+            size += packet_out->po_cold->pc_token_len
+                  ? packet_out->po_cold->pc_token_len : 32;
+    }
 
     if (packet_out->po_flags & PO_FREC_ARR)
         TAILQ_FOREACH(frec_arr, &packet_out->po_frecs.arr, next_stream_rec_arr)
@@ -552,3 +659,153 @@ lsquic_packet_out_pad_over (struct lsquic_packet_out *packet_out,
 
     packet_out->po_frame_types &= ~frame_types;
 }
+
+
+/* At most this many bytes of STREAM frame data that cannot be read back
+ * are kept in a paged-out packet.  This covers HTTP/3 DATA frame headers.
+ */
+#define MAX_PAGED_OUT_LIT 32
+
+
+/* A sent packet that carries a single STREAM frame whose data came from a
+ * file or a registered buffer (see lsquic_stream_write_file() and
+ * lsquic_stream_write_ref()) does not need to keep its data in memory: if
+ * the packet is lost, the data can be read from its source again.  Keep
+ * only the frame header and the few bytes that did not come from a source
+ * and return the packet buffer to the pool.
+ *
+ * Returns 0 if packet was paged out, -1 otherwise.
+ */
+int
+lsquic_packet_out_page_out (struct lsquic_packet_out *packet_out,
+                    struct lsquic_mm *mm, const struct parse_funcs *pf)
+{
+    struct frame_rec *frec;
+    struct paged_out_hdr *poh;
+    struct stream_frame stream_frame;
+    struct paged_out_lit lits[MAX_PAGED_OUT_LIT];
+    unsigned char *p;
+    size_t hdr_sz, off, run;
+    unsigned n_lits, lit_sz, i;
+    int len, from_src;
+
+    if ((packet_out->po_flags & (PO_FREC_ARR|PO_MINI|PO_ENCRYPTED
+                                                |PO_PAGED_OUT|PO_MTU_PROBE))
+            || packet_out->po_frame_types != QUIC_FTBIT_STREAM
+            || packet_out->po_regen_sz != 0)
+        return -1;
+
+    frec = &packet_out->po_frecs.one;
+    if (!(frec->fe_frame_type == QUIC_FRAME_STREAM
+            && frec->fe_off == 0
+            && frec->fe_len == packet_out->po_data_sz
+            && lsquic_stream_has_src_regs(frec->fe_stream)))
+        return -1;
+
+    len = pf->pf_parse_stream_frame(packet_out->po_data, frec->fe_len,
+                                                            &stream_frame);
+    if (len != (int) frec->fe_len || stream_frame.data_frame.df_size == 0)
+        return -1;
+    hdr_sz = stream_frame.data_frame.df_data - packet_out->po_data;
+    if (hdr_sz + stream_frame.data_frame.df_size != frec->fe_len)
+        return -1;
+
+    n_lits = 0;
+    lit_sz = 0;
+    for (off = 0; off < stream_frame.data_frame.df_size; off += run)
+    {
+        run = lsquic_stream_src_run(frec->fe_stream,
+                    stream_frame.data_frame.df_offset + off,
+                    stream_frame.data_frame.df_size - off, &from_src);
+        if (!from_src)
+        {
+            if (lit_sz + run > MAX_PAGED_OUT_LIT)
+                return -1;
+            lits[n_lits].pol_off = off;
+            lits[n_lits].pol_len = run;
+            ++n_lits;
+            lit_sz += run;
+        }
+    }
+    if (lit_sz == stream_frame.data_frame.df_size)
+        return -1;
+
+    poh = malloc(sizeof(*poh) + sizeof(lits[0]) * n_lits + hdr_sz + lit_sz);
+    if (!poh)
+        return -1;
+    poh->poh_stream_off = stream_frame.data_frame.df_offset;
+    poh->poh_hdr_sz = hdr_sz;
+    poh->poh_n_lits = n_lits;
+    poh->poh_lit_sz = lit_sz;
+    memcpy(poh->poh_lits, lits, sizeof(lits[0]) * n_lits);
+    p = (unsigned char *) (poh->poh_lits + n_lits);
+    memcpy(p, packet_out->po_data, hdr_sz);
+    p += hdr_sz;
+    for (i = 0; i < n_lits; ++i)
+    {
+        memcpy(p, packet_out->po_data + hdr_sz + lits[i].pol_off,
+                                                            lits[i].pol_len);
+        p += lits[i].pol_len;
+    }
+    lsquic_mm_put_packet_out_buf(mm, packet_out->po_data,
+                                                    packet_out->po_n_alloc);
+    packet_out->po_data = (unsigned char *) poh;
+    packet_out->po_flags |= PO_PAGED_OUT;
+    return 0;
+}
+
+
+/* Restore packet contents: allocate a new packet buffer, copy the STREAM
+ * frame header and literal bytes back, and read the rest of frame data
+ * from its source.
+ *
+ * Returns 0 on success, -1 on failure.  On failure, the packet remains
+ * paged out.
+ */
+int
+lsquic_packet_out_page_in (struct lsquic_packet_out *packet_out,
+                                                        struct lsquic_mm *mm)
+{
+    struct paged_out_hdr *const poh = (void *) packet_out->po_data;
+    const unsigned char *p;
+    unsigned char *buf, *data;
+    size_t data_sz, off, end;
+    unsigned i;
+
+    assert(packet_out->po_flags & PO_PAGED_OUT);
+    assert(!(packet_out->po_flags & PO_FREC_ARR));
+
+    buf = lsquic_mm_get_packet_out_buf(mm, packet_out->po_n_alloc);
+    if (!buf)
+        return -1;
+
+    p = (unsigned char *) (poh->poh_lits + poh->poh_n_lits);
+    memcpy(buf, p, poh->poh_hdr_sz);
+    p += poh->poh_hdr_sz;
+    data = buf + poh->poh_hdr_sz;
+    data_sz = packet_out->po_data_sz - poh->poh_hdr_sz;
+    for (off = 0, i = 0; off < data_sz; ++i)
+    {
+        end = i < poh->poh_n_lits ? poh->poh_lits[i].pol_off : data_sz;
+        if (end > off && 0 != lsquic_stream_read_src_range(
+                    packet_out->po_frecs.one.fe_stream,
+                    poh->poh_stream_off + off, data + off, end - off))
+        {
+            lsquic_mm_put_packet_out_buf(mm, buf, packet_out->po_n_alloc);
+            return -1;
+        }
+        if (i < poh->poh_n_lits)
+        {
+            memcpy(data + end, p, poh->poh_lits[i].pol_len);
+            p += poh->poh_lits[i].pol_len;
+            off = end + poh->poh_lits[i].pol_len;
+        }
+        else
+            off = end;
+    }
+
+    free(poh);
+    packet_out->po_data = buf;
+    packet_out->po_flags &= ~PO_PAGED_OUT;
+    return 0;
+}
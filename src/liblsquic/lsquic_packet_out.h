@@ -68,6 +68,25 @@ struct frame_rec_arr {
 TAILQ_HEAD(frame_rec_arr_tailq, frame_rec_arr);
 
 
+/* Fields that are needed by few packets: those that carry version tag,
+ * nonce, or token in the header, and those that belong to the IETF mini
+ * connection.  The cold part is allocated on demand, see
+ * lsquic_packet_out_get_cold().
+ */
+struct packet_out_cold
+{
+    unsigned char     *pc_nonce;        /* Use to generate header if PO_NONCE is set */
+#define pc_token pc_nonce
+    lsquic_ver_tag_t   pc_ver_tag;      /* Set if PO_VERSION is set */
+    unsigned short     pc_token_len;
+    unsigned short     pc_retx_cnt;     /* Used by IETF mini conn */
+    unsigned short     pc_padding_sz;   /* Used by IETF mini conn */
+};
+
+/* The structure is 128 bytes, which makes malo place it on a 128-byte
+ * boundary.  The first 64 bytes hold the fields used by ACK processing
+ * and loss detection, so that these touch a single cache line per packet.
+ */
 typedef struct lsquic_packet_out
 {
     /* `po_next' is used for packets_out, unacked_packets and expired_packets
@@ -98,8 +117,8 @@ typedef struct lsquic_packet_out
 #define POBIT_SHIFT 5
         PO_BITS_0   = (1 << 5),         /* PO_BITS_0 and PO_BITS_1 encode the */
         PO_BITS_1   = (1 << 6),         /*   packet number length.  See macros below. */
-        PO_NONCE    = (1 << 7),         /* Use value in `po_nonce' to generate header */
-        PO_VERSION  = (1 << 8),         /* Use value in `po_ver_tag' to generate header */
+        PO_NONCE    = (1 << 7),         /* Use value in `pc_nonce' to generate header */
+        PO_VERSION  = (1 << 8),         /* Use value in `pc_ver_tag' to generate header */
         PO_CONN_ID  = (1 << 9),         /* Include connection ID in public header */
         PO_REPACKNO = (1 <<10),         /* Regenerate packet number */
         PO_NOENCRYPT= (1 <<11),         /* Do not encrypt data in po_data */
@@ -112,6 +131,12 @@ typedef struct lsquic_packet_out
         PO_SENT_SZ  = (1 <<15),
         PO_LONGHEAD = (1 <<16),
         PO_ACKED_LOSS_CHAIN = (1<<17),
+        PO_PAGED_OUT= (1 <<18),         /* po_data only holds STREAM frame header:
+                                         *   see lsquic_packet_out_page_out().
+                                         */
+        PO_TXTIME   = (1 <<19),         /* Not sent yet; po_sent holds the
+                                         *   time the packet should leave.
+                                         */
 
 #define POIPv6_SHIFT 20
         PO_IPv6     = (1 <<20),         /* Set if pmi_allocate was passed is_ipv6=1,
@@ -135,20 +160,7 @@ typedef struct lsquic_packet_out
         PO_SPIN_BIT = (1 <<30),         /* Value of the spin bit */
     }                  po_flags;
     unsigned short     po_data_sz;      /* Number of usable bytes in data */
-    unsigned short     po_enc_data_sz;  /* Number of usable bytes in data */
     unsigned short     po_sent_sz;      /* If PO_SENT_SZ is set, real size of sent buffer. */
-    /* TODO Revisit po_regen_sz once gQUIC is dropped.  Now that all frames
-     * are recorded, we have more flexibility where to place ACK frames; they
-     * no longer really have to be at the beginning of the packet, since we
-     * can locate them.
-     */
-    unsigned short     po_regen_sz;     /* Number of bytes at the beginning
-                                         * of data containing bytes that are
-                                         * not to be retransmitted, e.g. ACK
-                                         * frames.
-                                         */
-    unsigned short     po_n_alloc;      /* Total number of bytes allocated in po_data */
-    unsigned short     po_token_len;
     enum header_type   po_header_type:8;
     unsigned char      po_dcid_len;     /* If PO_ENCRYPTED is set */
     enum {
@@ -170,6 +182,21 @@ typedef struct lsquic_packet_out
         POL_LIMITED     = 1 << 10,      /* Used to credit sc_next_limit if needed. */
         POL_FACKED   = 1 << 11,         /* Lost due to FACK check */
     }                  po_lflags:16;
+
+    /* End of the first cache line */
+
+    unsigned short     po_enc_data_sz;  /* Number of usable bytes in data */
+    /* TODO Revisit po_regen_sz once gQUIC is dropped.  Now that all frames
+     * are recorded, we have more flexibility where to place ACK frames; they
+     * no longer really have to be at the beginning of the packet, since we
+     * can locate them.
+     */
+    unsigned short     po_regen_sz;     /* Number of bytes at the beginning
+                                         * of data containing bytes that are
+                                         * not to be retransmitted, e.g. ACK
+                                         * frames.
+                                         */
+    unsigned short     po_n_alloc;      /* Total number of bytes allocated in po_data */
     unsigned char     *po_data;
 
     /* A lot of packets contain only one frame.  Thus, `one' is used first.
@@ -186,14 +213,11 @@ typedef struct lsquic_packet_out
      */
     unsigned char     *po_enc_data;
 
-    lsquic_ver_tag_t   po_ver_tag;      /* Set if PO_VERSION is set */
-    unsigned short     po_retx_cnt;
-    unsigned short     po_padding_sz;
-    unsigned char     *po_nonce;        /* Use to generate header if PO_NONCE is set */
     const struct network_path
                       *po_path;
-#define po_token po_nonce
     struct bwp_state  *po_bwp_state;
+    struct packet_out_cold
+                      *po_cold;         /* NULL unless needed */
 } lsquic_packet_out_t;
 
 /* This is to make sure these bit names are not used, they are only for
@@ -202,11 +226,10 @@ typedef struct lsquic_packet_out
 #define PO_PNS_HSK
 #define PO_PNS_APP
 
-/* The size of lsquic_packet_out_t could be further reduced:
- *
- * po_ver_tag could be encoded as a few bits representing enum lsquic_version
- * in po_flags.  The cost is a bit of complexity.  This will save us four bytes.
- */
+#define lsquic_packet_out_nonce(p) ((p)->po_cold ? (p)->po_cold->pc_nonce : NULL)
+#define lsquic_packet_out_token(p) lsquic_packet_out_nonce(p)
+#define lsquic_packet_out_token_len(p) \
+                            ((p)->po_cold ? (p)->po_cold->pc_token_len : 0)
 
 #define lsquic_packet_out_avail(p) ((unsigned short) \
                                         ((p)->po_n_alloc - (p)->po_data_sz))
@@ -316,6 +339,12 @@ lsquic_packet_out_new (struct lsquic_mm *, struct malo *, int use_cid,
                        const lsquic_ver_tag_t *, const unsigned char *nonce,
                        const struct network_path *, enum header_type);
 
+/* Allocate the cold part if it does not exist yet.  Returns NULL on
+ * failure.
+ */
+struct packet_out_cold *
+lsquic_packet_out_get_cold (struct lsquic_mm *, struct lsquic_packet_out *);
+
 void
 lsquic_packet_out_destroy (lsquic_packet_out_t *,
                         struct lsquic_engine_public *, void *peer_ctx);
@@ -340,7 +369,8 @@ void
 lsquic_packet_out_chop_regen (lsquic_packet_out_t *);
 
 void
-lsquic_packet_out_ack_streams (struct lsquic_packet_out *);
+lsquic_packet_out_ack_streams (struct lsquic_packet_out *,
+                                                const struct parse_funcs *);
 
 void
 lsquic_packet_out_zero_pad (struct lsquic_packet_out *);
@@ -360,4 +390,11 @@ void
 lsquic_packet_out_pad_over (struct lsquic_packet_out *packet_out,
                                                 enum quic_ft_bit frame_types);
 
+int
+lsquic_packet_out_page_out (struct lsquic_packet_out *, struct lsquic_mm *,
+                                                const struct parse_funcs *);
+
+int
+lsquic_packet_out_page_in (struct lsquic_packet_out *, struct lsquic_mm *);
+
 #endif
@@ -0,0 +1,328 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_page_arena.c -- Page provider backed by 2 MB huge pages.
+ *
+ * Memory is carved out of 2 MB chunks using a bump pointer.  Freed blocks
+ * are kept on free lists, one list per block size in pages, and are never
+ * returned to the system until the arena is destroyed.  Blocks are not
+ * coalesced: the memory manager asks for a few fixed sizes only (4 KB,
+ * 16 KB, and 64 KB slabs), so this is not a problem.
+ *
+ * A chunk is mapped using MAP_HUGETLB if huge pages are reserved.  If not,
+ * the chunk is aligned on 2 MB boundary and the kernel is advised to back
+ * it with a transparent huge page.  Either way, a packet buffer lookup
+ * needs one dTLB entry per 2 MB instead of one per 4 KB.
+ *
+ * Chunks are faulted in as soon as they are allocated.  Unless a NUMA node
+ * is specified explicitly, the first-touch policy places them on the node
+ * of the thread that allocates them -- that is, the engine's thread.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#else
+#include <vc_compat.h>
+#endif
+
+#include "lsquic.h"
+#include "lsquic_int_types.h"
+
+#define LSQUIC_LOGGER_MODULE LSQLM_ENGINE
+#include "lsquic_logger.h"
+
+
+#define PAGE_SZ 0x1000u
+#define CHUNK_SZ (2u << 20)
+#define PAGES_PER_CHUNK (CHUNK_SZ / PAGE_SZ)
+
+#if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+
+
+struct free_block
+{
+    SLIST_ENTRY(free_block)     next_block;
+};
+
+
+struct page_arena
+{
+    /* Indexed by block size in pages */
+    SLIST_HEAD(, free_block)    pa_free[PAGES_PER_CHUNK + 1];
+    unsigned char              *pa_cur,     /* Bump allocation */
+                               *pa_end;
+    void                      **pa_chunks;
+    unsigned                    pa_n_chunks,
+                                pa_n_alloc;
+    size_t                      pa_big_bytes;   /* Larger than a chunk */
+    int                         pa_numa_node;
+};
+
+
+#ifndef WIN32
+/* Map a chunk aligned on CHUNK_SZ boundary */
+static void *
+map_aligned (void)
+{
+    unsigned char *raw, *aligned;
+
+    raw = mmap(NULL, CHUNK_SZ * 2, PROT_READ|PROT_WRITE,
+                                        MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+        return NULL;
+    aligned = (unsigned char *) (((uintptr_t) raw + CHUNK_SZ - 1)
+                                                & ~((uintptr_t) CHUNK_SZ - 1));
+    if (aligned > raw)
+        munmap(raw, aligned - raw);
+    if (aligned + CHUNK_SZ < raw + CHUNK_SZ * 2)
+        munmap(aligned + CHUNK_SZ, raw + CHUNK_SZ * 2 - (aligned + CHUNK_SZ));
+    return aligned;
+}
+
+
+static void
+bind_to_node (void *mem, size_t size, int node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+    unsigned long mask[4];
+
+    if ((unsigned) node >= sizeof(mask) * 8)
+    {
+        LSQ_WARN("NUMA node %d is too large, not binding", node);
+        return;
+    }
+    memset(mask, 0, sizeof(mask));
+    mask[node / (sizeof(mask[0]) * 8)] = 1UL << (node % (sizeof(mask[0]) * 8));
+    if (0 != syscall(SYS_mbind, mem, size, MPOL_BIND, mask,
+                                                    sizeof(mask) * 8, 0))
+        LSQ_WARN("cannot bind chunk to NUMA node %d", node);
+#else
+    LSQ_WARN("binding to NUMA node is not supported on this platform");
+#endif
+}
+#endif
+
+
+static void *
+chunk_alloc (struct page_arena *arena)
+{
+    unsigned char *chunk;
+    size_t off;
+
+#ifndef WIN32
+#ifdef MAP_HUGETLB
+    chunk = mmap(NULL, CHUNK_SZ, PROT_READ|PROT_WRITE,
+                            MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    if (chunk == MAP_FAILED)
+#endif
+    {
+        chunk = map_aligned();
+        if (!chunk)
+            return NULL;
+#ifdef MADV_HUGEPAGE
+        (void) madvise(chunk, CHUNK_SZ, MADV_HUGEPAGE);
+#endif
+    }
+    if (arena->pa_numa_node >= 0)
+        bind_to_node(chunk, CHUNK_SZ, arena->pa_numa_node);
+#else
+    chunk = _aligned_malloc(CHUNK_SZ, CHUNK_SZ);
+    if (!chunk)
+        return NULL;
+#endif
+
+    /* Fault the chunk in now, from this thread */
+    for (off = 0; off < CHUNK_SZ; off += PAGE_SZ)
+        chunk[off] = 0;
+
+    return chunk;
+}
+
+
+static void
+chunk_free (void *chunk)
+{
+#ifndef WIN32
+    munmap(chunk, CHUNK_SZ);
+#else
+    _aligned_free(chunk);
+#endif
+}
+
+
+void *
+lsquic_page_arena_new (int numa_node)
+{
+    struct page_arena *arena;
+    unsigned i;
+
+    arena = malloc(sizeof(*arena));
+    if (!arena)
+        return NULL;
+
+    for (i = 0; i <= PAGES_PER_CHUNK; ++i)
+        SLIST_INIT(&arena->pa_free[i]);
+    arena->pa_cur = NULL;
+    arena->pa_end = NULL;
+    arena->pa_chunks = NULL;
+    arena->pa_n_chunks = 0;
+    arena->pa_n_alloc = 0;
+    arena->pa_big_bytes = 0;
+    arena->pa_numa_node = numa_node;
+    return arena;
+}
+
+
+void
+lsquic_page_arena_destroy (void *arena_p)
+{
+    struct page_arena *const arena = arena_p;
+    unsigned i;
+
+    for (i = 0; i < arena->pa_n_chunks; ++i)
+        chunk_free(arena->pa_chunks[i]);
+    free(arena->pa_chunks);
+    free(arena);
+}
+
+
+static void
+put_block (struct page_arena *arena, void *mem, unsigned n_pages)
+{
+    struct free_block *block;
+
+    assert(n_pages > 0 && n_pages <= PAGES_PER_CHUNK);
+    block = mem;
+    SLIST_INSERT_HEAD(&arena->pa_free[n_pages], block, next_block);
+}
+
+
+static int
+new_chunk (struct page_arena *arena)
+{
+    unsigned char *chunk;
+    void **chunks;
+    unsigned n_alloc;
+
+    if (arena->pa_n_chunks >= arena->pa_n_alloc)
+    {
+        n_alloc = arena->pa_n_alloc ? arena->pa_n_alloc * 2 : 8;
+        chunks = realloc(arena->pa_chunks, n_alloc * sizeof(chunks[0]));
+        if (!chunks)
+            return -1;
+        arena->pa_chunks = chunks;
+        arena->pa_n_alloc = n_alloc;
+    }
+
+    chunk = chunk_alloc(arena);
+    if (!chunk)
+    {
+        LSQ_WARN("cannot allocate 2 MB chunk");
+        return -1;
+    }
+    arena->pa_chunks[arena->pa_n_chunks++] = chunk;
+
+    /* Leftovers of the previous chunk can still be used */
+    if (arena->pa_cur < arena->pa_end)
+        put_block(arena, arena->pa_cur,
+                                    (arena->pa_end - arena->pa_cur) / PAGE_SZ);
+    arena->pa_cur = chunk;
+    arena->pa_end = chunk + CHUNK_SZ;
+    LSQ_DEBUG("allocated chunk #%u", arena->pa_n_chunks);
+    return 0;
+}
+
+
+static void *
+arena_alloc (void *arena_p, size_t size)
+{
+    struct page_arena *const arena = arena_p;
+    struct free_block *block;
+    unsigned n_pages;
+    void *mem;
+
+    assert(size > 0 && size % PAGE_SZ == 0);
+    if (size > CHUNK_SZ)
+    {
+        /* Not expected: the memory manager does not use blocks this large */
+#ifndef WIN32
+        mem = mmap(NULL, size, PROT_READ|PROT_WRITE,
+                                        MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+            mem = NULL;
+#else
+        mem = _aligned_malloc(size, PAGE_SZ);
+#endif
+        if (mem)
+            arena->pa_big_bytes += size;
+        return mem;
+    }
+
+    n_pages = size / PAGE_SZ;
+    block = SLIST_FIRST(&arena->pa_free[n_pages]);
+    if (block)
+    {
+        SLIST_REMOVE_HEAD(&arena->pa_free[n_pages], next_block);
+        return block;
+    }
+
+    if ((size_t) (arena->pa_end - arena->pa_cur) < size
+                                            && 0 != new_chunk(arena))
+        return NULL;
+
+    mem = arena->pa_cur;
+    arena->pa_cur += size;
+    return mem;
+}
+
+
+static void
+arena_free (void *arena_p, void *mem, size_t size)
+{
+    struct page_arena *const arena = arena_p;
+
+    assert(size > 0 && size % PAGE_SZ == 0);
+    if (size > CHUNK_SZ)
+    {
+#ifndef WIN32
+        munmap(mem, size);
+#else
+        _aligned_free(mem);
+#endif
+        arena->pa_big_bytes -= size;
+        return;
+    }
+
+    put_block(arena, mem, size / PAGE_SZ);
+}
+
+
+size_t
+lsquic_page_arena_mem_used (const void *arena_p)
+{
+    const struct page_arena *const arena = arena_p;
+
+    return sizeof(*arena) + arena->pa_n_alloc * sizeof(arena->pa_chunks[0])
+         + (size_t) arena->pa_n_chunks * CHUNK_SZ + arena->pa_big_bytes;
+}
+
+
+const struct lsquic_page_if lsquic_page_arena_if =
+{
+    .pgi_alloc  = arena_alloc,
+    .pgi_free   = arena_free,
+};
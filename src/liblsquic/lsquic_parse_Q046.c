@@ -174,9 +174,9 @@ gen_long_pkt_header (const struct lsquic_conn *lconn,
 
     p += write_packno(p, packet_out->po_packno, packno_bits);
 
-    if (packet_out->po_nonce)
+    if (lsquic_packet_out_nonce(packet_out))
     {
-        memcpy(p, packet_out->po_nonce, 32);
+        memcpy(p, packet_out->po_cold->pc_nonce, 32);
         p += 32;
     }
 
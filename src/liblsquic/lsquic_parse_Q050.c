@@ -345,7 +345,7 @@ gquic_Q050_packout_header_size_long_by_packet (const struct lsquic_conn *lconn,
        + (packet_out->po_header_type == HETY_INITIAL)
        + 2 /* Always use two bytes to encode payload length */
        + iquic_packno_bits2len(packno_bits)
-       + (packet_out->po_nonce ? DNONC_LENGTH : 0)
+       + (lsquic_packet_out_nonce(packet_out) ? DNONC_LENGTH : 0)
        ;
 
     return sz;
@@ -396,18 +396,19 @@ gquic_Q050_gen_long_pkt_header (const struct lsquic_conn *lconn,
 
     if (HETY_INITIAL == packet_out->po_header_type)
     {
-        token_len = packet_out->po_token_len;
+        token_len = lsquic_packet_out_token_len(packet_out);
         bits = vint_val2bits(token_len);
         vint_write(p, token_len, bits, 1 << bits);
         p += 1 << bits;
-        memcpy(p, packet_out->po_token, token_len);
+        if (token_len)
+            memcpy(p, packet_out->po_cold->pc_token, token_len);
         p += token_len;
     }
 
     payload_len = packet_out->po_data_sz
                 + lconn->cn_esf_c->esf_tag_len
                 + iquic_packno_bits2len(packno_bits);
-    if (packet_out->po_nonce)
+    if (lsquic_packet_out_nonce(packet_out))
         payload_len += DNONC_LENGTH;
     bits = 1;   /* Always use two bytes to encode payload length */
     vint_write(p, payload_len, bits, 1 << bits);
@@ -416,9 +417,9 @@ gquic_Q050_gen_long_pkt_header (const struct lsquic_conn *lconn,
     *packno_len_p = iquic_packno_bits2len(packno_bits);
     p += write_packno(p, packet_out->po_packno, packno_bits);
 
-    if (packet_out->po_nonce)
+    if (lsquic_packet_out_nonce(packet_out))
     {
-        memcpy(p, packet_out->po_nonce, DNONC_LENGTH);
+        memcpy(p, packet_out->po_cold->pc_nonce, DNONC_LENGTH);
         p += DNONC_LENGTH;
     }
 
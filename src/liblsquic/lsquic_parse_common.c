@@ -334,6 +334,24 @@ lsquic_dcid_from_packet (const unsigned char *buf, size_t bufsz,
 }
 
 
+int
+lsquic_shard_from_packet (const unsigned char *buf, size_t bufsz,
+                                unsigned server_cid_len, unsigned n_shards)
+{
+    unsigned cid_len;
+    int off;
+
+    if (n_shards == 0 || n_shards > 256)
+        return -1;
+
+    off = lsquic_dcid_from_packet(buf, bufsz, server_cid_len, &cid_len);
+    if (off < 0 || cid_len == 0 || (size_t) off >= bufsz)
+        return -1;
+
+    return buf[off] % n_shards;
+}
+
+
 /* See [draft-ietf-quic-transport-28], Section 12.4 (Table 3) */
 const enum quic_ft_bit lsquic_legal_frames_by_level[N_LSQVER][N_ENC_LEVS] =
 {
@@ -165,13 +165,13 @@ lsquic_gquic_be_gen_reg_pkt_header (const struct lsquic_conn *lconn,
 
         if (have_ver)
         {
-            memcpy(p, &packet_out->po_ver_tag, 4);
+            memcpy(p, &packet_out->po_cold->pc_ver_tag, 4);
             p += 4;
         }
 
         if (have_nonce)
         {
-            memcpy(p, packet_out->po_nonce , 32);
+            memcpy(p, packet_out->po_cold->pc_nonce, 32);
             p += 32;
         }
     }
@@ -111,7 +111,7 @@ ietf_v1_packout_header_size_long_by_packet (const struct lsquic_conn *lconn,
        + 1 /* SCIL */
        + CN_SCID(lconn)->len
        + (packet_out->po_header_type == HETY_INITIAL ?
-            (token_len = packet_out->po_token_len,
+            (token_len = lsquic_packet_out_token_len(packet_out),
                 (1 << vint_val2bits(token_len)) + token_len) : 0)
        + 2 /* Always use two bytes to encode payload length */
        + iquic_packno_bits2len(packno_bits)
@@ -237,11 +237,12 @@ gen_long_pkt_header (const struct lsquic_conn *lconn,
 
     if (HETY_INITIAL == packet_out->po_header_type)
     {
-        token_len = packet_out->po_token_len;
+        token_len = lsquic_packet_out_token_len(packet_out);
         bits = vint_val2bits(token_len);
         vint_write(p, token_len, bits, 1 << bits);
         p += 1 << bits;
-        memcpy(p, packet_out->po_token, token_len);
+        if (token_len)
+            memcpy(p, packet_out->po_cold->pc_token, token_len);
         p += token_len;
     }
 
@@ -390,6 +390,7 @@ lsquic_iquic_gen_retry_pkt (unsigned char *buf, size_t bufsz,
     unsigned char *const end = buf + bufsz;
     unsigned char *p = buf;
     lsquic_ver_tag_t ver_tag;
+    lsquic_cid_t retry_scid;
     size_t ad_len, out_len;
     unsigned ret_ver;
     ssize_t sz;
@@ -408,9 +409,23 @@ lsquic_iquic_gen_retry_pkt (unsigned char *buf, size_t bufsz,
 
     unsigned char tag[INTEGRITY_TAG_LEN];
 
+    /* The client uses this SCID as DCID of its next Initial packet: it is
+     * generated like the other CIDs the server issues, so that it can be
+     * routed the same way.  There is no connection yet, which user's
+     * ea_generate_scid() does not expect.
+     */
+    if (enpub->enp_flags & ENPUB_RETRY_SCID)
+        enpub->enp_generate_scid(enpub->enp_gen_scid_ctx, NULL, &retry_scid,
+                                                                our_scid_len);
+    else
+    {
+        retry_scid.len = our_scid_len;
+        RAND_bytes(retry_scid.idbuf, our_scid_len);
+    }
+
     /* See [draft-ietf-quic-transport-25], Section 17.2.5 */
 
-    if (bufsz < 1 + sizeof(ver_tag) + 1 + our_scid_len + 1 + dcid->len
+    if (bufsz < 1 + sizeof(ver_tag) + 1 + retry_scid.len + 1 + dcid->len
                         + MAX_RETRY_TOKEN_LEN + INTEGRITY_TAG_LEN)
         return -1;
 
@@ -429,11 +444,11 @@ lsquic_iquic_gen_retry_pkt (unsigned char *buf, size_t bufsz,
     *p++ = scid->len;
     memcpy(p, scid->idbuf, scid->len);
     p += scid->len;
-    *p++ = our_scid_len;
-    RAND_bytes(p, our_scid_len);
-    p += our_scid_len;
+    *p++ = retry_scid.len;
+    memcpy(p, retry_scid.idbuf, retry_scid.len);
+    p += retry_scid.len;
     sz = lsquic_tg_generate_retry(tokgen, p, end - p,
-                        p - our_scid_len, our_scid_len, sockaddr, dcid);
+                        p - retry_scid.len, retry_scid.len, sockaddr, dcid);
     if (sz < 0)
         return -1;
     p += sz;
@@ -0,0 +1,149 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_path_cache.c -- Path state saved across connections.
+ *
+ * The entries are kept in the shared hash (see ea_shi), so that engines
+ * sharing the hash share the cache.  The stored format has fixed-size
+ * fields and a version number, because the hash may outlive the process
+ * that wrote the entry.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <time.h>
+
+#ifndef WIN32
+#include <netinet/in.h>
+#include <sys/socket.h>
+#else
+#include "vc_compat.h"
+#include <Ws2tcpip.h>
+#endif
+
+#include "lsquic.h"
+#include "lsquic_int_types.h"
+#include "lsquic_types.h"
+#include "lsquic_mm.h"
+#include "lsquic_engine_public.h"
+#include "lsquic_path_cache.h"
+
+#define PATH_CACHE_VERSION 1
+
+/* Hosts in the same network are assumed to share the path */
+#define PATH_CACHE_IPV4_PREFIX  3       /* /24 */
+#define PATH_CACHE_IPV6_PREFIX  6       /* /48 */
+
+/* Ignore obviously bogus entries */
+#define PATH_CACHE_MAX_RTT      10000000    /* Microseconds */
+
+#define PATH_CACHE_KEY_PREFIX "PATHC"
+#define PATH_CACHE_KEY_PREFIX_SIZE (sizeof(PATH_CACHE_KEY_PREFIX) - 1)
+
+struct path_cache_entry
+{
+    uint32_t    pce_version;
+    uint32_t    pce_plpmtu;
+    uint64_t    pce_min_rtt;
+    uint64_t    pce_srtt;
+    uint64_t    pce_bw;
+    uint64_t    pce_cwnd;
+};
+
+
+/* Returns key size or zero if address family is not supported */
+static unsigned
+path_cache_key (const struct sockaddr *peer_sa,
+        unsigned char key[PATH_CACHE_KEY_PREFIX_SIZE + 1
+                                                + PATH_CACHE_IPV6_PREFIX])
+{
+    const void *addr;
+    unsigned prefix_sz;
+
+    switch (peer_sa->sa_family)
+    {
+    case AF_INET:
+        addr = &((const struct sockaddr_in *) peer_sa)->sin_addr;
+        prefix_sz = PATH_CACHE_IPV4_PREFIX;
+        break;
+    case AF_INET6:
+        addr = &((const struct sockaddr_in6 *) peer_sa)->sin6_addr;
+        prefix_sz = PATH_CACHE_IPV6_PREFIX;
+        break;
+    default:
+        return 0;
+    }
+
+    memcpy(key, PATH_CACHE_KEY_PREFIX, PATH_CACHE_KEY_PREFIX_SIZE);
+    key[PATH_CACHE_KEY_PREFIX_SIZE] = (unsigned char) prefix_sz;
+    memcpy(key + PATH_CACHE_KEY_PREFIX_SIZE + 1, addr, prefix_sz);
+    return PATH_CACHE_KEY_PREFIX_SIZE + 1 + prefix_sz;
+}
+
+
+int
+lsquic_path_cache_lookup (struct lsquic_engine_public *enpub,
+                const struct sockaddr *peer_sa, struct path_state *state)
+{
+    unsigned char key[PATH_CACHE_KEY_PREFIX_SIZE + 1 + PATH_CACHE_IPV6_PREFIX];
+    struct path_cache_entry entry;
+    unsigned key_sz, sz;
+    void *data;
+    int s;
+
+    key_sz = path_cache_key(peer_sa, key);
+    if (!key_sz)
+        return -1;
+
+    data = &entry;
+    sz = sizeof(entry);
+    s = enpub->enp_shi->shi_lookup(enpub->enp_shi_ctx, key, key_sz,
+                                                                &data, &sz);
+    if (s != 1 || sz != sizeof(entry))
+        return -1;
+    if (data != (void *) &entry)
+        memcpy(&entry, data, sizeof(entry));
+
+    if (entry.pce_version != PATH_CACHE_VERSION
+            || entry.pce_min_rtt == 0
+            || entry.pce_min_rtt > entry.pce_srtt
+            || entry.pce_srtt > PATH_CACHE_MAX_RTT
+            || entry.pce_cwnd == 0
+            || entry.pce_plpmtu > 0xFFFF)
+        return -1;
+
+    state->ps_min_rtt = entry.pce_min_rtt;
+    state->ps_srtt    = entry.pce_srtt;
+    state->ps_bw      = entry.pce_bw;
+    state->ps_cwnd    = entry.pce_cwnd;
+    state->ps_plpmtu  = (unsigned short) entry.pce_plpmtu;
+    return 0;
+}
+
+
+int
+lsquic_path_cache_save (struct lsquic_engine_public *enpub,
+            const struct sockaddr *peer_sa, const struct path_state *state)
+{
+    unsigned char key[PATH_CACHE_KEY_PREFIX_SIZE + 1 + PATH_CACHE_IPV6_PREFIX];
+    struct path_cache_entry entry;
+    unsigned key_sz;
+
+    key_sz = path_cache_key(peer_sa, key);
+    if (!key_sz)
+        return -1;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.pce_version = PATH_CACHE_VERSION;
+    entry.pce_plpmtu  = state->ps_plpmtu;
+    entry.pce_min_rtt = state->ps_min_rtt;
+    entry.pce_srtt    = state->ps_srtt;
+    entry.pce_bw      = state->ps_bw;
+    entry.pce_cwnd    = state->ps_cwnd;
+
+    /* Inserting an existing key fails: the newest state replaces it */
+    (void) enpub->enp_shi->shi_delete(enpub->enp_shi_ctx, key, key_sz);
+    return enpub->enp_shi->shi_insert(enpub->enp_shi_ctx, key, key_sz,
+                &entry, sizeof(entry),
+                time(NULL) + enpub->enp_settings.es_path_cache_ttl);
+}
@@ -0,0 +1,37 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_path_cache.h -- Path state saved across connections.
+ *
+ * When a connection is destroyed, what it has learned about the path --
+ * RTT, bandwidth, congestion window, and PLPMTU -- is saved in the shared
+ * hash, keyed by the peer address prefix.  A new connection to the same
+ * destination uses it to get up to speed sooner.  The saved state is not
+ * trusted: see lsquic_send_ctl_resume().
+ */
+
+#ifndef LSQUIC_PATH_CACHE_H
+#define LSQUIC_PATH_CACHE_H 1
+
+struct lsquic_engine_public;
+struct sockaddr;
+
+struct path_state
+{
+    lsquic_time_t       ps_min_rtt;
+    lsquic_time_t       ps_srtt;
+    uint64_t            ps_bw;          /* Bytes per second */
+    uint64_t            ps_cwnd;
+    unsigned short      ps_plpmtu;      /* Zero if unknown */
+};
+
+/* Returns 0 if valid state for this destination is found, -1 otherwise */
+int
+lsquic_path_cache_lookup (struct lsquic_engine_public *,
+                    const struct sockaddr *peer_sa, struct path_state *);
+
+/* Returns 0 on success, -1 on failure */
+int
+lsquic_path_cache_save (struct lsquic_engine_public *,
+                    const struct sockaddr *peer_sa, const struct path_state *);
+
+#endif
@@ -0,0 +1,199 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_pnidx.c -- Packet number index.
+ *
+ * Slot for packet number N is N modulo the number of slots.  All slots
+ * outside of [base, base + span) are NULL.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsquic_int_types.h"
+#include "lsquic_pnidx.h"
+
+
+#define INIT_SLOTS 64
+/* This is 2 MB worth of pointers on a 64-bit platform.  A window this wide
+ * is unusual enough to give up on indexing.
+ */
+#define MAX_SLOTS (1u << 18)
+
+#define SLOT(pnidx_, packno_) \
+            (&(pnidx_)->pni_slots[(packno_) & ((pnidx_)->pni_n_alloc - 1)])
+
+
+void
+lsquic_pnidx_init (struct pn_index *pnidx)
+{
+    memset(pnidx, 0, sizeof(*pnidx));
+}
+
+
+void
+lsquic_pnidx_cleanup (struct pn_index *pnidx)
+{
+    free(pnidx->pni_slots);
+    memset(pnidx, 0, sizeof(*pnidx));
+}
+
+
+static void
+pnidx_turn_off (struct pn_index *pnidx)
+{
+    free(pnidx->pni_slots);
+    pnidx->pni_slots = NULL;
+    pnidx->pni_n_alloc = 0;
+    pnidx->pni_span = 0;
+    pnidx->pni_flags |= PNI_OFF;
+}
+
+
+static int
+pnidx_grow (struct pn_index *pnidx, unsigned span)
+{
+    struct lsquic_packet_out **slots;
+    lsquic_packno_t packno;
+    unsigned n_alloc, i;
+
+    n_alloc = pnidx->pni_n_alloc ? pnidx->pni_n_alloc : INIT_SLOTS;
+    while (n_alloc < span)
+        n_alloc <<= 1;
+
+    slots = calloc(n_alloc, sizeof(slots[0]));
+    if (!slots)
+        return -1;
+
+    for (i = 0; i < pnidx->pni_span; ++i)
+    {
+        packno = pnidx->pni_base + i;
+        slots[packno & (n_alloc - 1)] = *SLOT(pnidx, packno);
+    }
+
+    free(pnidx->pni_slots);
+    pnidx->pni_slots = slots;
+    pnidx->pni_n_alloc = n_alloc;
+    return 0;
+}
+
+
+void
+lsquic_pnidx_set (struct pn_index *pnidx, lsquic_packno_t packno,
+                                        struct lsquic_packet_out *packet_out)
+{
+    lsquic_packno_t base;
+    uint64_t span;
+
+    if (pnidx->pni_flags & PNI_OFF)
+        return;
+
+    if (pnidx->pni_span == 0)
+    {
+        base = packno;
+        span = 1;
+    }
+    else if (packno < pnidx->pni_base)
+    {
+        base = packno;
+        span = pnidx->pni_base + pnidx->pni_span - packno;
+    }
+    else if (packno - pnidx->pni_base >= pnidx->pni_span)
+    {
+        base = pnidx->pni_base;
+        span = packno - pnidx->pni_base + 1;
+    }
+    else
+    {
+        base = pnidx->pni_base;
+        span = pnidx->pni_span;
+    }
+
+    if (span > pnidx->pni_n_alloc
+            && (span > MAX_SLOTS || 0 != pnidx_grow(pnidx, (unsigned) span)))
+    {
+        pnidx_turn_off(pnidx);
+        return;
+    }
+
+    pnidx->pni_base = base;
+    pnidx->pni_span = (unsigned) span;
+    *SLOT(pnidx, packno) = packet_out;
+}
+
+
+void
+lsquic_pnidx_clear (struct pn_index *pnidx, lsquic_packno_t packno,
+                                        struct lsquic_packet_out *packet_out)
+{
+    struct lsquic_packet_out **slot;
+
+    if ((pnidx->pni_flags & PNI_OFF)
+            || packno < pnidx->pni_base
+            || packno - pnidx->pni_base >= pnidx->pni_span)
+        return;
+
+    slot = SLOT(pnidx, packno);
+    if (*slot != packet_out)
+        return;
+    *slot = NULL;
+
+    /* Packets are mostly removed from the bottom */
+    if (packno == pnidx->pni_base)
+        while (pnidx->pni_span && !*SLOT(pnidx, pnidx->pni_base))
+        {
+            ++pnidx->pni_base;
+            --pnidx->pni_span;
+        }
+    else if (packno == pnidx->pni_base + pnidx->pni_span - 1)
+        while (pnidx->pni_span
+                && !*SLOT(pnidx, pnidx->pni_base + pnidx->pni_span - 1))
+            --pnidx->pni_span;
+}
+
+
+void
+lsquic_pnidx_reset (struct pn_index *pnidx)
+{
+    unsigned i;
+
+    if (pnidx->pni_flags & PNI_OFF)
+        pnidx->pni_flags &= ~PNI_OFF;
+    else
+    {
+        for (i = 0; i < pnidx->pni_span; ++i)
+            *SLOT(pnidx, pnidx->pni_base + i) = NULL;
+        pnidx->pni_span = 0;
+    }
+}
+
+
+struct lsquic_packet_out *
+lsquic_pnidx_find (const struct pn_index *pnidx, lsquic_packno_t low,
+                                                        lsquic_packno_t high)
+{
+    struct lsquic_packet_out *packet_out;
+
+    assert(!(pnidx->pni_flags & PNI_OFF));
+    if (pnidx->pni_span == 0)
+        return NULL;
+
+    if (low < pnidx->pni_base)
+        low = pnidx->pni_base;
+    if (high > pnidx->pni_base + pnidx->pni_span - 1)
+        high = pnidx->pni_base + pnidx->pni_span - 1;
+
+    for ( ; low <= high; ++low)
+        if ((packet_out = *SLOT(pnidx, low)))
+            return packet_out;
+
+    return NULL;
+}
+
+
+size_t
+lsquic_pnidx_mem_used (const struct pn_index *pnidx)
+{
+    return pnidx->pni_n_alloc * sizeof(pnidx->pni_slots[0]);
+}
@@ -0,0 +1,69 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_pnidx.h -- Packet number index.
+ *
+ * The send controller keeps unacknowledged packets on a queue sorted by
+ * packet number.  Sent packet numbers are dense, so the index is a ring
+ * buffer of pointers to queue elements, addressed by packet number.  It
+ * lets ACK processing jump over the packets that are not acknowledged
+ * instead of walking them one by one.
+ *
+ * If the range of packet numbers becomes too wide, the index turns itself
+ * off.  It is turned back on when the queue becomes empty and the index is
+ * reset.
+ */
+
+#ifndef LSQUIC_PNIDX_H
+#define LSQUIC_PNIDX_H 1
+
+struct lsquic_packet_out;
+
+struct pn_index
+{
+    struct lsquic_packet_out  **pni_slots;
+    lsquic_packno_t             pni_base;       /* Lowest indexed packno */
+    unsigned                    pni_span;       /* [base, base + span) */
+    unsigned                    pni_n_alloc;    /* Zero or power of two */
+    enum {
+        PNI_OFF     = 1 << 0,
+    }                           pni_flags;
+};
+
+void
+lsquic_pnidx_init (struct pn_index *);
+
+void
+lsquic_pnidx_cleanup (struct pn_index *);
+
+/* Point packet number `packno' at `packet_out', replacing whatever entry
+ * was there before.
+ */
+void
+lsquic_pnidx_set (struct pn_index *, lsquic_packno_t packno,
+                                        struct lsquic_packet_out *packet_out);
+
+/* The entry is only cleared if it points at `packet_out' */
+void
+lsquic_pnidx_clear (struct pn_index *, lsquic_packno_t packno,
+                                        struct lsquic_packet_out *packet_out);
+
+/* Call this when the queue is empty */
+void
+lsquic_pnidx_reset (struct pn_index *);
+
+#define lsquic_pnidx_is_on(pnidx_) (!((pnidx_)->pni_flags & PNI_OFF))
+
+/* Return the entry with the smallest packet number in the range [low, high]
+ * or NULL if there are no entries in that range.  The index must be on.
+ */
+struct lsquic_packet_out *
+lsquic_pnidx_find (const struct pn_index *, lsquic_packno_t low,
+                                                    lsquic_packno_t high);
+
+/* The index is embedded into the send controller: this does not include
+ * the size of struct pn_index.
+ */
+size_t
+lsquic_pnidx_mem_used (const struct pn_index *);
+
+#endif
@@ -0,0 +1,359 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_prague.c -- Prague congestion control for L4S.
+ *
+ * The scalable response follows DCTCP (RFC 8257): once per round, alpha
+ * is updated with the fraction F of CE-marked packets,
+ *
+ *      alpha = (1 - g) * alpha + g * F
+ *
+ * and on CE the window is reduced by alpha / 2, at most once per round.
+ * The additive increase follows the "reduced RTT dependence" requirement
+ * of RFC 9331, Section 4.3: below PRAGUE_TARGET_RTT, the increase is
+ * scaled down by (srtt / PRAGUE_TARGET_RTT)^2, so that the rate grows
+ * as fast as that of a flow with PRAGUE_TARGET_RTT.
+ *
+ * RFC 9331, Section 4.3 also requires fallback to a Reno-friendly response
+ * on classic ECN bottlenecks.  send_ctl tells us when the path remarks
+ * ECT(1), see cci_l4s_fallback().  A classic single-queue AQM is detected
+ * heuristically: an L4S AQM marks at a shallow queue, so a CE-marked round
+ * whose smallest RTT sample is still well above the minimum RTT points to
+ * a classic one.
+ */
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifdef WIN32
+#include <vc_compat.h>
+#endif
+
+#include "lsquic_int_types.h"
+#include "lsquic_types.h"
+#include "lsquic_hash.h"
+#include "lsquic_util.h"
+#include "lsquic_cong_ctl.h"
+#include "lsquic_sfcw.h"
+#include "lsquic_conn_flow.h"
+#include "lsquic_varint.h"
+#include "lsquic_hq.h"
+#include "lsquic_stream.h"
+#include "lsquic_rtt.h"
+#include "lsquic_conn_public.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_packet_out.h"
+#include "lsquic_prague.h"
+
+#define LSQUIC_LOGGER_MODULE LSQLM_PRAGUE
+#define LSQUIC_LOG_CONN_ID lsquic_conn_log_cid(prague->pr_conn)
+#include "lsquic_logger.h"
+
+#define PRAGUE_MSS              1460
+#define PRAGUE_INIT_CWND        (32 * PRAGUE_MSS)   /* Same as Cubic */
+#define PRAGUE_MIN_CWND         (2 * PRAGUE_MSS)
+#define PRAGUE_ALPHA_GAIN_SHIFT 4                   /* g = 1/16 */
+#define PRAGUE_TARGET_RTT       25000               /* Microseconds */
+
+/* Classic AQM detection: this many consecutive CE-marked rounds with the
+ * queuing delay above PRAGUE_CLASSIC_QDELAY.
+ */
+#define PRAGUE_CLASSIC_QDELAY   5000                /* Microseconds */
+#define PRAGUE_CLASSIC_ROUNDS   8
+
+
+static void
+prague_reset (struct lsquic_prague *prague)
+{
+    memset(&prague->pr_cwnd, 0,
+                sizeof(*prague) - offsetof(struct lsquic_prague, pr_cwnd));
+    prague->pr_cwnd = PRAGUE_INIT_CWND;
+    prague->pr_ssthresh = UINT64_MAX;
+    prague->pr_alpha = PRAGUE_ALPHA_SCALE;
+    prague->pr_round_min_rtt = UINT64_MAX;
+}
+
+
+static void
+lsquic_prague_init (void *cong_ctl, const struct lsquic_conn_public *conn_pub,
+                                            enum quic_ft_bit UNUSED_retx_frames)
+{
+    struct lsquic_prague *const prague = cong_ctl;
+
+    prague->pr_conn = conn_pub->lconn;
+    prague->pr_rtt_stats = &conn_pub->rtt_stats;
+    prague_reset(prague);
+    LSQ_INFO("initialized");
+}
+
+
+static void
+lsquic_prague_reinit (void *cong_ctl)
+{
+    struct lsquic_prague *const prague = cong_ctl;
+    unsigned classic;
+
+    /* Once send_ctl has fallen back to ECT(0), it stays there */
+    classic = prague->pr_flags & PR_CLASSIC;
+    prague_reset(prague);
+    prague->pr_flags |= classic;
+    LSQ_DEBUG("re-initialized");
+}
+
+
+/* Reduce window to `cwnd', at most once per round */
+static void
+prague_reduce (struct lsquic_prague *prague, uint64_t cwnd, const char *why)
+{
+    if (prague->pr_flags & PR_IN_CWR)
+        return;
+
+    if (cwnd < PRAGUE_MIN_CWND)
+        cwnd = PRAGUE_MIN_CWND;
+    LSQ_INFO("%s: cwnd %"PRIu64" -> %"PRIu64, why, prague->pr_cwnd, cwnd);
+    prague->pr_cwnd = cwnd;
+    prague->pr_ssthresh = cwnd;
+    prague->pr_ai_acked = 0;
+    prague->pr_flags |= PR_IN_CWR;
+    prague->pr_cwr_end = prague->pr_last_sent;
+}
+
+
+static void
+lsquic_prague_sent (void *cong_ctl, struct lsquic_packet_out *packet_out,
+                                        uint64_t in_flight, int app_limited)
+{
+    struct lsquic_prague *const prague = cong_ctl;
+
+    prague->pr_last_sent = packet_out->po_packno;
+}
+
+
+static void
+lsquic_prague_ack (void *cong_ctl, struct lsquic_packet_out *packet_out,
+                  unsigned n_bytes, lsquic_time_t now, int app_limited)
+{
+    struct lsquic_prague *const prague = cong_ctl;
+    lsquic_time_t rtt, srtt;
+    uint64_t acked;
+
+    rtt = now - packet_out->po_sent;
+    if (0 == prague->pr_min_rtt || rtt < prague->pr_min_rtt)
+        prague->pr_min_rtt = rtt;
+    if (rtt < prague->pr_round_min_rtt)
+        prague->pr_round_min_rtt = rtt;
+    if (packet_out->po_packno > prague->pr_largest_acked)
+        prague->pr_largest_acked = packet_out->po_packno;
+
+    if ((prague->pr_flags & PR_IN_CWR) || app_limited)
+        return;
+
+    if (prague->pr_cwnd < prague->pr_ssthresh)
+    {
+        prague->pr_cwnd += n_bytes;
+        LSQ_DEBUG("ACK: slow start, cwnd: %"PRIu64, prague->pr_cwnd);
+        return;
+    }
+
+    acked = n_bytes;
+    srtt = lsquic_rtt_stats_get_srtt(prague->pr_rtt_stats);
+    if (srtt && srtt < PRAGUE_TARGET_RTT)
+        acked = acked * srtt * srtt / PRAGUE_TARGET_RTT / PRAGUE_TARGET_RTT;
+    prague->pr_ai_acked += acked;
+    if (prague->pr_ai_acked >= prague->pr_cwnd)
+    {
+        prague->pr_ai_acked -= prague->pr_cwnd;
+        prague->pr_cwnd += PRAGUE_MSS;
+        LSQ_DEBUG("ACK: cwnd: %"PRIu64, prague->pr_cwnd);
+    }
+}
+
+
+static void
+lsquic_prague_ecn (void *cong_ctl, uint64_t n_ce, uint64_t n_ect)
+{
+    struct lsquic_prague *const prague = cong_ctl;
+
+    prague->pr_ce_in_round += n_ce;
+    prague->pr_ect_in_round += n_ect;
+    if (n_ce == 0)
+        return;
+
+    prague->pr_flags |= PR_CE_IN_ROUND;
+    if (prague->pr_flags & PR_CLASSIC)
+        prague_reduce(prague, prague->pr_cwnd / 2, "CE (classic)");
+    else
+        prague_reduce(prague, prague->pr_cwnd - prague->pr_cwnd
+                        * prague->pr_alpha / PRAGUE_ALPHA_SCALE / 2, "CE");
+}
+
+
+static void
+prague_end_round (struct lsquic_prague *prague)
+{
+    uint64_t frac;
+
+    if (prague->pr_ect_in_round)
+    {
+        frac = prague->pr_ce_in_round * PRAGUE_ALPHA_SCALE
+                                                / prague->pr_ect_in_round;
+        if (frac > PRAGUE_ALPHA_SCALE)
+            frac = PRAGUE_ALPHA_SCALE;
+        prague->pr_alpha = prague->pr_alpha
+                        - (prague->pr_alpha >> PRAGUE_ALPHA_GAIN_SHIFT)
+                        + (frac >> PRAGUE_ALPHA_GAIN_SHIFT);
+        LSQ_DEBUG("round: CE %"PRIu64"/%"PRIu64"; alpha: %"PRIu64"/%u",
+            prague->pr_ce_in_round, prague->pr_ect_in_round,
+            prague->pr_alpha, PRAGUE_ALPHA_SCALE);
+    }
+
+    if ((prague->pr_flags & (PR_CE_IN_ROUND|PR_CLASSIC)) == PR_CE_IN_ROUND)
+    {
+        if (prague->pr_round_min_rtt != UINT64_MAX
+                && prague->pr_round_min_rtt
+                            > prague->pr_min_rtt + PRAGUE_CLASSIC_QDELAY)
+        {
+            if (++prague->pr_classic_rounds >= PRAGUE_CLASSIC_ROUNDS)
+            {
+                LSQ_INFO("queuing delay stays above %u usec while CE-marked: "
+                    "assume classic AQM", PRAGUE_CLASSIC_QDELAY);
+                prague->pr_flags |= PR_CLASSIC;
+            }
+        }
+        else
+            prague->pr_classic_rounds = 0;
+    }
+
+    prague->pr_ce_in_round = 0;
+    prague->pr_ect_in_round = 0;
+    prague->pr_round_min_rtt = UINT64_MAX;
+    prague->pr_flags &= ~PR_CE_IN_ROUND;
+    prague->pr_round_end = prague->pr_last_sent;
+}
+
+
+static void
+lsquic_prague_end_ack (void *cong_ctl, uint64_t in_flight)
+{
+    struct lsquic_prague *const prague = cong_ctl;
+
+    if ((prague->pr_flags & PR_IN_CWR)
+                        && prague->pr_largest_acked > prague->pr_cwr_end)
+        prague->pr_flags &= ~PR_IN_CWR;
+    if (prague->pr_largest_acked > prague->pr_round_end)
+        prague_end_round(prague);
+}
+
+
+static void
+lsquic_prague_loss (void *cong_ctl)
+{
+    struct lsquic_prague *const prague = cong_ctl;
+
+    prague_reduce(prague, prague->pr_cwnd / 2, "loss");
+}
+
+
+static void
+lsquic_prague_l4s_fallback (void *cong_ctl)
+{
+    struct lsquic_prague *const prague = cong_ctl;
+
+    LSQ_INFO("path does not support L4S: use classic ECN response");
+    prague->pr_flags |= PR_CLASSIC;
+}
+
+
+static void
+lsquic_prague_resume (void *cong_ctl, uint64_t cwnd, uint64_t bw)
+{
+    struct lsquic_prague *const prague = cong_ctl;
+
+    if (cwnd < PRAGUE_MIN_CWND)
+        cwnd = PRAGUE_MIN_CWND;
+    LSQ_INFO("%s: cwnd %"PRIu64" -> %"PRIu64, bw ? "resume" : "retreat",
+                                                    prague->pr_cwnd, cwnd);
+    prague->pr_cwnd = cwnd;
+    prague->pr_ai_acked = 0;
+    if (!bw)
+        prague->pr_ssthresh = cwnd;
+}
+
+
+static void
+lsquic_prague_timeout (void *cong_ctl)
+{
+    struct lsquic_prague *const prague = cong_ctl;
+
+    prague->pr_ssthresh = prague->pr_cwnd / 2;
+    if (prague->pr_ssthresh < PRAGUE_MIN_CWND)
+        prague->pr_ssthresh = PRAGUE_MIN_CWND;
+    prague->pr_cwnd = PRAGUE_MIN_CWND;
+    prague->pr_ai_acked = 0;
+    prague->pr_flags &= ~PR_IN_CWR;
+    LSQ_INFO("timeout, cwnd: %"PRIu64, prague->pr_cwnd);
+}
+
+
+static void
+lsquic_prague_was_quiet (void *cong_ctl, lsquic_time_t now, uint64_t in_flight)
+{
+    struct lsquic_prague *const prague = cong_ctl;
+
+    LSQ_DEBUG("%s(prague, %"PRIu64")", __func__, now);
+    prague->pr_ai_acked = 0;
+}
+
+
+static uint64_t
+lsquic_prague_get_cwnd (void *cong_ctl)
+{
+    struct lsquic_prague *const prague = cong_ctl;
+    return prague->pr_cwnd;
+}
+
+
+static uint64_t
+lsquic_prague_pacing_rate (void *cong_ctl, int in_recovery)
+{
+    struct lsquic_prague *const prague = cong_ctl;
+    uint64_t bandwidth;
+    lsquic_time_t srtt;
+
+    srtt = lsquic_rtt_stats_get_srtt(prague->pr_rtt_stats);
+    if (srtt == 0)
+        srtt = 50000;
+    bandwidth = prague->pr_cwnd * 1000000 / srtt;
+    if (prague->pr_cwnd < prague->pr_ssthresh)
+        return bandwidth * 2;
+    else if (in_recovery)
+        return bandwidth;
+    else
+        return bandwidth + bandwidth / 4;
+}
+
+
+static void
+lsquic_prague_cleanup (void *cong_ctl)
+{
+}
+
+
+const struct cong_ctl_if lsquic_cong_prague_if =
+{
+    .cci_ack           = lsquic_prague_ack,
+    .cci_cleanup       = lsquic_prague_cleanup,
+    .cci_ecn           = lsquic_prague_ecn,
+    .cci_end_ack       = lsquic_prague_end_ack,
+    .cci_get_cwnd      = lsquic_prague_get_cwnd,
+    .cci_init          = lsquic_prague_init,
+    .cci_l4s_fallback  = lsquic_prague_l4s_fallback,
+    .cci_loss          = lsquic_prague_loss,
+    .cci_pacing_rate   = lsquic_prague_pacing_rate,
+    .cci_reinit        = lsquic_prague_reinit,
+    .cci_resume        = lsquic_prague_resume,
+    .cci_sent          = lsquic_prague_sent,
+    .cci_timeout       = lsquic_prague_timeout,
+    .cci_was_quiet     = lsquic_prague_was_quiet,
+};
@@ -0,0 +1,51 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * lsquic_prague.h -- Prague congestion control for L4S.
+ *
+ * Prague is a scalable congestion controller (RFC 9331, RFC 9332): packets
+ * are sent with ECT(1) and the window is reduced once per RTT in proportion
+ * to the fraction of CE-marked packets, as in DCTCP.  Additive increase is
+ * Reno-like, scaled so that flows with short RTTs do not outgrow flows with
+ * longer ones.
+ *
+ * Loss gets the classic Reno response.  If the path remarks ECT(1) or the
+ * CE marks look like they come from a classic AQM, CE is treated as loss
+ * as well for the rest of the connection.
+ */
+
+#ifndef LSQUIC_PRAGUE_H
+#define LSQUIC_PRAGUE_H 1
+
+struct lsquic_conn;
+
+struct lsquic_prague
+{
+    const struct lsquic_conn
+                   *pr_conn;            /* Used for logging */
+    const struct lsquic_rtt_stats
+                   *pr_rtt_stats;
+    uint64_t        pr_cwnd;
+    uint64_t        pr_ssthresh;
+    uint64_t        pr_ai_acked;        /* Bytes toward next increase */
+    /* DCTCP alpha: EWMA of CE fraction, scaled by PRAGUE_ALPHA_SCALE */
+    uint64_t        pr_alpha;
+    uint64_t        pr_ce_in_round, pr_ect_in_round;
+    lsquic_packno_t pr_last_sent;
+    lsquic_packno_t pr_largest_acked;
+    lsquic_packno_t pr_round_end;       /* Round ends when this is acked */
+    lsquic_packno_t pr_cwr_end;         /* One reduction per round */
+    lsquic_time_t   pr_min_rtt;
+    lsquic_time_t   pr_round_min_rtt;
+    unsigned        pr_classic_rounds;  /* Consecutive classic-looking rounds */
+    enum {
+        PR_IN_CWR       = 1 << 0,       /* Window reduced this round */
+        PR_CE_IN_ROUND  = 1 << 1,
+        PR_CLASSIC      = 1 << 2,       /* Fell back to classic ECN */
+    }               pr_flags;
+};
+
+#define PRAGUE_ALPHA_SCALE (1 << 20)
+
+extern const struct cong_ctl_if lsquic_cong_prague_if;
+
+#endif
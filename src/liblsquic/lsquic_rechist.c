@@ -1,6 +1,21 @@
 /* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
 /*
  * lsquic_rechist.c -- History of received packets.
+ *
+ * Received packet numbers are stored as bits in 64-bit chunks.  A packet
+ * is inserted and checked for duplicates by setting or testing a single
+ * bit.  Ranges are extracted by counting leading zeroes, which skips up to
+ * 63 packet numbers at a time, no matter how many gaps there are.
+ *
+ * Packets mostly arrive in order and old history is dropped as ACKs are
+ * acknowledged, so chunks are added at the top and removed at the bottom.
+ * Both operations are O(1).  Reordered packets usually land in one of the
+ * top chunks, which are checked first.
+ *
+ * The number of ranges is kept current as bits are set, so that the
+ * limit on the number of ranges can be enforced cheaply: when the limit
+ * is exceeded, the lowest range is dropped.  The number of chunks is
+ * limited as well, as a single range can span many chunks.
  */
 
 #include <assert.h>
@@ -16,13 +31,66 @@
 #include "lsquic_rechist.h"
 
 
-#define BITS_PER_MASK (sizeof(uintptr_t) * 8)
+#define CHUNK_BITS 64
+#define CHUNK_BASE(packno_) ((packno_) & ~(lsquic_packno_t) (CHUNK_BITS - 1))
+#define CHUNK_BIT(packno_) ((unsigned) ((packno_) & (CHUNK_BITS - 1)))
 
-#if UINTPTR_MAX == 18446744073709551615UL
-#define LOG2_BITS 6
+/* When there is a limit on the number of ranges, there is a limit on the
+ * number of chunks, too.  1024 chunks cover 65536 packet numbers.
+ */
+#define MAX_CHUNKS 1024
+
+
+static unsigned
+count_leading_zeroes (uint64_t x)
+{
+    assert(x);
+#if __GNUC__
+    return __builtin_clzll(x);
 #else
-#define LOG2_BITS 5
+    unsigned n = 0;
+    if (0 == (x >> 32)) { n += 32; x <<= 32; }
+    if (0 == (x >> 48)) { n += 16; x <<= 16; }
+    if (0 == (x >> 56)) { n +=  8; x <<=  8; }
+    if (0 == (x >> 60)) { n +=  4; x <<=  4; }
+    if (0 == (x >> 62)) { n +=  2; x <<=  2; }
+    if (0 == (x >> 63)) { n +=  1; }
+    return n;
 #endif
+}
+
+
+static unsigned
+count_trailing_zeroes (uint64_t x)
+{
+    assert(x);
+#if __GNUC__
+    return __builtin_ctzll(x);
+#else
+    unsigned n = 0;
+    if (0 == (x & 0xFFFFFFFFu)) { n += 32; x >>= 32; }
+    if (0 == (x & 0xFFFFu))     { n += 16; x >>= 16; }
+    if (0 == (x & 0xFFu))       { n +=  8; x >>=  8; }
+    if (0 == (x & 0xFu))        { n +=  4; x >>=  4; }
+    if (0 == (x & 0x3u))        { n +=  2; x >>=  2; }
+    if (0 == (x & 0x1u))        { n +=  1; }
+    return n;
+#endif
+}
+
+
+static unsigned
+count_ones (uint64_t x)
+{
+#if __GNUC__
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (x * 0x0101010101010101ULL) >> 56;
+#endif
+}
 
 
 void
@@ -31,11 +99,6 @@ lsquic_rechist_init (struct lsquic_rechist *rechist, int ietf,
 {
     memset(rechist, 0, sizeof(*rechist));
     rechist->rh_cutoff = ietf ? 0 : 1;
-    /* '1' is an odd case that would add an extra conditional in
-     * rechist_reuse_last_elem(), so we prohibit it.
-     */
-    if (max_ranges == 1)
-        max_ranges = 2;
     rechist->rh_max_ranges = max_ranges;
 }
 
@@ -43,190 +106,228 @@ lsquic_rechist_init (struct lsquic_rechist *rechist, int ietf,
 void
 lsquic_rechist_cleanup (lsquic_rechist_t *rechist)
 {
-    free(rechist->rh_elems);
+    free(rechist->rh_chunks);
     memset(rechist, 0, sizeof(*rechist));
 }
 
 
-static void
-rechist_free_elem (struct lsquic_rechist *rechist, unsigned idx)
-{
-    rechist->rh_masks[idx >> LOG2_BITS] &=
-                                ~(1ull << (idx & ((1u << LOG2_BITS) - 1)));
-    --rechist->rh_n_used;
-}
-
+#define FIRST_CHUNK(rechist_) (&(rechist_)->rh_chunks[(rechist_)->rh_first])
+#define LAST_CHUNK(rechist_) (&(rechist_)->rh_chunks[(rechist_)->rh_first \
+                                            + (rechist_)->rh_n_chunks - 1])
+#define END_IDX(rechist_) ((rechist_)->rh_first + (rechist_)->rh_n_chunks)
 
-#define RE_HIGH(el_) ((el_)->re_low + (el_)->re_count - 1)
 
-#if LSQUIC_TEST
-static void
-rechist_dump_elem(struct rechist_elem *el)
+/* Returns index of the chunk with `base' or the index where such chunk
+ * would be inserted.
+ */
+static unsigned
+rechist_find_chunk (const struct lsquic_rechist *rechist,
+                                                    lsquic_packno_t base)
 {
-    fprintf(stderr, "[%" PRIu64 "-%" PRIu64 "]", RE_HIGH(el), el->re_low);
+    unsigned low, high, mid;
+
+    /* Most packets land in one of the top chunks */
+    high = END_IDX(rechist);
+    if (base > rechist->rh_chunks[high - 1].rc_base)
+        return high;
+    if (base == rechist->rh_chunks[high - 1].rc_base)
+        return high - 1;
+
+    low = rechist->rh_first;
+    --high;
+    while (low < high)
+    {
+        mid = low + (high - low) / 2;
+        if (rechist->rh_chunks[mid].rc_base < base)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
 }
 
-#ifdef __GNUC__
-__attribute__((unused))
-#endif
-static void
-rechist_dump(struct lsquic_rechist *rechist)
+
+static int
+rechist_test_bit (const struct lsquic_rechist *rechist, lsquic_packno_t packno)
 {
-    fprintf(stderr,
-            "%p: cutoff %" PRIu64 " l. acked %" PRIu64
-            " masks %u alloced %u used %u max ranges %u head %u\n",
-            rechist,
-            rechist->rh_cutoff, 
-            rechist->rh_largest_acked_received,
-            rechist->rh_n_masks,
-            rechist->rh_n_alloced,
-            rechist->rh_n_used,
-            rechist->rh_max_ranges,
-            rechist->rh_head);
+    unsigned idx;
 
-    if (rechist->rh_n_used)
-    {
-        int idx = rechist->rh_head;
-        fprintf(stderr, " ");
-        unsigned n_elems = 0;
-        while (n_elems < rechist->rh_n_used)
-        {
-            ++n_elems;
-            struct rechist_elem *el =  &rechist->rh_elems[idx];
-            fprintf(stderr, " (%u)", idx); 
-            rechist_dump_elem(el);            
-            if (el->re_next == UINT_MAX)
-                break;
-            idx = el->re_next;
-        }
-        fprintf(stderr, "\n");
-    }
+    idx = rechist_find_chunk(rechist, CHUNK_BASE(packno));
+    return idx < END_IDX(rechist)
+        && rechist->rh_chunks[idx].rc_base == CHUNK_BASE(packno)
+        && (rechist->rh_chunks[idx].rc_bits >> CHUNK_BIT(packno) & 1);
 }
-#endif /* LSQUIC_TEST */
 
-static unsigned
-find_free_slot (uintptr_t slots)
+
+/* Make room for a chunk at index `idx'.  Returns index of the new slot
+ * (it may have shifted) or -1 on failure.
+ */
+static int
+rechist_insert_chunk (struct lsquic_rechist *rechist, unsigned idx,
+                                                    lsquic_packno_t base)
 {
-#if __GNUC__
-    if (slots)
-#if UINTPTR_MAX == 18446744073709551615UL
-        return __builtin_ctzll(~slots);
-#else
-        return __builtin_ctzl(~slots);
-#endif
+    struct rechist_chunk *chunks;
+    unsigned n_alloced;
+
+    if (rechist->rh_n_chunks == 0)
+        rechist->rh_first = idx = 0;
+
+    if (idx == rechist->rh_first && rechist->rh_first > 0)
+        idx = --rechist->rh_first;
+    else if (END_IDX(rechist) < rechist->rh_n_alloced)
+        memmove(&rechist->rh_chunks[idx + 1], &rechist->rh_chunks[idx],
+                        (END_IDX(rechist) - idx) * sizeof(chunks[0]));
+    else if (rechist->rh_first > 0)
+    {
+        memmove(&rechist->rh_chunks[rechist->rh_first - 1],
+                    &rechist->rh_chunks[rechist->rh_first],
+                    (idx - rechist->rh_first) * sizeof(chunks[0]));
+        --rechist->rh_first;
+        --idx;
+    }
     else
-        return 0;
-#else
-    unsigned n;
+    {
+        n_alloced = rechist->rh_n_alloced ? rechist->rh_n_alloced * 2 : 4;
+        chunks = realloc(rechist->rh_chunks, n_alloced * sizeof(chunks[0]));
+        if (!chunks)
+            return -1;
+        rechist->rh_chunks = chunks;
+        rechist->rh_n_alloced = n_alloced;
+        memmove(&rechist->rh_chunks[idx + 1], &rechist->rh_chunks[idx],
+                        (END_IDX(rechist) - idx) * sizeof(chunks[0]));
+    }
 
-    slots =~ slots;
-    n = 0;
+    rechist->rh_chunks[idx].rc_base = base;
+    rechist->rh_chunks[idx].rc_bits = 0;
+    ++rechist->rh_n_chunks;
+    return idx;
+}
 
-#if UINTPTR_MAX == 18446744073709551615UL
-    if (0 == (slots & ((1ULL << 32) - 1))) { n += 32; slots >>= 32; }
-#endif
-    if (0 == (slots & ((1ULL << 16) - 1))) { n += 16; slots >>= 16; }
-    if (0 == (slots & ((1ULL <<  8) - 1))) { n +=  8; slots >>=  8; }
-    if (0 == (slots & ((1ULL <<  4) - 1))) { n +=  4; slots >>=  4; }
-    if (0 == (slots & ((1ULL <<  2) - 1))) { n +=  2; slots >>=  2; }
-    if (0 == (slots & ((1ULL <<  1) - 1))) { n +=  1; slots >>=  1; }
-    return n;
-#endif
+
+static void
+rechist_remove_chunk (struct lsquic_rechist *rechist, unsigned idx)
+{
+    if (idx == rechist->rh_first)
+        ++rechist->rh_first;
+    else if (idx + 1 < END_IDX(rechist))
+        memmove(&rechist->rh_chunks[idx], &rechist->rh_chunks[idx + 1],
+            (END_IDX(rechist) - idx - 1) * sizeof(rechist->rh_chunks[0]));
+    --rechist->rh_n_chunks;
 }
 
 
-static int
-rechist_grow (struct lsquic_rechist *rechist)
+/* Bits that start a range: the bit below is not set */
+static uint64_t
+range_starts (const struct lsquic_rechist *rechist, unsigned idx)
 {
-    unsigned n_masks, nelems;
-    size_t size;
-    ptrdiff_t moff;
-    char *mem;
-
-    moff = (char *) rechist->rh_masks - (char *) rechist->rh_elems;
-    if (rechist->rh_n_alloced)
-        nelems = rechist->rh_n_alloced * 2;
-    else
-        nelems = 4;
-    if (rechist->rh_max_ranges && nelems > rechist->rh_max_ranges)
-        nelems = rechist->rh_max_ranges;
-    n_masks = (nelems + (-nelems & (BITS_PER_MASK - 1))) / BITS_PER_MASK;
-    size = sizeof(struct rechist_elem) * nelems + sizeof(uintptr_t) * n_masks;
-    mem = realloc(rechist->rh_elems, size);
-    if (!mem)
-        return -1;
-    if (moff)
-        memcpy(mem + size - n_masks * sizeof(rechist->rh_masks[0]),
-            (char *) mem + moff,
-            rechist->rh_n_masks * sizeof(rechist->rh_masks[0]));
-    if (rechist->rh_n_masks < n_masks)
-        memset(mem + nelems * sizeof(rechist->rh_elems[0])
-            + rechist->rh_n_masks * sizeof(rechist->rh_masks[0]),
-            0, (n_masks - rechist->rh_n_masks) * sizeof(rechist->rh_masks[0]));
-    rechist->rh_n_alloced = nelems;
-    rechist->rh_n_masks = n_masks;
-    rechist->rh_elems = (void *) mem;
-    rechist->rh_masks = (void *) (mem + size
-                                    - n_masks * sizeof(rechist->rh_masks[0]));
-    return 0;
+    const struct rechist_chunk *const chunk = &rechist->rh_chunks[idx];
+    uint64_t starts;
+
+    starts = chunk->rc_bits & ~(chunk->rc_bits << 1);
+    if (idx > rechist->rh_first
+            && chunk[-1].rc_base + CHUNK_BITS == chunk->rc_base
+            && (chunk[-1].rc_bits >> (CHUNK_BITS - 1)))
+        starts &= ~1ULL;
+    return starts;
 }
 
 
-/* We hit maximum number of elements.  To allocate a new element, we drop
- * the last element and return its index, reusing the slot.
- */
-static int
-rechist_reuse_last_elem (struct lsquic_rechist *rechist)
+static unsigned
+rechist_count_ranges (const struct lsquic_rechist *rechist)
 {
-    struct rechist_elem *last, *penultimate;
-    unsigned last_idx;
+    unsigned idx, count;
 
-    /* No need to check bitmask anywhere: the array is full! */
-    last = rechist->rh_elems;
-    while (last->re_next != UINT_MAX)
-        ++last;
+    count = 0;
+    for (idx = rechist->rh_first; idx < END_IDX(rechist); ++idx)
+        count += count_ones(range_starts(rechist, idx));
+    return count;
+}
 
-    last_idx = last - rechist->rh_elems;
-    penultimate = rechist->rh_elems;
-    while (penultimate->re_next != last_idx)
-        ++penultimate;
 
-    penultimate->re_next = UINT_MAX;
-    return last_idx;
+/* Drop the lowest chunk.  A range that continues into the next chunk is
+ * truncated rather than dropped.
+ */
+static void
+rechist_drop_lowest_chunk (struct lsquic_rechist *rechist)
+{
+    const struct rechist_chunk *const chunk = FIRST_CHUNK(rechist);
+    unsigned n_dropped;
+
+    n_dropped = count_ones(range_starts(rechist, rechist->rh_first));
+    if (rechist->rh_n_chunks > 1
+                && chunk[1].rc_base == chunk->rc_base + CHUNK_BITS
+                && (chunk[1].rc_bits & 1)
+                && (chunk->rc_bits >> (CHUNK_BITS - 1)))
+        --n_dropped;    /* The range goes on */
+    rechist_remove_chunk(rechist, rechist->rh_first);
+    rechist->rh_n_ranges -= n_dropped;
 }
 
 
-static int
-rechist_alloc_elem (struct lsquic_rechist *rechist)
+static void
+rechist_drop_lowest_range (struct lsquic_rechist *rechist)
 {
-    unsigned i, idx;
-    uintptr_t *mask;
+    struct rechist_chunk *chunk;
+    uint64_t run;
+    unsigned low, len;
 
-    if (rechist->rh_n_used == rechist->rh_n_alloced)
+    chunk = FIRST_CHUNK(rechist);
+    while (1)
     {
-        if (rechist->rh_max_ranges
-                            && rechist->rh_n_used >= rechist->rh_max_ranges)
-            return rechist_reuse_last_elem(rechist);
-        if (0 != rechist_grow(rechist))
-            return -1;
+        low = count_trailing_zeroes(chunk->rc_bits);
+        run = ~(chunk->rc_bits >> low);
+        len = run ? count_trailing_zeroes(run) : CHUNK_BITS - low;
+        if (low + len < CHUNK_BITS)
+        {
+            chunk->rc_bits &= ~(((1ULL << len) - 1) << low);
+            break;
+        }
+        /* The range reaches the top of the chunk: it may continue into
+         * the next one.
+         */
+        chunk->rc_bits &= (1ULL << low) - 1;
+        if (!(rechist->rh_n_chunks > 1
+                    && chunk[1].rc_base == chunk->rc_base + CHUNK_BITS
+                    && (chunk[1].rc_bits & 1)))
+            break;
+        assert(chunk->rc_bits == 0);
+        rechist_remove_chunk(rechist, rechist->rh_first);
+        chunk = FIRST_CHUNK(rechist);
     }
+    if (chunk->rc_bits == 0)
+        rechist_remove_chunk(rechist, rechist->rh_first);
+    --rechist->rh_n_ranges;
+}
 
-    for (mask = rechist->rh_masks; *mask == UINTPTR_MAX; ++mask)
-        ;
-
-    i = mask - rechist->rh_masks;
-    assert(i < rechist->rh_n_masks);
 
-    idx = find_free_slot(*mask);
-    *mask |= 1ull << idx;
-    ++rechist->rh_n_used;
-    /* Note that re_next is invalid at this point, caller must set it */
+#if LSQUIC_TEST
+#ifdef __GNUC__
+__attribute__((unused))
+#endif
+static void
+rechist_dump (struct lsquic_rechist *rechist)
+{
+    unsigned idx;
 
-    return idx + i * BITS_PER_MASK;
+    fprintf(stderr,
+            "%p: cutoff %" PRIu64 " l. acked %" PRIu64
+            " first %u chunks %u alloced %u ranges %u max ranges %u\n",
+            rechist,
+            rechist->rh_cutoff,
+            rechist->rh_largest_acked_received,
+            rechist->rh_first,
+            rechist->rh_n_chunks,
+            rechist->rh_n_alloced,
+            rechist->rh_n_ranges,
+            rechist->rh_max_ranges);
+    for (idx = rechist->rh_first; idx < END_IDX(rechist); ++idx)
+        fprintf(stderr, " [%" PRIu64 ": %016" PRIX64 "]",
+            rechist->rh_chunks[idx].rc_base, rechist->rh_chunks[idx].rc_bits);
+    if (rechist->rh_n_chunks)
+        fprintf(stderr, "\n");
 }
 
 
-#if LSQUIC_TEST
 /* When compiled as unit test, run sanity check every 127 operations
  * (127 is better than 128, as the latter aligns too well with the
  * regular rechist data structure sizes).
@@ -234,36 +335,24 @@ rechist_alloc_elem (struct lsquic_rechist *rechist)
 static void
 rechist_test_sanity (const struct lsquic_rechist *rechist)
 {
-    const struct rechist_elem *el;
-    ptrdiff_t idx;
-    uint64_t *masks;
-    unsigned n_elems;
+    static unsigned count;
+    unsigned idx;
 
-    masks = calloc(rechist->rh_n_masks, sizeof(masks[0]));
+    if (++count % 127)
+        return;
 
-    n_elems = 0;
-    if (rechist->rh_n_used)
+    assert(rechist->rh_first + rechist->rh_n_chunks <= rechist->rh_n_alloced);
+    for (idx = rechist->rh_first; idx < END_IDX(rechist); ++idx)
     {
-        el = &rechist->rh_elems[rechist->rh_head];
-        while (1)
-        {
-            ++n_elems;
-            idx = el - rechist->rh_elems;
-            if (n_elems > rechist->rh_n_alloced
-                || idx >=  rechist->rh_n_alloced)
-                break;
-            masks[idx >> LOG2_BITS] |= 1ull << (idx & ((1u << LOG2_BITS) - 1));
-            if (el->re_next != UINT_MAX)
-                el = &rechist->rh_elems[el->re_next];
-            else
-                break;
-        }
+        assert(rechist->rh_chunks[idx].rc_bits);
+        assert(0 == CHUNK_BIT(rechist->rh_chunks[idx].rc_base));
+        if (idx > rechist->rh_first)
+            assert(rechist->rh_chunks[idx - 1].rc_base
+                                        < rechist->rh_chunks[idx].rc_base);
     }
-
-    assert(rechist->rh_n_used == n_elems);
-    assert(0 == memcmp(masks, rechist->rh_masks,
-                                    sizeof(masks[0]) * rechist->rh_n_masks));
-    free(masks);
+    assert(rechist->rh_n_ranges == rechist_count_ranges(rechist));
+    if (rechist->rh_max_ranges)
+        assert(rechist->rh_n_ranges <= rechist->rh_max_ranges);
 }
 #define rechist_sanity_check(rechist_) do {                         \
         rechist_test_sanity(rechist_);                              \
@@ -277,112 +366,66 @@ enum received_st
 lsquic_rechist_received (lsquic_rechist_t *rechist, lsquic_packno_t packno,
                          lsquic_time_t now)
 {
-    struct rechist_elem *el, *prev;
-    ptrdiff_t next_idx, prev_idx;
-    int idx;
+    const lsquic_packno_t base = CHUNK_BASE(packno);
+    const unsigned bit = CHUNK_BIT(packno);
+    struct rechist_chunk *chunk;
+    int idx, below, above;
 
-    if (rechist->rh_n_used == 0)
-        goto first_elem;
+    if (rechist->rh_n_chunks == 0)
+    {
+        if (packno < rechist->rh_cutoff)
+            return REC_ST_ERR;
+        idx = rechist_insert_chunk(rechist, 0, base);
+        if (idx < 0)
+            return REC_ST_ERR;
+        rechist->rh_chunks[idx].rc_bits = 1ULL << bit;
+        rechist->rh_n_ranges = 1;
+        rechist->rh_largest_acked_received = now;
+        rechist_sanity_check(rechist);
+        return REC_ST_OK;
+    }
 
     if (packno < rechist->rh_cutoff)
         return REC_ST_DUP;
 
-    el = &rechist->rh_elems[rechist->rh_head];
-    prev = NULL;
-
-    if (packno > RE_HIGH(el))
+    if (packno > lsquic_rechist_largest_packno(rechist))
         rechist->rh_largest_acked_received = now;
 
-    while (1)
+    idx = rechist_find_chunk(rechist, base);
+    chunk = &rechist->rh_chunks[idx];
+    if ((unsigned) idx < END_IDX(rechist) && chunk->rc_base == base)
     {
-        if (packno > RE_HIGH(el) + 1)
-            goto insert_before;
-        if (packno == el->re_low - 1)
-        {
-            --el->re_low;
-            ++el->re_count;
-            if (el->re_next != UINT_MAX
-                && el->re_low == RE_HIGH(&rechist->rh_elems[el->re_next]) + 1)
-            {
-                rechist_free_elem(rechist, el->re_next);
-                el->re_count += rechist->rh_elems[el->re_next].re_count;
-                el->re_low    = rechist->rh_elems[el->re_next].re_low;
-                el->re_next   = rechist->rh_elems[el->re_next].re_next;
-            }
-            rechist_sanity_check(rechist);
-            return REC_ST_OK;
-        }
-        if (packno == RE_HIGH(el) + 1)
-        {
-            ++el->re_count;
-            rechist_sanity_check(rechist);
-            return REC_ST_OK;
-        }
-        if (packno >= el->re_low && packno <= RE_HIGH(el))
+        if (chunk->rc_bits >> bit & 1)
             return REC_ST_DUP;
-        if (el->re_next == UINT_MAX)
-            break;  /* insert tail */
-        prev = el;
-        el = &rechist->rh_elems[el->re_next];
+    }
+    else
+    {
+        idx = rechist_insert_chunk(rechist, idx, base);
+        if (idx < 0)
+            return REC_ST_ERR;
+        chunk = &rechist->rh_chunks[idx];
     }
 
-    if (rechist->rh_max_ranges && rechist->rh_n_used >= rechist->rh_max_ranges)
-        goto replace_last_el;
-    prev_idx = el - rechist->rh_elems;
-    idx = rechist_alloc_elem(rechist);
-    if (idx < 0)
-        return REC_ST_ERR;
-
-    rechist->rh_elems[idx].re_low   = packno;
-    rechist->rh_elems[idx].re_count = 1;
-    rechist->rh_elems[idx].re_next  = UINT_MAX;
-    rechist->rh_elems[prev_idx].re_next  = idx;
-    rechist_sanity_check(rechist);
-    return REC_ST_OK;
-
-  first_elem:
-    if (packno < rechist->rh_cutoff)
-        return REC_ST_ERR;
-    idx = rechist_alloc_elem(rechist);
-    if (idx < 0)
-        return REC_ST_ERR;
-
-    rechist->rh_elems[idx].re_low   = packno;
-    rechist->rh_elems[idx].re_count = 1;
-    rechist->rh_elems[idx].re_next  = UINT_MAX;
-    rechist->rh_head = idx;
-    rechist->rh_largest_acked_received = now;
-    rechist_sanity_check(rechist);
-    return REC_ST_OK;
-
-  insert_before:
-    if (el->re_next == UINT_MAX && rechist->rh_max_ranges
-                            && rechist->rh_n_used >= rechist->rh_max_ranges)
-        goto replace_last_el;
-    prev_idx = prev - rechist->rh_elems;
-    next_idx = el - rechist->rh_elems;
-    idx = rechist_alloc_elem(rechist);
-    if (idx < 0)
-        return REC_ST_ERR;
-
-    rechist->rh_elems[idx].re_low   = packno;
-    rechist->rh_elems[idx].re_count = 1;
-    rechist->rh_elems[idx].re_next  = next_idx;
-    if (next_idx == (ptrdiff_t)rechist->rh_head)
-        rechist->rh_head = idx;
+    /* Neighbors are usually in the same chunk */
+    if (bit > 0)
+        below = chunk->rc_bits >> (bit - 1) & 1;
+    else
+        below = packno > 0 && rechist_test_bit(rechist, packno - 1);
+    if (bit < CHUNK_BITS - 1)
+        above = chunk->rc_bits >> (bit + 1) & 1;
     else
-        rechist->rh_elems[prev_idx].re_next = idx;
+        above = rechist_test_bit(rechist, packno + 1);
+    chunk->rc_bits |= 1ULL << bit;
+    rechist->rh_n_ranges += 1 - below - above;
 
-    rechist_sanity_check(rechist);
-    return REC_ST_OK;
+    if (rechist->rh_max_ranges)
+    {
+        if (rechist->rh_n_ranges > rechist->rh_max_ranges)
+            rechist_drop_lowest_range(rechist);
+        if (rechist->rh_n_chunks > MAX_CHUNKS)
+            rechist_drop_lowest_chunk(rechist);
+    }
 
-  replace_last_el:
-    /* Special case: replace last element if chopping, because we cannot
-     * realloc the "prev_idx" hook
-     */
-    assert(el->re_next == UINT_MAX);
-    el->re_low   = packno;
-    el->re_count = 1;
     rechist_sanity_check(rechist);
     return REC_ST_OK;
 }
@@ -391,7 +434,7 @@ lsquic_rechist_received (lsquic_rechist_t *rechist, lsquic_packno_t packno,
 void
 lsquic_rechist_stop_wait (lsquic_rechist_t *rechist, lsquic_packno_t cutoff)
 {
-    struct rechist_elem *el, *prev;
+    struct rechist_chunk *chunk;
 
     if (rechist->rh_flags & RH_CUTOFF_SET)
     {
@@ -403,50 +446,25 @@ lsquic_rechist_stop_wait (lsquic_rechist_t *rechist, lsquic_packno_t cutoff)
     rechist->rh_cutoff = cutoff;
     rechist->rh_flags |= RH_CUTOFF_SET;
 
-    if (rechist->rh_n_used == 0)
+    if (rechist->rh_n_chunks == 0)
         return;
 
-    el = &rechist->rh_elems[rechist->rh_head];
-    prev = NULL;
-    while (1)
+    while (rechist->rh_n_chunks
+                && FIRST_CHUNK(rechist)->rc_base + CHUNK_BITS <= cutoff)
+        rechist_remove_chunk(rechist, rechist->rh_first);
+
+    if (rechist->rh_n_chunks)
     {
-        if (cutoff > RE_HIGH(el))
-        {
-            if (prev)
-                prev->re_next = UINT_MAX;
-            break;
-        }
-        else if (cutoff > el->re_low)
+        chunk = FIRST_CHUNK(rechist);
+        if (chunk->rc_base < cutoff)
         {
-            el->re_count = RE_HIGH(el) - cutoff + 1;
-            el->re_low = cutoff;
-            if (el->re_next != UINT_MAX)
-            {
-                prev = el;
-                el = &rechist->rh_elems[el->re_next];
-                prev->re_next = UINT_MAX;
-                break;
-            }
-            else
-                goto end;
+            chunk->rc_bits &= ~((1ULL << CHUNK_BIT(cutoff)) - 1);
+            if (chunk->rc_bits == 0)
+                rechist_remove_chunk(rechist, rechist->rh_first);
         }
-        else if (el->re_next == UINT_MAX)
-            goto end;
-        prev = el;
-        el = &rechist->rh_elems[el->re_next];
     }
 
-    assert(el);
-    while (1)
-    {
-        rechist_free_elem(rechist, el - rechist->rh_elems);
-        if (el->re_next != UINT_MAX)
-            el = &rechist->rh_elems[el->re_next];
-        else
-            break;
-    }
-
-  end:
+    rechist->rh_n_ranges = rechist_count_ranges(rechist);
     rechist_sanity_check(rechist);
 }
 
@@ -454,8 +472,14 @@ lsquic_rechist_stop_wait (lsquic_rechist_t *rechist, lsquic_packno_t cutoff)
 lsquic_packno_t
 lsquic_rechist_largest_packno (const lsquic_rechist_t *rechist)
 {
-    if (rechist->rh_n_used)
-        return RE_HIGH(&rechist->rh_elems[rechist->rh_head]);
+    const struct rechist_chunk *chunk;
+
+    if (rechist->rh_n_chunks)
+    {
+        chunk = LAST_CHUNK(rechist);
+        return chunk->rc_base + CHUNK_BITS - 1
+                                    - count_leading_zeroes(chunk->rc_bits);
+    }
     else
         return 0;   /* Don't call this function if history is empty */
 }
@@ -478,19 +502,63 @@ lsquic_rechist_largest_recv (const lsquic_rechist_t *rechist)
 }
 
 
-const struct lsquic_packno_range *
-lsquic_rechist_first (lsquic_rechist_t *rechist)
+/* Find the highest range below `limit', starting search at chunk `idx'
+ * and going down.
+ */
+static const struct lsquic_packno_range *
+rechist_range_below (struct lsquic_rechist *rechist, unsigned idx,
+                                                    lsquic_packno_t limit)
 {
-    unsigned idx;
+    const struct rechist_chunk *chunk;
+    uint64_t bits;
+    unsigned top;
+
+    for (bits = 0; idx >= rechist->rh_first && idx < END_IDX(rechist); --idx)
+    {
+        chunk = &rechist->rh_chunks[idx];
+        bits = chunk->rc_bits;
+        if (limit <= chunk->rc_base)
+            bits = 0;
+        else if (limit - chunk->rc_base < CHUNK_BITS)
+            bits &= (1ULL << (limit - chunk->rc_base)) - 1;
+        if (bits)
+            break;
+    }
+    if (!bits)
+        return NULL;
 
-    if (rechist->rh_n_used)
+    top = CHUNK_BITS - 1 - count_leading_zeroes(bits);
+    rechist->rh_iter.range.high = chunk->rc_base + top;
+
+    /* Look for a clear bit below the top, crossing into adjacent chunks
+     * if necessary.
+     */
+    bits = ~chunk->rc_bits & ((2ULL << top) - 1);
+    while (bits == 0 && idx > rechist->rh_first
+                && chunk[-1].rc_base + CHUNK_BITS == chunk->rc_base
+                && (chunk[-1].rc_bits >> (CHUNK_BITS - 1)))
     {
-        idx = rechist->rh_head;
-        rechist->rh_iter.range.low  = rechist->rh_elems[idx].re_low;
-        rechist->rh_iter.range.high = RE_HIGH(&rechist->rh_elems[idx]);
-        rechist->rh_iter.next       = rechist->rh_elems[idx].re_next;
-        return &rechist->rh_iter.range;
+        --idx;
+        --chunk;
+        bits = ~chunk->rc_bits;
     }
+    if (bits)
+        rechist->rh_iter.range.low = chunk->rc_base + CHUNK_BITS
+                                                - count_leading_zeroes(bits);
+    else
+        rechist->rh_iter.range.low = chunk->rc_base;
+    rechist->rh_iter.chunk = idx;
+
+    return &rechist->rh_iter.range;
+}
+
+
+const struct lsquic_packno_range *
+lsquic_rechist_first (lsquic_rechist_t *rechist)
+{
+    if (rechist->rh_n_chunks)
+        return rechist_range_below(rechist, END_IDX(rechist) - 1,
+                                                    ~(lsquic_packno_t) 0);
     else
         return NULL;
 }
@@ -499,16 +567,9 @@ lsquic_rechist_first (lsquic_rechist_t *rechist)
 const struct lsquic_packno_range *
 lsquic_rechist_next (lsquic_rechist_t *rechist)
 {
-    unsigned idx;
-
-    idx = rechist->rh_iter.next;
-    if (idx != UINT_MAX)
-    {
-        rechist->rh_iter.range.low  = rechist->rh_elems[idx].re_low;
-        rechist->rh_iter.range.high = RE_HIGH(&rechist->rh_elems[idx]);
-        rechist->rh_iter.next       = rechist->rh_elems[idx].re_next;
-        return &rechist->rh_iter.range;
-    }
+    if (rechist->rh_iter.range.low > 0)
+        return rechist_range_below(rechist, rechist->rh_iter.chunk,
+                                                rechist->rh_iter.range.low);
     else
         return NULL;
 }
@@ -518,24 +579,49 @@ size_t
 lsquic_rechist_mem_used (const struct lsquic_rechist *rechist)
 {
     return sizeof(*rechist)
-         + rechist->rh_n_alloced * sizeof(rechist->rh_elems[0])
-         + rechist->rh_n_masks * sizeof(rechist->rh_masks[0]);
+         + rechist->rh_n_alloced * sizeof(rechist->rh_chunks[0]);
 }
 
 
 const struct lsquic_packno_range *
 lsquic_rechist_peek (struct lsquic_rechist *rechist)
 {
-    if (rechist->rh_n_used)
+    return lsquic_rechist_first(rechist);
+}
+
+
+static int
+rechist_set_range (struct lsquic_rechist *rechist,
+                                    lsquic_packno_t low, lsquic_packno_t high)
+{
+    lsquic_packno_t base;
+    uint64_t bits;
+    unsigned idx;
+    int new_idx;
+
+    for (base = CHUNK_BASE(low); base <= high; base += CHUNK_BITS)
     {
-        rechist->rh_iter.range.low
-                            = rechist->rh_elems[rechist->rh_head].re_low;
-        rechist->rh_iter.range.high
-                            = RE_HIGH(&rechist->rh_elems[rechist->rh_head]);
-        return &rechist->rh_iter.range;
+        bits = ~0ULL;
+        if (low > base)
+            bits &= ~((1ULL << CHUNK_BIT(low)) - 1);
+        if (high - base < CHUNK_BITS - 1)
+            bits &= (2ULL << CHUNK_BIT(high)) - 1;
+        if (rechist->rh_n_chunks)
+            idx = rechist_find_chunk(rechist, base);
+        else
+            idx = 0;
+        if (!(idx < END_IDX(rechist) && rechist->rh_chunks[idx].rc_base == base))
+        {
+            new_idx = rechist_insert_chunk(rechist, idx, base);
+            if (new_idx < 0)
+                return -1;
+            idx = new_idx;
+        }
+        rechist->rh_chunks[idx].rc_bits |= bits;
+        if (base + CHUNK_BITS < base)
+            break;  /* Overflow */
     }
-    else
-        return NULL;
+    return 0;
 }
 
 
@@ -545,35 +631,23 @@ lsquic_rechist_copy_ranges (struct lsquic_rechist *rechist, void *src_rechist,
     const struct lsquic_packno_range * (*next) (void *))
 {
     const struct lsquic_packno_range *range;
-    struct rechist_elem *el;
-    unsigned prev_idx;
-    int idx;
+    unsigned n_ranges;
 
     /* This function only works if rechist contains no elements */
-    assert(rechist->rh_n_used == 0);
+    assert(rechist->rh_n_chunks == 0);
 
-    prev_idx = UINT_MAX;
+    n_ranges = 0;
     for (range = first(src_rechist); range &&
-            /* Do not overwrite higher-numbered ranges.  (Also, logic below
-             * does not work if rechist_reuse_last_elem() is used.)
-             */
-            (rechist->rh_max_ranges == 0
-                            || rechist->rh_n_used < rechist->rh_max_ranges);
+            /* Do not overwrite higher-numbered ranges */
+            (rechist->rh_max_ranges == 0 || n_ranges < rechist->rh_max_ranges);
                                                     range = next(src_rechist))
     {
-        idx = rechist_alloc_elem(rechist);
-        if (idx < 0)
+        if (0 != rechist_set_range(rechist, range->low, range->high))
             return -1;
-        el = &rechist->rh_elems[idx];
-        el->re_low = range->low;
-        el->re_count = range->high - range->low + 1;
-        el->re_next = UINT_MAX;
-        if (prev_idx == UINT_MAX)
-            rechist->rh_head = idx;
-        else
-            rechist->rh_elems[prev_idx].re_next = idx;
-        prev_idx = idx;
+        ++n_ranges;
     }
 
+    rechist->rh_n_ranges = rechist_count_ranges(rechist);
+    rechist_sanity_check(rechist);
     return 0;
 }
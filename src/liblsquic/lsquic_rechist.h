@@ -2,7 +2,8 @@
 /*
  * lsquic_rechist.h -- History of received packets.
  *
- * The purpose of received packet history is to generate ACK frames.
+ * The purpose of received packet history is to generate ACK frames and
+ * to detect duplicate packets.
  */
 
 #ifndef LSQUIC_RECHIST_H
@@ -12,24 +13,28 @@
 #define LSQUIC_TEST 0
 #endif
 
-/* Structure is exposed to facilitate some manipulations in unit tests. */
-struct rechist_elem {
-    lsquic_packno_t     re_low;
-    unsigned            re_count;
-    unsigned            re_next;    /* UINT_MAX means no next element */
+/* Packets are tracked using 64-bit bitmaps, one per 64 packet numbers.
+ * Only chunks with at least one bit set are kept.
+ */
+struct rechist_chunk {
+    lsquic_packno_t     rc_base;    /* Multiple of 64 */
+    uint64_t            rc_bits;    /* Bit N is packet number rc_base + N */
 };
 
 
+/* Structure is exposed to facilitate some manipulations in unit tests. */
 struct lsquic_rechist {
-    /* elems and masks are allocated in contiguous memory */
-    struct rechist_elem            *rh_elems;
-    uintptr_t                      *rh_masks;
+    /* Chunks are sorted by base in ascending order.  They occupy slots
+     * [rh_first, rh_first + rh_n_chunks) so that chunks can be added and
+     * removed at either end cheaply.
+     */
+    struct rechist_chunk           *rh_chunks;
     lsquic_packno_t                 rh_cutoff;
     lsquic_time_t                   rh_largest_acked_received;
-    unsigned                        rh_n_masks;
+    unsigned                        rh_first;
+    unsigned                        rh_n_chunks;
     unsigned                        rh_n_alloced;
-    unsigned                        rh_n_used;
-    unsigned                        rh_head;
+    unsigned                        rh_n_ranges;
     unsigned                        rh_max_ranges;
     enum {
         RH_CUTOFF_SET   = (1 << 0),
@@ -37,7 +42,7 @@ struct lsquic_rechist {
     struct
     {
         struct lsquic_packno_range      range;
-        unsigned                        next;
+        unsigned                        chunk;  /* Chunk with range.low */
     }                               rh_iter;
 };
 
@@ -83,7 +88,7 @@ lsquic_rechist_mem_used (const struct lsquic_rechist *);
 const struct lsquic_packno_range *
 lsquic_rechist_peek (struct lsquic_rechist *);
 
-#define lsquic_rechist_is_empty(rechist_) ((rechist_)->rh_n_used == 0)
+#define lsquic_rechist_is_empty(rechist_) ((rechist_)->rh_n_chunks == 0)
 
 int
 lsquic_rechist_copy_ranges (struct lsquic_rechist *, void *rechist_ctx,
@@ -30,6 +30,8 @@
 #include "lsquic_bw_sampler.h"
 #include "lsquic_minmax.h"
 #include "lsquic_bbr.h"
+#include "lsquic_bbr2.h"
+#include "lsquic_prague.h"
 #include "lsquic_adaptive_cc.h"
 #include "lsquic_util.h"
 #include "lsquic_sfcw.h"
@@ -41,6 +43,7 @@
 #include "lsquic_ev_log.h"
 #include "lsquic_conn.h"
 #include "lsquic_send_ctl.h"
+#include "lsquic_path_cache.h"
 #include "lsquic_conn_flow.h"
 #include "lsquic_conn_public.h"
 #include "lsquic_cong_ctl.h"
@@ -304,6 +307,11 @@ retx_alarm_rings (enum alarm_id al_id, void *ctx, lsquic_time_t expiry, lsquic_t
             ++ctl->sc_n_consec_rtos;
             ctl->sc_next_limit = 2;
             ctl->sc_ci->cci_timeout(CGP(ctl));
+            if (ctl->sc_flags & SC_RESUME)
+            {
+                LSQ_INFO("careful resume: abandoned due to RTO");
+                ctl->sc_flags &= ~SC_RESUME;
+            }
             if (lconn->cn_if->ci_retx_timeout)
                 lconn->cn_if->ci_retx_timeout(lconn);
         }
@@ -362,6 +370,8 @@ lsquic_send_ctl_init (lsquic_send_ctl_t *ctl, struct lsquic_alarmset *alset,
     TAILQ_INIT(&ctl->sc_unacked_packets[PNS_INIT]);
     TAILQ_INIT(&ctl->sc_unacked_packets[PNS_HSK]);
     TAILQ_INIT(&ctl->sc_unacked_packets[PNS_APP]);
+    for (i = 0; i < N_PNS; ++i)
+        lsquic_pnidx_init(&ctl->sc_unacked_idx[i]);
     TAILQ_INIT(&ctl->sc_lost_packets);
     TAILQ_INIT(&ctl->sc_0rtt_stash);
     ctl->sc_enpub = enpub;
@@ -372,7 +382,11 @@ lsquic_send_ctl_init (lsquic_send_ctl_t *ctl, struct lsquic_alarmset *alset,
     ctl->sc_flags = flags;
     send_ctl_pick_initial_packno(ctl);
     if (enpub->enp_settings.es_pace_packets)
+    {
         ctl->sc_flags |= SC_PACE;
+        if (enpub->enp_settings.es_txtime)
+            ctl->sc_flags |= SC_TXTIME;
+    }
     if (flags & SC_ECN)
         ctl->sc_ecn = ECN_ECT0;
     else
@@ -396,23 +410,35 @@ lsquic_send_ctl_init (lsquic_send_ctl_t *ctl, struct lsquic_alarmset *alset,
     {
     case 1:
         ctl->sc_ci = &lsquic_cong_cubic_if;
-        ctl->sc_cong_ctl = &ctl->sc_adaptive_cc.acc_cubic;
+        ctl->sc_cong_ctl = &ctl->sc_cc.adaptive.acc_cubic;
         break;
     case 2:
         ctl->sc_ci = &lsquic_cong_bbr_if;
-        ctl->sc_cong_ctl = &ctl->sc_adaptive_cc.acc_bbr;
+        ctl->sc_cong_ctl = &ctl->sc_cc.adaptive.acc_bbr;
+        break;
+    case 4:
+        ctl->sc_ci = &lsquic_cong_bbr2_if;
+        ctl->sc_cong_ctl = &ctl->sc_cc.bbr2;
+        break;
+    case 5:
+        ctl->sc_ci = &lsquic_cong_prague_if;
+        ctl->sc_cong_ctl = &ctl->sc_cc.prague;
+        /* L4S: ECT(1) instead of ECT(0) */
+        if (ctl->sc_ecn == ECN_ECT0)
+            ctl->sc_ecn = ECN_ECT1;
         break;
     case 3:
     default:
         ctl->sc_ci = &lsquic_cong_adaptive_if;
-        ctl->sc_cong_ctl = &ctl->sc_adaptive_cc;
+        ctl->sc_cong_ctl = &ctl->sc_cc.adaptive;
         break;
     }
     ctl->sc_ci->cci_init(CGP(ctl), conn_pub, ctl->sc_retx_frames);
     if (ctl->sc_flags & SC_PACE)
         lsquic_pacer_init(&ctl->sc_pacer, conn_pub->lconn,
         /* TODO: conn_pub has a pointer to enpub: drop third argument */
-                                    enpub->enp_settings.es_clock_granularity);
+                                    enpub->enp_settings.es_clock_granularity,
+                                    enpub->enp_settings.es_txtime);
     for (i = 0; i < sizeof(ctl->sc_buffered_packets) /
                                 sizeof(ctl->sc_buffered_packets[0]); ++i)
         TAILQ_INIT(&ctl->sc_buffered_packets[i].bpq_packets);
@@ -532,7 +558,8 @@ set_retx_alarm (struct lsquic_send_ctl *ctl, enum packnum_space pns,
     lsquic_alarmset_set(ctl->sc_alset, AL_RETX_INIT + pns, now + delay);
 
     if (PNS_APP == pns
-            && ctl->sc_ci == &lsquic_cong_bbr_if
+            && (ctl->sc_ci == &lsquic_cong_bbr_if
+                || ctl->sc_ci == &lsquic_cong_bbr2_if)
             && lsquic_alarmset_is_inited(ctl->sc_alset, AL_PACK_TOL)
             && !lsquic_alarmset_is_set(ctl->sc_alset, AL_PACK_TOL))
         lsquic_alarmset_set(ctl->sc_alset, AL_PACK_TOL, now + delay);
@@ -561,6 +588,44 @@ send_ctl_transfer_time (void *ctx)
 }
 
 
+/* Unacked queues are only modified using the three functions below: this
+ * keeps the packet number index current.
+ */
+static void
+send_ctl_unacked_link (struct lsquic_send_ctl *ctl, enum packnum_space pns,
+                                        struct lsquic_packet_out *packet_out)
+{
+    TAILQ_INSERT_TAIL(&ctl->sc_unacked_packets[pns], packet_out, po_next);
+    lsquic_pnidx_set(&ctl->sc_unacked_idx[pns], packet_out->po_packno,
+                                                                packet_out);
+}
+
+
+/* Loss record takes the place of the lost packet */
+static void
+send_ctl_unacked_link_before (struct lsquic_send_ctl *ctl,
+                                enum packnum_space pns,
+                                struct lsquic_packet_out *packet_out,
+                                struct lsquic_packet_out *loss_record)
+{
+    TAILQ_INSERT_BEFORE(packet_out, loss_record, po_next);
+    lsquic_pnidx_set(&ctl->sc_unacked_idx[pns], loss_record->po_packno,
+                                                                loss_record);
+}
+
+
+static void
+send_ctl_unacked_unlink (struct lsquic_send_ctl *ctl, enum packnum_space pns,
+                                        struct lsquic_packet_out *packet_out)
+{
+    TAILQ_REMOVE(&ctl->sc_unacked_packets[pns], packet_out, po_next);
+    lsquic_pnidx_clear(&ctl->sc_unacked_idx[pns], packet_out->po_packno,
+                                                                packet_out);
+    if (TAILQ_EMPTY(&ctl->sc_unacked_packets[pns]))
+        lsquic_pnidx_reset(&ctl->sc_unacked_idx[pns]);
+}
+
+
 static void
 send_ctl_unacked_append (struct lsquic_send_ctl *ctl,
                          struct lsquic_packet_out *packet_out)
@@ -569,7 +634,7 @@ send_ctl_unacked_append (struct lsquic_send_ctl *ctl,
 
     pns = lsquic_packet_out_pns(packet_out);
     assert(0 == (packet_out->po_flags & (PO_LOSS_REC|PO_POISON)));
-    TAILQ_INSERT_TAIL(&ctl->sc_unacked_packets[pns], packet_out, po_next);
+    send_ctl_unacked_link(ctl, pns, packet_out);
     packet_out->po_flags |= PO_UNACKED;
     ctl->sc_bytes_unacked_all += packet_out_sent_sz(packet_out);
     ctl->sc_n_in_flight_all  += 1;
@@ -588,7 +653,7 @@ send_ctl_unacked_remove (struct lsquic_send_ctl *ctl,
     enum packnum_space pns;
 
     pns = lsquic_packet_out_pns(packet_out);
-    TAILQ_REMOVE(&ctl->sc_unacked_packets[pns], packet_out, po_next);
+    send_ctl_unacked_unlink(ctl, pns, packet_out);
     packet_out->po_flags &= ~PO_UNACKED;
     assert(ctl->sc_bytes_unacked_all >= packet_sz);
     ctl->sc_bytes_unacked_all -= packet_sz;
@@ -663,7 +728,7 @@ send_ctl_add_poison (struct lsquic_send_ctl *ctl)
     poison->po_flags      = PO_UNACKED|PO_POISON;
     poison->po_packno     = ctl->sc_gap;
     poison->po_loss_chain = poison; /* Won't be used, but just in case */
-    TAILQ_INSERT_TAIL(&ctl->sc_unacked_packets[PNS_APP], poison, po_next);
+    send_ctl_unacked_link(ctl, PNS_APP, poison);
     LSQ_DEBUG("insert poisoned packet #%"PRIu64, poison->po_packno);
     ctl->sc_flags |= SC_POISON;
     return 0;
@@ -681,7 +746,7 @@ send_ctl_reschedule_poison (struct lsquic_send_ctl *ctl)
         if (poison->po_flags & PO_POISON)
         {
             LSQ_DEBUG("remove poisoned packet #%"PRIu64, poison->po_packno);
-            TAILQ_REMOVE(&ctl->sc_unacked_packets[PNS_APP], poison, po_next);
+            send_ctl_unacked_unlink(ctl, PNS_APP, poison);
             lsquic_malo_put(poison);
             lsquic_send_ctl_begin_optack_detection(ctl);
             ctl->sc_flags &= ~SC_POISON;
@@ -738,6 +803,7 @@ lsquic_send_ctl_sent_packet (lsquic_send_ctl_t *ctl,
     char frames[lsquic_frame_types_str_sz];
 
     assert(!(packet_out->po_flags & PO_ENCRYPTED));
+    packet_out->po_flags &= ~PO_TXTIME;
     ctl->sc_last_sent_time = packet_out->po_sent;
     pns = lsquic_packet_out_pns(packet_out);
     if (0 != send_ctl_update_poison_hist(ctl, packet_out->po_packno))
@@ -750,6 +816,10 @@ lsquic_send_ctl_sent_packet (lsquic_send_ctl_t *ctl,
         ctl->sc_ci->cci_sent(CGP(ctl), packet_out, ctl->sc_bytes_unacked_all,
                                             ctl->sc_flags & SC_APP_LIMITED);
     send_ctl_unacked_append(ctl, packet_out);
+    if ((packet_out->po_frame_types & QUIC_FTBIT_STREAM)
+            && 0 == lsquic_packet_out_page_out(packet_out,
+                    &ctl->sc_enpub->enp_mm, ctl->sc_conn_pub->lconn->cn_pf))
+        LSQ_DEBUG("paged out packet #%"PRIu64, packet_out->po_packno);
     if (packet_out->po_frame_types & ctl->sc_retx_frames)
     {
         if (!lsquic_alarmset_is_set(ctl->sc_alset, AL_RETX_INIT + pns))
@@ -782,7 +852,7 @@ send_ctl_select_cc (struct lsquic_send_ctl *ctl)
             "the threshold of %u usec: select Cubic congestion controller",
             srtt, ctl->sc_enpub->enp_settings.es_cc_rtt_thresh);
         ctl->sc_ci = &lsquic_cong_cubic_if;
-        ctl->sc_cong_ctl = &ctl->sc_adaptive_cc.acc_cubic;
+        ctl->sc_cong_ctl = &ctl->sc_cc.adaptive.acc_cubic;
         ctl->sc_flags |= SC_CLEANUP_BBR;
     }
     else
@@ -791,11 +861,107 @@ send_ctl_select_cc (struct lsquic_send_ctl *ctl)
             "of %u usec: select BBRv1 congestion controller", srtt,
             ctl->sc_enpub->enp_settings.es_cc_rtt_thresh);
         ctl->sc_ci = &lsquic_cong_bbr_if;
-        ctl->sc_cong_ctl = &ctl->sc_adaptive_cc.acc_bbr;
+        ctl->sc_cong_ctl = &ctl->sc_cc.adaptive.acc_bbr;
+    }
+}
+
+
+/* Careful resume: the first RTT sample tells whether the saved path state
+ * still applies.  If it does, jump to half of the saved window.
+ */
+static void
+send_ctl_resume_jump (struct lsquic_send_ctl *ctl)
+{
+    lsquic_time_t min_rtt;
+    uint64_t cwnd;
+
+    ctl->sc_flags &= ~SC_RESUME;
+
+    min_rtt = lsquic_rtt_stats_get_min_rtt(&ctl->sc_conn_pub->rtt_stats);
+    if (min_rtt < ctl->sc_resume.min_rtt / 2
+                                    || min_rtt > ctl->sc_resume.min_rtt * 10)
+    {
+        LSQ_INFO("careful resume: RTT %"PRIu64" usec does not match saved "
+            "min RTT %"PRIu64" usec: abandon", min_rtt,
+            ctl->sc_resume.min_rtt);
+        return;
+    }
+
+    cwnd = ctl->sc_ci->cci_get_cwnd(CGP(ctl));
+    if (ctl->sc_resume.cwnd / 2 <= cwnd)
+    {
+        LSQ_DEBUG("careful resume: half of saved cwnd %"PRIu64" is not "
+            "larger than current cwnd %"PRIu64": abandon",
+            ctl->sc_resume.cwnd, cwnd);
+        return;
+    }
+
+    ctl->sc_ci->cci_resume(CGP(ctl), ctl->sc_resume.cwnd / 2,
+                                                    ctl->sc_resume.bw / 2);
+    ctl->sc_resume.pipesize = 0;
+    ctl->sc_resume.jump_packno = lsquic_senhist_largest(&ctl->sc_senhist) + 1;
+    ctl->sc_resume.phase = CR_UNVALIDATED;
+    ctl->sc_flags |= SC_RESUME;
+    LSQ_INFO("careful resume: jump from cwnd %"PRIu64" to %"PRIu64"; "
+        "first unvalidated packet is #%"PRIu64, cwnd,
+        ctl->sc_resume.cwnd / 2, ctl->sc_resume.jump_packno);
+}
+
+
+/* The jump is validated when all packets sent before the first packet
+ * sent after the jump is acknowledged are acknowledged.
+ */
+static void
+send_ctl_resume_acked (struct lsquic_send_ctl *ctl)
+{
+    switch (ctl->sc_resume.phase)
+    {
+    case CR_UNVALIDATED:
+        if (ctl->sc_largest_acked_packno >= ctl->sc_resume.jump_packno)
+        {
+            ctl->sc_resume.last_unval
+                                = lsquic_senhist_largest(&ctl->sc_senhist);
+            ctl->sc_resume.phase = CR_VALIDATING;
+            LSQ_DEBUG("careful resume: validating until packet #%"PRIu64
+                " is acked", ctl->sc_resume.last_unval);
+        }
+        break;
+    case CR_VALIDATING:
+        if (ctl->sc_largest_acked_packno >= ctl->sc_resume.last_unval)
+        {
+            ctl->sc_flags &= ~SC_RESUME;
+            LSQ_INFO("careful resume: jump validated");
+        }
+        break;
+    default:
+        break;
     }
 }
 
 
+/* Loss after the jump: the saved state overestimated the path.  Reduce
+ * the window to half of what the path has delivered since the jump.
+ */
+static void
+send_ctl_resume_retreat (struct lsquic_send_ctl *ctl)
+{
+    uint64_t cwnd;
+
+    ctl->sc_flags &= ~SC_RESUME;
+    if (ctl->sc_resume.phase == CR_RECON)
+    {
+        LSQ_INFO("careful resume: loss before first RTT sample: abandon");
+        return;
+    }
+
+    cwnd = ctl->sc_resume.pipesize / 2;
+    if (cwnd < ctl->sc_ci->cci_get_cwnd(CGP(ctl)))
+        ctl->sc_ci->cci_resume(CGP(ctl), cwnd, 0);
+    LSQ_INFO("careful resume: loss after jump: retreat to cwnd %"PRIu64,
+        ctl->sc_ci->cci_get_cwnd(CGP(ctl)));
+}
+
+
 static void
 take_rtt_sample (lsquic_send_ctl_t *ctl,
                  lsquic_time_t now, lsquic_time_t lack_delta)
@@ -818,6 +984,9 @@ take_rtt_sample (lsquic_send_ctl_t *ctl,
             lsquic_rtt_stats_get_srtt(&ctl->sc_conn_pub->rtt_stats));
         if (ctl->sc_ci == &lsquic_cong_adaptive_if)
             send_ctl_select_cc(ctl);
+        if (UNLIKELY(ctl->sc_flags & SC_RESUME)
+                                    && ctl->sc_resume.phase == CR_RECON)
+            send_ctl_resume_jump(ctl);
     }
 }
 
@@ -887,7 +1056,7 @@ send_ctl_process_loss_chain_pkt (struct lsquic_send_ctl *ctl,
         if (chain_cur->po_flags & PO_LOSS_REC)
         {
             pns = lsquic_packet_out_pns(chain_cur);
-            TAILQ_REMOVE(&ctl->sc_unacked_packets[pns], chain_cur, po_next);
+            send_ctl_unacked_unlink(ctl, pns, chain_cur);
             state = "loss record";
         }
         else
@@ -913,7 +1082,8 @@ send_ctl_process_loss_chain_pkt (struct lsquic_send_ctl *ctl,
     if (next && *next == chain_cur)
         *next = TAILQ_NEXT(*next, po_next);
     if (0 == (chain_cur->po_flags & PO_LOSS_REC))
-        lsquic_packet_out_ack_streams(chain_cur);
+        lsquic_packet_out_ack_streams(chain_cur,
+                                        ctl->sc_conn_pub->lconn->cn_pf);
     LSQ_DEBUG("loss chain, destroy %s packet #%"PRIu64, state,
                 chain_cur->po_packno);
     send_ctl_destroy_packet(ctl, chain_cur);
@@ -999,7 +1169,8 @@ send_ctl_record_loss (struct lsquic_send_ctl *ctl,
         /* Place the loss record next to the lost packet we are about to
          * remove from the list:
          */
-        TAILQ_INSERT_BEFORE(packet_out, loss_record, po_next);
+        send_ctl_unacked_link_before(ctl, lsquic_packet_out_pns(packet_out),
+                                                    packet_out, loss_record);
         return loss_record;
     }
     else
@@ -1111,10 +1282,27 @@ largest_retx_packet_number (const struct lsquic_send_ctl *ctl,
 }
 
 
+/* We send ECT(1), but peer sees ECT(0): the path does not support L4S */
+static void
+send_ctl_l4s_fallback (struct lsquic_send_ctl *ctl)
+{
+    struct lsquic_packet_out *packet_out;
+
+    LSQ_INFO("ECT(1) is remarked as ECT(0): fall back to classic ECN");
+    ctl->sc_ecn = ECN_ECT0;
+    TAILQ_FOREACH(packet_out, &ctl->sc_scheduled_packets, po_next)
+        lsquic_packet_out_set_ecn(packet_out, ECN_ECT0);
+    if (ctl->sc_ci->cci_l4s_fallback)
+        ctl->sc_ci->cci_l4s_fallback(CGP(ctl));
+}
+
+
 static void
 send_ctl_loss_event (struct lsquic_send_ctl *ctl)
 {
     ctl->sc_ci->cci_loss(CGP(ctl));
+    if (UNLIKELY(ctl->sc_flags & SC_RESUME))
+        send_ctl_resume_retreat(ctl);
     if (ctl->sc_flags & SC_PACE)
         lsquic_pacer_loss_event(&ctl->sc_pacer);
     ctl->sc_largest_sent_at_cutback =
@@ -1356,15 +1544,15 @@ lsquic_send_ctl_got_ack (lsquic_send_ctl_t *ctl,
             {
                 packet_sz = packet_out_sent_sz(packet_out);
                 send_ctl_unacked_remove(ctl, packet_out, packet_sz);
-                lsquic_packet_out_ack_streams(packet_out);
+                lsquic_packet_out_ack_streams(packet_out,
+                                        ctl->sc_conn_pub->lconn->cn_pf);
                 LSQ_DEBUG("acking via regular record #%"PRIu64,
                                                         packet_out->po_packno);
             }
             else if (packet_out->po_flags & PO_LOSS_REC)
             {
                 packet_sz = packet_out->po_sent_sz;
-                TAILQ_REMOVE(&ctl->sc_unacked_packets[pns], packet_out,
-                                                                    po_next);
+                send_ctl_unacked_unlink(ctl, pns, packet_out);
                 LSQ_DEBUG("acking via loss record #%"PRIu64,
                                                         packet_out->po_packno);
                 send_ctl_maybe_increase_reord_thresh(ctl, packet_out,
@@ -1390,10 +1578,19 @@ lsquic_send_ctl_got_ack (lsquic_send_ctl_t *ctl,
             do_rtt |= packet_out->po_packno == largest_acked(acki);
             ctl->sc_ci->cci_ack(CGP(ctl), packet_out, packet_sz, now,
                                                              app_limited);
+            if (UNLIKELY(ctl->sc_flags & SC_RESUME))
+                ctl->sc_resume.pipesize += packet_sz;
             send_ctl_acked_loss_chain(ctl, packet_out, &next,
                                       largest_acked(acki), &do_rtt);
             send_ctl_destroy_packet(ctl, packet_out);
         }
+        else if (next && next->po_packno < range->low
+                        && lsquic_pnidx_is_on(&ctl->sc_unacked_idx[pns]))
+            /* Jump over packets that fall into the gap below this range
+             * instead of visiting them one by one.
+             */
+            next = lsquic_pnidx_find(&ctl->sc_unacked_idx[pns], range->low,
+                                                        largest_acked(acki));
         packet_out = next;
     }
     while (packet_out && packet_out->po_packno <= largest_acked(acki));
@@ -1407,6 +1604,9 @@ lsquic_send_ctl_got_ack (lsquic_send_ctl_t *ctl,
         ctl->sc_n_tlp = 0;
     }
 
+    if (UNLIKELY(ctl->sc_flags & SC_RESUME))
+        send_ctl_resume_acked(ctl);
+
   detect_losses:
     losses_detected = send_ctl_detect_losses(ctl, pns, ack_recv_time);
     if (send_ctl_first_unacked_retx_packet(ctl, pns))
@@ -1436,16 +1636,30 @@ lsquic_send_ctl_got_ack (lsquic_send_ctl_t *ctl,
         const uint64_t sum = acki->ecn_counts[ECN_ECT0]
                            + acki->ecn_counts[ECN_ECT1]
                            + acki->ecn_counts[ECN_CE];
+        const uint64_t prev_sum = ctl->sc_ecn_total_acked[pns];
+        const uint64_t prev_ce = ctl->sc_ecn_ce_cnt[pns];
         ctl->sc_ecn_total_acked[pns] += ecn_total_acked;
         ctl->sc_ecn_ce_cnt[pns] += ecn_ce_cnt;
         if (sum >= ctl->sc_ecn_total_acked[pns])
         {
+            /* Only 1-RTT packets: mini connection sends ECT(0) */
+            if (ctl->sc_ecn == ECN_ECT1 && pns == PNS_APP
+                                        && acki->ecn_counts[ECN_ECT0])
+                send_ctl_l4s_fallback(ctl);
+            if (ctl->sc_ci->cci_ecn && sum > prev_sum)
+                ctl->sc_ci->cci_ecn(CGP(ctl),
+                    acki->ecn_counts[ECN_CE] > prev_ce
+                        ? acki->ecn_counts[ECN_CE] - prev_ce : 0,
+                    sum - prev_sum);
             if (sum > ctl->sc_ecn_total_acked[pns])
                 ctl->sc_ecn_total_acked[pns] = sum;
             if (acki->ecn_counts[ECN_CE] > ctl->sc_ecn_ce_cnt[pns])
             {
                 ctl->sc_ecn_ce_cnt[pns] = acki->ecn_counts[ECN_CE];
-                if (losses_detected)
+                if (ctl->sc_ecn == ECN_ECT1)
+                    /* L4S: CE is not a loss signal, see cci_ecn() */
+                    LSQ_DEBUG("ECN-CE marking detected");
+                else if (losses_detected)
                     /* It's either-or.  From [draft-ietf-quic-recovery-29],
                      * Section 7.4:
                      " When a loss or ECN-CE marking is detected [...]
@@ -1523,6 +1737,11 @@ send_ctl_next_lost (lsquic_send_ctl_t *ctl)
     lost_packet = TAILQ_FIRST(&ctl->sc_lost_packets);
     if (lost_packet)
     {
+        /* Frames of reset streams are elided before the packet is paged
+         * in: the source of their data -- a file or a registered buffer --
+         * may no longer be available.  A paged-out packet carries a single
+         * STREAM frame, so it is either dropped here or paged in in full.
+         */
         if (lost_packet->po_frame_types & (1 << QUIC_FRAME_STREAM))
         {
             if (0 == (lost_packet->po_flags & PO_MINI))
@@ -1549,6 +1768,18 @@ send_ctl_next_lost (lsquic_send_ctl_t *ctl)
             }
         }
 
+        if (lost_packet->po_flags & PO_PAGED_OUT)
+        {
+            if (0 != lsquic_packet_out_page_in(lost_packet,
+                                                    &ctl->sc_enpub->enp_mm))
+            {
+                lconn->cn_if->ci_internal_error(lconn,
+                                            "cannot page in lost packet");
+                return NULL;
+            }
+            LSQ_DEBUG("paged in lost packet #%"PRIu64, lost_packet->po_packno);
+        }
+
         if (!lsquic_send_ctl_can_send(ctl))
             return NULL;
 
@@ -1610,7 +1841,7 @@ lsquic_send_ctl_cleanup (lsquic_send_ctl_t *ctl)
     for (pns = PNS_INIT; pns < N_PNS; ++pns)
         while ((packet_out = TAILQ_FIRST(&ctl->sc_unacked_packets[pns])))
         {
-            TAILQ_REMOVE(&ctl->sc_unacked_packets[pns], packet_out, po_next);
+            send_ctl_unacked_unlink(ctl, pns, packet_out);
             packet_out->po_flags &= ~PO_UNACKED;
 #ifndef NDEBUG
             if (0 == (packet_out->po_flags & (PO_LOSS_REC|PO_POISON)))
@@ -1621,6 +1852,8 @@ lsquic_send_ctl_cleanup (lsquic_send_ctl_t *ctl)
 #endif
             send_ctl_destroy_packet(ctl, packet_out);
         }
+    for (pns = PNS_INIT; pns < N_PNS; ++pns)
+        lsquic_pnidx_cleanup(&ctl->sc_unacked_idx[pns]);
     assert(0 == ctl->sc_n_in_flight_all);
     assert(0 == ctl->sc_bytes_unacked_all);
     while ((packet_out = TAILQ_FIRST(&ctl->sc_lost_packets)))
@@ -1650,7 +1883,7 @@ lsquic_send_ctl_cleanup (lsquic_send_ctl_t *ctl)
     if (ctl->sc_flags & SC_CLEANUP_BBR)
     {
         assert(ctl->sc_ci == &lsquic_cong_cubic_if);
-        lsquic_cong_bbr_if.cci_cleanup(&ctl->sc_adaptive_cc.acc_bbr);
+        lsquic_cong_bbr_if.cci_cleanup(&ctl->sc_cc.adaptive.acc_bbr);
     }
 #if LSQUIC_SEND_STATS
     LSQ_NOTICE("stats: n_total_sent: %u; n_resent: %u; n_delayed: %u",
@@ -1886,6 +2119,10 @@ lsquic_send_ctl_do_sanity_check (const struct lsquic_send_ctl *ctl)
                 prev_packno = packet_out->po_packno;
                 prev_packno_set = 1;
             }
+            if (lsquic_pnidx_is_on(&ctl->sc_unacked_idx[pns]))
+                assert(packet_out == lsquic_pnidx_find(
+                            &ctl->sc_unacked_idx[pns], packet_out->po_packno,
+                                                    packet_out->po_packno));
             if (0 == (packet_out->po_flags & (PO_LOSS_REC|PO_POISON)))
             {
                 bytes += packet_out_sent_sz(packet_out);
@@ -1925,8 +2162,15 @@ lsquic_send_ctl_scheduled_one (lsquic_send_ctl_t *ctl,
     if (ctl->sc_flags & SC_PACE)
     {
         unsigned n_out = ctl->sc_n_in_flight_retx + ctl->sc_n_scheduled;
-        lsquic_pacer_packet_scheduled(&ctl->sc_pacer, n_out,
+        lsquic_time_t departure;
+        departure = lsquic_pacer_packet_scheduled(&ctl->sc_pacer, n_out,
             send_ctl_in_recovery(ctl), send_ctl_transfer_time, ctl);
+        if (ctl->sc_flags & SC_TXTIME)
+        {
+            /* po_sent is not used until the packet is sent */
+            packet_out->po_sent = departure;
+            packet_out->po_flags |= PO_TXTIME;
+        }
     }
     send_ctl_sched_append(ctl, packet_out);
 }
@@ -2212,8 +2456,16 @@ static int
 send_ctl_set_packet_out_token (const struct lsquic_send_ctl *ctl,
                                         struct lsquic_packet_out *packet_out)
 {
+    struct packet_out_cold *cold;
     unsigned char *token;
 
+    cold = lsquic_packet_out_get_cold(&ctl->sc_enpub->enp_mm, packet_out);
+    if (!cold)
+    {
+        LSQ_WARN("malloc failed: cannot set initial token");
+        return -1;
+    }
+
     token = malloc(ctl->sc_token_sz);
     if (!token)
     {
@@ -2222,8 +2474,8 @@ send_ctl_set_packet_out_token (const struct lsquic_send_ctl *ctl,
     }
 
     memcpy(token, ctl->sc_token, ctl->sc_token_sz);
-    packet_out->po_token = token;
-    packet_out->po_token_len = ctl->sc_token_sz;
+    cold->pc_token = token;
+    cold->pc_token_len = ctl->sc_token_sz;
     packet_out->po_flags |= PO_NONCE;
     LSQ_DEBUG("set initial token on packet");
     return 0;
@@ -2269,8 +2521,10 @@ send_ctl_allocate_packet (struct lsquic_send_ctl *ctl, enum packno_bits bits,
             if (ctl->sc_token)
             {
                 (void) send_ctl_set_packet_out_token(ctl, packet_out);
-                if (packet_out->po_n_alloc > packet_out->po_token_len)
-                    packet_out->po_n_alloc -= packet_out->po_token_len;
+                if (packet_out->po_n_alloc
+                                > lsquic_packet_out_token_len(packet_out))
+                    packet_out->po_n_alloc
+                                -= lsquic_packet_out_token_len(packet_out);
                 else
                 {
                     /* XXX fail earlier: when retry token is parsed out */
@@ -2428,7 +2682,8 @@ update_for_resending (lsquic_send_ctl_t *ctl, lsquic_packet_out_t *packet_out)
     if (ctl->sc_ver_neg->vn_tag)
     {
         assert(packet_out->po_flags & PO_VERSION);  /* It can only disappear */
-        packet_out->po_ver_tag = *ctl->sc_ver_neg->vn_tag;
+        assert(packet_out->po_cold);    /* Allocated along with PO_VERSION */
+        packet_out->po_cold->pc_ver_tag = *ctl->sc_ver_neg->vn_tag;
     }
 
     assert(packet_out->po_regen_sz < packet_out->po_data_sz);
@@ -3240,7 +3495,7 @@ lsquic_send_ctl_turn_on_fin (struct lsquic_send_ctl *ctl,
             return 0;
 
     TAILQ_FOREACH(packet_out, &ctl->sc_scheduled_packets, po_next)
-        if (0 == packet_out->po_sent
+        if ((0 == packet_out->po_sent || (packet_out->po_flags & PO_TXTIME))
             && 0 == lsquic_packet_out_turn_on_fin(packet_out, pf, stream))
         {
             return 0;
@@ -3267,6 +3522,8 @@ lsquic_send_ctl_mem_used (const struct lsquic_send_ctl *ctl)
     };
 
     size = sizeof(*ctl);
+    for (n = 0; n < N_PNS; ++n)
+        size += lsquic_pnidx_mem_used(&ctl->sc_unacked_idx[n]);
 
     for (n = 0; n < sizeof(queues) / sizeof(queues[0]); ++n)
         TAILQ_FOREACH(packet_out, &queues[n], po_next)
@@ -3361,7 +3618,7 @@ lsquic_send_ctl_retry (struct lsquic_send_ctl *ctl,
     struct lsquic_conn *const lconn = ctl->sc_conn_pub->lconn;
     size_t sz;
 
-    if (token_sz >= 1ull << (sizeof(packet_out->po_token_len) * 8))
+    if (token_sz >= 1ull << (sizeof(packet_out->po_cold->pc_token_len) * 8))
     {
         LSQ_WARN("token size %zu is too long", token_sz);
         return -1;
@@ -3385,10 +3642,11 @@ lsquic_send_ctl_retry (struct lsquic_send_ctl *ctl,
         if (HETY_INITIAL != packet_out->po_header_type)
             continue;
 
-        if (packet_out->po_nonce)
+        if (lsquic_packet_out_nonce(packet_out))
         {
-            free(packet_out->po_nonce);
-            packet_out->po_nonce = NULL;
+            free(packet_out->po_cold->pc_nonce);
+            packet_out->po_cold->pc_nonce = NULL;
+            packet_out->po_cold->pc_token_len = 0;
             packet_out->po_flags &= ~PO_NONCE;
         }
 
@@ -3418,7 +3676,7 @@ lsquic_send_ctl_set_token (struct lsquic_send_ctl *ctl,
     unsigned char *copy;
 
     if (token_sz > 1 <<
-                (sizeof(((struct lsquic_packet_out *)0)->po_token_len) * 8))
+                (sizeof(((struct packet_out_cold *)0)->pc_token_len) * 8))
     {
         errno = EINVAL;
         return -1;
@@ -3509,12 +3767,13 @@ lsquic_send_ctl_empty_pns (struct lsquic_send_ctl *ctl, enum packnum_space pns)
     {
         next = TAILQ_NEXT(packet_out, po_next);
         if (packet_out->po_flags & (PO_LOSS_REC|PO_POISON))
-            TAILQ_REMOVE(&ctl->sc_unacked_packets[pns], packet_out, po_next);
+            send_ctl_unacked_unlink(ctl, pns, packet_out);
         else
         {
             packet_sz = packet_out_sent_sz(packet_out);
             send_ctl_unacked_remove(ctl, packet_out, packet_sz);
-            lsquic_packet_out_ack_streams(packet_out);
+            lsquic_packet_out_ack_streams(packet_out,
+                                        ctl->sc_conn_pub->lconn->cn_pf);
         }
         send_ctl_destroy_packet(ctl, packet_out);
         ++count;
@@ -3747,6 +4006,7 @@ lsquic_send_ctl_repath (struct lsquic_send_ctl *ctl,
         memset(&ctl->sc_conn_pub->rtt_stats, 0,
                                         sizeof(ctl->sc_conn_pub->rtt_stats));
         ctl->sc_ci->cci_reinit(CGP(ctl));
+        ctl->sc_flags &= ~SC_RESUME;
     }
 }
 
@@ -3894,6 +4154,70 @@ lsquic_send_ctl_path_validated (struct lsquic_send_ctl *ctl)
 }
 
 
+/* Careful resume [draft-ietf-tsvwg-careful-resume].  Until this connection
+ * takes its own RTT sample, the saved smoothed RTT is used as if it were a
+ * rough RTT estimate.  The first sample decides whether to jump, see
+ * send_ctl_resume_jump().
+ */
+void
+lsquic_send_ctl_resume (struct lsquic_send_ctl *ctl,
+                                            const struct path_state *state)
+{
+    lsquic_time_t srtt;
+
+    if (!(ctl->sc_flags & SC_PACE) || !ctl->sc_ci->cci_resume)
+    {
+        LSQ_DEBUG("careful resume: needs pacing and congestion controller "
+            "support");
+        return;
+    }
+
+    ctl->sc_resume.cwnd = state->ps_cwnd;
+    ctl->sc_resume.bw = state->ps_bw;
+    ctl->sc_resume.min_rtt = state->ps_min_rtt;
+    ctl->sc_resume.phase = CR_RECON;
+    ctl->sc_flags |= SC_RESUME;
+
+    if (0 == lsquic_rtt_stats_get_srtt(&ctl->sc_conn_pub->rtt_stats))
+    {
+        srtt = state->ps_srtt;
+        if (srtt > 500000)
+            srtt = 500000;
+        lsquic_rtt_stats_update(&ctl->sc_conn_pub->rtt_stats, srtt, 0);
+        ctl->sc_flags |= SC_ROUGH_RTT;
+        LSQ_DEBUG("careful resume: use saved RTT of %"PRIu64" usec", srtt);
+    }
+}
+
+
+/* Path state is saved only after this many round trips */
+#define PATH_STATE_MIN_ROUNDS 4
+
+int
+lsquic_send_ctl_get_path_state (const struct lsquic_send_ctl *ctl,
+                                                    struct path_state *state)
+{
+    const struct lsquic_rtt_stats *const rtt_stats
+                                            = &ctl->sc_conn_pub->rtt_stats;
+    lsquic_time_t srtt;
+
+    /* Do not save a window that has not been validated or that comes
+     * from a connection too short to have grown it.
+     */
+    srtt = lsquic_rtt_stats_get_srtt(rtt_stats);
+    if ((ctl->sc_flags & (SC_RESUME|SC_ROUGH_RTT)) || srtt == 0
+                                || ctl->sc_rt_count < PATH_STATE_MIN_ROUNDS)
+        return -1;
+
+    state->ps_min_rtt = lsquic_rtt_stats_get_min_rtt(rtt_stats);
+    state->ps_srtt = srtt;
+    state->ps_cwnd = ctl->sc_ci->cci_get_cwnd(CGP(ctl));
+    state->ps_bw = state->ps_cwnd * 1000000 / srtt;
+    state->ps_plpmtu = 0;
+    return 0;
+}
+
+
 int
 lsquic_send_ctl_can_send_probe (const struct lsquic_send_ctl *ctl,
                                             const struct network_path *path)
@@ -5,6 +5,7 @@
 #include <sys/queue.h>
 
 #include "lsquic_types.h"
+#include "lsquic_pnidx.h"
 
 #ifndef LSQUIC_SEND_STATS
 #   define LSQUIC_SEND_STATS 1
@@ -18,6 +19,7 @@ struct lsquic_alarmset;
 struct lsquic_engine_public;
 struct lsquic_conn_public;
 struct network_path;
+struct path_state;
 struct ver_neg;
 enum pns;
 struct to_coal;
@@ -54,6 +56,8 @@ enum send_ctl_flags {
     SC_ACK_RECV_HSK =  SC_ACK_RECV_INIT << PNS_HSK,
     SC_ACK_RECV_APP =  SC_ACK_RECV_INIT << PNS_APP,
     SC_ROUGH_RTT    =  1 << 22,
+    SC_TXTIME       =  1 << 23,     /* Packets carry departure time */
+    SC_RESUME       =  1 << 24,     /* Careful resume in progress */
 #if LSQUIC_DEVEL
     SC_DYN_PTHRESH  =  1 << 31u,    /* dynamic packet threshold enabled */
 #endif
@@ -69,6 +73,7 @@ typedef struct lsquic_send_ctl {
     enum ecn                        sc_ecn;
     unsigned                        sc_n_stop_waiting;
     struct lsquic_packets_tailq     sc_unacked_packets[N_PNS];
+    struct pn_index                 sc_unacked_idx[N_PNS];
     lsquic_packno_t                 sc_largest_acked_packno;
     lsquic_time_t                   sc_largest_acked_sent_time;
     lsquic_time_t                   sc_last_sent_time;
@@ -76,7 +81,11 @@ typedef struct lsquic_send_ctl {
     int                           (*sc_can_send)(struct lsquic_send_ctl *);
     unsigned                        sc_bytes_unacked_retx;
     unsigned                        sc_bytes_scheduled;
-    struct adaptive_cc              sc_adaptive_cc;
+    union {
+        struct adaptive_cc          adaptive;
+        struct lsquic_bbr2          bbr2;
+        struct lsquic_prague        prague;
+    }                               sc_cc;
     const struct cong_ctl_if       *sc_ci;
     void                           *sc_cong_ctl;
     struct lsquic_engine_public    *sc_enpub;
@@ -145,6 +154,22 @@ typedef struct lsquic_send_ctl {
     unsigned                        sc_square_count;/* Used to set square bit */
     unsigned                        sc_reord_thresh;
     signed char                     sc_cidlen;      /* For debug purposes */
+    /* Careful resume: valid when SC_RESUME is set */
+    struct
+    {
+        uint64_t                cwnd;       /* Saved values */
+        uint64_t                bw;
+        lsquic_time_t           min_rtt;
+        uint64_t                pipesize;   /* Bytes acked since the jump */
+        lsquic_packno_t         jump_packno;/* First packet sent after jump */
+        lsquic_packno_t         last_unval; /* Last packet sent before the
+                                             * jump was acked */
+        enum {
+            CR_RECON,       /* Waiting for first RTT sample */
+            CR_UNVALIDATED, /* Jumped; no packet sent after jump acked */
+            CR_VALIDATING,  /* Waiting for last_unval to be acked */
+        }                       phase;
+    }                               sc_resume;
 } lsquic_send_ctl_t;
 
 void
@@ -424,6 +449,13 @@ lsquic_send_ctl_begin_optack_detection (struct lsquic_send_ctl *);
 void
 lsquic_send_ctl_path_validated (struct lsquic_send_ctl *);
 
+void
+lsquic_send_ctl_resume (struct lsquic_send_ctl *, const struct path_state *);
+
+int
+lsquic_send_ctl_get_path_state (const struct lsquic_send_ctl *,
+                                                        struct path_state *);
+
 /* Has immediately sendable packets */
 #define lsquic_send_ctl_has_sendable(ctl_) \
     (lsquic_send_ctl_n_scheduled(ctl_) > 0 \
@@ -89,6 +89,27 @@ sfcw_maybe_increase_max_window (struct lsquic_sfcw *fc)
 }
 
 
+static void
+sfcw_shrink_max_window (struct lsquic_sfcw *fc)
+{
+    unsigned new_max_window;
+
+    new_max_window = fc->sf_max_recv_win / 2;
+    if (new_max_window < MIN_SHRUNK_FCW)
+        new_max_window = MIN_SHRUNK_FCW;
+
+    if (new_max_window < fc->sf_max_recv_win)
+    {
+        LSQ_DEBUG("low on memory: max window decrease %u -> %u",
+                                    fc->sf_max_recv_win, new_max_window);
+        EV_LOG_CONN_EVENT(LSQUIC_LOG_CONN_ID,
+            "max SFCW decrease %u -> %u", fc->sf_max_recv_win,
+                                                            new_max_window);
+        fc->sf_max_recv_win = new_max_window;
+    }
+}
+
+
 int
 lsquic_sfcw_fc_offsets_changed (struct lsquic_sfcw *fc)
 {
@@ -106,7 +127,9 @@ lsquic_sfcw_fc_offsets_changed (struct lsquic_sfcw *fc)
     fc->sf_last_updated = now;
 
     srtt = lsquic_rtt_stats_get_srtt(&fc->sf_conn_pub->rtt_stats);
-    if (since_last_update < srtt * 2)
+    if (fc->sf_conn_pub->enpub->enp_mem_level >= MEM_SHRINK_FC)
+        sfcw_shrink_max_window(fc);
+    else if (since_last_update < srtt * 2)
         sfcw_maybe_increase_max_window(fc);
 
     fc->sf_recv_off = fc->sf_read_off + fc->sf_max_recv_win;
@@ -14,6 +14,10 @@
 
 #ifdef WIN32
 #include <malloc.h>
+#else
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #endif
 
 #include "fiu-local.h"
@@ -47,6 +51,8 @@
 #include "lsquic_bw_sampler.h"
 #include "lsquic_minmax.h"
 #include "lsquic_bbr.h"
+#include "lsquic_bbr2.h"
+#include "lsquic_prague.h"
 #include "lsquic_adaptive_cc.h"
 #include "lsquic_send_ctl.h"
 #include "lsquic_headers.h"
@@ -84,6 +90,8 @@ stream_wantwrite (lsquic_stream_t *stream, int is_want);
 enum stream_write_options
 {
     SWO_BUFFER  = 1 << 0,       /* Allow buffering in sm_buf */
+    SWO_WREFS   = 1 << 1,       /* Writing out registered buffers */
+    SWO_FORCE   = 1 << 2,       /* Packetize data that does not fill packet */
 };
 
 
@@ -100,6 +108,27 @@ stream_flush (lsquic_stream_t *stream);
 static int
 stream_flush_nocheck (lsquic_stream_t *stream);
 
+static int
+stream_write_refs (struct lsquic_stream *, int force);
+
+static void
+drop_wrefs (struct lsquic_stream *);
+
+static void
+release_wref (struct lsquic_stream *, struct stream_wref *);
+
+static void
+free_src_reg (struct lsquic_stream *, struct stream_src_reg *);
+
+static void
+put_file (struct lsquic_stream *, struct stream_file *);
+
+static ssize_t
+stream_pwritev (struct lsquic_stream *,
+    ssize_t (*preadv)(void *user_data, const struct iovec *iov, int iovcnt),
+    void *user_data, size_t n_to_write, uint64_t *iov_offs,
+    unsigned n_iov_offs, enum stream_write_options);
+
 static void
 maybe_remove_from_write_q (lsquic_stream_t *stream, enum stream_q_flags flag);
 
@@ -423,6 +452,9 @@ stream_new_common (lsquic_stream_id_t id, struct lsquic_conn_public *conn_pub,
     stream->sm_write_avail = stream_write_avail_no_frames;
 
     STAILQ_INIT(&stream->sm_hq_frames);
+    TAILQ_INIT(&stream->sm_wrefs);
+    TAILQ_INIT(&stream->sm_written_wrefs);
+    TAILQ_INIT(&stream->sm_src_regs);
 
     stream->sm_bflags |= ctor_flags & ((1 << N_SMBF_FLAGS) - 1);
     if (conn_pub->lconn->cn_flags & LSCONN_SERVER)
@@ -599,10 +631,15 @@ maybe_resize_stream_buffer (struct lsquic_stream *stream)
     {
         free(stream->sm_buf);
         stream->sm_buf = NULL;
+        stream->conn_pub->enpub->enp_stream_mem -= stream->sm_n_allocated;
         stream->sm_n_allocated = 0;
     }
     else if (stream->sm_n_allocated > stream->conn_pub->path->np_pack_size)
+    {
+        stream->conn_pub->enpub->enp_stream_mem -= stream->sm_n_allocated
+                                    - stream->conn_pub->path->np_pack_size;
         stream->sm_n_allocated = stream->conn_pub->path->np_pack_size;
+    }
 }
 
 
@@ -612,6 +649,7 @@ drop_buffered_data (struct lsquic_stream *stream)
     decr_conn_cap(stream, stream->sm_n_buffered);
     stream->sm_n_buffered = 0;
     maybe_resize_stream_buffer(stream);
+    drop_wrefs(stream);
     if (stream->sm_qflags & SMQF_WRITE_Q_FLAGS)
         maybe_remove_from_write_q(stream, SMQF_WRITE_Q_FLAGS);
 }
@@ -643,6 +681,8 @@ lsquic_stream_destroy (lsquic_stream_t *stream)
     struct push_promise *promise;
     struct stream_hq_frame *shf;
     struct uncompressed_headers *uh;
+    struct stream_src_reg *reg;
+    struct stream_wref *wref;
 
     stream->stream_flags |= STREAM_U_WRITE_DONE|STREAM_U_READ_DONE;
     if ((stream->stream_flags & (STREAM_ONNEW_DONE|STREAM_ONCLOSE_DONE)) ==
@@ -695,7 +735,23 @@ lsquic_stream_destroy (lsquic_stream_t *stream)
         stream->uh = uh->uh_next;
         destroy_uh(uh, stream->conn_pub->enpub->enp_hsi_if);
     }
-    free(stream->sm_buf);
+    while ((reg = TAILQ_FIRST(&stream->sm_src_regs)))
+    {
+        TAILQ_REMOVE(&stream->sm_src_regs, reg, ssr_next);
+        free_src_reg(stream, reg);
+    }
+    if (stream->sm_file)
+        put_file(stream, stream->sm_file);
+    while ((wref = TAILQ_FIRST(&stream->sm_written_wrefs)))
+    {
+        TAILQ_REMOVE(&stream->sm_written_wrefs, wref, swr_next);
+        release_wref(stream, wref);
+    }
+    if (stream->sm_buf)
+    {
+        free(stream->sm_buf);
+        stream->conn_pub->enpub->enp_stream_mem -= stream->sm_n_allocated;
+    }
     free(stream->sm_header_block);
     LSQ_DEBUG("destroyed stream");
     SM_HISTORY_DUMP_REMAINING(stream);
@@ -937,8 +993,11 @@ stream_writeable (struct lsquic_stream *stream)
          *   able to collect the error).
          */
            lsquic_stream_is_write_reset(stream)
-        /* - Data can be written to stream: */
-        || lsquic_stream_write_avail(stream)
+        /* - Data can be written to stream and registered buffers, if
+         *   any, have been written out:
+         */
+        || (!(stream->sm_qflags & SMQF_WRITE_REFS)
+                                        && lsquic_stream_write_avail(stream))
     ;
 }
 
@@ -1762,6 +1821,111 @@ lsquic_stream_read (lsquic_stream_t *stream, void *buf, size_t len)
 }
 
 
+/* Data that is not backed by a packet -- for example, uncompressed headers
+ * or frames buffered by the "hash" data_in -- is copied into a new packet
+ * buffer in chunks of at most this size.
+ */
+#define MAX_LEND_COPY 0x1000
+
+struct lend_ctx
+{
+    struct lsquic_stream      *stream;
+    struct lsquic_slice       *slice;
+    struct lsquic_slice *const end;
+};
+
+
+static struct lsquic_packet_in *
+lend_copy (struct lsquic_mm *mm, const unsigned char *buf, size_t len)
+{
+    struct lsquic_packet_in *packet_in;
+
+    packet_in = lsquic_mm_get_packet_in(mm);
+    if (!packet_in)
+        return NULL;
+    packet_in->pi_data = lsquic_mm_get_packet_in_buf(mm, len);
+    if (!packet_in->pi_data)
+    {
+        lsquic_mm_put_packet_in(mm, packet_in);
+        return NULL;
+    }
+    memcpy(packet_in->pi_data, buf, len);
+    packet_in->pi_data_sz = len;
+    packet_in->pi_flags |= PI_OWN_DATA;
+    packet_in->pi_refcnt = 1;
+    return packet_in;
+}
+
+
+static size_t
+lend_f (void *ctx_p, const unsigned char *buf, size_t len, int fin)
+{
+    struct lend_ctx *const ctx = ctx_p;
+    struct lsquic_stream *const stream = ctx->stream;
+    struct data_in *const data_in = stream->data_in;
+    struct data_frame *data_frame;
+    struct lsquic_packet_in *packet_in;
+
+    if (len == 0 || ctx->slice >= ctx->end)
+        return 0;
+
+    /* The frame being read is the one at the current read offset: it is
+     * only advanced after this callback returns.
+     */
+    packet_in = NULL;
+    if (data_in->di_if->di_frame_packet
+        && (data_frame = data_in->di_if->di_get_frame(data_in,
+                                                        stream->read_offset))
+        && buf >= data_frame->df_data
+        && buf + len <= data_frame->df_data + data_frame->df_size)
+    {
+        packet_in = data_in->di_if->di_frame_packet(data_in, data_frame);
+        /* User-supplied packet data does not outlive the call to
+         * lsquic_engine_packet_in(): do not lend it.
+         */
+        if (!(packet_in->pi_flags & PI_OWN_DATA))
+            packet_in = NULL;
+    }
+
+    if (packet_in)
+        lsquic_packet_in_upref(packet_in);
+    else
+    {
+        if (len > MAX_LEND_COPY)
+            len = MAX_LEND_COPY;
+        packet_in = lend_copy(stream->conn_pub->mm, buf, len);
+        if (!packet_in)
+        {
+            LSQ_WARN("cannot allocate packet to copy lent data into");
+            return 0;
+        }
+        buf = packet_in->pi_data;
+    }
+
+    ctx->slice->buf    = buf;
+    ctx->slice->len    = len;
+    ctx->slice->handle = packet_in;
+    ++ctx->slice;
+    return len;
+}
+
+
+ssize_t
+lsquic_stream_lend (struct lsquic_stream *stream,
+                        struct lsquic_slice *slices, unsigned *n_slices)
+{
+    struct lend_ctx ctx = { stream, slices, slices + *n_slices, };
+    ssize_t nread;
+
+    nread = lsquic_stream_readf(stream, lend_f, &ctx);
+    *n_slices = ctx.slice - slices;
+    if (nread > 0)
+        LSQ_DEBUG("lent %zd bytes in %u slice%.*s", nread, *n_slices,
+                                                    *n_slices != 1, "s");
+    return nread;
+}
+
+
 void
 lsquic_stream_ss_frame_sent (struct lsquic_stream *stream)
 {
@@ -1872,6 +2036,14 @@ stream_shutdown_write (lsquic_stream_t *stream)
             LSQ_DEBUG("headers not sent, send a reset");
             stream_reset(stream, 0, 1);
         }
+        else if (!TAILQ_EMPTY(&stream->sm_wrefs))
+        {
+            /* FIN is sent once all of them have been written out */
+            if (0 == stream_write_refs(stream, 1)
+                                    && !TAILQ_EMPTY(&stream->sm_wrefs))
+                LSQ_DEBUG("FIN will be sent after registered buffers are "
+                                                            "written out");
+        }
         else if (stream->sm_n_buffered == 0)
         {
             if (0 == lsquic_send_ctl_turn_on_fin(stream->conn_pub->send_ctl,
@@ -2305,6 +2477,9 @@ stream_dispatch_write_events_loop (lsquic_stream_t *stream)
 
         on_write = select_on_write(stream);
         on_write(stream, stream->st_ctx);
+        /* Buffers registered by the callback are written out together */
+        if (stream->sm_qflags & SMQF_WRITE_REFS)
+            (void) stream_write_refs(stream, 1);
 
         if (no_progress_limit && progress_eq(progress, stream_progress(stream)))
         {
@@ -2424,6 +2599,9 @@ lsquic_stream_dispatch_write_events (lsquic_stream_t *stream)
     if (stream->sm_qflags & SMQF_WANT_FLUSH)
         (void) stream_flush(stream);
 
+    if (stream->sm_qflags & SMQF_WRITE_REFS)
+        (void) stream_write_refs(stream, 1);
+
     if (stream->sm_bflags & SMBF_RW_ONCE)
     {
         if ((stream->sm_qflags & SMQF_WANT_WRITE)
@@ -2432,6 +2610,8 @@ lsquic_stream_dispatch_write_events (lsquic_stream_t *stream)
         {
             on_write = select_on_write(stream);
             on_write(stream, stream->st_ctx);
+            if (stream->sm_qflags & SMQF_WRITE_REFS)
+                (void) stream_write_refs(stream, 1);
         }
     }
     else
@@ -2527,6 +2707,10 @@ lsquic_stream_flush (lsquic_stream_t *stream)
         return -1;
     }
 
+    if (stream->sm_qflags & SMQF_WRITE_REFS)
+        /* Buffered data, if any, is written out along with them */
+        return stream_write_refs(stream, 1);
+
     if (0 == stream->sm_n_buffered)
     {
         LSQ_DEBUG("flushing 0 bytes: noop");
@@ -2765,6 +2949,7 @@ frame_std_gen_fin (void *ctx)
     return !(fg_ctx->fgc_stream->sm_bflags & SMBF_CRYPTO)
         && (fg_ctx->fgc_stream->stream_flags & STREAM_U_WRITE_DONE)
         && 0 == fg_ctx->fgc_stream->sm_n_buffered
+        && TAILQ_EMPTY(&fg_ctx->fgc_stream->sm_wrefs)
         /* Do not use frame_std_gen_size() as it may chop the real size: */
         && 0 == fg_ctx->fgc_reader->lsqr_size(fg_ctx->fgc_reader->lsqr_ctx);
 }
@@ -3647,6 +3832,7 @@ save_to_buffer (lsquic_stream_t *stream, struct lsquic_reader *reader,
         if (!stream->sm_buf)
             return -1;
         stream->sm_n_allocated = n_allowed;
+        stream->conn_pub->enpub->enp_stream_mem += n_allowed;
     }
 
     if ((stream->sm_bflags & (SMBF_IETF|SMBF_USE_HEADERS))
@@ -3674,6 +3860,19 @@ stream_write (lsquic_stream_t *stream, struct lsquic_reader *reader,
     size_t thresh, len, frames, total_len, n_allowed, nwritten;
     ssize_t nw;
 
+    if ((stream->sm_qflags & SMQF_WRITE_REFS) && !(swo & SWO_WREFS))
+    {
+        /* stream_pwritev() writes them out before it starts */
+        if (swo & SWO_BUFFER)
+            (void) stream_write_refs(stream, 1);
+        if (stream->sm_qflags & SMQF_WRITE_REFS)
+        {
+            LSQ_DEBUG("registered buffers have not been written out: cannot "
+                                                                "write yet");
+            return 0;
+        }
+    }
+
     len = reader->lsqr_size(reader->lsqr_ctx);
     if (len == 0)
         return 0;
@@ -3687,7 +3886,7 @@ stream_write (lsquic_stream_t *stream, struct lsquic_reader *reader,
     total_len = len + frames + stream->sm_n_buffered;
     thresh = lsquic_stream_flush_threshold(stream, total_len);
     n_allowed = stream_get_n_allowed(stream);
-    if (total_len <= n_allowed && total_len < thresh)
+    if (!(swo & SWO_FORCE) && total_len <= n_allowed && total_len < thresh)
     {
         if (!(swo & SWO_BUFFER))
             return 0;
@@ -3706,7 +3905,8 @@ stream_write (lsquic_stream_t *stream, struct lsquic_reader *reader,
                         && stream->sm_n_buffered < stream->sm_n_allocated);
     }
     else
-        nwritten = stream_write_to_packets(stream, reader, thresh, swo);
+        nwritten = stream_write_to_packets(stream, reader,
+                                        swo & SWO_FORCE ? 0 : thresh, swo);
     if ((stream->sm_qflags & SMQF_SEND_BLOCKED) &&
         (stream->sm_bflags & SMBF_IETF))
     {
@@ -3844,6 +4044,11 @@ struct pwritev_ctx
     size_t        total_bytes;
     size_t        n_to_write;
     unsigned      n_iovecs, max_iovecs;
+    /* If set, stream offset of each iovec is recorded in `iov_offs' */
+    uint64_t     *iov_offs;
+    const struct lsquic_stream
+                 *stream;
+    uint64_t      payload_off;      /* Payload offset of first byte read */
 };
 
 
@@ -3866,6 +4071,12 @@ pwritev_read (void *lsqr_ctx, void *buf, size_t count)
     struct pwritev_ctx *const ctx = lsqr_ctx;
 
     assert(ctx->n_iovecs < ctx->max_iovecs);
+    if (ctx->iov_offs)
+        /* Stream and payload offsets advance in step while frame data is
+         * read: it is the HTTP/3 frame headers that set them apart.
+         */
+        ctx->iov_offs[ctx->n_iovecs] = ctx->stream->tosend_off
+            + ctx->payload_off + ctx->total_bytes - ctx->stream->sm_payload;
     ctx->iov[ctx->n_iovecs].iov_base = buf;
     ctx->iov[ctx->n_iovecs].iov_len = count;
     ++ctx->n_iovecs;
@@ -3882,11 +4093,15 @@ pwritev_read (void *lsqr_ctx, void *buf, size_t count)
  * part of the machinery that follows.  We optimize the normal path: it should
  * be cheap to be prepared for the unwinding; unwinding itself can be more
  * expensive, as we do not expect it to happen often.
+ *
+ * If `iov_offs' is set, the stream offset of each iovec passed to preadv()
+ * is recorded in it.  At most `n_iov_offs' iovecs are used in this case.
  */
-ssize_t
-lsquic_stream_pwritev (struct lsquic_stream *stream,
+static ssize_t
+stream_pwritev (struct lsquic_stream *stream,
     ssize_t (*preadv)(void *user_data, const struct iovec *iov, int iovcnt),
-    void *user_data, size_t n_to_write)
+    void *user_data, size_t n_to_write, uint64_t *iov_offs,
+    unsigned n_iov_offs, enum stream_write_options swo)
 {
     struct lsquic_send_ctl *const ctl = stream->conn_pub->send_ctl;
 #if MALLOC_PWRITEV
@@ -3907,8 +4122,11 @@ lsquic_stream_pwritev (struct lsquic_stream *stream,
     const unsigned short n_buffered = stream->sm_n_buffered;
 #endif
 
-    COMMON_WRITE_CHECKS();
-    SM_HISTORY_APPEND(stream, SHE_USER_WRITE_DATA);
+    /* Registered buffers go first.  This is done before `sm_hq_arr' is set,
+     * as they are written out using this function, too.
+     */
+    if ((stream->sm_qflags & SMQF_WRITE_REFS) && !(swo & SWO_WREFS))
+        (void) stream_write_refs(stream, 1);
 
 #if MALLOC_PWRITEV
     iovecs = malloc(sizeof(iovecs[0]) * PWRITEV_IOVECS);
@@ -3929,6 +4147,15 @@ lsquic_stream_pwritev (struct lsquic_stream *stream,
     ctx.max_iovecs = PWRITEV_IOVECS;
     ctx.iov = iovecs;
     ctx.hq_arr = &hq_arr;
+    ctx.iov_offs = iov_offs;
+    if (iov_offs)
+    {
+        if (ctx.max_iovecs > n_iov_offs)
+            ctx.max_iovecs = n_iov_offs;
+        ctx.stream = stream;
+        /* Buffered data is packetized first */
+        ctx.payload_off = stream->sm_payload + stream->sm_n_buffered;
+    }
 
     hq_arr.p = hq_frames;
     hq_arr.count = 0;
@@ -3939,7 +4166,7 @@ lsquic_stream_pwritev (struct lsquic_stream *stream,
     reader.lsqr_size = pwritev_size;
     reader.lsqr_read = pwritev_read;
 
-    nw = stream_write(stream, &reader, 0);
+    nw = stream_write(stream, &reader, swo);
     LSQ_DEBUG("pwritev: stream_write returned %zd, n_iovecs: %d", nw,
                                                                 ctx.n_iovecs);
     if (nw > 0)
@@ -4041,6 +4268,622 @@ lsquic_stream_pwritev (struct lsquic_stream *stream,
 }
 
 
+ssize_t
+lsquic_stream_pwritev (struct lsquic_stream *stream,
+    ssize_t (*preadv)(void *user_data, const struct iovec *iov, int iovcnt),
+    void *user_data, size_t n_to_write)
+{
+    COMMON_WRITE_CHECKS();
+    SM_HISTORY_APPEND(stream, SHE_USER_WRITE_DATA);
+    return stream_pwritev(stream, preadv, user_data, n_to_write, NULL, 0, 0);
+}
+
+
+static const struct stream_src_reg *
+find_src_reg (const struct lsquic_stream *stream, uint64_t off)
+{
+    const struct stream_src_reg *reg;
+
+    /* Most recently written data is the most likely to be retransmitted */
+    TAILQ_FOREACH_REVERSE(reg, &stream->sm_src_regs, stream_src_regs,
+                                                                    ssr_next)
+        if (off >= reg->ssr_stream_off
+                                && off < reg->ssr_stream_off + reg->ssr_len)
+            return reg;
+
+    return NULL;
+}
+
+
+/* Return length of the run of stream data that starts at offset `off', is
+ * no longer than `len' bytes, and either all can be read back from its
+ * source -- in which case `*from_src' is set -- or none of it can.
+ */
+size_t
+lsquic_stream_src_run (const struct lsquic_stream *stream, uint64_t off,
+                                                size_t len, int *from_src)
+{
+    const struct stream_src_reg *reg;
+
+    /* Regions are sorted by stream offset and do not overlap */
+    TAILQ_FOREACH(reg, &stream->sm_src_regs, ssr_next)
+        if (off < reg->ssr_stream_off + reg->ssr_len)
+        {
+            *from_src = off >= reg->ssr_stream_off;
+            if (*from_src)
+                return MIN(len, reg->ssr_stream_off + reg->ssr_len - off);
+            else
+                return MIN(len, reg->ssr_stream_off - off);
+        }
+
+    *from_src = 0;
+    return len;
+}
+
+
+/* Data written using lsquic_stream_write_file() is read back from a
+ * duplicate of the user's file descriptor.  This way, the user may close
+ * the descriptor once the write returns: the duplicate is closed when the
+ * last source region that references it is dropped.
+ */
+struct stream_file
+{
+    int         sf_fd;
+    unsigned    sf_n_refs;
+#ifndef WIN32
+    dev_t       sf_dev;
+    ino_t       sf_ino;
+#endif
+};
+
+
+static void
+put_file (struct lsquic_stream *stream, struct stream_file *file)
+{
+    assert(file->sf_n_refs > 0);
+    if (--file->sf_n_refs == 0)
+    {
+        LSQ_DEBUG("close duplicate fd %d", file->sf_fd);
+#ifndef WIN32
+        (void) close(file->sf_fd);
+#endif
+        free(file);
+    }
+}
+
+
+static void
+free_src_reg (struct lsquic_stream *stream, struct stream_src_reg *reg)
+{
+    if (reg->ssr_file)
+        put_file(stream, reg->ssr_file);
+    free(reg);
+}
+
+
+#ifndef WIN32
+/* Return file object for `fd'.  If the stream already has a duplicate
+ * descriptor for the same file, it is reused.
+ */
+static struct stream_file *
+stream_get_file (struct lsquic_stream *stream, int fd)
+{
+    struct stream_file *file;
+    struct stat st;
+
+    if (0 != fstat(fd, &st))
+    {
+        LSQ_INFO("cannot fstat fd %d: %s", fd, strerror(errno));
+        return NULL;
+    }
+
+    if (stream->sm_file && stream->sm_file->sf_dev == st.st_dev
+                                    && stream->sm_file->sf_ino == st.st_ino)
+        return stream->sm_file;
+
+    file = malloc(sizeof(*file));
+    if (!file)
+        return NULL;
+    file->sf_fd = dup(fd);
+    if (file->sf_fd < 0)
+    {
+        LSQ_INFO("cannot dup fd %d: %s", fd, strerror(errno));
+        free(file);
+        return NULL;
+    }
+    file->sf_n_refs = 1;    /* The stream's reference */
+    file->sf_dev = st.st_dev;
+    file->sf_ino = st.st_ino;
+    LSQ_DEBUG("duplicated fd %d as %d", fd, file->sf_fd);
+    if (stream->sm_file)
+        put_file(stream, stream->sm_file);
+    stream->sm_file = file;
+    return file;
+}
+
+
+static int
+read_from_file (struct lsquic_stream *stream, int fd, uint64_t file_off,
+                                            unsigned char *buf, size_t len)
+{
+    ssize_t nr;
+
+    while (len > 0)
+    {
+        nr = pread(fd, buf, len, (off_t) file_off);
+        if (nr > 0)
+        {
+            buf += nr;
+            len -= (size_t) nr;
+            file_off += (uint64_t) nr;
+        }
+        else if (nr < 0 && errno == EINTR)
+            continue;
+        else
+        {
+            LSQ_WARN("cannot read back %zu bytes from fd %d at offset "
+                "%"PRIu64": %s", len, fd, file_off,
+                nr < 0 ? strerror(errno) : "unexpected EOF");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+
+/* Read `len' bytes of stream data starting at stream offset `off' back from
+ * the files or registered buffers it was written from.  Returns 0 on
+ * success, -1 on failure.
+ */
+int
+lsquic_stream_read_src_range (struct lsquic_stream *stream, uint64_t off,
+                                            unsigned char *buf, size_t len)
+{
+    const struct stream_src_reg *reg;
+    uint64_t src_off;
+    size_t n_to_read;
+
+    while (len > 0)
+    {
+        reg = find_src_reg(stream, off);
+        if (!reg)
+        {
+            LSQ_WARN("no source region for %zu bytes at offset %"PRIu64,
+                                                                    len, off);
+            return -1;
+        }
+        src_off = reg->ssr_src_off + (off - reg->ssr_stream_off);
+        n_to_read = MIN(len, reg->ssr_stream_off + reg->ssr_len - off);
+        if (reg->ssr_wref)
+        {
+            LSQ_DEBUG("read back %zu bytes at offset %"PRIu64" from "
+                "registered buffer %p, buffer offset %"PRIu64, n_to_read, off,
+                reg->ssr_wref->swr_buf, src_off);
+            memcpy(buf, reg->ssr_wref->swr_buf + src_off, n_to_read);
+        }
+        else
+        {
+#ifndef WIN32
+            LSQ_DEBUG("read back %zu bytes at offset %"PRIu64" from fd %d, "
+                "file offset %"PRIu64, n_to_read, off, reg->ssr_file->sf_fd,
+                src_off);
+            if (0 != read_from_file(stream, reg->ssr_file->sf_fd, src_off,
+                                                            buf, n_to_read))
+                return -1;
+#else
+            return -1;
+#endif
+        }
+        buf += n_to_read;
+        len -= n_to_read;
+        off += n_to_read;
+    }
+
+    return 0;
+}
+
+
+static void
+release_wref (struct lsquic_stream *stream, struct stream_wref *wref)
+{
+    LSQ_DEBUG("release registered buffer %p of %zu bytes", wref->swr_buf,
+                                                                wref->swr_len);
+    if (wref->swr_release)
+        wref->swr_release(wref->swr_ctx, wref->swr_buf, wref->swr_len);
+    free(wref);
+}
+
+
+/* Stream data at [off, off + len) has been acknowledged.  Regions all of
+ * whose data has been acknowledged are no longer needed.  Neither are
+ * registered buffers.
+ */
+void
+lsquic_stream_src_data_acked (struct lsquic_stream *stream, uint64_t off,
+                                                                size_t len)
+{
+    struct stream_src_reg *reg, *next;
+    struct stream_wref *wref;
+    uint64_t begin, end;
+
+    for (reg = TAILQ_FIRST(&stream->sm_src_regs);
+                        reg && reg->ssr_stream_off < off + len; reg = next)
+    {
+        next = TAILQ_NEXT(reg, ssr_next);
+        begin = off > reg->ssr_stream_off ? off : reg->ssr_stream_off;
+        end = MIN(off + len, reg->ssr_stream_off + reg->ssr_len);
+        if (begin >= end)
+            continue;
+        reg->ssr_n_acked += end - begin;
+        assert(reg->ssr_n_acked <= reg->ssr_len);
+        wref = reg->ssr_wref;
+        if (reg->ssr_n_acked >= reg->ssr_len)
+        {
+            LSQ_DEBUG("source region at offset %"PRIu64" of length %"PRIu64
+                " has been ACKed, drop it", reg->ssr_stream_off,
+                reg->ssr_len);
+            TAILQ_REMOVE(&stream->sm_src_regs, reg, ssr_next);
+            free_src_reg(stream, reg);
+        }
+        /* A buffer is only moved to the written list once all of it has
+         * been written out.  By the time all of it is ACKed, all of the
+         * regions that point to it have been dropped.
+         */
+        if (wref)
+        {
+            wref->swr_n_acked += end - begin;
+            assert(wref->swr_n_acked <= wref->swr_len);
+            if (wref->swr_n_acked >= wref->swr_len)
+            {
+                TAILQ_REMOVE(&stream->sm_written_wrefs, wref, swr_next);
+                release_wref(stream, wref);
+            }
+        }
+    }
+}
+
+
+static int
+stream_add_src_reg (struct lsquic_stream *stream, struct stream_file *file,
+                struct stream_wref *wref, uint64_t src_off,
+                uint64_t stream_off, size_t len)
+{
+    struct stream_src_reg *reg;
+
+    reg = TAILQ_LAST(&stream->sm_src_regs, stream_src_regs);
+    if (reg && reg->ssr_wref == wref && reg->ssr_file == file
+            && reg->ssr_stream_off + reg->ssr_len == stream_off
+            && reg->ssr_src_off + reg->ssr_len == src_off)
+    {
+        reg->ssr_len += len;
+        return 0;
+    }
+
+    reg = malloc(sizeof(*reg));
+    if (!reg)
+        return -1;
+    reg->ssr_stream_off = stream_off;
+    reg->ssr_src_off    = src_off;
+    reg->ssr_len        = len;
+    reg->ssr_n_acked    = 0;
+    reg->ssr_wref       = wref;
+    reg->ssr_file       = file;
+    if (file)
+        ++file->sf_n_refs;
+    TAILQ_INSERT_TAIL(&stream->sm_src_regs, reg, ssr_next);
+    return 0;
+}
+
+
+#ifndef WIN32
+struct file_preadv_ctx
+{
+    struct lsquic_stream   *stream;
+    const uint64_t         *iov_offs;   /* Stream offset of each iovec */
+    struct stream_file     *file;
+    int                     fd;
+    off_t                   off;
+    int                     error;
+};
+
+
+static ssize_t
+file_preadv (void *user_data, const struct iovec *iov, int iovcnt)
+{
+    struct file_preadv_ctx *const ctx = user_data;
+    struct lsquic_stream *const stream = ctx->stream;
+    uint64_t file_off;
+    size_t len, rem;
+    ssize_t nr;
+    int i;
+
+    nr = preadv(ctx->fd, iov, iovcnt, ctx->off);
+    if (nr < 0)
+    {
+        /* Returning zero makes lsquic_stream_pwritev() unwind the write */
+        ctx->error = errno;
+        return 0;
+    }
+
+    /* With HTTP/3 framing, iovecs are not contiguous in the stream: each
+     * is recorded separately.
+     */
+    file_off = (uint64_t) ctx->off;
+    rem = (size_t) nr;
+    for (i = 0; i < iovcnt && rem > 0; ++i)
+    {
+        len = MIN(rem, iov[i].iov_len);
+        if (0 != stream_add_src_reg(stream, ctx->file, NULL, file_off,
+                                                    ctx->iov_offs[i], len))
+        {
+            LSQ_INFO("cannot allocate source region: data will not be read "
+                                                        "back from file");
+            break;
+        }
+        file_off += len;
+        rem -= len;
+    }
+
+    return nr;
+}
+#endif
+
+
+ssize_t
+lsquic_stream_write_file (struct lsquic_stream *stream, int fd, off_t off,
+                                                                size_t len)
+{
+#ifndef WIN32
+    struct file_preadv_ctx ctx;
+    struct stream_file *file;
+    uint64_t iov_offs[LSQUIC_PWRITEV_DEF_IOVECS];
+    unsigned char buf[0x1000];
+    uint64_t stream_off;
+    ssize_t nr, nw;
+
+    COMMON_WRITE_CHECKS();
+    SM_HISTORY_APPEND(stream, SHE_USER_WRITE_DATA);
+
+    if (len == 0)
+        return 0;
+
+    file = stream_get_file(stream, fd);
+    if (!file)
+        return -1;
+
+    ctx.stream = stream;
+    ctx.iov_offs = iov_offs;
+    ctx.file = file;
+    ctx.fd = fd;
+    ctx.off = off;
+    ctx.error = 0;
+    nw = stream_pwritev(stream, file_preadv, &ctx, len, iov_offs,
+                                sizeof(iov_offs) / sizeof(iov_offs[0]), 0);
+    if (ctx.error)
+    {
+        LSQ_INFO("cannot read from fd %d: %s", fd, strerror(ctx.error));
+        errno = ctx.error;
+        return -1;
+    }
+
+    if (nw == 0 && lsquic_stream_write_avail(stream) > 0)
+    {
+        /* Not enough to fill a packet: lsquic_stream_pwritev() does not
+         * buffer, so we read into a temporary buffer and write that.
+         */
+        do
+            nr = pread(fd, buf, len < sizeof(buf) ? len : sizeof(buf), off);
+        while (nr < 0 && errno == EINTR);
+        if (nr < 0)
+        {
+            LSQ_INFO("cannot read from fd %d: %s", fd, strerror(errno));
+            return -1;
+        }
+        /* Data written ahead of the file data -- the buffered bytes -- is
+         * packetized first.
+         */
+        stream_off = stream->tosend_off + stream->sm_n_buffered;
+        nw = lsquic_stream_write(stream, buf, (size_t) nr);
+        if (nw > 0
+            /* Where HTTP/3 frame headers go is not known until the buffered
+             * data is packetized.  This is a short tail, so we let its
+             * packet be held in memory.
+             */
+            && (stream->sm_bflags & (SMBF_IETF|SMBF_USE_HEADERS))
+                                            != (SMBF_IETF|SMBF_USE_HEADERS)
+            && 0 != stream_add_src_reg(stream, file, NULL, (uint64_t) off,
+                                                    stream_off, (size_t) nw))
+            LSQ_INFO("cannot allocate source region: data will not be read "
+                                                        "back from file");
+    }
+
+    LSQ_DEBUG("wrote %zd bytes from fd %d at offset %"PRIu64, nw, fd,
+                                                            (uint64_t) off);
+    return nw;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+
+/* Registered buffers are copied directly into packets.  Each range copied
+ * is recorded as a source region, so that the packets do not have to keep
+ * the data once they are sent.
+ */
+struct wref_preadv_ctx
+{
+    struct lsquic_stream   *stream;
+    const uint64_t         *iov_offs;   /* Stream offset of each iovec */
+};
+
+
+static ssize_t
+wref_preadv (void *user_data, const struct iovec *iov, int iovcnt)
+{
+    struct wref_preadv_ctx *const ctx = user_data;
+    struct lsquic_stream *const stream = ctx->stream;
+    struct stream_wref *wref;
+    unsigned char *p;
+    size_t n_tocopy, n_left;
+    ssize_t nr;
+    int i;
+
+    nr = 0;
+    for (i = 0; i < iovcnt; ++i)
+    {
+        p = iov[i].iov_base;
+        n_left = iov[i].iov_len;
+        while (n_left > 0 && (wref = TAILQ_FIRST(&stream->sm_wrefs)))
+        {
+            n_tocopy = MIN(n_left, wref->swr_len - wref->swr_off);
+            if (0 != stream_add_src_reg(stream, NULL, wref, wref->swr_off,
+                    ctx->iov_offs[i] + iov[i].iov_len - n_left, n_tocopy))
+            {
+                /* Short read makes stream_pwritev() unwind the write */
+                LSQ_WARN("cannot allocate source region");
+                return nr;
+            }
+            memcpy(p, wref->swr_buf + wref->swr_off, n_tocopy);
+            p += n_tocopy;
+            n_left -= n_tocopy;
+            nr += n_tocopy;
+            wref->swr_off += n_tocopy;
+            if (wref->swr_off == wref->swr_len)
+            {
+                TAILQ_REMOVE(&stream->sm_wrefs, wref, swr_next);
+                TAILQ_INSERT_TAIL(&stream->sm_written_wrefs, wref, swr_next);
+            }
+        }
+    }
+
+    return nr;
+}
+
+
+static size_t
+wrefs_size (const struct lsquic_stream *stream)
+{
+    const struct stream_wref *wref;
+    size_t size;
+
+    size = 0;
+    TAILQ_FOREACH(wref, &stream->sm_wrefs, swr_next)
+        size += wref->swr_len - wref->swr_off;
+
+    return size;
+}
+
+
+/* Buffers that have not been written out are released right away.  A
+ * buffer that has been written out, even partially, may still be needed
+ * to retransmit lost packets: it is released when the stream is destroyed.
+ */
+static void
+drop_wrefs (struct lsquic_stream *stream)
+{
+    struct stream_wref *wref;
+
+    while ((wref = TAILQ_FIRST(&stream->sm_wrefs)))
+    {
+        TAILQ_REMOVE(&stream->sm_wrefs, wref, swr_next);
+        if (wref->swr_off > 0)
+            TAILQ_INSERT_TAIL(&stream->sm_written_wrefs, wref, swr_next);
+        else
+            release_wref(stream, wref);
+    }
+}
+
+
+/* Write registered buffers to packets as flow control and congestion
+ * window allow.  Unless `force' is set, only full packets are written:
+ * the tail waits for more buffers to be registered.  Once all buffers
+ * have been written out, send FIN if the user has already shut down the
+ * stream for writing.
+ */
+static int
+stream_write_refs (struct lsquic_stream *stream, int force)
+{
+    struct wref_preadv_ctx ctx;
+    uint64_t iov_offs[LSQUIC_PWRITEV_DEF_IOVECS];
+    size_t total;
+    ssize_t nw;
+
+    ctx.stream = stream;
+    ctx.iov_offs = iov_offs;
+    total = 0;
+    do
+    {
+        nw = stream_pwritev(stream, wref_preadv, &ctx, wrefs_size(stream),
+                    iov_offs, sizeof(iov_offs) / sizeof(iov_offs[0]),
+                    SWO_WREFS | (force ? SWO_FORCE : 0));
+        if (nw < 0)
+            return -1;
+        total += (size_t) nw;
+    }
+    while (nw > 0 && !TAILQ_EMPTY(&stream->sm_wrefs));
+    LSQ_DEBUG("wrote %zu bytes from registered buffers", total);
+
+    if (TAILQ_EMPTY(&stream->sm_wrefs))
+    {
+        maybe_remove_from_write_q(stream, SMQF_WRITE_REFS);
+        if ((stream->stream_flags & (STREAM_U_WRITE_DONE|STREAM_FIN_SENT))
+                                                    == STREAM_U_WRITE_DONE
+                && !lsquic_stream_is_write_reset(stream))
+        {
+            if (stream->sm_n_buffered == 0
+                    && 0 == lsquic_send_ctl_turn_on_fin(
+                                        stream->conn_pub->send_ctl, stream))
+            {
+                LSQ_DEBUG("turned on FIN flag in the yet-unsent STREAM "
+                                                                    "frame");
+                stream->stream_flags |= STREAM_FIN_SENT;
+            }
+            else
+                return stream_flush_nocheck(stream);
+        }
+    }
+
+    return 0;
+}
+
+
+ssize_t
+lsquic_stream_write_ref (struct lsquic_stream *stream, const void *buf,
+        size_t len, void (*release)(void *ctx, const void *buf, size_t len),
+        void *ctx)
+{
+    struct stream_wref *wref;
+
+    COMMON_WRITE_CHECKS();
+    SM_HISTORY_APPEND(stream, SHE_USER_WRITE_DATA);
+
+    if (len == 0)
+        return 0;
+
+    wref = malloc(sizeof(*wref));
+    if (!wref)
+        return -1;
+
+    wref->swr_buf     = buf;
+    wref->swr_len     = len;
+    wref->swr_off     = 0;
+    wref->swr_n_acked = 0;
+    wref->swr_release = release;
+    wref->swr_ctx     = ctx;
+    TAILQ_INSERT_TAIL(&stream->sm_wrefs, wref, swr_next);
+    LSQ_DEBUG("registered buffer %p of %zu bytes", buf, len);
+
+    maybe_put_onto_write_q(stream, SMQF_WRITE_REFS);
+    if (0 != stream_write_refs(stream, 0))
+        return -1;
+
+    return len;
+}
+
+
 /* This bypasses COMMON_WRITE_CHECKS */
 static ssize_t
 stream_write_buf (struct lsquic_stream *stream, const void *buf, size_t sz)
@@ -5543,5 +6386,6 @@ lsquic_stream_set_http_prio (struct lsquic_stream *stream,
 int
 lsquic_stream_has_unacked_data (struct lsquic_stream *stream)
 {
-    return stream->n_unacked > 0 || stream->sm_n_buffered > 0;
+    return stream->n_unacked > 0 || stream->sm_n_buffered > 0
+        || !TAILQ_EMPTY(&stream->sm_wrefs);
 }
@@ -20,6 +20,7 @@ union hblock_ctx;
 struct lsquic_packet_out;
 struct lsquic_send_ctl;
 struct network_path;
+struct stream_file;
 
 TAILQ_HEAD(lsquic_streams_tailq, lsquic_stream);
 
@@ -96,6 +97,38 @@ struct stream_hq_frame
 };
 
 
+/* Application-owned buffer registered using lsquic_stream_write_ref().
+ * It is released once all of its contents have been acknowledged.
+ */
+struct stream_wref
+{
+    TAILQ_ENTRY(stream_wref)    swr_next;
+    const unsigned char        *swr_buf;
+    size_t                      swr_len;
+    size_t                      swr_off;    /* Bytes written to stream */
+    size_t                      swr_n_acked;
+    void                      (*swr_release)(void *ctx, const void *buf,
+                                                                size_t len);
+    void                       *swr_ctx;
+};
+
+
+/* Range of stream data written using lsquic_stream_write_file() or
+ * lsquic_stream_write_ref().  Packets that carry it do not need to keep
+ * it in memory: it can be read back from its source.
+ */
+struct stream_src_reg
+{
+    TAILQ_ENTRY(stream_src_reg)     ssr_next;
+    uint64_t                        ssr_stream_off;
+    uint64_t                        ssr_src_off;    /* Offset into source */
+    uint64_t                        ssr_len;
+    uint64_t                        ssr_n_acked;    /* Bytes ACKed so far */
+    struct stream_wref             *ssr_wref;       /* NULL if source is file */
+    struct stream_file             *ssr_file;       /* NULL if not file */
+};
+
+
 struct hq_filter
 {
     struct varint_read2_state   hqfi_vint2_state;
@@ -140,9 +173,10 @@ enum stream_q_flags
     SMQF_WANT_READ    = 1 << 0,
 
     /* write_streams: */
-#define SMQF_WRITE_Q_FLAGS (SMQF_WANT_FLUSH|SMQF_WANT_WRITE)
+#define SMQF_WRITE_Q_FLAGS (SMQF_WANT_FLUSH|SMQF_WANT_WRITE|SMQF_WRITE_REFS)
     SMQF_WANT_WRITE   = 1 << 1,
     SMQF_WANT_FLUSH   = 1 << 2,     /* Flush until sm_flush_to is hit */
+    SMQF_WRITE_REFS   = 1 << 12,    /* Have registered buffers on sm_wrefs */
 
     /* There are more than one reason that a stream may be put onto
      * connections's sending_streams queue.  Note that writing STREAM
@@ -277,6 +311,26 @@ struct lsquic_stream
     /* List of active HQ frames */
     STAILQ_HEAD(, stream_hq_frame)  sm_hq_frames;
 
+    /* Buffers registered using lsquic_stream_write_ref() that have not
+     * been written out yet, in stream order.
+     */
+    TAILQ_HEAD(stream_wrefs, stream_wref)
+                                    sm_wrefs;
+
+    /* Registered buffers that have been written out, but whose contents
+     * have not been acknowledged yet.
+     */
+    struct stream_wrefs             sm_written_wrefs;
+
+    /* Stream data that can be read back from its source if it needs to be
+     * retransmitted.
+     */
+    TAILQ_HEAD(stream_src_regs, stream_src_reg)
+                                    sm_src_regs;
+
+    /* File last written using lsquic_stream_write_file() */
+    struct stream_file             *sm_file;
+
     /* For efficiency, several frames are allocated as part of the stream
      * itself.  If more frames are needed, they are allocated.
      */
@@ -641,4 +695,19 @@ lsquic_stream_set_pwritev_params (unsigned iovecs, unsigned frames);
 void
 lsquic_stream_drop_hset_ref (struct lsquic_stream *);
 
+#define lsquic_stream_has_src_regs(stream_) \
+                                (!TAILQ_EMPTY(&(stream_)->sm_src_regs))
+
+size_t
+lsquic_stream_src_run (const struct lsquic_stream *, uint64_t off,
+                                                size_t len, int *from_src);
+
+int
+lsquic_stream_read_src_range (struct lsquic_stream *, uint64_t off,
+                                                    unsigned char *, size_t);
+
+void
+lsquic_stream_src_data_acked (struct lsquic_stream *, uint64_t off,
+                                                                size_t len);
+
 #endif
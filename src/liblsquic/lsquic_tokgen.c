@@ -227,8 +227,10 @@ get_or_generate_state (struct lsquic_engine_public *enpub, time_t now,
                                                     sizeof(*shm_state), 0);
     if (s != 0)
     {
-        LSQ_ERROR("cannot insert into SHM");
-        return -1;
+        /* Another engine sharing the hash may have inserted it first.  If
+         * so, the lookup below will find it.
+         */
+        LSQ_INFO("cannot insert into SHM");
     }
     sz = sizeof(*shm_state);
     s = shi->shi_lookup(ctx, TOKGEN_SHM_KEY, TOKGEN_SHM_KEY_SIZE, &copy, &sz);
@@ -0,0 +1,285 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * This is not really a test: this program measures how long it takes the
+ * send controller to process incoming ACKs when there are many packets in
+ * flight.
+ *
+ * Each round, `-n' packets are sent and then acknowledged in increasing
+ * order, `-a' packets per ACK frame.  If `-g' is specified, every Nth packet
+ * is left out of the ACK ranges; these packets end up declared lost and are
+ * retransmitted in the next round.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifndef WIN32
+#include <unistd.h>
+#else
+#include <getopt.h>
+#endif
+
+#include "lsquic.h"
+
+#include "lsquic_int_types.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_alarmset.h"
+#include "lsquic_conn_flow.h"
+#include "lsquic_rtt.h"
+#include "lsquic_sfcw.h"
+#include "lsquic_varint.h"
+#include "lsquic_hq.h"
+#include "lsquic_hash.h"
+#include "lsquic_stream.h"
+#include "lsquic_types.h"
+#include "lsquic_malo.h"
+#include "lsquic_mm.h"
+#include "lsquic_conn_public.h"
+#include "lsquic_logger.h"
+#include "lsquic_parse.h"
+#include "lsquic_conn.h"
+#include "lsquic_engine_public.h"
+#include "lsquic_cubic.h"
+#include "lsquic_pacer.h"
+#include "lsquic_senhist.h"
+#include "lsquic_bw_sampler.h"
+#include "lsquic_minmax.h"
+#include "lsquic_bbr.h"
+#include "lsquic_bbr2.h"
+#include "lsquic_prague.h"
+#include "lsquic_adaptive_cc.h"
+#include "lsquic_send_ctl.h"
+#include "lsquic_ver_neg.h"
+#include "lsquic_packet_out.h"
+#include "lsquic_enc_sess.h"
+#include "lsquic_util.h"
+
+
+struct bench_objs
+{
+    struct lsquic_conn          lconn;
+    struct lsquic_engine_public eng_pub;
+    struct lsquic_conn_public   conn_pub;
+    struct lsquic_send_ctl      send_ctl;
+    struct lsquic_alarmset      alset;
+    struct ver_neg              ver_neg;
+};
+
+
+static struct network_path network_path;
+
+
+static struct network_path *
+get_network_path (struct lsquic_conn *lconn, const struct sockaddr *sa)
+{
+    return &network_path;
+}
+
+
+static int
+can_write_ack (struct lsquic_conn *lconn)
+{
+    return 0;
+}
+
+
+static const struct conn_iface our_conn_if =
+{
+    .ci_can_write_ack = can_write_ack,
+    .ci_get_path      = get_network_path,
+};
+
+
+#if LSQUIC_CONN_STATS
+static struct conn_stats s_conn_stats;
+#endif
+
+
+static void
+init_bench_objs (struct bench_objs *bobjs)
+{
+    memset(bobjs, 0, sizeof(*bobjs));
+    LSCONN_INITIALIZE(&bobjs->lconn);
+    bobjs->lconn.cn_pf = select_pf_by_ver(LSQVER_043);
+    bobjs->lconn.cn_version = LSQVER_043;
+    bobjs->lconn.cn_esf_c = &lsquic_enc_session_common_gquic_1;
+    bobjs->lconn.cn_if = &our_conn_if;
+    network_path.np_pack_size = 1370;
+    lsquic_mm_init(&bobjs->eng_pub.enp_mm);
+    /* Cubic: we are measuring bookkeeping, not congestion control */
+    bobjs->eng_pub.enp_settings.es_cc_algo = 1;
+    TAILQ_INIT(&bobjs->conn_pub.sending_streams);
+    TAILQ_INIT(&bobjs->conn_pub.read_streams);
+    TAILQ_INIT(&bobjs->conn_pub.write_streams);
+    TAILQ_INIT(&bobjs->conn_pub.service_streams);
+    bobjs->conn_pub.enpub = &bobjs->eng_pub;
+    lsquic_alarmset_init(&bobjs->alset, 0);
+    bobjs->conn_pub.mm = &bobjs->eng_pub.enp_mm;
+    bobjs->conn_pub.lconn = &bobjs->lconn;
+    bobjs->conn_pub.send_ctl = &bobjs->send_ctl;
+    bobjs->conn_pub.packet_out_malo =
+                        lsquic_malo_create(sizeof(struct lsquic_packet_out));
+    bobjs->conn_pub.path = &network_path;
+#if LSQUIC_CONN_STATS
+    bobjs->conn_pub.conn_stats = &s_conn_stats;
+#endif
+    lsquic_send_ctl_init(&bobjs->send_ctl, &bobjs->alset, &bobjs->eng_pub,
+        &bobjs->ver_neg, &bobjs->conn_pub, 0);
+}
+
+
+static void
+deinit_bench_objs (struct bench_objs *bobjs)
+{
+    lsquic_send_ctl_cleanup(&bobjs->send_ctl);
+    lsquic_malo_destroy(bobjs->conn_pub.packet_out_malo);
+    lsquic_mm_cleanup(&bobjs->eng_pub.enp_mm);
+}
+
+
+/* Returns the number of packets sent */
+static unsigned
+send_packets (struct bench_objs *bobjs, unsigned n_packets, lsquic_time_t now,
+                                                    lsquic_packno_t *largest)
+{
+    struct lsquic_send_ctl *const ctl = &bobjs->send_ctl;
+    struct lsquic_packet_out *packet_out;
+    unsigned n, n_sent = 0;
+
+    (void) lsquic_send_ctl_reschedule_packets(ctl);
+    for (n = 0; n < n_packets; ++n)
+    {
+        packet_out = lsquic_send_ctl_new_packet_out(ctl, 0, PNS_APP,
+                                                                &network_path);
+        assert(packet_out);
+        packet_out->po_data[0] = 0x07;  /* PING */
+        packet_out->po_data_sz = 1;
+        packet_out->po_frame_types |= QUIC_FTBIT_PING;
+        lsquic_send_ctl_scheduled_one(ctl, packet_out);
+    }
+
+    while ((packet_out = lsquic_send_ctl_next_packet_to_send(ctl, NULL)))
+    {
+        packet_out->po_sent = now;
+        *largest = packet_out->po_packno;
+        lsquic_send_ctl_sent_packet(ctl, packet_out);
+        ++n_sent;
+    }
+
+    return n_sent;
+}
+
+
+/* Fill in ranges [low, high], skipping every `gap'th packet number. */
+static void
+fill_ack (struct ack_info *acki, lsquic_packno_t low, lsquic_packno_t high,
+                                                                unsigned gap)
+{
+    struct lsquic_packno_range *range;
+
+    acki->n_ranges = 0;
+    while (high >= low && acki->n_ranges
+                            < sizeof(acki->ranges) / sizeof(acki->ranges[0]))
+    {
+        if (gap)
+            while (high >= low && high % gap == 0)
+                --high;
+        if (high < low)
+            break;
+        range = &acki->ranges[acki->n_ranges++];
+        range->high = high;
+        if (gap)
+            range->low = high - high % gap + 1;
+        else
+            range->low = low;
+        if (range->low < low)
+            range->low = low;
+        high = range->low - 1;
+    }
+}
+
+
+int
+main (int argc, char **argv)
+{
+    struct bench_objs bobjs;
+    struct ack_info *acki;
+    lsquic_packno_t largest = 0, low, high;
+    lsquic_time_t now, start, elapsed = 0;
+    unsigned n_packets = 10000, n_rounds = 100, gap = 0, per_ack = 2, round;
+    unsigned long n_sent = 0, n_acks = 0;
+    int opt, s;
+
+    while (-1 != (opt = getopt(argc, argv, "a:g:n:r:")))
+    {
+        switch (opt)
+        {
+        case 'a':
+            per_ack = atoi(optarg);
+            break;
+        case 'g':
+            gap = atoi(optarg);
+            break;
+        case 'n':
+            n_packets = atoi(optarg);
+            break;
+        case 'r':
+            n_rounds = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n packets] [-r rounds] "
+                "[-a packets per ACK] [-g gap]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (per_ack == 0)
+        per_ack = 1;
+
+    acki = calloc(1, sizeof(*acki));
+    if (!acki)
+        return 1;
+    acki->pns = PNS_APP;
+
+    init_bench_objs(&bobjs);
+    now = 1000000;
+    low = 1;
+    for (round = 0; round < n_rounds; ++round)
+    {
+        n_sent += send_packets(&bobjs, n_packets, now, &largest);
+        now += 10000;
+        start = lsquic_time_now();
+        for (high = low + per_ack - 1; low <= largest; high += per_ack)
+        {
+            if (high > largest)
+                high = largest;
+            fill_ack(acki, low, high, gap);
+            if (acki->n_ranges)
+            {
+                s = lsquic_send_ctl_got_ack(&bobjs.send_ctl, acki, now, now);
+                assert(0 == s);
+                ++n_acks;
+            }
+            if (acki->n_ranges < sizeof(acki->ranges)
+                                                    / sizeof(acki->ranges[0]))
+                low = high + 1;
+            else
+                low = acki->ranges[acki->n_ranges - 1].low;
+            now += 10;
+        }
+        elapsed += lsquic_time_now() - start;
+    }
+
+    printf("sizeof(struct lsquic_packet_out): %zu\n",
+                                            sizeof(struct lsquic_packet_out));
+    printf("%u rounds of %u packets, gap %u: %lu packets sent, %lu ACKs, "
+        "%"PRIu64" usec, %.1f nsec per packet\n", n_rounds, n_packets, gap,
+        n_sent, n_acks, elapsed, (double) elapsed * 1000 / (double) n_sent);
+
+    deinit_bench_objs(&bobjs);
+    free(acki);
+    (void) s;
+    return 0;
+}
@@ -0,0 +1,943 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * This is not really a test: this program is an offline congestion control
+ * simulator.  Several flows, each driven by its own send controller, share
+ * a bottleneck link.  The link has a fixed rate and a drop-tail buffer; it
+ * can also drop packets at random, in bursts (Gilbert-Elliott model), and
+ * CE-mark them when the queue builds up past a threshold.
+ *
+ * Each flow is a bulk sender: whenever the send controller allows, a new
+ * full-sized packet is scheduled.  The receiver ACKs every second packet,
+ * immediately on a gap, or after the delayed-ACK timeout.  ACKs travel
+ * back over an uncongested path.
+ *
+ * The simulation is discrete-event and does not depend on wall-clock time.
+ * All randomness -- including that used by the congestion controllers -- comes
+ * from a seeded generator, so that a given command line always produces
+ * the same result.
+ *
+ * At the end, goodput, loss, and RTT percentiles are printed for each flow,
+ * followed by link utilization and Jain's fairness index.  Use -U, -J, and
+ * -Q to turn the program into a pass/fail check.
+ *
+ * Example: compare BBRv1 and Cubic over a shallow-buffered 20 Mbps link:
+ *
+ *  sim_cc -b 20 -q 10 -f bbr:40 -f cubic:40
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifndef WIN32
+#include <unistd.h>
+#else
+#include <getopt.h>
+#endif
+
+#include "lsquic.h"
+
+#include "lsquic_int_types.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_alarmset.h"
+#include "lsquic_conn_flow.h"
+#include "lsquic_rtt.h"
+#include "lsquic_sfcw.h"
+#include "lsquic_varint.h"
+#include "lsquic_hq.h"
+#include "lsquic_hash.h"
+#include "lsquic_stream.h"
+#include "lsquic_types.h"
+#include "lsquic_malo.h"
+#include "lsquic_mm.h"
+#include "lsquic_conn_public.h"
+#include "lsquic_logger.h"
+#include "lsquic_parse.h"
+#include "lsquic_conn.h"
+#include "lsquic_engine_public.h"
+#include "lsquic_crand.h"
+#include "lsquic_cong_ctl.h"
+#include "lsquic_cubic.h"
+#include "lsquic_pacer.h"
+#include "lsquic_senhist.h"
+#include "lsquic_bw_sampler.h"
+#include "lsquic_minmax.h"
+#include "lsquic_bbr.h"
+#include "lsquic_bbr2.h"
+#include "lsquic_prague.h"
+#include "lsquic_adaptive_cc.h"
+#include "lsquic_send_ctl.h"
+#include "lsquic_ver_neg.h"
+#include "lsquic_packet_out.h"
+#include "lsquic_enc_sess.h"
+
+
+#define MS(n) ((lsquic_time_t) (n) * 1000)  /* Milliseconds */
+#define SEC(n) ((lsquic_time_t) (n) * 1000 * 1000)
+
+#define PACK_SIZE           1370
+#define ACK_EVERY           2           /* Packets */
+#define MAX_ACK_DELAY       MS(25)
+#define ACK_RANGES          32          /* Most recent ranges sent in ACK */
+#define MAX_FLOWS           64
+
+
+/* Deterministic pseudo-random numbers (xorshift64*) */
+static uint64_t s_rand_state = 1;
+
+static uint64_t
+sim_rand (void)
+{
+    s_rand_state ^= s_rand_state >> 12;
+    s_rand_state ^= s_rand_state << 25;
+    s_rand_state ^= s_rand_state >> 27;
+    return s_rand_state * 0x2545F4914F6CDD1DULL;
+}
+
+
+/* Returns value in [0, 1) */
+static double
+sim_rand_unit (void)
+{
+    return (double) (sim_rand() >> 11) / (double) (1ULL << 53);
+}
+
+
+/* A simple growable FIFO of fixed-size elements */
+struct fifo
+{
+    char           *buf;
+    size_t          elem_sz;
+    unsigned        head, count, nalloc;    /* `nalloc' is a power of two */
+};
+
+
+static void
+fifo_init (struct fifo *fifo, size_t elem_sz)
+{
+    memset(fifo, 0, sizeof(*fifo));
+    fifo->elem_sz = elem_sz;
+}
+
+
+static void *
+fifo_elem (const struct fifo *fifo, unsigned idx)
+{
+    return fifo->buf + ((fifo->head + idx) & (fifo->nalloc - 1))
+                                                            * fifo->elem_sz;
+}
+
+
+static void *
+fifo_push (struct fifo *fifo)
+{
+    char *buf;
+    unsigned nalloc, i;
+
+    if (fifo->count == fifo->nalloc)
+    {
+        nalloc = fifo->nalloc ? fifo->nalloc * 2 : 64;
+        buf = malloc(nalloc * fifo->elem_sz);
+        if (!buf)
+        {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        for (i = 0; i < fifo->count; ++i)
+            memcpy(buf + i * fifo->elem_sz, fifo_elem(fifo, i), fifo->elem_sz);
+        free(fifo->buf);
+        fifo->buf = buf;
+        fifo->nalloc = nalloc;
+        fifo->head = 0;
+    }
+
+    return fifo_elem(fifo, fifo->count++);
+}
+
+
+#define fifo_peek(fifo_) ((fifo_)->count ? fifo_elem(fifo_, 0) : NULL)
+
+static void
+fifo_pop (struct fifo *fifo)
+{
+    assert(fifo->count);
+    fifo->head = (fifo->head + 1) & (fifo->nalloc - 1);
+    --fifo->count;
+}
+
+
+/* Packet on its way to the receiver */
+struct net_packet
+{
+    lsquic_packno_t     packno;
+    lsquic_time_t       sent;
+    lsquic_time_t       arrive;
+    unsigned short      data_sz;
+    enum ecn            ecn;
+};
+
+
+/* ACK on its way to the sender */
+struct net_ack
+{
+    lsquic_time_t       arrive;
+    lsquic_time_t       largest_sent;
+    lsquic_time_t       lack_delta;
+    uint64_t            ecn_counts[4];
+    unsigned            n_ranges;
+    struct lsquic_packno_range
+                        ranges[ACK_RANGES];
+};
+
+
+struct flow
+{
+    unsigned            id;
+    const char         *algo;
+    int                 started;
+    lsquic_time_t       rtt;                /* Base RTT */
+    lsquic_time_t       start, stop;
+
+    /* Sender */
+    struct lsquic_conn          lconn;
+    struct lsquic_engine_public enpub;
+    struct lsquic_conn_public   conn_pub;
+    struct lsquic_send_ctl      send_ctl;
+    struct lsquic_alarmset      alset;
+    struct ver_neg              ver_neg;
+    struct crand                crand;
+    lsquic_time_t               pacer_wake;
+    lsquic_packno_t             largest_acked;
+
+    /* Network */
+    struct fifo         to_receiver;        /* struct net_packet */
+    struct fifo         to_sender;          /* struct net_ack */
+
+    /* Receiver */
+    struct lsquic_packno_range
+                        rx_ranges[ACK_RANGES];  /* Ring buffer */
+    unsigned            rx_n_ranges, rx_cur;
+    unsigned            rx_n_unacked;
+    lsquic_time_t       rx_largest_sent;
+    lsquic_time_t       rx_largest_time;
+    lsquic_time_t       rx_ack_deadline;
+    uint64_t            rx_ecn_counts[4];
+
+    /* Statistics */
+    uint64_t            n_sent, n_dropped, n_ce;
+    uint64_t            rx_bytes, rx_bytes_at_trace;
+    uint32_t           *rtts;
+    size_t              n_rtts, rtts_nalloc;
+};
+
+
+struct link
+{
+    uint64_t            rate;               /* Bytes per second */
+    uint64_t            buffer;             /* Bytes */
+    lsquic_time_t       free_at;            /* Queue drains at this time */
+    lsquic_time_t       ce_thresh;          /* Zero means no ECN marking */
+    double              loss;               /* Random loss probability */
+    double              ge_p, ge_r;         /* Gilbert-Elliott transitions */
+    int                 ge_bad;
+    int                 remark;             /* Remark ECT(1) as ECT(0) */
+
+    uint64_t            tx_bytes;
+    uint64_t            n_packets;
+    lsquic_time_t       queue_delay_sum;
+};
+
+
+static struct network_path network_path;
+
+
+static struct network_path *
+get_network_path (struct lsquic_conn *lconn, const struct sockaddr *sa)
+{
+    return &network_path;
+}
+
+
+static int
+can_write_ack (struct lsquic_conn *lconn)
+{
+    return 0;
+}
+
+
+static const struct conn_iface our_conn_if =
+{
+    .ci_can_write_ack = can_write_ack,
+    .ci_get_path      = get_network_path,
+};
+
+
+#if LSQUIC_CONN_STATS
+static struct conn_stats s_conn_stats;
+#endif
+
+
+static const struct {
+    const char  *name;
+    unsigned     cc_algo;   /* Value of es_cc_algo */
+} algos[] = {
+    { "cubic",      1, },
+    { "bbr",        2, },
+    { "adaptive",   3, },
+    { "bbr2",       4, },
+    { "prague",     5, },
+};
+
+
+static unsigned
+algo_by_name (const char *name)
+{
+    unsigned i;
+
+    for (i = 0; i < sizeof(algos) / sizeof(algos[0]); ++i)
+        if (0 == strcmp(name, algos[i].name))
+            return algos[i].cc_algo;
+
+    return 0;
+}
+
+
+/* Feed deterministic bytes to the controllers that need randomness.  We
+ * refill the cache before it runs out, so that lsquic_crand never calls
+ * RAND_bytes().
+ */
+static void
+flow_refill_crand (struct flow *flow)
+{
+    unsigned i;
+
+    if (flow->crand.nybble_off == 0
+            || flow->crand.nybble_off > sizeof(flow->crand.rand_buf) * 2 - 16)
+    {
+        for (i = 0; i < sizeof(flow->crand.rand_buf); ++i)
+            flow->crand.rand_buf[i] = (uint8_t) sim_rand();
+        flow->crand.nybble_off = 2;
+    }
+}
+
+
+static void
+flow_init (struct flow *flow, unsigned id, const char *algo,
+            unsigned cc_algo, lsquic_time_t rtt, lsquic_time_t start,
+            lsquic_time_t stop, int ecn)
+{
+    memset(flow, 0, sizeof(*flow));
+    flow->id = id;
+    flow->algo = algo;
+    flow->rtt = rtt;
+    flow->start = start;
+    flow->stop = stop;
+    fifo_init(&flow->to_receiver, sizeof(struct net_packet));
+    fifo_init(&flow->to_sender, sizeof(struct net_ack));
+
+    LSCONN_INITIALIZE(&flow->lconn);
+    flow->lconn.cn_cces_buf[0].cce_cid.len = 8;
+    memcpy(flow->lconn.cn_cces_buf[0].cce_cid.idbuf, &id, sizeof(id));
+    flow->lconn.cn_pf = select_pf_by_ver(LSQVER_043);
+    flow->lconn.cn_version = LSQVER_043;
+    flow->lconn.cn_esf_c = &lsquic_enc_session_common_gquic_1;
+    flow->lconn.cn_if = &our_conn_if;
+    lsquic_engine_init_settings(&flow->enpub.enp_settings, 0);
+    flow->enpub.enp_settings.es_cc_algo = cc_algo;
+    flow->enpub.enp_crand = &flow->crand;
+    lsquic_mm_init(&flow->enpub.enp_mm);
+    TAILQ_INIT(&flow->conn_pub.sending_streams);
+    TAILQ_INIT(&flow->conn_pub.read_streams);
+    TAILQ_INIT(&flow->conn_pub.write_streams);
+    TAILQ_INIT(&flow->conn_pub.service_streams);
+    flow->conn_pub.enpub = &flow->enpub;
+    lsquic_alarmset_init(&flow->alset, &flow->lconn);
+    flow->conn_pub.mm = &flow->enpub.enp_mm;
+    flow->conn_pub.lconn = &flow->lconn;
+    flow->conn_pub.send_ctl = &flow->send_ctl;
+    flow->conn_pub.packet_out_malo =
+                        lsquic_malo_create(sizeof(struct lsquic_packet_out));
+    flow->conn_pub.path = &network_path;
+#if LSQUIC_CONN_STATS
+    flow->conn_pub.conn_stats = &s_conn_stats;
+#endif
+    flow_refill_crand(flow);
+    lsquic_send_ctl_init(&flow->send_ctl, &flow->alset, &flow->enpub,
+        &flow->ver_neg, &flow->conn_pub, ecn ? SC_ECN : 0);
+}
+
+
+static void
+flow_cleanup (struct flow *flow)
+{
+    lsquic_send_ctl_cleanup(&flow->send_ctl);
+    lsquic_malo_destroy(flow->conn_pub.packet_out_malo);
+    lsquic_mm_cleanup(&flow->enpub.enp_mm);
+    free(flow->to_receiver.buf);
+    free(flow->to_sender.buf);
+    free(flow->rtts);
+}
+
+
+static uint64_t
+flow_cwnd (struct flow *flow)
+{
+    return flow->send_ctl.sc_ci->cci_get_cwnd(flow->send_ctl.sc_cong_ctl);
+}
+
+
+static lsquic_time_t
+link_queue_delay (const struct link *link, lsquic_time_t now)
+{
+    return link->free_at > now ? link->free_at - now : 0;
+}
+
+
+/* Returns 0 if the packet is dropped */
+static int
+link_enqueue (struct link *link, struct flow *flow,
+                        struct net_packet *npacket, unsigned sz)
+{
+    lsquic_time_t queue_delay, depart;
+
+    if (link->ge_p > 0)
+    {
+        if (link->ge_bad)
+            link->ge_bad = sim_rand_unit() >= link->ge_r;
+        else
+            link->ge_bad = sim_rand_unit() < link->ge_p;
+        if (link->ge_bad)
+            return 0;
+    }
+
+    if (link->loss > 0 && sim_rand_unit() < link->loss)
+        return 0;
+
+    queue_delay = link_queue_delay(link, npacket->sent);
+    if (queue_delay * link->rate / 1000000 + sz > link->buffer)
+        return 0;
+
+    if (link->remark && npacket->ecn == ECN_ECT1)
+        npacket->ecn = ECN_ECT0;
+
+    if (link->ce_thresh && queue_delay > link->ce_thresh
+                                            && npacket->ecn != ECN_NOT_ECT)
+    {
+        npacket->ecn = ECN_CE;
+        ++flow->n_ce;
+    }
+
+    depart = npacket->sent + queue_delay + (lsquic_time_t) sz * 1000000
+                                                                / link->rate;
+    link->free_at = depart;
+    link->tx_bytes += sz;
+    ++link->n_packets;
+    link->queue_delay_sum += queue_delay;
+    npacket->arrive = depart + flow->rtt / 2;
+    return 1;
+}
+
+
+static void
+flow_send_ack (struct flow *flow, lsquic_time_t now)
+{
+    struct net_ack *ack;
+    unsigned n, idx;
+
+    ack = fifo_push(&flow->to_sender);
+    ack->arrive = now + flow->rtt - flow->rtt / 2;
+    ack->largest_sent = flow->rx_largest_sent;
+    ack->lack_delta = now - flow->rx_largest_time;
+    memcpy(ack->ecn_counts, flow->rx_ecn_counts, sizeof(ack->ecn_counts));
+    for (n = 0; n < flow->rx_n_ranges; ++n)
+    {
+        idx = (flow->rx_cur + ACK_RANGES - n) % ACK_RANGES;
+        ack->ranges[n] = flow->rx_ranges[idx];
+    }
+    ack->n_ranges = flow->rx_n_ranges;
+    flow->rx_n_unacked = 0;
+    flow->rx_ack_deadline = 0;
+}
+
+
+static void
+flow_receive (struct flow *flow, const struct net_packet *npacket,
+                                                        lsquic_time_t now)
+{
+    struct lsquic_packno_range *range;
+    int gap;
+
+    if (flow->rx_n_ranges
+            && flow->rx_ranges[flow->rx_cur].high + 1 == npacket->packno)
+    {
+        flow->rx_ranges[flow->rx_cur].high = npacket->packno;
+        gap = 0;
+    }
+    else
+    {
+        gap = flow->rx_n_ranges > 0;
+        flow->rx_cur = (flow->rx_cur + 1) % ACK_RANGES;
+        if (flow->rx_n_ranges < ACK_RANGES)
+            ++flow->rx_n_ranges;
+        range = &flow->rx_ranges[flow->rx_cur];
+        range->low = range->high = npacket->packno;
+    }
+
+    flow->rx_largest_sent = npacket->sent;
+    flow->rx_largest_time = now;
+    ++flow->rx_ecn_counts[npacket->ecn];
+    flow->rx_bytes += npacket->data_sz;
+
+    if (gap || ++flow->rx_n_unacked >= ACK_EVERY)
+        flow_send_ack(flow, now);
+    else if (!flow->rx_ack_deadline)
+        flow->rx_ack_deadline = now + MAX_ACK_DELAY;
+}
+
+
+static void
+flow_record_rtt (struct flow *flow, lsquic_time_t rtt)
+{
+    uint32_t *rtts;
+
+    if (flow->n_rtts >= flow->rtts_nalloc)
+    {
+        flow->rtts_nalloc = flow->rtts_nalloc ? flow->rtts_nalloc * 2 : 1024;
+        rtts = realloc(flow->rtts, flow->rtts_nalloc * sizeof(rtts[0]));
+        if (!rtts)
+        {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        flow->rtts = rtts;
+    }
+    flow->rtts[flow->n_rtts++] = (uint32_t) rtt;
+}
+
+
+static void
+flow_got_ack (struct flow *flow, const struct net_ack *ack, lsquic_time_t now)
+{
+    static struct ack_info acki;
+    int s;
+
+    acki.pns = PNS_APP;
+    acki.flags = flow->send_ctl.sc_ecn != ECN_NOT_ECT ? AI_ECN : 0;
+    acki.n_ranges = ack->n_ranges;
+    acki.lack_delta = ack->lack_delta;
+    memcpy(acki.ecn_counts, ack->ecn_counts, sizeof(acki.ecn_counts));
+    memcpy(acki.ranges, ack->ranges, ack->n_ranges * sizeof(ack->ranges[0]));
+
+    if (acki.ranges[0].high > flow->largest_acked)
+    {
+        flow->largest_acked = acki.ranges[0].high;
+        flow_record_rtt(flow, now - ack->largest_sent - ack->lack_delta);
+    }
+
+    s = lsquic_send_ctl_got_ack(&flow->send_ctl, &acki, now, now);
+    if (s != 0)
+    {
+        fprintf(stderr, "flow %u: error processing ACK\n", flow->id);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+/* Do what connection and engine do on each tick: process alarms, then
+ * generate and send as many packets as the send controller allows.
+ */
+static void
+flow_tick (struct flow *flow, struct link *link, lsquic_time_t now)
+{
+    struct lsquic_send_ctl *const ctl = &flow->send_ctl;
+    struct lsquic_packet_out *packet_out;
+    struct net_packet npacket;
+    unsigned sz;
+
+    lsquic_send_ctl_tick_in(ctl, now);
+    /* There is no engine to put us on the advisory tick queue: we check
+     * the pacer ourselves below.
+     */
+    ctl->sc_flags &= ~SC_SCHED_TICK;
+    lsquic_alarmset_ring_expired(&flow->alset, now);
+    (void) lsquic_send_ctl_reschedule_packets(ctl);
+
+    if (now < flow->stop)
+        while (lsquic_send_ctl_can_send(ctl))
+        {
+            packet_out = lsquic_send_ctl_new_packet_out(ctl, 0, PNS_APP,
+                                                                &network_path);
+            if (!packet_out)
+                break;
+            packet_out->po_data[0] = 0x07;  /* PING */
+            packet_out->po_data_sz = 1;
+            packet_out->po_frame_types |= QUIC_FTBIT_PING;
+            lsquic_packet_out_zero_pad(packet_out);
+            lsquic_send_ctl_scheduled_one(ctl, packet_out);
+        }
+
+    while ((packet_out = lsquic_send_ctl_next_packet_to_send(ctl, NULL)))
+    {
+        /* The engine sets this when it encrypts the packet */
+        lsquic_packet_out_set_enc_level(packet_out, ENC_LEV_APP);
+        packet_out->po_sent = now;
+        sz = lsquic_packet_out_total_sz(&flow->lconn, packet_out);
+        npacket.packno = packet_out->po_packno;
+        npacket.sent = now;
+        npacket.data_sz = packet_out->po_data_sz;
+        npacket.ecn = lsquic_packet_out_ecn(packet_out);
+        if (link_enqueue(link, flow, &npacket, sz))
+            *(struct net_packet *) fifo_push(&flow->to_receiver) = npacket;
+        else
+            ++flow->n_dropped;
+        ++flow->n_sent;
+        lsquic_send_ctl_sent_packet(ctl, packet_out);
+    }
+
+    lsquic_send_ctl_tick_out(ctl);
+
+    flow->pacer_wake = lsquic_send_ctl_next_pacer_time(ctl);
+    if (flow->pacer_wake <= now)
+        flow->pacer_wake = 0;
+}
+
+
+static lsquic_time_t
+flow_next_event (const struct flow *flow)
+{
+    const struct net_packet *npacket;
+    const struct net_ack *ack;
+    lsquic_time_t t, next;
+    enum alarm_id al_id;
+
+    if (!flow->started)
+        return flow->start;
+
+    next = UINT64_MAX;
+    if ((npacket = fifo_peek(&flow->to_receiver)))
+        next = npacket->arrive;
+    if ((ack = fifo_peek(&flow->to_sender)) && ack->arrive < next)
+        next = ack->arrive;
+    if (flow->rx_ack_deadline && flow->rx_ack_deadline < next)
+        next = flow->rx_ack_deadline;
+    if (flow->pacer_wake && flow->pacer_wake < next)
+        next = flow->pacer_wake;
+    t = lsquic_alarmset_mintime(&flow->alset, &al_id);
+    /* Alarms ring when they are in the past */
+    if (t && t + 1 < next)
+        next = t + 1;
+
+    return next;
+}
+
+
+static void
+flow_process (struct flow *flow, struct link *link, lsquic_time_t now)
+{
+    const struct net_packet *npacket;
+    const struct net_ack *ack;
+
+    flow_refill_crand(flow);
+    flow->started = 1;
+
+    while ((npacket = fifo_peek(&flow->to_receiver))
+                                                && npacket->arrive <= now)
+    {
+        flow_receive(flow, npacket, now);
+        fifo_pop(&flow->to_receiver);
+    }
+    if (flow->rx_ack_deadline && flow->rx_ack_deadline <= now)
+        flow_send_ack(flow, now);
+
+    while ((ack = fifo_peek(&flow->to_sender)) && ack->arrive <= now)
+    {
+        flow_got_ack(flow, ack, now);
+        fifo_pop(&flow->to_sender);
+    }
+
+    flow_tick(flow, link, now);
+}
+
+
+static int
+cmp_rtts (const void *ap, const void *bp)
+{
+    const uint32_t a = *(const uint32_t *) ap, b = *(const uint32_t *) bp;
+    return (a > b) - (a < b);
+}
+
+
+static double
+rtt_percentile (struct flow *flow, unsigned pct)
+{
+    size_t idx;
+
+    if (!flow->n_rtts)
+        return 0;
+    idx = flow->n_rtts * pct / 100;
+    if (idx >= flow->n_rtts)
+        idx = flow->n_rtts - 1;
+    return (double) flow->rtts[idx] / 1000;
+}
+
+
+static void
+usage (const char *argv0)
+{
+    fprintf(stderr,
+"usage: %s [options]\n"
+"\n"
+"   -f ALGO[:RTT[:START[:STOP]]]\n"
+"                   Add a flow.  ALGO is one of cubic, bbr, adaptive, bbr2,\n"
+"                   or prague.  RTT is the base RTT in milliseconds; START\n"
+"                   and STOP are in seconds.  May be specified several times.\n"
+"                   If not specified, a single Cubic flow is simulated.\n"
+"   -b MBPS         Bottleneck rate in megabits per second.  Defaults\n"
+"                   to 10.\n"
+"   -r MS           Default base RTT.  Defaults to 40 ms.\n"
+"   -q MS           Buffer size, expressed as queuing delay.  Defaults to\n"
+"                   the largest RTT, that is, one BDP.\n"
+"   -l PCT          Random loss, in percent.\n"
+"   -g P,R          Bursty loss using the Gilbert-Elliott model: P is the\n"
+"                   percent chance to enter the lossy state, R is the\n"
+"                   percent chance to leave it.\n"
+"   -e MS           Mark packets CE when queuing delay exceeds this value.\n"
+"                   Turns on ECN in all flows.\n"
+"   -R              Remark ECT(1) as ECT(0), like a path that does not\n"
+"                   support L4S.\n"
+"   -t SEC          Duration of the simulation.  Defaults to 30 seconds.\n"
+"   -s SEED         Random seed.  Defaults to 1.\n"
+"   -i MS           Print per-flow cwnd and goodput at this interval.\n"
+"   -U PCT          Exit with status 1 if link utilization is lower.\n"
+"   -J INDEX        Exit with status 1 if Jain's fairness index is lower.\n"
+"   -Q MS           Exit with status 1 if average queuing delay is higher.\n"
+"   -L LEVEL        Set library-wide log level.\n"
+"   -m MOD=LEVEL    Set log level for module.\n"
+        , argv0);
+}
+
+
+int
+main (int argc, char **argv)
+{
+    static struct flow flows[MAX_FLOWS];
+    struct link link;
+    struct flow *flow;
+    char *algo_spec[MAX_FLOWS];
+    char *algo, *s;
+    unsigned n_flows = 0, i, cc_algo;
+    double mbps = 10, buffer_ms = -1, min_util = 0, min_jain = 0, mbps_f,
+            util, jain, sum, sum_sq, qdelay, max_qdelay = -1;
+    lsquic_time_t now, next, t, duration = SEC(30), default_rtt = MS(40),
+            max_rtt, interval = 0, next_trace, start, stop, active;
+    int opt, ecn = 0, rv = 0;
+
+    memset(&link, 0, sizeof(link));
+    lsquic_log_to_fstream(stderr, LLTS_NONE);
+
+    while (-1 != (opt = getopt(argc, argv, "b:e:f:g:hi:J:l:L:m:q:Q:r:Rs:t:U:")))
+    {
+        switch (opt)
+        {
+        case 'b':
+            mbps = atof(optarg);
+            break;
+        case 'e':
+            link.ce_thresh = (lsquic_time_t) (atof(optarg) * 1000);
+            ecn = 1;
+            break;
+        case 'f':
+            if (n_flows >= MAX_FLOWS)
+            {
+                fprintf(stderr, "too many flows\n");
+                return 1;
+            }
+            algo_spec[n_flows++] = optarg;
+            break;
+        case 'g':
+            link.ge_p = atof(optarg) / 100;
+            s = strchr(optarg, ',');
+            link.ge_r = s ? atof(s + 1) / 100 : 0.5;
+            break;
+        case 'i':
+            interval = MS(atoi(optarg));
+            break;
+        case 'J':
+            min_jain = atof(optarg);
+            break;
+        case 'l':
+            link.loss = atof(optarg) / 100;
+            break;
+        case 'L':
+            if (0 != lsquic_set_log_level(optarg))
+                return 1;
+            break;
+        case 'm':
+            if (0 != lsquic_logger_lopt(optarg))
+                return 1;
+            break;
+        case 'q':
+            buffer_ms = atof(optarg);
+            break;
+        case 'Q':
+            max_qdelay = atof(optarg);
+            break;
+        case 'r':
+            default_rtt = MS(atoi(optarg));
+            break;
+        case 'R':
+            link.remark = 1;
+            break;
+        case 's':
+            s_rand_state = strtoull(optarg, NULL, 10);
+            if (!s_rand_state)
+                s_rand_state = 1;
+            break;
+        case 't':
+            duration = (lsquic_time_t) (atof(optarg) * 1000000);
+            break;
+        case 'U':
+            min_util = atof(optarg);
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (n_flows == 0)
+        algo_spec[n_flows++] = "cubic";
+
+    network_path.np_pack_size = PACK_SIZE;
+    max_rtt = 0;
+    for (i = 0; i < n_flows; ++i)
+    {
+        algo = strdup(algo_spec[i]);
+        t = default_rtt;
+        start = 0;
+        stop = UINT64_MAX;
+        if ((s = strchr(algo, ':')))
+        {
+            *s++ = '\0';
+            t = MS(atoi(s));
+            if ((s = strchr(s, ':')))
+            {
+                start = (lsquic_time_t) (atof(++s) * 1000000);
+                if ((s = strchr(s, ':')))
+                    stop = (lsquic_time_t) (atof(++s) * 1000000);
+            }
+        }
+        cc_algo = algo_by_name(algo);
+        if (!cc_algo || !t)
+        {
+            fprintf(stderr, "invalid flow specification `%s'\n",
+                                                                algo_spec[i]);
+            return 1;
+        }
+        if (t > max_rtt)
+            max_rtt = t;
+        flow_init(&flows[i], i, algo, cc_algo, t, start, stop, ecn);
+    }
+
+    link.rate = (uint64_t) (mbps * 1000000 / 8);
+    if (buffer_ms < 0)
+        buffer_ms = (double) max_rtt / 1000;
+    link.buffer = (uint64_t) (link.rate * buffer_ms / 1000);
+    if (link.buffer < PACK_SIZE)
+        link.buffer = PACK_SIZE;
+
+    now = 0;
+    next_trace = interval;
+    for (;;)
+    {
+        next = UINT64_MAX;
+        for (i = 0; i < n_flows; ++i)
+        {
+            t = flow_next_event(&flows[i]);
+            if (t < next)
+                next = t;
+        }
+        if (next >= duration)
+            break;
+        now = next;
+
+        while (interval && next_trace <= now)
+        {
+            printf("%7.3f", (double) next_trace / 1000000);
+            for (i = 0; i < n_flows; ++i)
+            {
+                flow = &flows[i];
+                printf("  %u: cwnd %6"PRIu64" %6.2f Mbps", i, flow_cwnd(flow),
+                    (double) (flow->rx_bytes - flow->rx_bytes_at_trace) * 8
+                                                            / interval);
+                flow->rx_bytes_at_trace = flow->rx_bytes;
+            }
+            printf("  queue %5.1f ms\n",
+                        (double) link_queue_delay(&link, next_trace) / 1000);
+            next_trace += interval;
+        }
+
+        for (i = 0; i < n_flows; ++i)
+            if (flow_next_event(&flows[i]) == now)
+                flow_process(&flows[i], &link, now);
+    }
+
+    sum = sum_sq = 0;
+    for (i = 0; i < n_flows; ++i)
+    {
+        flow = &flows[i];
+        qsort(flow->rtts, flow->n_rtts, sizeof(flow->rtts[0]), cmp_rtts);
+        active = (flow->stop < duration ? flow->stop : duration) - flow->start;
+        mbps_f = active && flow->start < duration
+               ? (double) flow->rx_bytes * 8 / active : 0;
+        sum += mbps_f;
+        sum_sq += mbps_f * mbps_f;
+        printf("flow %2u: %-8s rtt %4"PRIu64" ms; goodput %7.3f Mbps; "
+            "sent %"PRIu64"; dropped %"PRIu64" (%.2f%%); CE %"PRIu64"; "
+            "RTT p50 %.1f ms, p99 %.1f ms\n", i, flow->algo, flow->rtt / 1000,
+            mbps_f, flow->n_sent, flow->n_dropped,
+            flow->n_sent ? 100.0 * flow->n_dropped / flow->n_sent : 0.,
+            flow->n_ce, rtt_percentile(flow, 50), rtt_percentile(flow, 99));
+    }
+
+    /* Bytes still queued at the end of the run have not been transmitted */
+    util = 100.0 * ((double) link.tx_bytes
+                - (double) link_queue_delay(&link, duration) * link.rate / 1000000)
+                                    / ((double) link.rate * duration / 1000000);
+    jain = sum_sq > 0 ? sum * sum / (n_flows * sum_sq) : 0;
+    qdelay = link.n_packets
+           ? (double) link.queue_delay_sum / link.n_packets / 1000 : 0.;
+    printf("link: %.1f Mbps, buffer %"PRIu64" bytes; utilization %.1f%%; "
+        "avg queue delay %.1f ms; fairness %.3f\n", mbps, link.buffer, util,
+        qdelay, jain);
+
+    if (util < min_util)
+    {
+        printf("utilization %.1f%% is below %.1f%%\n", util, min_util);
+        rv = 1;
+    }
+    if (jain < min_jain)
+    {
+        printf("fairness %.3f is below %.3f\n", jain, min_jain);
+        rv = 1;
+    }
+    if (max_qdelay >= 0 && qdelay > max_qdelay)
+    {
+        printf("average queue delay %.1f ms is above %.1f ms\n", qdelay,
+                                                                max_qdelay);
+        rv = 1;
+    }
+
+    for (i = 0; i < n_flows; ++i)
+    {
+        free((char *) flows[i].algo);
+        flow_cleanup(&flows[i]);
+    }
+
+    return rv;
+}
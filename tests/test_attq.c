@@ -51,6 +51,20 @@ cmp_chars_desc (const void *ap, const void *bp)
 }
 
 
+/* If set, the queue is backed by timing wheel with this granularity */
+static unsigned s_wheel_granularity;
+
+
+static struct attq *
+new_attq (void)
+{
+    if (s_wheel_granularity)
+        return lsquic_attq_create_wheel(s_wheel_granularity);
+    else
+        return lsquic_attq_create();
+}
+
+
 enum sort_action { SORT_NONE, SORT_ASC, SORT_DESC, };
 
 static void
@@ -78,7 +92,7 @@ test_attq_ordering (enum sort_action sa)
         break;
     }
 
-    q = lsquic_attq_create();
+    q = new_attq();
 
     for (i = 0; i < sizeof(curiosity); ++i)
     {
@@ -147,7 +161,7 @@ test_attq_removal_1 (void)
     struct attq *q;
     struct lsquic_conn *conns;
 
-    q = lsquic_attq_create();
+    q = new_attq();
     conns = calloc(6, sizeof(conns[0]));
 
     lsquic_attq_add(q, &conns[0], 1, 0);
@@ -171,7 +185,7 @@ test_attq_removal_2 (void)
     struct attq *q;
     struct lsquic_conn *conns;
 
-    q = lsquic_attq_create();
+    q = new_attq();
     conns = calloc(9, sizeof(conns[0]));
 
     lsquic_attq_add(q, &conns[0], 1, 0);
@@ -198,7 +212,7 @@ test_attq_removal_3 (void)
     struct attq *q;
     struct lsquic_conn *conns;
 
-    q = lsquic_attq_create();
+    q = new_attq();
     conns = calloc(9, sizeof(conns[0]));
 
     lsquic_attq_add(q, &conns[0], 1, 0);
@@ -218,14 +232,114 @@ test_attq_removal_3 (void)
 }
 
 
+/* Times spread widely enough to exercise cascading and far elements.
+ * The queue is checked against brute-force computation.
+ */
+static void
+test_attq_spread (void)
+{
+    enum { N_CONNS = 2000, };
+    struct attq *q;
+    struct lsquic_conn *conns, *conn;
+    const struct attq_elem *next_attq;
+    lsquic_time_t *times, cutoff, min;
+    unsigned i, count, n_left;
+    uint64_t rnd;
+    int s;
+
+    const lsquic_time_t base = 1650000000000000ULL;
+
+    q = new_attq();
+    conns = calloc(N_CONNS, sizeof(conns[0]));
+    times = malloc(N_CONNS * sizeof(times[0]));
+
+    rnd = 0x1234567;
+    for (i = 0; i < N_CONNS; ++i)
+    {
+        rnd = rnd * 6364136223846793005ULL + 1442695040888963407ULL;
+        times[i] = base + ((rnd >> 20) & ((1ULL << (10 + 4 * (i % 8))) - 1));
+        s = lsquic_attq_add(q, &conns[i], times[i], 0);
+        assert(s == 0);
+    }
+
+    /* Remove every tenth connection */
+    for (i = 0; i < N_CONNS; i += 10)
+    {
+        lsquic_attq_remove(q, &conns[i]);
+        assert(!conns[i].cn_attq_elem);
+    }
+
+    n_left = N_CONNS - N_CONNS / 10;
+    for (cutoff = base + 100; n_left > 0; cutoff += (cutoff - base) / 2)
+    {
+        count = 0;
+        for (i = 0; i < N_CONNS; ++i)
+            count += conns[i].cn_attq_elem && times[i] < cutoff;
+        /* The heap only gives a lower bound */
+        if (s_wheel_granularity)
+            assert(count == lsquic_attq_count_before(q, cutoff));
+        else
+            assert(count >= lsquic_attq_count_before(q, cutoff));
+
+        while ((conn = lsquic_attq_pop(q, cutoff)))
+        {
+            assert(!conn->cn_attq_elem);
+            assert(times[conn - conns] < cutoff);
+            --n_left;
+            --count;
+        }
+        assert(count == 0);
+
+        min = ~0ULL;
+        for (i = 0; i < N_CONNS; ++i)
+            if (conns[i].cn_attq_elem && times[i] < min)
+                min = times[i];
+        next_attq = lsquic_attq_next(q);
+        if (n_left)
+        {
+            assert(next_attq);
+            assert(next_attq->ae_adv_time == min);
+            assert(next_attq->ae_adv_time >= cutoff);
+        }
+        else
+            assert(!next_attq);
+
+        /* Connection scheduled in the past comes out first */
+        if (n_left > 1)
+        {
+            conn = next_attq->ae_conn;
+            lsquic_attq_remove(q, conn);
+            times[conn - conns] = cutoff - 50;
+            s = lsquic_attq_add(q, conn, times[conn - conns], 0);
+            assert(s == 0);
+            assert(conn == lsquic_attq_pop(q, cutoff));
+            --n_left;
+        }
+    }
+
+    assert(!lsquic_attq_next(q));
+    free(times);
+    free(conns);
+    lsquic_attq_destroy(q);
+}
+
+
 int
 main (void)
 {
-    test_attq_ordering(SORT_NONE);
-    test_attq_ordering(SORT_ASC);
-    test_attq_ordering(SORT_DESC);
-    test_attq_removal_1();
-    test_attq_removal_2();
-    test_attq_removal_3();
+    static const unsigned granularities[] = { 0, 1, 10, 1000, };
+    unsigned i;
+
+    for (i = 0; i < sizeof(granularities) / sizeof(granularities[0]); ++i)
+    {
+        s_wheel_granularity = granularities[i];
+        test_attq_ordering(SORT_NONE);
+        test_attq_ordering(SORT_ASC);
+        test_attq_ordering(SORT_DESC);
+        test_attq_removal_1();
+        test_attq_removal_2();
+        test_attq_removal_3();
+        test_attq_spread();
+    }
     return 0;
 }
@@ -0,0 +1,357 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Drive BBRv2 through a simple bottleneck: a FIFO link with fixed rate,
+ * propagation delay, and a drop-tail buffer that can optionally CE-mark
+ * packets instead of queuing them past a threshold.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifndef WIN32
+#include <unistd.h>
+#else
+#include <getopt.h>
+#endif
+
+#include "lsquic.h"
+#include "lsquic_int_types.h"
+#include "lsquic_cong_ctl.h"
+#include "lsquic_minmax.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_packet_out.h"
+#include "lsquic_bw_sampler.h"
+#include "lsquic_bbr2.h"
+#include "lsquic_hash.h"
+#include "lsquic_conn.h"
+#include "lsquic_sfcw.h"
+#include "lsquic_conn_flow.h"
+#include "lsquic_varint.h"
+#include "lsquic_hq.h"
+#include "lsquic_stream.h"
+#include "lsquic_rtt.h"
+#include "lsquic_conn_public.h"
+#include "lsquic_malo.h"
+#include "lsquic_crand.h"
+#include "lsquic_mm.h"
+#include "lsquic_engine_public.h"
+
+#define cci ((const struct cong_ctl_if *const)&lsquic_cong_bbr2_if)
+
+#define ms(val_) ((val_) * 1000)
+#define sec(val_) ((val_) * 1000 * 1000)
+
+#define PACKET_SZ 1200
+#define MAX_IN_FLIGHT 0x4000    /* Power of two */
+
+#define MAX_TIME(a, b) ((a) > (b) ? (a) : (b))
+
+
+struct sim_packet
+{
+    struct lsquic_packet_out    packet_out;
+    lsquic_time_t               ack_time;
+    int                         dropped;
+    int                         ce;
+};
+
+
+struct link_params
+{
+    uint64_t        rate;           /* Bytes per second */
+    lsquic_time_t   rtt;            /* Base RTT */
+    uint64_t        buffer;         /* Bytes */
+    uint64_t        ce_thresh;      /* Mark CE above this queue size; 0 */
+};                                  /*   means no ECN.                  */
+
+
+struct sim_result
+{
+    uint64_t        delivered;
+    uint64_t        lost;
+    lsquic_time_t   queue_delay_sum;
+    uint64_t        n_ce;
+};
+
+
+/* BBRv2 keeps pointers to connection public and engine public, so they
+ * must outlive the call to simulate().
+ */
+struct sim_ctx
+{
+    struct lsquic_conn              lconn;
+    struct lsquic_engine_public     enpub;
+    struct lsquic_conn_public       conn_pub;
+    struct crand                    crand;
+    struct lsquic_bbr2              bbr2;
+};
+
+
+static struct sim_packet packets[MAX_IN_FLIGHT];
+
+
+static void
+simulate (struct sim_ctx *ctx, const struct link_params *link,
+            lsquic_time_t duration, struct sim_result *result)
+{
+    struct lsquic_conn lconn = LSCONN_INITIALIZER_CIDLEN(ctx->lconn, 8);
+    struct lsquic_bbr2 *const bbr2 = &ctx->bbr2;
+    struct sim_packet *pkt;
+    lsquic_time_t now, end, next_send, link_free, depart, queue_delay;
+    lsquic_packno_t packno;
+    uint64_t in_flight, queue, pacing_rate;
+    unsigned head, tail, n;
+
+    memset(ctx, 0, sizeof(*ctx));
+    memset(result, 0, sizeof(*result));
+    ctx->lconn = lconn;
+    ctx->enpub.enp_crand = &ctx->crand;
+    ctx->conn_pub.lconn = &ctx->lconn;
+    ctx->conn_pub.enpub = &ctx->enpub;
+    cci->cci_init(bbr2, &ctx->conn_pub, QUIC_FTBIT_STREAM);
+
+    now = sec(1);
+    end = now + duration;
+    next_send = now;
+    link_free = now;
+    packno = 0;
+    in_flight = 0;
+    head = tail = 0;
+
+    while (now < end)
+    {
+        if (head != tail && (tail - head >= MAX_IN_FLIGHT
+                || in_flight + PACKET_SZ > cci->cci_get_cwnd(bbr2)
+                || packets[head & (MAX_IN_FLIGHT - 1)].ack_time <= next_send))
+        {
+            /* Process ACK of the next delivered packet, declaring dropped
+             * packets sent before it lost.
+             */
+            for (n = head; packets[n & (MAX_IN_FLIGHT - 1)].dropped; ++n)
+                if (n + 1 == tail)
+                    break;
+            pkt = &packets[n & (MAX_IN_FLIGHT - 1)];
+            if (pkt->dropped)
+            {
+                /* Nothing to ACK: pretend the loss is detected by timer */
+                now = MAX_TIME(now, link_free + link->rtt);
+                for ( ; head != tail; ++head)
+                {
+                    pkt = &packets[head & (MAX_IN_FLIGHT - 1)];
+                    cci->cci_lost(bbr2, &pkt->packet_out, PACKET_SZ);
+                    in_flight -= PACKET_SZ;
+                    result->lost += PACKET_SZ;
+                }
+                continue;
+            }
+            if (now < pkt->ack_time)
+                now = pkt->ack_time;
+            lsquic_rtt_stats_update(&ctx->conn_pub.rtt_stats,
+                                        now - pkt->packet_out.po_sent, 0);
+            cci->cci_begin_ack(bbr2, now, in_flight);
+            cci->cci_ack(bbr2, &pkt->packet_out, PACKET_SZ, now, 0);
+            in_flight -= PACKET_SZ;
+            result->delivered += PACKET_SZ;
+            if (link->ce_thresh)
+                cci->cci_ecn(bbr2, pkt->ce, 1);
+            result->n_ce += pkt->ce;
+            for ( ; head != n; ++head)
+            {
+                cci->cci_lost(bbr2,
+                    &packets[head & (MAX_IN_FLIGHT - 1)].packet_out,
+                    PACKET_SZ);
+                in_flight -= PACKET_SZ;
+                result->lost += PACKET_SZ;
+            }
+            ++head;
+            cci->cci_end_ack(bbr2, in_flight);
+            continue;
+        }
+
+        if (in_flight + PACKET_SZ > cci->cci_get_cwnd(bbr2))
+        {
+            /* Cannot send and nothing in flight: should not happen */
+            assert(head != tail);
+            continue;
+        }
+
+        if (now < next_send)
+            now = next_send;
+        pkt = &packets[tail++ & (MAX_IN_FLIGHT - 1)];
+        memset(pkt, 0, sizeof(*pkt));
+        pkt->packet_out.po_packno = ++packno;
+        pkt->packet_out.po_sent = now;
+        pkt->packet_out.po_frame_types = QUIC_FTBIT_STREAM;
+        pkt->packet_out.po_flags = PO_SENT_SZ;
+        pkt->packet_out.po_sent_sz = PACKET_SZ;
+        cci->cci_sent(bbr2, &pkt->packet_out, in_flight, 0);
+        in_flight += PACKET_SZ;
+
+        queue = link_free > now ? (link_free - now) * link->rate / 1000000 : 0;
+        if (queue + PACKET_SZ > link->buffer)
+        {
+            pkt->dropped = 1;
+            pkt->ack_time = link_free + link->rtt;
+        }
+        else
+        {
+            pkt->ce = link->ce_thresh && queue > link->ce_thresh;
+            depart = MAX_TIME(now, link_free)
+                                    + PACKET_SZ * 1000000 / link->rate;
+            queue_delay = depart - now - PACKET_SZ * 1000000 / link->rate;
+            result->queue_delay_sum += queue_delay;
+            link_free = depart;
+            pkt->ack_time = depart + link->rtt;
+        }
+
+        pacing_rate = cci->cci_pacing_rate(bbr2, 0);
+        next_send = now + PACKET_SZ * 1000000 / (pacing_rate ? pacing_rate : 1);
+    }
+}
+
+
+static int s_verbose;
+
+
+static void
+print_result (const char *name, const struct lsquic_bbr2 *bbr2,
+        const struct link_params *link, lsquic_time_t duration,
+        const struct sim_result *result)
+{
+    uint64_t n_delivered;
+
+    if (!s_verbose)
+        return;
+
+    n_delivered = result->delivered / PACKET_SZ;
+    printf("%s: goodput %.1f%% of link rate; lost %.2f%%; avg queue "
+        "delay %.1f ms; CE %"PRIu64"; cwnd: %"PRIu64"; max_bw: %"PRIu64
+        "; min_rtt: %"PRIu64"\n", name,
+        100.0 * result->delivered / (link->rate * duration / 1000000),
+        100.0 * result->lost / (result->lost + result->delivered),
+        (double) result->queue_delay_sum / (n_delivered ? n_delivered : 1)
+                                                                    / 1000,
+        result->n_ce, cci->cci_get_cwnd((void *) bbr2), bbr2->bbr2_max_bw,
+        bbr2->bbr2_min_rtt);
+}
+
+
+static struct sim_ctx ctx;
+
+
+/* 10 Mbps link with 40 ms RTT and a deep buffer: BBRv2 should exit
+ * STARTUP, find the bottleneck bandwidth and the base RTT, and fill
+ * the pipe without loss.
+ */
+static void
+test_deep_buffer (void)
+{
+    const struct link_params link = {
+        .rate       = 1250000,
+        .rtt        = ms(40),
+        .buffer     = 4 * 50000,
+    };
+    struct sim_result result;
+
+    simulate(&ctx, &link, sec(10), &result);
+    print_result("deep buffer", &ctx.bbr2, &link, sec(10), &result);
+
+    assert(ctx.bbr2.bbr2_mode != BBR2_MODE_STARTUP
+                                && ctx.bbr2.bbr2_mode != BBR2_MODE_DRAIN);
+    assert(ctx.bbr2.bbr2_flags & BBR2_FLAG_FULL_BW_REACHED);
+    assert(ctx.bbr2.bbr2_max_bw >= link.rate * 9 / 10);
+    assert(ctx.bbr2.bbr2_max_bw <= link.rate * 11 / 10);
+    assert(ctx.bbr2.bbr2_min_rtt >= link.rtt);
+    assert(ctx.bbr2.bbr2_min_rtt <= link.rtt + ms(2));
+    assert(result.lost == 0);
+    assert(result.delivered >= link.rate * 10 * 90 / 100);
+
+    cci->cci_cleanup(&ctx.bbr2);
+}
+
+
+/* Buffer of half BDP: loss should make BBRv2 set inflight_hi and keep
+ * the loss rate low, while still using most of the link.
+ */
+static void
+test_shallow_buffer (void)
+{
+    const struct link_params link = {
+        .rate       = 1250000,
+        .rtt        = ms(40),
+        .buffer     = 50000 / 2,
+    };
+    struct sim_result result;
+
+    simulate(&ctx, &link, sec(10), &result);
+    print_result("shallow buffer", &ctx.bbr2, &link, sec(10), &result);
+
+    assert(ctx.bbr2.bbr2_inflight_hi != UINT64_MAX);
+    assert(result.lost > 0);
+    assert(result.lost * 100 < (result.lost + result.delivered) * 3);
+    assert(result.delivered >= link.rate * 10 * 85 / 100);
+
+    cci->cci_cleanup(&ctx.bbr2);
+}
+
+
+/* Deep buffer with CE marking above a small queue: the ECN response
+ * should keep the standing queue short without any loss.
+ */
+static void
+test_ecn (void)
+{
+    const struct link_params no_ecn = {
+        .rate       = 1250000,
+        .rtt        = ms(40),
+        .buffer     = 4 * 50000,
+    };
+    const struct link_params ecn = {
+        .rate       = 1250000,
+        .rtt        = ms(40),
+        .buffer     = 4 * 50000,
+        .ce_thresh  = 50000 / 4,
+    };
+    struct sim_result result, no_ecn_result;
+
+    simulate(&ctx, &no_ecn, sec(10), &no_ecn_result);
+    cci->cci_cleanup(&ctx.bbr2);
+    simulate(&ctx, &ecn, sec(10), &result);
+    print_result("ECN", &ctx.bbr2, &ecn, sec(10), &result);
+
+    assert(result.n_ce > 0);
+    assert(result.lost == 0);
+    assert(result.queue_delay_sum * no_ecn_result.delivered
+                    < no_ecn_result.queue_delay_sum * result.delivered);
+    assert(result.delivered >= ecn.rate * 10 * 85 / 100);
+
+    cci->cci_cleanup(&ctx.bbr2);
+}
+
+
+int
+main (int argc, char **argv)
+{
+    int opt;
+
+    while (-1 != (opt = getopt(argc, argv, "v")))
+    {
+        switch (opt)
+        {
+        case 'v':
+            s_verbose = 1;
+            break;
+        default:
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+
+    test_deep_buffer();
+    test_shallow_buffer();
+    test_ecn();
+    return 0;
+}
@@ -0,0 +1,511 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * test_careful_resume.c -- Test careful resume in the send controller:
+ * what happens to the congestion window after lsquic_send_ctl_resume()
+ * as packets are sent, acknowledged, and lost.
+ */
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#ifndef WIN32
+#include <unistd.h>
+#else
+#include <getopt.h>
+#endif
+
+#include "lsquic.h"
+
+#include "lsquic_int_types.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_alarmset.h"
+#include "lsquic_conn_flow.h"
+#include "lsquic_rtt.h"
+#include "lsquic_sfcw.h"
+#include "lsquic_varint.h"
+#include "lsquic_hq.h"
+#include "lsquic_hash.h"
+#include "lsquic_stream.h"
+#include "lsquic_types.h"
+#include "lsquic_malo.h"
+#include "lsquic_mm.h"
+#include "lsquic_conn_public.h"
+#include "lsquic_logger.h"
+#include "lsquic_parse.h"
+#include "lsquic_conn.h"
+#include "lsquic_engine_public.h"
+#include "lsquic_crand.h"
+#include "lsquic_cong_ctl.h"
+#include "lsquic_cubic.h"
+#include "lsquic_pacer.h"
+#include "lsquic_senhist.h"
+#include "lsquic_bw_sampler.h"
+#include "lsquic_minmax.h"
+#include "lsquic_bbr.h"
+#include "lsquic_bbr2.h"
+#include "lsquic_prague.h"
+#include "lsquic_adaptive_cc.h"
+#include "lsquic_send_ctl.h"
+#include "lsquic_ver_neg.h"
+#include "lsquic_packet_out.h"
+#include "lsquic_enc_sess.h"
+#include "lsquic_path_cache.h"
+
+
+#define MS(n) ((lsquic_time_t) (n) * 1000)  /* Milliseconds */
+
+#define RTT MS(40)
+
+
+static struct network_path s_paths[2];
+
+
+static struct network_path *
+get_network_path (struct lsquic_conn *lconn, const struct sockaddr *sa)
+{
+    return &s_paths[0];
+}
+
+
+static int
+can_write_ack (struct lsquic_conn *lconn)
+{
+    return 0;
+}
+
+
+static const struct conn_iface our_conn_if =
+{
+    .ci_can_write_ack = can_write_ack,
+    .ci_get_path      = get_network_path,
+};
+
+
+#if LSQUIC_CONN_STATS
+static struct conn_stats s_conn_stats;
+#endif
+
+
+struct test_objs {
+    struct lsquic_engine_public eng_pub;
+    struct lsquic_conn        lconn;
+    struct lsquic_conn_public conn_pub;
+    struct lsquic_send_ctl    send_ctl;
+    struct lsquic_alarmset    alset;
+    struct ver_neg            ver_neg;
+    struct crand              crand;
+    lsquic_time_t             now;
+};
+
+
+/* The path that the previous connection saved */
+static const struct path_state s_saved_state =
+{
+    .ps_min_rtt = RTT,
+    .ps_srtt    = RTT + MS(5),
+    .ps_bw      = (uint64_t) 1000000 * 1000000 / (RTT + MS(5)),
+    .ps_cwnd    = 1000000,
+};
+
+
+static void
+init_test_objs (struct test_objs *tobjs, int pace,
+                                            const struct path_state *state)
+{
+    memset(tobjs, 0, sizeof(*tobjs));
+    LSCONN_INITIALIZE(&tobjs->lconn);
+    tobjs->lconn.cn_pf = select_pf_by_ver(LSQVER_I001);
+    tobjs->lconn.cn_version = LSQVER_I001;
+    tobjs->lconn.cn_esf_c = &lsquic_enc_session_common_ietf_v1;
+    tobjs->lconn.cn_if = &our_conn_if;
+    lsquic_engine_init_settings(&tobjs->eng_pub.enp_settings, 0);
+    tobjs->eng_pub.enp_settings.es_cc_algo = 1;     /* Cubic */
+    tobjs->eng_pub.enp_settings.es_pace_packets = pace;
+    tobjs->eng_pub.enp_crand = &tobjs->crand;
+    lsquic_mm_init(&tobjs->eng_pub.enp_mm);
+    TAILQ_INIT(&tobjs->conn_pub.sending_streams);
+    TAILQ_INIT(&tobjs->conn_pub.read_streams);
+    TAILQ_INIT(&tobjs->conn_pub.write_streams);
+    TAILQ_INIT(&tobjs->conn_pub.service_streams);
+    tobjs->conn_pub.enpub = &tobjs->eng_pub;
+    lsquic_alarmset_init(&tobjs->alset, &tobjs->lconn);
+    tobjs->conn_pub.mm = &tobjs->eng_pub.enp_mm;
+    tobjs->conn_pub.lconn = &tobjs->lconn;
+    tobjs->conn_pub.send_ctl = &tobjs->send_ctl;
+    tobjs->conn_pub.packet_out_malo =
+                        lsquic_malo_create(sizeof(struct lsquic_packet_out));
+    tobjs->conn_pub.path = &s_paths[0];
+#if LSQUIC_CONN_STATS
+    tobjs->conn_pub.conn_stats = &s_conn_stats;
+#endif
+    lsquic_send_ctl_init(&tobjs->send_ctl, &tobjs->alset, &tobjs->eng_pub,
+        &tobjs->ver_neg, &tobjs->conn_pub, SC_IETF);
+    tobjs->now = MS(1000);
+    if (state)
+        lsquic_send_ctl_resume(&tobjs->send_ctl, state);
+}
+
+
+static void
+deinit_test_objs (struct test_objs *tobjs)
+{
+    lsquic_send_ctl_cleanup(&tobjs->send_ctl);
+    lsquic_malo_destroy(tobjs->conn_pub.packet_out_malo);
+    lsquic_mm_cleanup(&tobjs->eng_pub.enp_mm);
+}
+
+
+/* Send `count' packets right away, disregarding cwnd and pacer */
+static void
+send_packets (struct test_objs *tobjs, unsigned count)
+{
+    struct lsquic_send_ctl *const ctl = &tobjs->send_ctl;
+    struct lsquic_packet_out *packet_out;
+
+    while (count--)
+    {
+        packet_out = lsquic_send_ctl_new_packet_out(ctl, 0, PNS_APP,
+                                                                &s_paths[0]);
+        assert(packet_out);
+        /* Retransmittable, so that the retransmission alarm is set */
+        packet_out->po_data[0] = 0x10;  /* MAX_DATA */
+        packet_out->po_data[1] = 0x00;
+        packet_out->po_data_sz = 2;
+        packet_out->po_frame_types |= QUIC_FTBIT_MAX_DATA;
+        lsquic_packet_out_zero_pad(packet_out);
+        lsquic_send_ctl_scheduled_one(ctl, packet_out);
+    }
+
+    while ((packet_out = lsquic_send_ctl_next_packet_to_send(ctl, NULL)))
+    {
+        lsquic_packet_out_set_enc_level(packet_out, ENC_LEV_APP);
+        packet_out->po_sent = tobjs->now;
+        lsquic_send_ctl_sent_packet(ctl, packet_out);
+    }
+}
+
+
+/* `n_ranges' low-high pairs follow, from highest to lowest */
+static void
+ack_ranges (struct test_objs *tobjs, lsquic_time_t rtt, unsigned n_ranges,
+                                                                        ...)
+{
+    static struct ack_info acki;
+    va_list ap;
+    int s;
+
+    memset(&acki, 0, sizeof(acki));
+    acki.pns = PNS_APP;
+    va_start(ap, n_ranges);
+    for (acki.n_ranges = 0; acki.n_ranges < n_ranges; ++acki.n_ranges)
+    {
+        acki.ranges[acki.n_ranges].low = va_arg(ap, lsquic_packno_t);
+        acki.ranges[acki.n_ranges].high = va_arg(ap, lsquic_packno_t);
+    }
+    va_end(ap);
+
+    tobjs->now += rtt;
+    s = lsquic_send_ctl_got_ack(&tobjs->send_ctl, &acki, tobjs->now,
+                                                                tobjs->now);
+    assert(0 == s);
+}
+
+
+#define ack(tobjs_, rtt_, low_, high_) ack_ranges(tobjs_, rtt_, 1, \
+            (lsquic_packno_t) (low_), (lsquic_packno_t) (high_))
+
+
+static uint64_t
+get_cwnd (struct test_objs *tobjs)
+{
+    struct lsquic_send_ctl *const ctl = &tobjs->send_ctl;
+    return ctl->sc_ci->cci_get_cwnd(ctl->sc_cong_ctl);
+}
+
+
+static lsquic_packno_t
+largest_sent (struct test_objs *tobjs)
+{
+    return lsquic_senhist_largest(&tobjs->send_ctl.sc_senhist);
+}
+
+
+/* Send the first flight and acknowledge it, which makes the jump */
+static void
+jump (struct test_objs *tobjs)
+{
+    struct lsquic_send_ctl *const ctl = &tobjs->send_ctl;
+
+    send_packets(tobjs, 10);
+    ack(tobjs, RTT, 0, largest_sent(tobjs));
+    assert(ctl->sc_flags & SC_RESUME);
+    assert(ctl->sc_resume.phase == CR_UNVALIDATED);
+    assert(ctl->sc_resume.jump_packno == largest_sent(tobjs) + 1);
+    assert(get_cwnd(tobjs) == s_saved_state.ps_cwnd / 2);
+}
+
+
+/* Careful resume is not possible without pacing */
+static void
+test_no_pacing (void)
+{
+    struct test_objs tobjs;
+
+    init_test_objs(&tobjs, 0, &s_saved_state);
+    assert(!(tobjs.send_ctl.sc_flags & (SC_RESUME|SC_ROUGH_RTT)));
+    deinit_test_objs(&tobjs);
+}
+
+
+/* Matching first RTT sample: jump, then validate the jump */
+static void
+test_jump_and_validate (void)
+{
+    struct test_objs tobjs;
+    struct lsquic_send_ctl *const ctl = &tobjs.send_ctl;
+    struct path_state state;
+    lsquic_packno_t first, last_unval;
+    uint64_t init_cwnd;
+    int s;
+
+    init_test_objs(&tobjs, 1, &s_saved_state);
+    assert(ctl->sc_flags & SC_RESUME);
+    assert(ctl->sc_resume.phase == CR_RECON);
+    /* Saved RTT is used until the first sample */
+    assert(ctl->sc_flags & SC_ROUGH_RTT);
+    assert(lsquic_rtt_stats_get_srtt(&tobjs.conn_pub.rtt_stats)
+                                                == s_saved_state.ps_srtt);
+    s = lsquic_send_ctl_get_path_state(ctl, &state);
+    assert(s == -1);
+
+    init_cwnd = get_cwnd(&tobjs);
+    assert(init_cwnd < s_saved_state.ps_cwnd / 2);
+
+    jump(&tobjs);
+    assert(!(ctl->sc_flags & SC_ROUGH_RTT));
+    assert(lsquic_rtt_stats_get_srtt(&tobjs.conn_pub.rtt_stats) == RTT);
+    s = lsquic_send_ctl_get_path_state(ctl, &state);
+    assert(s == -1);
+
+    /* Packets sent after the jump are acked: wait for the rest */
+    first = largest_sent(&tobjs) + 1;
+    send_packets(&tobjs, 20);
+    last_unval = largest_sent(&tobjs);
+    ack(&tobjs, RTT, first, last_unval);
+    assert(ctl->sc_flags & SC_RESUME);
+    assert(ctl->sc_resume.phase == CR_VALIDATING);
+    assert(ctl->sc_resume.last_unval == last_unval);
+    s = lsquic_send_ctl_get_path_state(ctl, &state);
+    assert(s == -1);
+
+    send_packets(&tobjs, 5);
+    ack(&tobjs, RTT, last_unval + 1, largest_sent(&tobjs));
+    assert(!(ctl->sc_flags & SC_RESUME));
+    assert(get_cwnd(&tobjs) >= s_saved_state.ps_cwnd / 2);
+
+    /* Enough round trips: now the state can be saved */
+    while (ctl->sc_rt_count < 4)
+    {
+        s = lsquic_send_ctl_get_path_state(ctl, &state);
+        assert(s == -1);
+        send_packets(&tobjs, 5);
+        ack(&tobjs, RTT, largest_sent(&tobjs) - 4, largest_sent(&tobjs));
+    }
+    s = lsquic_send_ctl_get_path_state(ctl, &state);
+    assert(s == 0);
+    assert(state.ps_min_rtt == RTT);
+    assert(state.ps_srtt == RTT);
+    assert(state.ps_cwnd == get_cwnd(&tobjs));
+    assert(state.ps_bw == state.ps_cwnd * 1000000 / RTT);
+
+    deinit_test_objs(&tobjs);
+}
+
+
+/* Path state is not saved while resume is in progress, even if there
+ * have been enough round trips.
+ */
+static void
+test_no_save_during_resume (void)
+{
+    struct test_objs tobjs;
+    struct lsquic_send_ctl *const ctl = &tobjs.send_ctl;
+    struct path_state state;
+    lsquic_packno_t first;
+    int s;
+
+    init_test_objs(&tobjs, 1, NULL);
+    first = 0;
+    while (ctl->sc_rt_count < 4)
+    {
+        send_packets(&tobjs, 5);
+        ack(&tobjs, RTT, first, largest_sent(&tobjs));
+        first = largest_sent(&tobjs) + 1;
+    }
+    s = lsquic_send_ctl_get_path_state(ctl, &state);
+    assert(s == 0);
+
+    lsquic_send_ctl_resume(ctl, &s_saved_state);
+    assert(ctl->sc_flags & SC_RESUME);
+    assert(!(ctl->sc_flags & SC_ROUGH_RTT));
+    s = lsquic_send_ctl_get_path_state(ctl, &state);
+    assert(s == -1);
+
+    send_packets(&tobjs, 5);
+    ack(&tobjs, RTT, first, largest_sent(&tobjs));
+    assert(ctl->sc_resume.phase == CR_UNVALIDATED);
+    s = lsquic_send_ctl_get_path_state(ctl, &state);
+    assert(s == -1);
+
+    first = largest_sent(&tobjs) + 1;
+    send_packets(&tobjs, 5);
+    ack(&tobjs, RTT, first, largest_sent(&tobjs));
+    first = largest_sent(&tobjs) + 1;
+    send_packets(&tobjs, 5);
+    ack(&tobjs, RTT, first, largest_sent(&tobjs));
+    assert(!(ctl->sc_flags & SC_RESUME));
+    s = lsquic_send_ctl_get_path_state(ctl, &state);
+    assert(s == 0);
+    assert(state.ps_cwnd >= s_saved_state.ps_cwnd / 2);
+
+    deinit_test_objs(&tobjs);
+}
+
+
+/* First RTT sample does not match saved RTT: no jump.  The window is
+ * the same as that of a connection that had no saved state.
+ */
+static void
+test_rtt_mismatch (lsquic_time_t saved_rtt)
+{
+    struct test_objs tobjs;
+    struct lsquic_send_ctl *const ctl = &tobjs.send_ctl;
+    struct path_state state = s_saved_state;
+    uint64_t cwnd;
+
+    init_test_objs(&tobjs, 1, NULL);
+    send_packets(&tobjs, 10);
+    ack(&tobjs, RTT, 0, 9);
+    cwnd = get_cwnd(&tobjs);
+    deinit_test_objs(&tobjs);
+
+    state.ps_min_rtt = saved_rtt;
+    state.ps_srtt = saved_rtt;
+    init_test_objs(&tobjs, 1, &state);
+    assert(ctl->sc_flags & SC_RESUME);
+    send_packets(&tobjs, 10);
+    ack(&tobjs, RTT, 0, 9);
+    assert(!(ctl->sc_flags & SC_RESUME));
+    assert(get_cwnd(&tobjs) == cwnd);
+    deinit_test_objs(&tobjs);
+}
+
+
+/* Loss after the jump: retreat to half of PipeSize */
+static void
+test_retreat (void)
+{
+    struct test_objs tobjs;
+    struct lsquic_send_ctl *const ctl = &tobjs.send_ctl;
+    lsquic_packno_t first;
+
+    init_test_objs(&tobjs, 1, &s_saved_state);
+    jump(&tobjs);
+
+    /* Packets first+10 through first+13 are lost */
+    first = largest_sent(&tobjs) + 1;
+    send_packets(&tobjs, 40);
+    ack_ranges(&tobjs, RTT, 2,
+        first + 14, largest_sent(&tobjs),
+        first, first + 9);
+
+    assert(!(ctl->sc_flags & SC_RESUME));
+    assert(ctl->sc_resume.pipesize > 0);
+    assert(get_cwnd(&tobjs) == ctl->sc_resume.pipesize / 2);
+    assert(get_cwnd(&tobjs) < s_saved_state.ps_cwnd / 4);
+
+    deinit_test_objs(&tobjs);
+}
+
+
+/* RTO during resume cancels it */
+static void
+test_rto (void)
+{
+    struct test_objs tobjs;
+    struct lsquic_send_ctl *const ctl = &tobjs.send_ctl;
+    unsigned n;
+
+    init_test_objs(&tobjs, 1, &s_saved_state);
+    jump(&tobjs);
+
+    send_packets(&tobjs, 10);
+    /* Tail loss probes first, then RTO */
+    for (n = 0; n < 10 && 0 == ctl->sc_n_consec_rtos; ++n)
+    {
+        assert(ctl->sc_flags & SC_RESUME);
+        tobjs.now += MS(10000);
+        lsquic_alarmset_ring_expired(&tobjs.alset, tobjs.now);
+    }
+    assert(ctl->sc_n_consec_rtos > 0);
+    assert(!(ctl->sc_flags & SC_RESUME));
+
+    deinit_test_objs(&tobjs);
+}
+
+
+/* Moving to a new path cancels resume, unless path properties are kept */
+static void
+test_repath (void)
+{
+    struct test_objs tobjs;
+    struct lsquic_send_ctl *const ctl = &tobjs.send_ctl;
+
+    init_test_objs(&tobjs, 1, &s_saved_state);
+    jump(&tobjs);
+
+    lsquic_send_ctl_repath(ctl, &s_paths[0], &s_paths[1], 1);
+    assert(ctl->sc_flags & SC_RESUME);
+    lsquic_send_ctl_repath(ctl, &s_paths[1], &s_paths[0], 0);
+    assert(!(ctl->sc_flags & SC_RESUME));
+
+    deinit_test_objs(&tobjs);
+}
+
+
+int
+main (int argc, char **argv)
+{
+    int opt;
+
+    while (-1 != (opt = getopt(argc, argv, "l:")))
+    {
+        switch (opt)
+        {
+        case 'l':
+            lsquic_log_to_fstream(stderr, LLTS_NONE);
+            lsquic_logger_lopt(optarg);
+            break;
+        default:
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+
+    s_paths[0].np_pack_size = 1370;
+    s_paths[1].np_pack_size = 1370;
+
+    test_no_pacing();
+    test_jump_and_validate();
+    test_no_save_during_resume();
+    test_rtt_mismatch(MS(200));     /* Sample is too small */
+    test_rtt_mismatch(MS(2));       /* Sample is too large */
+    test_retreat();
+    test_rto();
+    test_repath();
+
+    return 0;
+}
@@ -0,0 +1,239 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+
+#include "lsquic.h"
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_hash.h"
+#include "lsquic_conn.h"
+#include "lsquic_cid_hash.h"
+
+
+static uint64_t s_rand = 0x123456789ULL;
+
+static unsigned
+get_rand (void)
+{
+    s_rand = s_rand * 6364136223846793005ULL + 1442695040888963407ULL;
+    return s_rand >> 33;
+}
+
+
+static void
+gen_cid (lsquic_cid_t *cid, unsigned n)
+{
+    unsigned i;
+
+    /* Mostly 8-byte CIDs, as on a server, with some variety */
+    cid->len = n % 5 ? 8 : n % 21;
+    for (i = 0; i < cid->len; ++i)
+        cid->idbuf[i] = get_rand();
+    if (cid->len >= sizeof(n))
+        memcpy(cid->idbuf, &n, sizeof(n));  /* Make it unique */
+}
+
+
+static void
+test_many (unsigned nelems)
+{
+    struct cid_hash *hash;
+    struct lsquic_conn *conns, *conn;
+    struct conn_cid_elem *cces;
+    unsigned n, count, *seen;
+    int s;
+
+    hash = lsquic_cidh_create();
+    conns = calloc(nelems, sizeof(conns[0]));
+    cces = calloc(nelems, sizeof(cces[0]));
+    seen = calloc(nelems, sizeof(seen[0]));
+
+    for (n = 0; n < nelems; ++n)
+    {
+        gen_cid(&cces[n].cce_cid, n);
+        if (cces[n].cce_cid.len < sizeof(n))
+            continue;   /* Short CIDs may collide */
+        conn = lsquic_cidh_find(hash, &cces[n].cce_cid);
+        assert(!conn);
+        s = lsquic_cidh_insert(hash, &conns[n], &cces[n]);
+        assert(0 == s);
+        assert(cces[n].cce_hashed);
+        /* Check an earlier element: it may be in the old table */
+        count = get_rand() % (n + 1);
+        if (cces[count].cce_hashed)
+            assert(&conns[count] ==
+                                lsquic_cidh_find(hash, &cces[count].cce_cid));
+    }
+
+    count = 0;
+    for (n = 0; n < nelems; ++n)
+        if (cces[n].cce_hashed)
+        {
+            ++count;
+            assert(&conns[n] == lsquic_cidh_find(hash, &cces[n].cce_cid));
+        }
+    assert(count == lsquic_cidh_count(hash));
+    assert(lsquic_cidh_mem_used(hash) > count * sizeof(lsquic_cid_t));
+
+    /* Erase every other element while iterating: those that have not
+     * been visited yet must not come up.
+     */
+    for (conn = lsquic_cidh_first(hash); conn; conn = lsquic_cidh_next(hash))
+    {
+        n = conn - conns;
+        assert(n < nelems);
+        assert(cces[n].cce_hashed);
+        assert(!seen[n]);
+        seen[n] = 1;
+        if (n + 1 < nelems && cces[n + 1].cce_hashed && !seen[n + 1]
+                                                                && (n & 1))
+        {
+            lsquic_cidh_erase(hash, &conns[n + 1], &cces[n + 1]);
+            --count;
+        }
+    }
+    assert(count == lsquic_cidh_count(hash));
+
+    for (n = 0; n < nelems; ++n)
+        if (cces[n].cce_hashed)
+        {
+            lsquic_cidh_erase(hash, &conns[n], &cces[n]);
+            assert(!lsquic_cidh_find(hash, &cces[n].cce_cid));
+            --count;
+        }
+    assert(0 == count);
+    assert(0 == lsquic_cidh_count(hash));
+
+    lsquic_cidh_destroy(hash);
+    free(seen);
+    free(cces);
+    free(conns);
+}
+
+
+/* Same CID may be inserted by two connections: erase must remove the
+ * right one.
+ */
+static void
+test_duplicates (void)
+{
+    struct cid_hash *hash;
+    struct lsquic_conn conns[2];
+    struct conn_cid_elem cces[2];
+    struct lsquic_conn *conn;
+    int s;
+
+    memset(cces, 0, sizeof(cces));
+    hash = lsquic_cidh_create();
+    gen_cid(&cces[0].cce_cid, 1);
+    cces[1].cce_cid = cces[0].cce_cid;
+    s = lsquic_cidh_insert(hash, &conns[0], &cces[0]);
+    assert(0 == s);
+    s = lsquic_cidh_insert(hash, &conns[1], &cces[1]);
+    assert(0 == s);
+    assert(2 == lsquic_cidh_count(hash));
+
+    lsquic_cidh_erase(hash, &conns[0], &cces[0]);
+    conn = lsquic_cidh_find(hash, &cces[0].cce_cid);
+    assert(conn == &conns[1]);
+    lsquic_cidh_erase(hash, &conns[1], &cces[1]);
+    assert(!lsquic_cidh_find(hash, &cces[0].cce_cid));
+
+    lsquic_cidh_destroy(hash);
+}
+
+
+static void
+test_port (void)
+{
+    struct cid_hash *hash;
+    struct lsquic_conn conn;
+    struct conn_cid_elem cce;
+    lsquic_cid_t key;
+    int s;
+
+    memset(&cce, 0, sizeof(cce));
+    hash = lsquic_cidh_create();
+    cce.cce_port = 12345;
+    cce.cce_flags = CCE_PORT;
+    s = lsquic_cidh_insert(hash, &conn, &cce);
+    assert(0 == s);
+
+    lsquic_cidh_port2key(12345, &key);
+    assert(&conn == lsquic_cidh_find(hash, &key));
+    lsquic_cidh_port2key(12346, &key);
+    assert(!lsquic_cidh_find(hash, &key));
+
+    lsquic_cidh_erase(hash, &conn, &cce);
+    lsquic_cidh_port2key(12345, &key);
+    assert(!lsquic_cidh_find(hash, &key));
+
+    lsquic_cidh_destroy(hash);
+}
+
+
+/* Insert and erase in a loop without growing the number of elements:
+ * deleted slots must get reused.
+ */
+static void
+test_churn (void)
+{
+    enum { N_LIVE = 100, N_ROUNDS = 100000, };
+    struct cid_hash *hash;
+    struct lsquic_conn conns[N_LIVE];
+    struct conn_cid_elem cces[N_LIVE];
+    unsigned n, i;
+    size_t mem_used;
+    int s;
+
+    memset(cces, 0, sizeof(cces));
+    hash = lsquic_cidh_create();
+    for (i = 0; i < N_LIVE; ++i)
+    {
+        gen_cid(&cces[i].cce_cid, i * 5 + 1);
+        s = lsquic_cidh_insert(hash, &conns[i], &cces[i]);
+        assert(0 == s);
+    }
+    mem_used = 0;
+    for (n = 0; n < N_ROUNDS; ++n)
+    {
+        i = get_rand() % N_LIVE;
+        lsquic_cidh_erase(hash, &conns[i], &cces[i]);
+        gen_cid(&cces[i].cce_cid, (N_LIVE + n) * 5 + 1);
+        s = lsquic_cidh_insert(hash, &conns[i], &cces[i]);
+        assert(0 == s);
+        assert(&conns[i] == lsquic_cidh_find(hash, &cces[i].cce_cid));
+        if (n == N_ROUNDS / 2)
+            mem_used = lsquic_cidh_mem_used(hash);
+    }
+    assert(N_LIVE == lsquic_cidh_count(hash));
+    /* The table does not keep growing.  (It may be twice as large while
+     * a migration is in progress.)
+     */
+    assert(lsquic_cidh_mem_used(hash) <= 2 * mem_used);
+
+    lsquic_cidh_destroy(hash);
+}
+
+
+int
+main (int argc, char **argv)
+{
+    unsigned nelems;
+
+    if (argc > 1)
+        nelems = atoi(argv[1]);
+    else
+        nelems = 200000;
+
+    test_many(nelems);
+    test_many(10);
+    test_duplicates();
+    test_port();
+    test_churn();
+
+    return 0;
+}
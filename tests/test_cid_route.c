@@ -0,0 +1,295 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+
+#include "lsquic.h"
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_hash.h"
+#include "lsquic_conn.h"
+#include "lsquic_cid_route.h"
+#if FIU_ENABLE
+#include <fiu.h>
+#include <fiu-control.h>
+#include "lsquic_mm.h"
+#include "lsquic_engine_public.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_packet_in.h"
+#include "lsquic_rtt.h"
+#include "lsquic_enc_sess.h"
+#include "lsquic_trechist.h"
+#include "lsquic_crand.h"
+#include "lsquic_mini_conn_ietf.h"
+#endif
+
+
+static void
+init_conn (struct lsquic_conn *conn)
+{
+    memset(conn, 0, sizeof(*conn));
+    LSCONN_INITIALIZE(conn);
+    conn->cn_cces_mask = 0;
+}
+
+
+/* Generate CID into the first unused CCE and mark it as hashed */
+static struct conn_cid_elem *
+add_cid (struct cid_route *route, struct lsquic_conn *conn, unsigned len)
+{
+    struct conn_cid_elem *cce;
+
+    for (cce = conn->cn_cces; cce < END_OF_CCES(conn); ++cce)
+        if (!(conn->cn_cces_mask & (1 << (cce - conn->cn_cces))))
+            break;
+    assert(cce < END_OF_CCES(conn));
+    lsquic_cidr_generate(route, conn, &cce->cce_cid, len);
+    conn->cn_cces_mask |= 1 << (cce - conn->cn_cces);
+    cce->cce_hashed = 1;
+    return cce;
+}
+
+
+static void
+test_many (unsigned nconns)
+{
+    struct cid_route *route;
+    struct lsquic_conn *conns;
+    struct conn_cid_elem *cce;
+    lsquic_cid_t cid;
+    unsigned n, i;
+
+    route = lsquic_cidr_new(NULL);
+    conns = malloc(nconns * sizeof(conns[0]));
+    for (n = 0; n < nconns; ++n)
+    {
+        init_conn(&conns[n]);
+        for (i = 0; i < 3; ++i)
+            (void) add_cid(route, &conns[n], 8);
+        assert(conns[n].cn_route_slot == n + 1);
+    }
+
+    for (n = 0; n < nconns; ++n)
+        for (i = 0; i < 3; ++i)
+            assert(&conns[n] ==
+                        lsquic_cidr_find(route, &conns[n].cn_cces[i].cce_cid));
+
+    /* CIDs of the same connection look unrelated */
+    assert(0 != memcmp(conns[0].cn_cces[0].cce_cid.idbuf,
+                                    conns[0].cn_cces[1].cce_cid.idbuf, 8));
+
+    /* Retired CID is no longer found */
+    cce = &conns[0].cn_cces[1];
+    cce->cce_hashed = 0;
+    assert(!lsquic_cidr_find(route, &cce->cce_cid));
+
+    /* Slot of destroyed connection is reused, but old CIDs do not match
+     * the new connection.
+     */
+    cid = conns[1].cn_cces[0].cce_cid;
+    lsquic_cidr_release(route, &conns[1]);
+    assert(!lsquic_cidr_find(route, &cid));
+    init_conn(&conns[1]);
+    cce = add_cid(route, &conns[1], 8);
+    assert(conns[1].cn_route_slot == 2);
+    assert(&conns[1] == lsquic_cidr_find(route, &cce->cce_cid));
+    conns[1].cn_cces[1].cce_cid = cid;
+    conns[1].cn_cces[1].cce_hashed = 1;
+    conns[1].cn_cces_mask |= 2;
+    /* Even if the same CID is present, the generation does not match */
+    assert(!lsquic_cidr_find(route, &cid));
+
+    /* Random CIDs do not decode */
+    for (n = 0; n < 1000; ++n)
+    {
+        lsquic_generate_cid(&cid, 8);
+        assert(!lsquic_cidr_find(route, &cid));
+    }
+
+    for (n = 0; n < nconns; ++n)
+        lsquic_cidr_release(route, &conns[n]);
+    assert(lsquic_cidr_mem_used(route) > nconns * sizeof(void *));
+    free(conns);
+    lsquic_cidr_destroy(route);
+}
+
+
+static void
+test_server_id (void)
+{
+    struct lsquic_route_ctx ctx = {
+        .rc_server_id = { 0xAB, 0xCD, 0xEF, },
+        .rc_server_id_len = 3,
+        .rc_config_id = 5,
+    };
+    struct cid_route *route;
+    struct lsquic_conn conn;
+    struct conn_cid_elem *cce;
+    lsquic_cid_t cid;
+
+    route = lsquic_cidr_new(&ctx);
+    init_conn(&conn);
+
+    /* Too short for the slot: only the prefix is set */
+    cce = add_cid(route, &conn, 8);
+    assert(cce->cce_cid.len == 8);
+    assert((cce->cce_cid.idbuf[0] >> 5) == 5);
+    assert(0 == memcmp(cce->cce_cid.idbuf + 1, ctx.rc_server_id, 3));
+    assert(!conn.cn_route_slot);
+    assert(!lsquic_cidr_find(route, &cce->cce_cid));
+
+    cce = add_cid(route, &conn, 12);
+    assert((cce->cce_cid.idbuf[0] >> 5) == 5);
+    assert(0 == memcmp(cce->cce_cid.idbuf + 1, ctx.rc_server_id, 3));
+    assert(conn.cn_route_slot);
+    assert(&conn == lsquic_cidr_find(route, &cce->cce_cid));
+
+    /* Wrong config ID */
+    cid = cce->cce_cid;
+    cid.idbuf[0] ^= 0x20;
+    assert(!lsquic_cidr_find(route, &cid));
+
+    /* Retry SCID has no connection: only the prefix is set */
+    lsquic_cidr_generate(route, NULL, &cid, 12);
+    assert(cid.len == 12);
+    assert((cid.idbuf[0] >> 5) == 5);
+    assert(0 == memcmp(cid.idbuf + 1, ctx.rc_server_id, 3));
+    assert(!lsquic_cidr_find(route, &cid));
+
+    lsquic_cidr_release(route, &conn);
+    lsquic_cidr_destroy(route);
+
+    ctx.rc_server_id_len = 12;
+    assert(!lsquic_cidr_new(&ctx));
+}
+
+
+/* Mini connection is promoted: its CIDs are found in the full connection */
+static void
+test_move (void)
+{
+    struct cid_route *route;
+    struct lsquic_conn mini, full;
+    struct conn_cid_elem *cce;
+
+    route = lsquic_cidr_new(NULL);
+    init_conn(&mini);
+    init_conn(&full);
+    cce = add_cid(route, &mini, 20);
+    assert(&mini == lsquic_cidr_find(route, &cce->cce_cid));
+
+    full.cn_cces[0] = *cce;
+    full.cn_cces_mask = 1;
+    lsquic_cidr_move(route, &mini, &full);
+    assert(!mini.cn_route_slot);
+    assert(&full == lsquic_cidr_find(route, &cce->cce_cid));
+
+    /* Releasing the mini connection does nothing */
+    lsquic_cidr_release(route, &mini);
+    assert(&full == lsquic_cidr_find(route, &cce->cce_cid));
+
+    lsquic_cidr_release(route, &full);
+    assert(!lsquic_cidr_find(route, &cce->cce_cid));
+    lsquic_cidr_destroy(route);
+}
+
+
+#if FIU_ENABLE
+static struct {
+    lsquic_cid_t    cid;
+    unsigned        slot;
+}   s_last_gen;
+
+
+static void
+record_generate (void *route, struct lsquic_conn *conn, lsquic_cid_t *cid,
+                                                                unsigned len)
+{
+    lsquic_cidr_generate(route, conn, cid, len);
+    s_last_gen.cid = *cid;
+    s_last_gen.slot = conn->cn_route_slot;
+}
+
+
+/* Mini connection that fails to be constructed must release the slot it
+ * got when its SCID was generated: otherwise, the slot points to freed
+ * memory.
+ */
+static void
+test_mini_conn_ctor_failure (const char *fail_point, int use_trechist)
+{
+    struct lsquic_engine_public enpub;
+    struct lsquic_packet_in packet_in;
+    struct lsquic_conn *conn, other;
+    struct conn_cid_elem *cce;
+    struct crand crand;
+    unsigned char data[1200];
+    int s;
+
+    memset(&enpub, 0, sizeof(enpub));
+    lsquic_mm_init(&enpub.enp_mm);
+    lsquic_engine_init_settings(&enpub.enp_settings, LSENG_SERVER);
+    enpub.enp_cid_route = lsquic_cidr_new(NULL);
+    enpub.enp_generate_scid = record_generate;
+    enpub.enp_gen_scid_ctx = enpub.enp_cid_route;
+    enpub.enp_settings.es_scid_len = 16;
+    /* The first nybble decides whether trechist is used */
+    memset(&crand, 0, sizeof(crand));
+    crand.nybble_off = 2;
+    crand.rand_buf[1] = use_trechist ? 0 : 1;
+    enpub.enp_crand = &crand;
+
+    memset(&packet_in, 0, sizeof(packet_in));
+    memset(data, 0, sizeof(data));
+    packet_in.pi_data = data;
+    packet_in.pi_data_sz = sizeof(data);
+    packet_in.pi_dcid.len = 8;
+
+    s = fiu_enable(fail_point, 1, NULL, 0);
+    assert(s == 0);
+    conn = lsquic_mini_conn_ietf_new(&enpub, &packet_in, LSQVER_I001, 1,
+                                                        NULL, sizeof(data));
+    fiu_disable(fail_point);
+    assert(!conn);
+    assert(s_last_gen.slot == 1);
+    assert(!lsquic_cidr_find(enpub.enp_cid_route, &s_last_gen.cid));
+
+    /* The slot is free to be used again */
+    init_conn(&other);
+    cce = add_cid(enpub.enp_cid_route, &other, 16);
+    assert(other.cn_route_slot == 1);
+    assert(&other == lsquic_cidr_find(enpub.enp_cid_route, &cce->cce_cid));
+    assert(!lsquic_cidr_find(enpub.enp_cid_route, &s_last_gen.cid));
+
+    lsquic_cidr_release(enpub.enp_cid_route, &other);
+    lsquic_cidr_destroy(enpub.enp_cid_route);
+    lsquic_mm_cleanup(&enpub.enp_mm);
+}
+
+
+#endif
+
+
+int
+main (int argc, char **argv)
+{
+    unsigned nconns;
+
+    if (argc > 1)
+        nconns = atoi(argv[1]);
+    else
+        nconns = 10000;
+
+    test_many(nconns);
+    test_server_id();
+    test_move();
+#if FIU_ENABLE
+    fiu_init(0);
+    test_mini_conn_ctor_failure("mini_conn_ietf/enc_sess", 0);
+    test_mini_conn_ctor_failure("mini_conn_ietf/trechist", 1);
+#endif
+
+    return 0;
+}
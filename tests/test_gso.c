@@ -0,0 +1,332 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <netinet/in.h>
+#include <sys/socket.h>
+#else
+#include "vc_compat.h"
+#include <Ws2tcpip.h>
+#endif
+
+#include "lsquic.h"
+#include "lsquic_gso.h"
+
+#define MAX_SPECS 128
+
+static struct sockaddr_in s_local, s_peer[2];
+static struct lsquic_conn *const s_conns[2] = {
+    (struct lsquic_conn *) &s_conns[0],
+    (struct lsquic_conn *) &s_conns[1],
+};
+
+struct gso_test
+{
+    struct iovec            iov[MAX_SPECS];
+    struct lsquic_out_spec  outs[MAX_SPECS];
+    struct lsquic_conn     *conns[MAX_SPECS];
+    struct lsquic_out_spec  gso_outs[MAX_SPECS];
+    unsigned                gso_idx[MAX_SPECS];
+    unsigned                n_outs;
+};
+
+
+/* Each spec gets its own iov element, so that consecutive specs can be
+ * combined.
+ */
+static void
+add_out (struct gso_test *test, size_t sz)
+{
+    struct lsquic_out_spec *const out = &test->outs[test->n_outs];
+
+    assert(test->n_outs < MAX_SPECS);
+    test->iov[test->n_outs].iov_base = NULL;
+    test->iov[test->n_outs].iov_len = sz;
+    memset(out, 0, sizeof(*out));
+    out->iov = &test->iov[test->n_outs];
+    out->iovlen = 1;
+    out->local_sa = (struct sockaddr *) &s_local;
+    out->dest_sa = (struct sockaddr *) &s_peer[0];
+    test->conns[test->n_outs] = s_conns[0];
+    ++test->n_outs;
+}
+
+
+static unsigned
+combine (struct gso_test *test, unsigned unmerged_end)
+{
+    return lsquic_gso_combine(test->outs, test->conns, 0, test->n_outs,
+                            unmerged_end, test->gso_outs, test->gso_idx);
+}
+
+
+static void
+test_same_size (void)
+{
+    struct gso_test test = { .n_outs = 0, };
+    unsigned n;
+
+    add_out(&test, 1200);
+    n = combine(&test, 0);
+    assert(n == 1);
+    assert(test.gso_outs[0].iovlen == 1);
+    assert(test.gso_outs[0].gso_size == 0);
+
+    add_out(&test, 1200);
+    add_out(&test, 1200);
+    n = combine(&test, 0);
+    assert(n == 1);
+    assert(test.gso_idx[0] == 0);
+    assert(test.gso_outs[0].iov == &test.iov[0]);
+    assert(test.gso_outs[0].iovlen == 3);
+    assert(test.gso_outs[0].gso_size == 1200);
+}
+
+
+/* Only the last segment may be smaller: a smaller segment ends the spec */
+static void
+test_mixed_sizes (void)
+{
+    struct gso_test test = { .n_outs = 0, };
+    unsigned n;
+
+    add_out(&test, 1200);
+    add_out(&test, 1200);
+    add_out(&test, 800);
+    add_out(&test, 1200);
+    add_out(&test, 1300);
+    add_out(&test, 700);
+    add_out(&test, 700);
+    n = combine(&test, 0);
+    assert(n == 4);
+
+    assert(test.gso_idx[0] == 0);
+    assert(test.gso_outs[0].iovlen == 3);
+    assert(test.gso_outs[0].gso_size == 1200);
+
+    /* A larger datagram cannot follow */
+    assert(test.gso_idx[1] == 3);
+    assert(test.gso_outs[1].iovlen == 1);
+    assert(test.gso_outs[1].gso_size == 0);
+
+    assert(test.gso_idx[2] == 4);
+    assert(test.gso_outs[2].iovlen == 2);
+    assert(test.gso_outs[2].gso_size == 1300);
+
+    assert(test.gso_idx[3] == 6);
+    assert(test.gso_outs[3].iovlen == 1);
+}
+
+
+static void
+test_limits (void)
+{
+    struct gso_test test = { .n_outs = 0, };
+    unsigned n, i;
+
+    for (i = 0; i < MAX_GSO_SEGS + 6; ++i)
+        add_out(&test, 1000);
+    n = combine(&test, 0);
+    assert(n == 2);
+    assert(test.gso_outs[0].iovlen == MAX_GSO_SEGS);
+    assert(test.gso_idx[1] == MAX_GSO_SEGS);
+    assert(test.gso_outs[1].iovlen == 6);
+
+    test.n_outs = 0;
+    for (i = 0; i < 50; ++i)
+        add_out(&test, 1400);
+    n = combine(&test, 0);
+    assert(n == 2);
+    assert(test.gso_outs[0].iovlen == MAX_GSO_BYTES / 1400);
+    assert(test.gso_outs[1].iovlen == 50 - MAX_GSO_BYTES / 1400);
+}
+
+
+static void
+test_not_combined (void)
+{
+    struct gso_test test = { .n_outs = 0, };
+    struct iovec two_iov[2] = { { NULL, 1200, }, { NULL, 1200, }, };
+    unsigned n, i;
+
+    for (i = 0; i < 6; ++i)
+        add_out(&test, 1200);
+    test.conns[1] = s_conns[1];
+    test.outs[2].dest_sa = (struct sockaddr *) &s_peer[1];
+    test.outs[3].ecn = 1;
+    test.outs[4].peer_ctx = &test;
+    test.outs[5].iov = two_iov;     /* Coalesced datagram */
+    test.outs[5].iovlen = 2;
+    n = combine(&test, 0);
+    assert(n == 6);
+    for (i = 0; i < n; ++i)
+    {
+        assert(test.gso_idx[i] == i);
+        assert(test.gso_outs[i].gso_size == 0);
+    }
+
+    /* Specs whose iov elements are not adjacent */
+    test.n_outs = 0;
+    add_out(&test, 1200);
+    add_out(&test, 1200);
+    test.outs[1].iov = &test.iov[2];
+    test.iov[2].iov_len = 1200;
+    n = combine(&test, 0);
+    assert(n == 2);
+
+    /* Datagrams before `unmerged_end' go out one by one */
+    test.n_outs = 0;
+    for (i = 0; i < 5; ++i)
+        add_out(&test, 1200);
+    n = combine(&test, 3);
+    assert(n == 4);
+    assert(test.gso_idx[3] == 3);
+    assert(test.gso_outs[3].iovlen == 2);
+    assert(test.gso_outs[3].gso_size == 1200);
+
+    /* Starting in the middle of the batch */
+    n = lsquic_gso_combine(test.outs, test.conns, 2, test.n_outs, 0,
+                                            test.gso_outs, test.gso_idx);
+    assert(n == 1);
+    assert(test.gso_idx[0] == 2);
+    assert(test.gso_outs[0].iovlen == 3);
+}
+
+
+/* The kernel sends all segments at once: only datagrams that are due at
+ * the same time are combined.
+ */
+static void
+test_txtime (void)
+{
+    struct gso_test test = { .n_outs = 0, };
+    unsigned n, i;
+
+    for (i = 0; i < 6; ++i)
+    {
+        add_out(&test, 1200);
+        test.outs[i].txtime = 1000 + i / 2 * 100;
+    }
+    n = combine(&test, 0);
+    assert(n == 3);
+    for (i = 0; i < n; ++i)
+    {
+        assert(test.gso_idx[i] == i * 2);
+        assert(test.gso_outs[i].iovlen == 2);
+        assert(test.gso_outs[i].txtime == 1000 + i * 100);
+    }
+
+    /* Packet that is not paced does not join paced packets */
+    test.outs[1].txtime = 0;
+    test.outs[2].txtime = 0;
+    n = combine(&test, 0);
+    assert(n == 4);
+    assert(test.gso_idx[1] == 1);
+    assert(test.gso_outs[1].iovlen == 2);
+    assert(test.gso_outs[1].txtime == 0);
+    assert(test.gso_idx[2] == 3);
+    assert(test.gso_outs[2].iovlen == 1);
+}
+
+
+struct gro_test
+{
+    const unsigned char    *bufs[8];
+    size_t                  sizes[8];
+    int                     retvals[8];
+    unsigned                n_calls;
+};
+
+
+static int
+gro_packet_in (void *ctx, const unsigned char *buf, size_t bufsz,
+                                        const struct lsquic_in_spec *spec)
+{
+    struct gro_test *const test = ctx;
+
+    assert(test->n_calls < sizeof(test->bufs) / sizeof(test->bufs[0]));
+    assert(buf >= spec->buf && buf + bufsz <= spec->buf + spec->bufsz);
+    test->bufs[test->n_calls] = buf;
+    test->sizes[test->n_calls] = bufsz;
+    return test->retvals[test->n_calls++];
+}
+
+
+static void
+test_gro (void)
+{
+    static unsigned char buf[0x1000];
+    struct lsquic_in_spec spec = {
+        .buf = buf,
+        .gso_size = 1200,
+    };
+    struct gro_test test;
+    int s;
+
+    /* Last segment is smaller */
+    memset(&test, 0, sizeof(test));
+    spec.bufsz = 3000;
+    s = lsquic_gro_packets_in(&spec, gro_packet_in, &test);
+    assert(s == 0);
+    assert(test.n_calls == 3);
+    assert(test.bufs[0] == buf && test.sizes[0] == 1200);
+    assert(test.bufs[1] == buf + 1200 && test.sizes[1] == 1200);
+    assert(test.bufs[2] == buf + 2400 && test.sizes[2] == 600);
+
+    /* Buffer ends at segment boundary */
+    memset(&test, 0, sizeof(test));
+    spec.bufsz = 2400;
+    s = lsquic_gro_packets_in(&spec, gro_packet_in, &test);
+    assert(s == 0);
+    assert(test.n_calls == 2);
+    assert(test.bufs[1] == buf + 1200 && test.sizes[1] == 1200);
+
+    /* Last segment is one byte */
+    memset(&test, 0, sizeof(test));
+    spec.bufsz = 2401;
+    s = lsquic_gro_packets_in(&spec, gro_packet_in, &test);
+    assert(s == 0);
+    assert(test.n_calls == 3);
+    assert(test.bufs[2] == buf + 2400 && test.sizes[2] == 1);
+
+    /* Zero is returned if any datagram was processed */
+    memset(&test, 0, sizeof(test));
+    test.retvals[0] = 1;
+    test.retvals[1] = 0;
+    test.retvals[2] = 1;
+    spec.bufsz = 3000;
+    s = lsquic_gro_packets_in(&spec, gro_packet_in, &test);
+    assert(s == 0);
+    assert(test.n_calls == 3);
+
+    memset(&test, 0, sizeof(test));
+    test.retvals[0] = 1;
+    test.retvals[1] = 1;
+    test.retvals[2] = 1;
+    s = lsquic_gro_packets_in(&spec, gro_packet_in, &test);
+    assert(s == 1);
+
+    /* Error stops processing */
+    memset(&test, 0, sizeof(test));
+    test.retvals[1] = -1;
+    s = lsquic_gro_packets_in(&spec, gro_packet_in, &test);
+    assert(s == -1);
+    assert(test.n_calls == 2);
+}
+
+
+int
+main (void)
+{
+    test_same_size();
+    test_mixed_sizes();
+    test_limits();
+    test_not_combined();
+    test_txtime();
+    test_gro();
+
+    return 0;
+}
@@ -45,6 +45,8 @@
 #include "lsquic_bw_sampler.h"
 #include "lsquic_minmax.h"
 #include "lsquic_bbr.h"
+#include "lsquic_bbr2.h"
+#include "lsquic_prague.h"
 #include "lsquic_adaptive_cc.h"
 #include "lsquic_send_ctl.h"
 #include "lsquic_ver_neg.h"
@@ -352,13 +354,13 @@ init_test_objs (struct test_objs *tobjs, unsigned initial_conn_window,
     TAILQ_INIT(&tobjs->conn_pub.read_streams);
     TAILQ_INIT(&tobjs->conn_pub.write_streams);
     TAILQ_INIT(&tobjs->conn_pub.service_streams);
+    tobjs->conn_pub.enpub = &tobjs->eng_pub;
     lsquic_cfcw_init(&tobjs->conn_pub.cfcw, &tobjs->conn_pub,
                                                     initial_conn_window);
     lsquic_conn_cap_init(&tobjs->conn_pub.conn_cap, initial_conn_window);
     lsquic_alarmset_init(&tobjs->alset, 0);
     tobjs->conn_pub.mm = &tobjs->eng_pub.enp_mm;
     tobjs->conn_pub.lconn = &tobjs->lconn;
-    tobjs->conn_pub.enpub = &tobjs->eng_pub;
     tobjs->conn_pub.send_ctl = &tobjs->send_ctl;
     tobjs->conn_pub.packet_out_malo =
                         lsquic_malo_create(sizeof(struct lsquic_packet_out));
@@ -371,8 +373,8 @@ init_test_objs (struct test_objs *tobjs, unsigned initial_conn_window,
     tobjs->eng_pub.enp_hsi_if = &tobjs->hsi_if;
     lsquic_send_ctl_init(&tobjs->send_ctl, &tobjs->alset, &tobjs->eng_pub,
         &tobjs->ver_neg, &tobjs->conn_pub, 0);
-    tobjs->send_ctl.sc_adaptive_cc.acc_cubic.cu_cwnd = ~0ull;
-    tobjs->send_ctl.sc_cong_ctl = &tobjs->send_ctl.sc_adaptive_cc.acc_cubic;
+    tobjs->send_ctl.sc_cc.adaptive.acc_cubic.cu_cwnd = ~0ull;
+    tobjs->send_ctl.sc_cong_ctl = &tobjs->send_ctl.sc_cc.adaptive.acc_cubic;
     tobjs->stream_if = &stream_if;
     tobjs->stream_if_ctx = &test_ctx;
     tobjs->ctor_flags = stream_ctor_flags;
@@ -1611,6 +1613,198 @@ test_reading_zero_size_data_frame_scenario3 (void)
 }
 
 
+/* File data written to HTTP/3 stream is interspersed with DATA frame
+ * headers.  Packets that carry it are still paged out; the frame headers
+ * and other data that did not come from file are restored when the packet
+ * is paged back in.
+ */
+static void
+test_write_file (void)
+{
+    struct test_objs tobjs;
+    struct lsquic_stream *stream;
+    struct lsquic_packet_out *packet_out;
+    FILE *file;
+    ssize_t n;
+    size_t nw;
+    unsigned n_packets, n_paged_out;
+    int fd, s;
+    unsigned char buf_in[0x8000];
+    unsigned char prologue[17];
+    unsigned char copy[0x1000];
+
+    struct lsxpack_header header = { XHDR(":method", "GET") };
+    struct lsquic_http_headers headers = { 1, &header, };
+
+    init_buf(buf_in, sizeof(buf_in));
+    init_buf(prologue, sizeof(prologue));
+    file = tmpfile();
+    assert(file);
+    nw = fwrite(buf_in, 1, sizeof(buf_in), file);
+    assert(nw == sizeof(buf_in));
+    s = fflush(file);
+    assert(0 == s);
+    fd = fileno(file);
+
+    init_test_ctl_settings(&g_ctl_settings);
+
+    stream_ctor_flags |= SCF_IETF;
+    init_test_objs(&tobjs, 0x10000, 0x10000, 1252);
+    tobjs.ctor_flags |= SCF_HTTP|SCF_IETF;
+
+    stream = new_stream(&tobjs, 0, 0x10000);
+    s = lsquic_stream_send_headers(stream, &headers, 0);
+    assert(0 == s);
+
+    /* Buffered data goes into the same packet as file data that follows */
+    n = lsquic_stream_write(stream, prologue, sizeof(prologue));
+    assert(n == (ssize_t) sizeof(prologue));
+    for (nw = 0; nw < sizeof(buf_in); nw += (size_t) n)
+    {
+        n = lsquic_stream_write_file(stream, fd, (off_t) nw,
+                                                    sizeof(buf_in) - nw);
+        assert(n > 0);
+    }
+    s = lsquic_stream_flush(stream);
+    assert(0 == s);
+
+    n_packets = 0;
+    n_paged_out = 0;
+    TAILQ_FOREACH(packet_out, &tobjs.send_ctl.sc_scheduled_packets, po_next)
+    {
+        if (!(packet_out->po_frame_types & QUIC_FTBIT_STREAM))
+            continue;
+        ++n_packets;
+        assert(packet_out->po_data_sz <= sizeof(copy));
+        memcpy(copy, packet_out->po_data, packet_out->po_data_sz);
+        s = lsquic_packet_out_page_out(packet_out, &tobjs.eng_pub.enp_mm,
+                                                                        g_pf);
+        if (s != 0)
+            continue;
+        ++n_paged_out;
+        assert(lsquic_packet_out_mem_used(packet_out)
+                                                < packet_out->po_n_alloc);
+        s = lsquic_packet_out_page_in(packet_out, &tobjs.eng_pub.enp_mm);
+        assert(0 == s);
+        assert(0 == memcmp(copy, packet_out->po_data, packet_out->po_data_sz));
+        s = lsquic_packet_out_page_out(packet_out, &tobjs.eng_pub.enp_mm,
+                                                                        g_pf);
+        assert(0 == s);
+    }
+    /* The tail too short to fill a packet is buffered: with HTTP/3, the
+     * last packet is held in memory.
+     */
+    assert(n_packets > 2);
+    assert(n_paged_out == n_packets - 1);
+
+    /* Once all data is ACKed, file regions are dropped */
+    assert(lsquic_stream_has_src_regs(stream));
+    TAILQ_FOREACH(packet_out, &tobjs.send_ctl.sc_scheduled_packets, po_next)
+        lsquic_packet_out_ack_streams(packet_out, g_pf);
+    assert(!lsquic_stream_has_src_regs(stream));
+
+    lsquic_stream_destroy(stream);
+    deinit_test_objs(&tobjs);
+    fclose(file);
+
+    stream_ctor_flags &= ~SCF_IETF;
+}
+
+static void
+on_wref_release (void *ctx, const void *buf, size_t len)
+{
+    unsigned *const n_released = ctx;
+    ++*n_released;
+}
+
+
+/* Test that packets carrying data from registered buffers page out and in
+ * correctly with HTTP/3 framing and that the buffers are released once
+ * all of the data is ACKed.
+ */
+static void
+test_write_ref (void)
+{
+    struct test_objs tobjs;
+    struct lsquic_stream *stream;
+    struct lsquic_packet_out *packet_out;
+    ssize_t n;
+    unsigned n_packets, n_paged_out, n_released;
+    int s;
+    unsigned char buf_in[0x8000];
+    unsigned char prologue[17];
+    unsigned char copy[0x1000];
+
+    struct lsxpack_header header = { XHDR(":method", "GET") };
+    struct lsquic_http_headers headers = { 1, &header, };
+
+    init_buf(buf_in, sizeof(buf_in));
+    init_buf(prologue, sizeof(prologue));
+
+    init_test_ctl_settings(&g_ctl_settings);
+
+    stream_ctor_flags |= SCF_IETF;
+    init_test_objs(&tobjs, 0x10000, 0x10000, 1252);
+    tobjs.ctor_flags |= SCF_HTTP|SCF_IETF;
+
+    stream = new_stream(&tobjs, 0, 0x10000);
+    s = lsquic_stream_send_headers(stream, &headers, 0);
+    assert(0 == s);
+
+    n_released = 0;
+    n = lsquic_stream_write(stream, prologue, sizeof(prologue));
+    assert(n == (ssize_t) sizeof(prologue));
+    n = lsquic_stream_write_ref(stream, buf_in, 0x4321, on_wref_release,
+                                                                &n_released);
+    assert(0x4321 == n);
+    n = lsquic_stream_write_ref(stream, buf_in + 0x4321,
+                    sizeof(buf_in) - 0x4321, on_wref_release, &n_released);
+    assert((ssize_t) sizeof(buf_in) - 0x4321 == n);
+    s = lsquic_stream_flush(stream);
+    assert(0 == s);
+    assert(!(stream->sm_qflags & SMQF_WRITE_REFS));
+
+    n_packets = 0;
+    n_paged_out = 0;
+    TAILQ_FOREACH(packet_out, &tobjs.send_ctl.sc_scheduled_packets, po_next)
+    {
+        if (!(packet_out->po_frame_types & QUIC_FTBIT_STREAM))
+            continue;
+        ++n_packets;
+        assert(packet_out->po_data_sz <= sizeof(copy));
+        memcpy(copy, packet_out->po_data, packet_out->po_data_sz);
+        s = lsquic_packet_out_page_out(packet_out, &tobjs.eng_pub.enp_mm,
+                                                                        g_pf);
+        if (s != 0)
+            continue;
+        ++n_paged_out;
+        s = lsquic_packet_out_page_in(packet_out, &tobjs.eng_pub.enp_mm);
+        assert(0 == s);
+        assert(0 == memcmp(copy, packet_out->po_data, packet_out->po_data_sz));
+        s = lsquic_packet_out_page_out(packet_out, &tobjs.eng_pub.enp_mm,
+                                                                        g_pf);
+        assert(0 == s);
+    }
+    /* Nothing is buffered: the tail is packetized from the buffer, too.
+     * Its packet is held in memory all the same, as the DATA frame header
+     * makes the tail spill over into a second STREAM frame.
+     */
+    assert(n_packets > 2);
+    assert(n_paged_out == n_packets - 1);
+
+    assert(0 == n_released);
+    TAILQ_FOREACH(packet_out, &tobjs.send_ctl.sc_scheduled_packets, po_next)
+        lsquic_packet_out_ack_streams(packet_out, g_pf);
+    assert(2 == n_released);
+    assert(!lsquic_stream_has_src_regs(stream));
+
+    lsquic_stream_destroy(stream);
+    deinit_test_objs(&tobjs);
+
+    stream_ctor_flags &= ~SCF_IETF;
+}
+
+
 int
 main (int argc, char **argv)
 {
@@ -1658,6 +1852,8 @@ main (int argc, char **argv)
         test_reading_zero_size_data_frame();
         test_reading_zero_size_data_frame_scenario2();
         test_reading_zero_size_data_frame_scenario3();
+        test_write_file();
+        test_write_ref();
     }
 
     return 0;
@@ -27,6 +27,8 @@ main (int argc, char **argv)
     struct lsquic_hash_elem *el;
     unsigned n, nelems;
     struct widget *widgets, *widget;
+    size_t mem_used, prev_mem_used, grown;
+    unsigned long key;
 
     hash = lsquic_hash_create();
 
@@ -37,6 +39,8 @@ main (int argc, char **argv)
 
     widgets = calloc(nelems, sizeof(widgets[0]));
 
+    prev_mem_used = lsquic_hash_mem_used(hash);
+    grown = 0;
     for (n = 0; n < nelems; ++n)
     {
         widget = &widgets[n];
@@ -46,6 +50,18 @@ main (int argc, char **argv)
         assert(!el);
         el = lsquic_hash_insert(hash, &widget->key, sizeof(widget->key), widget, &widget->hash_el);
         assert(el);
+        /* Earlier elements may not have been migrated yet */
+        key = n / 2;
+        el = lsquic_hash_find(hash, &key, sizeof(key));
+        assert(el);
+        assert(((struct widget *) lsquic_hashelem_getdata(el))->key == key);
+        /* During migration, both bucket arrays are counted */
+        mem_used = lsquic_hash_mem_used(hash);
+        if (mem_used > prev_mem_used)
+            grown = mem_used - prev_mem_used;
+        else if (mem_used < prev_mem_used)
+            assert(prev_mem_used - mem_used == grown / 2);
+        prev_mem_used = mem_used;
     }
 
     assert(nelems == lsquic_hash_count(hash));
@@ -60,7 +76,7 @@ main (int argc, char **argv)
 
     for (n = 0; n < nelems; ++n)
     {
-        unsigned long key = n;
+        key = n;
         el = lsquic_hash_find(hash, &key, sizeof(key));
         assert(el);
         widget = lsquic_hashelem_getdata(el);
@@ -0,0 +1,111 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+
+#include "lsquic.h"
+#include "lsquic_int_types.h"
+#include "lsquic_malo.h"
+#include "lsquic_mm.h"
+
+
+#define N_PAGES 2000
+
+
+/* Pages cached after a burst are released once the pool stays idle */
+static void
+test_trim (void)
+{
+    struct lsquic_mm mm;
+    void *pages[N_PAGES];
+    size_t mem_used, peak;
+    lsquic_time_t now;
+    unsigned i;
+
+    lsquic_mm_init(&mm);
+    mem_used = lsquic_mm_mem_used(&mm);
+
+    for (i = 0; i < N_PAGES; ++i)
+        pages[i] = lsquic_mm_get_4k(&mm);
+    peak = lsquic_mm_mem_used(&mm);
+    assert(peak >= mem_used + N_PAGES * 0x1000);
+    for (i = 0; i < N_PAGES; ++i)
+        lsquic_mm_put_4k(&mm, pages[i]);
+    /* Freed pages are still owned by the memory manager */
+    assert(lsquic_mm_mem_used(&mm) == peak);
+
+    /* Trimming is rate-limited */
+    now = MM_TRIM_PERIOD;
+    lsquic_mm_trim(&mm, now);
+    mem_used = lsquic_mm_mem_used(&mm);
+    lsquic_mm_trim(&mm, now + MM_TRIM_PERIOD / 2);
+    assert(lsquic_mm_mem_used(&mm) == mem_used);
+
+    for (i = 0; i < 100; ++i)
+    {
+        now += MM_TRIM_PERIOD;
+        lsquic_mm_trim(&mm, now);
+    }
+    assert(lsquic_mm_mem_used(&mm) < peak - N_PAGES / 2 * 0x1000);
+
+    /* The pool still works */
+    for (i = 0; i < N_PAGES; ++i)
+        pages[i] = lsquic_mm_get_4k(&mm);
+    assert(lsquic_mm_mem_used(&mm) == peak);
+    for (i = 0; i < N_PAGES; ++i)
+        lsquic_mm_put_4k(&mm, pages[i]);
+
+    lsquic_mm_cleanup(&mm);
+}
+
+
+static void
+test_shed (void)
+{
+    struct lsquic_mm mm;
+    void *pages[N_PAGES], *page;
+    size_t mem_used, peak, shed;
+    unsigned i;
+
+    lsquic_mm_init(&mm);
+    mem_used = lsquic_mm_mem_used(&mm);
+
+    for (i = 0; i < N_PAGES; ++i)
+        pages[i] = i & 1 ? lsquic_mm_get_4k(&mm) : lsquic_mm_get_16k(&mm);
+    page = lsquic_mm_get_4k(&mm);
+    peak = lsquic_mm_mem_used(&mm);
+    for (i = 0; i < N_PAGES; ++i)
+        if (i & 1)
+            lsquic_mm_put_4k(&mm, pages[i]);
+        else
+            lsquic_mm_put_16k(&mm, pages[i]);
+
+    /* Larger pages go first */
+    shed = lsquic_mm_shed(&mm, 0x4000 * 10);
+    assert(shed == 0x4000 * 10);
+    assert(lsquic_mm_mem_used(&mm) == peak - shed);
+
+    /* Everything cached is released, pages in use are not */
+    shed += lsquic_mm_shed(&mm, SIZE_MAX);
+    assert(shed == (size_t) N_PAGES / 2 * (0x4000 + 0x1000));
+    assert(lsquic_mm_mem_used(&mm) == peak - shed);
+    assert(lsquic_mm_mem_used(&mm) >= mem_used + 0x1000);
+    assert(0 == lsquic_mm_shed(&mm, SIZE_MAX));
+
+    lsquic_mm_put_4k(&mm, page);
+    assert(0x1000 == lsquic_mm_shed(&mm, 1));
+    assert(lsquic_mm_mem_used(&mm) == mem_used);
+
+    lsquic_mm_cleanup(&mm);
+}
+
+
+int
+main (void)
+{
+    test_trim();
+    test_shed();
+    return 0;
+}
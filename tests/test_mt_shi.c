@@ -0,0 +1,157 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifndef WIN32
+#include <pthread.h>
+#endif
+
+#include "lsquic.h"
+
+
+static void
+test_basic (unsigned n_shards)
+{
+    struct lsquic_mt_shi *hash;
+    void *datap, *datap2;
+    unsigned data_sz;
+    const time_t now = time(NULL);
+    int s;
+
+    hash = lsquic_mt_shi_new(n_shards);
+    assert(hash);
+
+    s = lsquic_mt_shi.shi_insert(hash, "key", 3, "value", 5, 0);
+    assert(0 == s);
+    /* Key exists */
+    s = lsquic_mt_shi.shi_insert(hash, "key", 3, "other", 5, 0);
+    assert(-1 == s);
+    s = lsquic_mt_shi.shi_lookup(hash, "key", 3, &datap, &data_sz);
+    assert(1 == s);
+    assert(5 == data_sz);
+    assert(0 == memcmp(datap, "value", 5));
+
+    /* Already expired */
+    s = lsquic_mt_shi.shi_insert(hash, "old", 3, "data", 4, now - 1);
+    assert(0 == s);
+    s = lsquic_mt_shi.shi_lookup(hash, "old", 3, &datap2, &data_sz);
+    assert(0 == s);
+    /* Expired element does not prevent insertion */
+    s = lsquic_mt_shi.shi_insert(hash, "old", 3, "new", 3, now + 100);
+    assert(0 == s);
+    s = lsquic_mt_shi.shi_lookup(hash, "old", 3, &datap2, &data_sz);
+    assert(1 == s);
+    assert(3 == data_sz);
+    assert(0 == memcmp(datap2, "new", 3));
+
+    s = lsquic_mt_shi.shi_delete(hash, "key", 3);
+    assert(0 == s);
+    s = lsquic_mt_shi.shi_delete(hash, "key", 3);
+    assert(-1 == s);
+    s = lsquic_mt_shi.shi_lookup(hash, "key", 3, &datap, &data_sz);
+    assert(0 == s);
+    /* Deleted data is still readable for a while */
+    assert(0 == memcmp(datap, "value", 5));
+
+    lsquic_mt_shi_destroy(hash);
+}
+
+
+#ifndef WIN32
+#define N_THREADS 4
+#define N_KEYS 1000
+
+struct thread_arg
+{
+    struct lsquic_mt_shi   *hash;
+    unsigned                id;
+};
+
+
+static void *
+thread_func (void *ptr)
+{
+    const struct thread_arg *const arg = ptr;
+    void *datap;
+    unsigned data_sz, i, round;
+    char key[32];
+    int s, len;
+
+    for (round = 0; round < 10; ++round)
+    {
+        for (i = 0; i < N_KEYS; ++i)
+        {
+            len = snprintf(key, sizeof(key), "%u-%u", arg->id, i);
+            s = lsquic_mt_shi.shi_insert(arg->hash, key, len, &i, sizeof(i),
+                                                    i & 1 ? time(NULL) + 60 : 0);
+            assert(0 == s);
+        }
+        /* Shared key: only one thread succeeds, all threads find it */
+        (void) lsquic_mt_shi.shi_insert(arg->hash, "shared", 6, "x", 1, 0);
+        for (i = 0; i < N_KEYS; ++i)
+        {
+            len = snprintf(key, sizeof(key), "%u-%u", arg->id, i);
+            s = lsquic_mt_shi.shi_lookup(arg->hash, key, len, &datap,
+                                                                    &data_sz);
+            assert(1 == s);
+            assert(sizeof(i) == data_sz);
+            assert(0 == memcmp(datap, &i, sizeof(i)));
+            s = lsquic_mt_shi.shi_lookup(arg->hash, "shared", 6, &datap,
+                                                                    &data_sz);
+            assert(1 == s);
+        }
+        for (i = 0; i < N_KEYS; ++i)
+        {
+            len = snprintf(key, sizeof(key), "%u-%u", arg->id, i);
+            s = lsquic_mt_shi.shi_delete(arg->hash, key, len);
+            assert(0 == s);
+        }
+    }
+
+    return NULL;
+}
+
+
+static void
+test_threads (void)
+{
+    struct lsquic_mt_shi *hash;
+    struct thread_arg args[N_THREADS];
+    pthread_t threads[N_THREADS];
+    unsigned i;
+    int s;
+
+    hash = lsquic_mt_shi_new(N_THREADS);
+    assert(hash);
+
+    for (i = 0; i < N_THREADS; ++i)
+    {
+        args[i].hash = hash;
+        args[i].id = i;
+        s = pthread_create(&threads[i], NULL, thread_func, &args[i]);
+        assert(0 == s);
+    }
+    for (i = 0; i < N_THREADS; ++i)
+    {
+        s = pthread_join(threads[i], NULL);
+        assert(0 == s);
+    }
+
+    lsquic_mt_shi_destroy(hash);
+}
+#endif
+
+
+int
+main (void)
+{
+    test_basic(1);
+    test_basic(16);
+    assert(!lsquic_mt_shi_new(0));
+#ifndef WIN32
+    test_threads();
+#endif
+    return 0;
+}
@@ -0,0 +1,101 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+
+#include "lsquic.h"
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_pacer.h"
+
+
+#define TX_TIME 100
+
+
+static lsquic_time_t
+get_tx_time (void *ctx)
+{
+    return TX_TIME;
+}
+
+
+/* Without horizon, the pacer holds packets back once burst tokens are
+ * used up.
+ */
+static void
+test_no_horizon (void)
+{
+    struct pacer pacer;
+    lsquic_time_t now = 1000000, departure;
+    unsigned n;
+
+    lsquic_pacer_init(&pacer, NULL, 1000, 0);
+    lsquic_pacer_tick_in(&pacer, now);
+    for (n = 0; lsquic_pacer_can_schedule(&pacer, n); ++n)
+    {
+        departure = lsquic_pacer_packet_scheduled(&pacer, n, 0, get_tx_time,
+                                                                        NULL);
+        assert(departure >= now);
+        assert(departure <= now + 1000);
+    }
+    assert(lsquic_pacer_delayed(&pacer));
+    assert(lsquic_pacer_next_sched(&pacer) > now + 1000);
+    lsquic_pacer_tick_out(&pacer);
+    /* 10 burst tokens plus clock granularity worth of packets */
+    assert(n == 10 + 1000 / TX_TIME + 1);
+    lsquic_pacer_cleanup(&pacer);
+}
+
+
+/* With horizon, packets are released until departure time is too far out.
+ * Departure times are spaced by transfer time.
+ */
+static void
+test_horizon (void)
+{
+    struct pacer pacer;
+    lsquic_time_t now = 1000000, departure, prev_departure = 0;
+    const unsigned horizon = 10000;
+    unsigned n;
+
+    lsquic_pacer_init(&pacer, NULL, 1000, horizon);
+    lsquic_pacer_tick_in(&pacer, now);
+    for (n = 0; lsquic_pacer_can_schedule(&pacer, n); ++n)
+    {
+        departure = lsquic_pacer_packet_scheduled(&pacer, n, 0, get_tx_time,
+                                                                        NULL);
+        if (n < 10)
+            assert(departure == now);
+        else if (n > 10)
+            assert(departure == prev_departure + TX_TIME);
+        assert(departure <= now + horizon);
+        prev_departure = departure;
+    }
+    assert(n == 10 + horizon / TX_TIME + 1);
+    assert(lsquic_pacer_delayed(&pacer));
+    /* Connection is to be ticked when the next packet is within horizon */
+    assert(lsquic_pacer_next_sched(&pacer) + horizon == prev_departure + TX_TIME);
+    lsquic_pacer_tick_out(&pacer);
+
+    /* Nothing more can be scheduled until the clock advances */
+    now += TX_TIME;
+    lsquic_pacer_tick_in(&pacer, now);
+    assert(lsquic_pacer_can_schedule(&pacer, n));
+    departure = lsquic_pacer_packet_scheduled(&pacer, n, 0, get_tx_time,
+                                                                        NULL);
+    assert(departure == prev_departure + TX_TIME);
+    assert(!lsquic_pacer_can_schedule(&pacer, n + 1));
+    lsquic_pacer_tick_out(&pacer);
+    lsquic_pacer_cleanup(&pacer);
+}
+
+
+int
+main (void)
+{
+    test_no_horizon();
+    test_horizon();
+    return 0;
+}
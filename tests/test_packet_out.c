@@ -95,6 +95,20 @@ main (void)
     lsquic_packet_out_destroy(packet_out, &enpub, NULL);
     assert(!lsquic_malo_first(enpub.enp_mm.malo.frame_rec_arr));
 
+    /* Cold part is allocated on demand and freed with the packet */
+    packet_out = lsquic_mm_get_packet_out(&enpub.enp_mm, NULL, GQUIC_MAX_PAYLOAD_SZ);
+    assert(!packet_out->po_cold);
+    assert(!lsquic_packet_out_nonce(packet_out));
+    assert(0 == lsquic_packet_out_token_len(packet_out));
+    assert(lsquic_packet_out_get_cold(&enpub.enp_mm, packet_out));
+    assert(packet_out->po_cold
+            == lsquic_packet_out_get_cold(&enpub.enp_mm, packet_out));
+    packet_out->po_cold->pc_token = malloc(10);
+    packet_out->po_cold->pc_token_len = 10;
+    assert(10 == lsquic_packet_out_token_len(packet_out));
+    lsquic_packet_out_destroy(packet_out, &enpub, NULL);
+    assert(!lsquic_malo_first(enpub.enp_mm.malo.packet_out_cold));
+
     lsquic_mm_cleanup(&enpub.enp_mm);
     return 0;
 }
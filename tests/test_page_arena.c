@@ -0,0 +1,170 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+
+#include "lsquic.h"
+#include "lsquic_int_types.h"
+#include "lsquic_malo.h"
+#include "lsquic_mm.h"
+
+
+#define CHUNK_SZ (2u << 20)
+
+
+static void
+test_arena (void)
+{
+    enum { N_PAGES = 1000, };
+    void *arena, *pages[N_PAGES], *page16k, *p;
+    size_t mem_used;
+    unsigned i;
+
+    arena = lsquic_page_arena_new(-1);
+    assert(arena);
+    mem_used = lsquic_page_arena_mem_used(arena);
+
+    for (i = 0; i < N_PAGES; ++i)
+    {
+        pages[i] = lsquic_page_arena_if.pgi_alloc(arena, 0x1000);
+        assert(pages[i]);
+        assert(0 == ((uintptr_t) pages[i] & 0xFFF));
+        memset(pages[i], i, 0x1000);
+    }
+    /* 1000 pages fit into two chunks */
+    assert(lsquic_page_arena_mem_used(arena) >= mem_used + 2 * CHUNK_SZ);
+    assert(lsquic_page_arena_mem_used(arena) < mem_used + 3 * CHUNK_SZ);
+    mem_used = lsquic_page_arena_mem_used(arena);
+
+    /* Freed pages are reused */
+    lsquic_page_arena_if.pgi_free(arena, pages[10], 0x1000);
+    p = lsquic_page_arena_if.pgi_alloc(arena, 0x1000);
+    assert(p == pages[10]);
+
+    page16k = lsquic_page_arena_if.pgi_alloc(arena, 0x4000);
+    assert(page16k);
+    assert(0 == ((uintptr_t) page16k & 0xFFF));
+    memset(page16k, 0xAA, 0x4000);
+    for (i = 0; i < N_PAGES; ++i)
+        assert(((unsigned char *) pages[i])[0x800] == (unsigned char) i);
+    lsquic_page_arena_if.pgi_free(arena, page16k, 0x4000);
+    assert(page16k == lsquic_page_arena_if.pgi_alloc(arena, 0x4000));
+    lsquic_page_arena_if.pgi_free(arena, page16k, 0x4000);
+
+    for (i = 0; i < N_PAGES; ++i)
+        lsquic_page_arena_if.pgi_free(arena, pages[i], 0x1000);
+    for (i = 0; i < N_PAGES; ++i)
+        pages[i] = lsquic_page_arena_if.pgi_alloc(arena, 0x1000);
+    assert(lsquic_page_arena_mem_used(arena) == mem_used);
+
+    /* Blocks larger than a chunk are not expected, but they work */
+    p = lsquic_page_arena_if.pgi_alloc(arena, CHUNK_SZ * 2);
+    assert(p);
+    memset(p, 0, CHUNK_SZ * 2);
+    assert(lsquic_page_arena_mem_used(arena) == mem_used + CHUNK_SZ * 2);
+    lsquic_page_arena_if.pgi_free(arena, p, CHUNK_SZ * 2);
+    assert(lsquic_page_arena_mem_used(arena) == mem_used);
+
+    lsquic_page_arena_destroy(arena);
+}
+
+
+struct elem
+{
+    unsigned    id;
+    char        pad[100];
+};
+
+
+static void
+test_malo (void)
+{
+    enum { N_ELEMS = 10000, };
+    struct elem *el;
+    struct malo *malo;
+    void *arena;
+    uint64_t sum;
+    unsigned i;
+
+    arena = lsquic_page_arena_new(-1);
+    malo = lsquic_malo_create_pages(sizeof(struct elem),
+                                            &lsquic_page_arena_if, arena);
+    assert(malo);
+    for (i = 1; i <= N_ELEMS; ++i)
+    {
+        el = lsquic_malo_get(malo);
+        assert(el);
+        el->id = i;
+    }
+    sum = 0;
+    for (el = lsquic_malo_first(malo); el; el = lsquic_malo_next(malo))
+    {
+        sum += el->id;
+        lsquic_malo_put(el);
+    }
+    assert(sum == (uint64_t) N_ELEMS * (N_ELEMS + 1) / 2);
+    lsquic_malo_destroy(malo);
+    lsquic_page_arena_destroy(arena);
+}
+
+
+static void
+test_mm (void)
+{
+    enum { N_BUFS = 300, };
+    struct lsquic_mm mm;
+    void *arena, *bufs[N_BUFS], *page;
+    unsigned i;
+    int s;
+
+    arena = lsquic_page_arena_new(-1);
+    s = lsquic_mm_init_pages(&mm, &lsquic_page_arena_if, arena);
+    assert(0 == s);
+
+    /* Buffers of all sizes come from slabs and do not overlap */
+    for (i = 0; i < N_BUFS; ++i)
+    {
+        bufs[i] = lsquic_mm_get_packet_out_buf(&mm, 1200 + i % 3 * 2000);
+        assert(bufs[i]);
+        assert(0 == ((uintptr_t) bufs[i] & 0xF));
+        memset(bufs[i], i, 1200);
+    }
+    for (i = 0; i < N_BUFS; ++i)
+        assert(((unsigned char *) bufs[i])[1199] == (unsigned char) i);
+    for (i = 0; i < N_BUFS; ++i)
+        lsquic_mm_put_packet_out_buf(&mm, bufs[i], 1200 + i % 3 * 2000);
+
+    for (i = 0; i < N_BUFS; ++i)
+    {
+        bufs[i] = lsquic_mm_get_packet_in_buf(&mm, i % 2 ? 1370 : 0xFFFF);
+        assert(bufs[i]);
+        memset(bufs[i], i, 1370);
+    }
+    for (i = 0; i < N_BUFS; ++i)
+        assert(((unsigned char *) bufs[i])[1369] == (unsigned char) i);
+    for (i = 0; i < N_BUFS; ++i)
+        lsquic_mm_put_packet_in_buf(&mm, bufs[i], i % 2 ? 1370 : 0xFFFF);
+
+    page = lsquic_mm_get_4k(&mm);
+    assert(page && 0 == ((uintptr_t) page & 0xFFF));
+    lsquic_mm_put_4k(&mm, page);
+    page = lsquic_mm_get_16k(&mm);
+    assert(page && 0 == ((uintptr_t) page & 0xFFF));
+    lsquic_mm_put_16k(&mm, page);
+
+    lsquic_mm_cleanup(&mm);
+    lsquic_page_arena_destroy(arena);
+}
+
+
+int
+main (void)
+{
+    test_arena();
+    test_malo();
+    test_mm();
+
+    return 0;
+}
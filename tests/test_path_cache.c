@@ -0,0 +1,200 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <time.h>
+
+#ifndef WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#else
+#include "vc_compat.h"
+#include <Ws2tcpip.h>
+#endif
+
+#include "lsquic.h"
+#include "lsquic_types.h"
+#include "lsquic_int_types.h"
+#include "lsquic_mm.h"
+#include "lsquic_stock_shi.h"
+#include "lsquic_engine_public.h"
+#include "lsquic_path_cache.h"
+
+
+static void
+make_sin (struct sockaddr_in *sin, const char *addr)
+{
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(443);
+    inet_pton(AF_INET, addr, &sin->sin_addr);
+}
+
+
+static void
+make_sin6 (struct sockaddr_in6 *sin6, const char *addr)
+{
+    memset(sin6, 0, sizeof(*sin6));
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_port = htons(443);
+    inet_pton(AF_INET6, addr, &sin6->sin6_addr);
+}
+
+
+static const struct path_state good_state =
+{
+    .ps_min_rtt = 20000,
+    .ps_srtt    = 25000,
+    .ps_bw      = 10000000,
+    .ps_cwnd    = 250000,
+    .ps_plpmtu  = 1452,
+};
+
+
+static void
+test_round_trip (struct lsquic_engine_public *enpub)
+{
+    struct sockaddr_in sin;
+    struct sockaddr_in6 sin6;
+    struct path_state state;
+    int s;
+
+    make_sin(&sin, "192.0.2.10");
+    s = lsquic_path_cache_lookup(enpub, (struct sockaddr *) &sin, &state);
+    assert(s == -1);
+
+    s = lsquic_path_cache_save(enpub, (struct sockaddr *) &sin, &good_state);
+    assert(s == 0);
+    memset(&state, 0, sizeof(state));
+    s = lsquic_path_cache_lookup(enpub, (struct sockaddr *) &sin, &state);
+    assert(s == 0);
+    assert(0 == memcmp(&state, &good_state, sizeof(state)));
+
+    /* Same /24: same entry */
+    make_sin(&sin, "192.0.2.200");
+    s = lsquic_path_cache_lookup(enpub, (struct sockaddr *) &sin, &state);
+    assert(s == 0);
+    assert(state.ps_cwnd == good_state.ps_cwnd);
+
+    /* Different /24: no entry */
+    make_sin(&sin, "192.0.3.10");
+    s = lsquic_path_cache_lookup(enpub, (struct sockaddr *) &sin, &state);
+    assert(s == -1);
+
+    /* IPv6 is keyed by /48 */
+    make_sin6(&sin6, "2001:db8:1::1");
+    s = lsquic_path_cache_save(enpub, (struct sockaddr *) &sin6, &good_state);
+    assert(s == 0);
+    make_sin6(&sin6, "2001:db8:1:ffff::2");
+    s = lsquic_path_cache_lookup(enpub, (struct sockaddr *) &sin6, &state);
+    assert(s == 0);
+    assert(state.ps_srtt == good_state.ps_srtt);
+    make_sin6(&sin6, "2001:db8:2::1");
+    s = lsquic_path_cache_lookup(enpub, (struct sockaddr *) &sin6, &state);
+    assert(s == -1);
+}
+
+
+static void
+test_replace (struct lsquic_engine_public *enpub)
+{
+    struct sockaddr_in sin;
+    struct path_state state;
+    int s;
+
+    make_sin(&sin, "198.51.100.1");
+    s = lsquic_path_cache_save(enpub, (struct sockaddr *) &sin, &good_state);
+    assert(s == 0);
+
+    state = good_state;
+    state.ps_cwnd = 500000;
+    state.ps_plpmtu = 0;
+    s = lsquic_path_cache_save(enpub, (struct sockaddr *) &sin, &state);
+    assert(s == 0);
+
+    memset(&state, 0, sizeof(state));
+    s = lsquic_path_cache_lookup(enpub, (struct sockaddr *) &sin, &state);
+    assert(s == 0);
+    assert(state.ps_cwnd == 500000);
+    assert(state.ps_plpmtu == 0);
+}
+
+
+/* Entries that do not make sense are not returned */
+static void
+test_bad_state (struct lsquic_engine_public *enpub)
+{
+    struct sockaddr_in sin;
+    struct path_state state;
+    int s;
+
+    make_sin(&sin, "203.0.113.1");
+
+    state = good_state;
+    state.ps_min_rtt = 0;
+    s = lsquic_path_cache_save(enpub, (struct sockaddr *) &sin, &state);
+    assert(s == 0);
+    s = lsquic_path_cache_lookup(enpub, (struct sockaddr *) &sin, &state);
+    assert(s == -1);
+
+    state = good_state;
+    state.ps_min_rtt = state.ps_srtt + 1;
+    s = lsquic_path_cache_save(enpub, (struct sockaddr *) &sin, &state);
+    assert(s == 0);
+    s = lsquic_path_cache_lookup(enpub, (struct sockaddr *) &sin, &state);
+    assert(s == -1);
+
+    state = good_state;
+    state.ps_srtt = 60000000;
+    s = lsquic_path_cache_save(enpub, (struct sockaddr *) &sin, &state);
+    assert(s == 0);
+    s = lsquic_path_cache_lookup(enpub, (struct sockaddr *) &sin, &state);
+    assert(s == -1);
+
+    state = good_state;
+    state.ps_cwnd = 0;
+    s = lsquic_path_cache_save(enpub, (struct sockaddr *) &sin, &state);
+    assert(s == 0);
+    s = lsquic_path_cache_lookup(enpub, (struct sockaddr *) &sin, &state);
+    assert(s == -1);
+
+    /* Entry of wrong size, e.g. written by some other code */
+    {
+        unsigned char key[] = "PATHC\x03\xCB\x00\x71";
+        char junk[] = "junk";
+        struct sockaddr_in sin2;
+        make_sin(&sin2, "203.0.113.7");
+        s = lsquic_path_cache_save(enpub, (struct sockaddr *) &sin2,
+                                                                &good_state);
+        assert(s == 0);
+        s = enpub->enp_shi->shi_delete(enpub->enp_shi_ctx, key,
+                                                            sizeof(key) - 1);
+        assert(s == 0);
+        s = enpub->enp_shi->shi_insert(enpub->enp_shi_ctx, key,
+                sizeof(key) - 1, junk, sizeof(junk), time(NULL) + 60);
+        assert(s == 0);
+        s = lsquic_path_cache_lookup(enpub, (struct sockaddr *) &sin2, &state);
+        assert(s == -1);
+    }
+}
+
+
+int
+main (void)
+{
+    struct lsquic_engine_public enpub = {
+        .enp_shi_ctx = lsquic_stock_shared_hash_new(),
+        .enp_shi = &stock_shi,
+    };
+
+    enpub.enp_settings.es_path_cache_ttl = 3600;
+
+    test_round_trip(&enpub);
+    test_replace(&enpub);
+    test_bad_state(&enpub);
+
+    lsquic_stock_shared_hash_destroy(enpub.enp_shi_ctx);
+    return 0;
+}
@@ -0,0 +1,114 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsquic_int_types.h"
+#include "lsquic_pnidx.h"
+
+
+#define N_PACKETS 1000
+
+/* The index does not dereference the pointers */
+static char s_packets[N_PACKETS];
+#define PACKET(n_) ((struct lsquic_packet_out *) &s_packets[n_])
+
+
+static void
+test_find (void)
+{
+    struct pn_index pnidx;
+    unsigned i;
+
+    lsquic_pnidx_init(&pnidx);
+    assert(lsquic_pnidx_is_on(&pnidx));
+    assert(!lsquic_pnidx_find(&pnidx, 0, UINT64_MAX));
+
+    /* Start away from zero so that the ring wraps around */
+    for (i = 0; i < N_PACKETS; ++i)
+        lsquic_pnidx_set(&pnidx, 100 + i, PACKET(i));
+    assert(lsquic_pnidx_mem_used(&pnidx) >= N_PACKETS * sizeof(void *));
+
+    for (i = 0; i < N_PACKETS; ++i)
+        assert(PACKET(i) == lsquic_pnidx_find(&pnidx, 100 + i, 100 + i));
+    assert(PACKET(0) == lsquic_pnidx_find(&pnidx, 0, UINT64_MAX));
+    assert(!lsquic_pnidx_find(&pnidx, 100 + N_PACKETS, UINT64_MAX));
+    assert(!lsquic_pnidx_find(&pnidx, 0, 99));
+
+    /* Remove every other packet in the middle */
+    for (i = 100; i < 200; i += 2)
+        lsquic_pnidx_clear(&pnidx, 100 + i, PACKET(i));
+    assert(PACKET(101) == lsquic_pnidx_find(&pnidx, 200, 300));
+    assert(!lsquic_pnidx_find(&pnidx, 200, 200));
+
+    /* Only the matching entry is cleared */
+    lsquic_pnidx_clear(&pnidx, 100 + 101, PACKET(0));
+    assert(PACKET(101) == lsquic_pnidx_find(&pnidx, 200, 300));
+
+    /* Replace entry */
+    lsquic_pnidx_set(&pnidx, 100 + 101, PACKET(0));
+    assert(PACKET(0) == lsquic_pnidx_find(&pnidx, 200, 300));
+    lsquic_pnidx_clear(&pnidx, 100 + 101, PACKET(101));
+    assert(PACKET(0) == lsquic_pnidx_find(&pnidx, 200, 300));
+    lsquic_pnidx_clear(&pnidx, 100 + 101, PACKET(0));
+
+    /* Remove from the bottom and from the top */
+    for (i = 0; i < 100; ++i)
+        lsquic_pnidx_clear(&pnidx, 100 + i, PACKET(i));
+    assert(PACKET(103) == lsquic_pnidx_find(&pnidx, 0, UINT64_MAX));
+    for (i = N_PACKETS - 1; i >= 500; --i)
+        lsquic_pnidx_clear(&pnidx, 100 + i, PACKET(i));
+    assert(!lsquic_pnidx_find(&pnidx, 600, UINT64_MAX));
+    assert(PACKET(499) == lsquic_pnidx_find(&pnidx, 599, UINT64_MAX));
+
+    for (i = 200; i < 500; ++i)
+        lsquic_pnidx_clear(&pnidx, 100 + i, PACKET(i));
+    for (i = 100; i < 200; ++i)
+        lsquic_pnidx_clear(&pnidx, 100 + i, PACKET(i));
+    assert(!lsquic_pnidx_find(&pnidx, 0, UINT64_MAX));
+
+    /* Empty index can start anywhere */
+    lsquic_pnidx_set(&pnidx, 1000000, PACKET(1));
+    assert(PACKET(1) == lsquic_pnidx_find(&pnidx, 0, UINT64_MAX));
+    /* ...and grow downward */
+    lsquic_pnidx_set(&pnidx, 999990, PACKET(2));
+    assert(PACKET(2) == lsquic_pnidx_find(&pnidx, 0, UINT64_MAX));
+    assert(PACKET(1) == lsquic_pnidx_find(&pnidx, 999991, UINT64_MAX));
+
+    lsquic_pnidx_cleanup(&pnidx);
+}
+
+
+static void
+test_off (void)
+{
+    struct pn_index pnidx;
+
+    lsquic_pnidx_init(&pnidx);
+
+    lsquic_pnidx_set(&pnidx, 1, PACKET(1));
+    lsquic_pnidx_set(&pnidx, 1u << 30, PACKET(2));
+    assert(!lsquic_pnidx_is_on(&pnidx));
+    assert(0 == lsquic_pnidx_mem_used(&pnidx));
+    /* Ignored while off */
+    lsquic_pnidx_set(&pnidx, 3, PACKET(3));
+    lsquic_pnidx_clear(&pnidx, 1, PACKET(1));
+
+    lsquic_pnidx_reset(&pnidx);
+    assert(lsquic_pnidx_is_on(&pnidx));
+    assert(!lsquic_pnidx_find(&pnidx, 0, UINT64_MAX));
+    lsquic_pnidx_set(&pnidx, 3, PACKET(3));
+    assert(PACKET(3) == lsquic_pnidx_find(&pnidx, 0, UINT64_MAX));
+
+    lsquic_pnidx_cleanup(&pnidx);
+}
+
+
+int
+main (void)
+{
+    test_find();
+    test_off();
+    return 0;
+}
@@ -0,0 +1,250 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+/*
+ * Test the Prague congestion controller response to CE marks and loss.
+ * Each call to run_round() sends a flight of packets and acknowledges all
+ * of them in a single ACK, which makes it exactly one round.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+
+#include "lsquic.h"
+#include "lsquic_int_types.h"
+#include "lsquic_cong_ctl.h"
+#include "lsquic_packet_common.h"
+#include "lsquic_packet_out.h"
+#include "lsquic_prague.h"
+#include "lsquic_hash.h"
+#include "lsquic_conn.h"
+#include "lsquic_sfcw.h"
+#include "lsquic_conn_flow.h"
+#include "lsquic_varint.h"
+#include "lsquic_hq.h"
+#include "lsquic_stream.h"
+#include "lsquic_rtt.h"
+#include "lsquic_conn_public.h"
+
+#define cci ((const struct cong_ctl_if *const)&lsquic_cong_prague_if)
+
+#define PACKET_SZ 1200
+#define MAX_ROUND 64
+
+#define ms(val_) ((val_) * 1000)
+
+
+struct test_ctx
+{
+    struct lsquic_conn          lconn;
+    struct lsquic_conn_public   conn_pub;
+    struct lsquic_prague        prague;
+    struct lsquic_packet_out    packets[MAX_ROUND];
+    lsquic_packno_t             packno;
+    lsquic_time_t               now;
+};
+
+
+static void
+init_ctx (struct test_ctx *ctx)
+{
+    struct lsquic_conn lconn = LSCONN_INITIALIZER_CIDLEN(ctx->lconn, 8);
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->lconn = lconn;
+    ctx->conn_pub.lconn = &ctx->lconn;
+    ctx->now = 1000000;
+    cci->cci_init(&ctx->prague, &ctx->conn_pub, QUIC_FTBIT_STREAM);
+}
+
+
+/* Send `n' packets, then ACK them all after `rtt'.  If `n_ect' is not
+ * zero, the ACK carries ECN counts.
+ */
+static void
+run_round (struct test_ctx *ctx, unsigned n, lsquic_time_t rtt,
+                                            uint64_t n_ce, uint64_t n_ect)
+{
+    unsigned i;
+
+    assert(n <= MAX_ROUND);
+    for (i = 0; i < n; ++i)
+    {
+        memset(&ctx->packets[i], 0, sizeof(ctx->packets[i]));
+        ctx->packets[i].po_packno = ++ctx->packno;
+        ctx->packets[i].po_sent = ctx->now;
+        cci->cci_sent(&ctx->prague, &ctx->packets[i], i * PACKET_SZ, 0);
+    }
+    ctx->now += rtt;
+    lsquic_rtt_stats_update(&ctx->conn_pub.rtt_stats, rtt, 0);
+    for (i = 0; i < n; ++i)
+        cci->cci_ack(&ctx->prague, &ctx->packets[i], PACKET_SZ, ctx->now, 0);
+    if (n_ect)
+        cci->cci_ecn(&ctx->prague, n_ce, n_ect);
+    cci->cci_end_ack(&ctx->prague, 0);
+}
+
+
+static uint64_t
+get_cwnd (struct test_ctx *ctx)
+{
+    return cci->cci_get_cwnd(&ctx->prague);
+}
+
+
+/* First CE ends slow start with alpha of 1, that is, halves the window.
+ * After that, alpha tracks the fraction of CE-marked packets and the
+ * window is reduced by alpha / 2 once per round.
+ */
+static void
+test_scalable_response (void)
+{
+    struct test_ctx ctx;
+    uint64_t cwnd, alpha;
+    unsigned i;
+
+    init_ctx(&ctx);
+    run_round(&ctx, 40, ms(20), 0, 0);
+    cwnd = get_cwnd(&ctx) + 40 * PACKET_SZ;
+    run_round(&ctx, 40, ms(20), 1, 40);
+    assert(get_cwnd(&ctx) == cwnd - cwnd / 2);
+
+    for (i = 0; i < 200; ++i)
+        run_round(&ctx, 40, ms(20), 10, 40);
+    alpha = ctx.prague.pr_alpha;
+    assert(alpha > PRAGUE_ALPHA_SCALE / 4 - PRAGUE_ALPHA_SCALE / 100);
+    assert(alpha < PRAGUE_ALPHA_SCALE / 4 + PRAGUE_ALPHA_SCALE / 100);
+    assert(!(ctx.prague.pr_flags & PR_CLASSIC));
+
+    /* Several ACKs with CE in the same round: only one reduction */
+    init_ctx(&ctx);
+    run_round(&ctx, 40, ms(20), 0, 0);
+    run_round(&ctx, 40, ms(20), 0, 40);
+    alpha = ctx.prague.pr_alpha;
+    assert(alpha < PRAGUE_ALPHA_SCALE);
+    cwnd = get_cwnd(&ctx);
+    cci->cci_ecn(&ctx.prague, 10, 40);
+    assert(get_cwnd(&ctx) == cwnd - cwnd * alpha / PRAGUE_ALPHA_SCALE / 2);
+    cwnd = get_cwnd(&ctx);
+    cci->cci_ecn(&ctx.prague, 10, 40);
+    cci->cci_loss(&ctx.prague);
+    assert(get_cwnd(&ctx) == cwnd);
+}
+
+
+/* Loss gets Reno response */
+static void
+test_loss (void)
+{
+    struct test_ctx ctx;
+    uint64_t cwnd;
+
+    init_ctx(&ctx);
+    run_round(&ctx, 40, ms(20), 0, 0);
+    cwnd = get_cwnd(&ctx);
+    cci->cci_loss(&ctx.prague);
+    assert(get_cwnd(&ctx) == cwnd / 2);
+    cci->cci_loss(&ctx.prague);
+    assert(get_cwnd(&ctx) == cwnd / 2);
+
+    /* Next round: no growth while in CWR; next loss is a new event */
+    run_round(&ctx, 40, ms(20), 0, 0);
+    assert(get_cwnd(&ctx) == cwnd / 2);
+    cci->cci_loss(&ctx.prague);
+    assert(get_cwnd(&ctx) == cwnd / 4);
+}
+
+
+/* When the path remarks ECT(1), CE is treated like loss */
+static void
+test_l4s_fallback (void)
+{
+    struct test_ctx ctx;
+    uint64_t cwnd;
+    unsigned i;
+
+    init_ctx(&ctx);
+    run_round(&ctx, 40, ms(20), 0, 40);
+    cci->cci_loss(&ctx.prague);
+    for (i = 0; i < 100; ++i)
+        run_round(&ctx, 40, ms(20), 1, 40);
+    assert(ctx.prague.pr_alpha < PRAGUE_ALPHA_SCALE / 10);
+
+    cci->cci_l4s_fallback(&ctx.prague);
+    run_round(&ctx, 40, ms(20), 0, 40);
+    cwnd = get_cwnd(&ctx);
+    cci->cci_ecn(&ctx.prague, 1, 40);
+    assert(get_cwnd(&ctx) == cwnd / 2);
+}
+
+
+/* CE marks while the queue stays well above the minimum RTT mean that
+ * the bottleneck is a classic AQM.
+ */
+static void
+test_classic_aqm (void)
+{
+    struct test_ctx ctx;
+    unsigned i;
+
+    /* L4S AQM: marks at shallow queue */
+    init_ctx(&ctx);
+    run_round(&ctx, 40, ms(20), 0, 40);
+    for (i = 0; i < 50; ++i)
+        run_round(&ctx, 40, ms(21), 4, 40);
+    assert(!(ctx.prague.pr_flags & PR_CLASSIC));
+
+    /* Classic AQM: marks with 15 ms standing queue */
+    init_ctx(&ctx);
+    run_round(&ctx, 40, ms(20), 0, 40);
+    for (i = 0; i < 50; ++i)
+        run_round(&ctx, 40, ms(35), 4, 40);
+    assert(ctx.prague.pr_flags & PR_CLASSIC);
+}
+
+
+/* Below the target RTT, the window grows more slowly, so that the rate
+ * grows as fast as it would at the target RTT.
+ */
+static void
+test_rtt_independence (void)
+{
+    struct test_ctx ctx;
+    uint64_t cwnd, growth_long, growth_short;
+    unsigned i;
+
+    init_ctx(&ctx);
+    run_round(&ctx, 40, ms(25), 0, 0);
+    cci->cci_loss(&ctx.prague);
+    run_round(&ctx, 40, ms(25), 0, 0);
+    cwnd = get_cwnd(&ctx);
+    for (i = 0; i < 20; ++i)
+        run_round(&ctx, 40, ms(25), 0, 0);
+    growth_long = get_cwnd(&ctx) - cwnd;
+
+    init_ctx(&ctx);
+    run_round(&ctx, 40, ms(5), 0, 0);
+    cci->cci_loss(&ctx.prague);
+    run_round(&ctx, 40, ms(5), 0, 0);
+    cwnd = get_cwnd(&ctx);
+    for (i = 0; i < 20; ++i)
+        run_round(&ctx, 40, ms(5), 0, 0);
+    growth_short = get_cwnd(&ctx) - cwnd;
+
+    assert(growth_long > 0);
+    assert(growth_short * 10 < growth_long);
+}
+
+
+int
+main (void)
+{
+    test_scalable_response();
+    test_loss();
+    test_l4s_fallback();
+    test_classic_aqm();
+    test_rtt_independence();
+    return 0;
+}
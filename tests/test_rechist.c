@@ -334,6 +334,96 @@ test_shuffle_1000 (unsigned seed)
 }
 
 
+/* Every other packet is lost and then retransmitted: the history goes
+ * from many single-packet ranges to one range.
+ */
+static void
+test_gaps (void)
+{
+    struct lsquic_rechist rechist;
+    const struct lsquic_packno_range *range;
+    lsquic_packno_t packno;
+    unsigned count;
+
+    lsquic_rechist_init(&rechist, 1, 0);
+
+    for (packno = 0; packno < 1000; packno += 2)
+        assert(REC_ST_OK == lsquic_rechist_received(&rechist, packno, 0));
+    assert(lsquic_rechist_largest_packno(&rechist) == 998);
+
+    count = 0;
+    for (range = lsquic_rechist_first(&rechist); range;
+                                    range = lsquic_rechist_next(&rechist))
+    {
+        assert(range->high == range->low);
+        assert(range->high == 998 - count * 2);
+        ++count;
+    }
+    assert(count == 500);
+
+    for (packno = 999; packno < 1000; packno -= 2)
+        assert(REC_ST_OK == lsquic_rechist_received(&rechist, packno, 0));
+    for (packno = 0; packno < 1000; ++packno)
+        assert(REC_ST_DUP == lsquic_rechist_received(&rechist, packno, 0));
+
+    range = lsquic_rechist_first(&rechist);
+    assert(range);
+    assert(range->high == 999);
+    assert(range->low == 0);
+    assert(!lsquic_rechist_next(&rechist));
+
+    /* Cutoff in the middle of a chunk */
+    lsquic_rechist_stop_wait(&rechist, 100);
+    range = lsquic_rechist_first(&rechist);
+    assert(range);
+    assert(range->high == 999);
+    assert(range->low == 100);
+    assert(!lsquic_rechist_next(&rechist));
+
+    lsquic_rechist_cleanup(&rechist);
+}
+
+
+/* When the number of ranges is limited, memory use is bounded even if
+ * the cutoff never moves.
+ */
+static void
+test_bounded (void)
+{
+    struct lsquic_rechist rechist;
+    const struct lsquic_packno_range *range;
+    lsquic_packno_t packno;
+    size_t mem_used;
+    unsigned count;
+
+    lsquic_rechist_init(&rechist, 1, 10);
+
+    for (packno = 0; packno < 100000; ++packno)
+        if (packno % 1000 != 999)
+            assert(REC_ST_OK == lsquic_rechist_received(&rechist, packno, 0));
+    mem_used = lsquic_rechist_mem_used(&rechist);
+    for (; packno < 1000000; ++packno)
+        if (packno % 1000 != 999)
+            assert(REC_ST_OK == lsquic_rechist_received(&rechist, packno, 0));
+    assert(lsquic_rechist_mem_used(&rechist) == mem_used);
+
+    /* Highest ranges are kept */
+    count = 0;
+    for (range = lsquic_rechist_first(&rechist); range;
+                                    range = lsquic_rechist_next(&rechist))
+    {
+        if (count == 0)
+            assert(range->high == 999998);
+        assert(range->high % 1000 == 998);
+        assert(range->low % 1000 == 0);
+        ++count;
+    }
+    assert(count == 10);
+
+    lsquic_rechist_cleanup(&rechist);
+}
+
+
 int
 main (void)
 {
@@ -445,5 +535,8 @@ main (void)
     for (i = 0; i < 10; ++i)
         test_shuffle_1000(i);
 
+    test_gaps();
+    test_bounded();
+
     return 0;
 }
@@ -45,14 +45,18 @@ static void
 run_test (const struct test *const test)
 {
 
+    struct packet_out_cold cold =
+    {
+        .pc_nonce = (unsigned char *) test->nonce,
+        .pc_ver_tag = test->ver.val,
+    };
     struct lsquic_packet_out packet_out =
     {
         .po_flags = (test->cid ? PO_CONN_ID : 0)
                   | (test->ver.val ? PO_VERSION : 0)
                   | (test->nonce ? PO_NONCE: 0)
                   ,
-        .po_nonce = (unsigned char *) test->nonce,
-        .po_ver_tag = test->ver.val,
+        .po_cold = &cold,
         .po_packno = test->packno,
     };
     lsquic_packet_out_set_packno_bits(&packet_out, test->bits);
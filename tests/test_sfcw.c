@@ -16,24 +16,28 @@
 #include "lsquic_hash.h"
 #include "lsquic_stream.h"
 #include "lsquic_conn_public.h"
+#include "lsquic_mm.h"
+#include "lsquic_engine_public.h"
 #include "lsquic_conn.h"
 
 
-int
-main (void)
+static void
+test_basic (void)
 {
-    lsquic_global_init(LSQUIC_GLOBAL_SERVER);
     const unsigned INIT_WINDOW_SIZE = 16 * 1024;
     struct lsquic_sfcw fc;
     struct lsquic_conn lconn;
     struct lsquic_conn_public conn_pub;
+    struct lsquic_engine_public enpub;
     uint64_t recv_off;
     int s;
 
     memset(&lconn, 0, sizeof(lconn));
     LSCONN_INITIALIZE(&lconn);
     memset(&conn_pub, 0, sizeof(conn_pub));
+    memset(&enpub, 0, sizeof(enpub));
     conn_pub.lconn = &lconn;
+    conn_pub.enpub = &enpub;
     lsquic_sfcw_init(&fc, INIT_WINDOW_SIZE, NULL, &conn_pub, 123);
 
     recv_off = lsquic_sfcw_get_fc_recv_off(&fc);
@@ -59,6 +63,55 @@ main (void)
     recv_off = lsquic_sfcw_get_fc_recv_off(&fc);
     assert(("Updated flow control receive window checks out",
         INIT_WINDOW_SIZE * 5 / 3 == recv_off));
+}
+
+
+/* When the engine is low on memory, the window shrinks with each update,
+ * but not below the minimum.
+ */
+static void
+test_shrink (void)
+{
+    const unsigned INIT_WINDOW_SIZE = 64 * 1024;
+    struct lsquic_sfcw fc;
+    struct lsquic_conn lconn;
+    struct lsquic_conn_public conn_pub;
+    struct lsquic_engine_public enpub;
+    uint64_t recv_off, read_off;
+    unsigned i;
+    int s;
+
+    memset(&lconn, 0, sizeof(lconn));
+    LSCONN_INITIALIZE(&lconn);
+    memset(&conn_pub, 0, sizeof(conn_pub));
+    memset(&enpub, 0, sizeof(enpub));
+    conn_pub.lconn = &lconn;
+    conn_pub.enpub = &enpub;
+    lsquic_sfcw_init(&fc, INIT_WINDOW_SIZE, NULL, &conn_pub, 123);
+    assert(INIT_WINDOW_SIZE == fc.sf_max_recv_win);
+
+    enpub.enp_mem_level = MEM_SHRINK_FC;
+    for (i = 0; i < 4; ++i)
+    {
+        recv_off = lsquic_sfcw_get_fc_recv_off(&fc);
+        read_off = recv_off - fc.sf_max_recv_win / 4;
+        s = lsquic_sfcw_set_max_recv_off(&fc, read_off);
+        assert(s);
+        lsquic_sfcw_set_read_off(&fc, read_off);
+        s = lsquic_sfcw_fc_offsets_changed(&fc);
+        assert(s);
+        /* Receive offset never goes back */
+        assert(lsquic_sfcw_get_fc_recv_off(&fc) > recv_off);
+    }
+    assert(MIN_SHRUNK_FCW == fc.sf_max_recv_win);
+}
+
 
+int
+main (void)
+{
+    lsquic_global_init(LSQUIC_GLOBAL_SERVER);
+    test_basic();
+    test_shrink();
     return 0;
 }
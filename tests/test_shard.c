@@ -0,0 +1,73 @@
+/* Copyright (c) 2017 - 2022 LiteSpeed Technologies Inc.  See LICENSE. */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lsquic.h"
+
+
+static void
+test_short_header (unsigned n_shards)
+{
+    struct lsquic_shard_ctx shard;
+    lsquic_cid_t cid;
+    unsigned char buf[32];
+    unsigned i;
+    int s;
+
+    shard.shc_count = n_shards;
+    for (shard.shc_id = 0; shard.shc_id < n_shards; ++shard.shc_id)
+        for (i = 0; i < 100; ++i)
+        {
+            lsquic_shard_generate_scid(&shard, NULL, &cid, 8);
+            assert(cid.len == 8);
+            memset(buf, 0, sizeof(buf));
+            buf[0] = 0x40;  /* Short header */
+            memcpy(buf + 1, cid.idbuf, cid.len);
+            s = lsquic_shard_from_packet(buf, sizeof(buf), 8, n_shards);
+            assert(s == (int) shard.shc_id);
+        }
+}
+
+
+static void
+test_long_header (void)
+{
+    unsigned char buf[32];
+    int s;
+
+    memset(buf, 0, sizeof(buf));
+    buf[0] = 0xC0;  /* Initial */
+    buf[1] = 0; buf[2] = 0; buf[3] = 0; buf[4] = 1; /* Version 1 */
+    buf[5] = 8;     /* DCID length */
+    buf[6] = 77;    /* First byte of DCID */
+    s = lsquic_shard_from_packet(buf, sizeof(buf), 8, 10);
+    assert(s == 7);
+    s = lsquic_shard_from_packet(buf, sizeof(buf), 8, 1);
+    assert(s == 0);
+
+    /* Invalid number of shards */
+    s = lsquic_shard_from_packet(buf, sizeof(buf), 8, 0);
+    assert(s == -1);
+    s = lsquic_shard_from_packet(buf, sizeof(buf), 8, 257);
+    assert(s == -1);
+
+    /* Too short */
+    s = lsquic_shard_from_packet(buf, 5, 8, 10);
+    assert(s == -1);
+}
+
+
+int
+main (void)
+{
+    static const unsigned counts[] = { 1, 2, 3, 7, 8, 64, 100, 255, 256, };
+    unsigned i;
+
+    for (i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i)
+        test_short_header(counts[i]);
+    test_long_header();
+
+    return 0;
+}
@@ -40,6 +40,8 @@
 #include "lsquic_bw_sampler.h"
 #include "lsquic_minmax.h"
 #include "lsquic_bbr.h"
+#include "lsquic_bbr2.h"
+#include "lsquic_prague.h"
 #include "lsquic_adaptive_cc.h"
 #include "lsquic_send_ctl.h"
 #include "lsquic_ver_neg.h"
@@ -207,7 +209,8 @@ ack_packet (lsquic_send_ctl_t *send_ctl, lsquic_packno_t packno)
     TAILQ_FOREACH(packet_out, &send_ctl->sc_unacked_packets[PNS_APP], po_next)
         if (packet_out->po_packno == packno)
         {
-            lsquic_packet_out_ack_streams(packet_out);
+            lsquic_packet_out_ack_streams(packet_out,
+                                        send_ctl->sc_conn_pub->lconn->cn_pf);
             return;
         }
     assert(0);
@@ -343,10 +346,20 @@ write_ack (struct lsquic_conn *lconn, struct lsquic_packet_out *packet_out)
 }
 
 
+static unsigned s_n_internal_errors;
+
+static void
+internal_error (struct lsquic_conn *lconn, const char *format, ...)
+{
+    ++s_n_internal_errors;
+}
+
+
 static const struct conn_iface our_conn_if =
 {
     .ci_can_write_ack = can_write_ack,
     .ci_get_path      = get_network_path,
+    .ci_internal_error = internal_error,
     .ci_write_ack     = write_ack,
 };
 
@@ -372,13 +385,13 @@ init_test_objs (struct test_objs *tobjs, unsigned initial_conn_window,
     TAILQ_INIT(&tobjs->conn_pub.read_streams);
     TAILQ_INIT(&tobjs->conn_pub.write_streams);
     TAILQ_INIT(&tobjs->conn_pub.service_streams);
+    tobjs->conn_pub.enpub = &tobjs->eng_pub;
     lsquic_cfcw_init(&tobjs->conn_pub.cfcw, &tobjs->conn_pub,
                                                     initial_conn_window);
     lsquic_conn_cap_init(&tobjs->conn_pub.conn_cap, initial_conn_window);
     lsquic_alarmset_init(&tobjs->alset, 0);
     tobjs->conn_pub.mm = &tobjs->eng_pub.enp_mm;
     tobjs->conn_pub.lconn = &tobjs->lconn;
-    tobjs->conn_pub.enpub = &tobjs->eng_pub;
     tobjs->conn_pub.send_ctl = &tobjs->send_ctl;
     tobjs->conn_pub.packet_out_malo =
                         lsquic_malo_create(sizeof(struct lsquic_packet_out));
@@ -1735,6 +1748,332 @@ test_writev (void)
 }
 
 
+static void
+on_wref_release (void *ctx, const void *buf, size_t len)
+{
+    unsigned *const n_released = ctx;
+    ++*n_released;
+}
+
+
+/* Test that registered buffer is written out as flow control allows it,
+ * that other writes are not allowed until then, that FIN follows, and
+ * that the buffer is released once all of it is ACKed.
+ */
+static void
+test_write_ref (void)
+{
+    struct test_objs tobjs;
+    lsquic_stream_t *stream;
+    struct lsquic_packet_out *packet_out;
+    ssize_t n;
+    unsigned n_released, n_packets, n_paged_out;
+    unsigned char buf_in[0x4000];
+    unsigned char buf_out[0x4000];
+    int fin, s;
+
+    memset(buf_in,          'A', 0x1000);
+    memset(buf_in + 0x1000, 'B', 0x1000);
+    memset(buf_in + 0x2000, 'C', 0x1000);
+    memset(buf_in + 0x3000, 'D', 0x1000);
+
+    init_test_objs(&tobjs, UINT_MAX, UINT_MAX, NULL);
+    stream = new_stream_ext(&tobjs, 12345, 0x1000);
+
+    /* Only full packets are written right away */
+    n_released = 0;
+    n = lsquic_stream_write_ref(stream, buf_in, 0x4000, on_wref_release,
+                                                                &n_released);
+    assert(0x4000 == n);
+    assert(0 == n_released);
+    assert(stream->sm_qflags & SMQF_WRITE_REFS);
+    assert(stream->tosend_off > 0 && stream->tosend_off < 0x1000);
+    assert(0 == stream->sm_n_buffered);
+
+    /* Regular writes have to wait for the registered buffer.  What can be
+     * written of it is written out first.
+     */
+    n = lsquic_stream_write(stream, "x", 1);
+    assert(0 == n);
+    assert(0x1000 == stream->tosend_off);
+    assert(0 == stream->sm_n_buffered);
+
+    s = lsquic_stream_shutdown(stream, 1);
+    assert(0 == s);
+    assert(!(stream->stream_flags & STREAM_FIN_SENT));
+
+    lsquic_stream_window_update(stream, 0x4000);
+    lsquic_stream_dispatch_write_events(stream);
+    assert(0 == n_released);
+    assert(!(stream->sm_qflags & SMQF_WRITE_REFS));
+    assert(stream->stream_flags & STREAM_FIN_SENT);
+
+    n = read_from_scheduled_packets(&tobjs.send_ctl, stream->id, buf_out,
+                                            sizeof(buf_out), 0, &fin, 0);
+    assert(0x4000 == n);
+    assert(0 == memcmp(buf_out, buf_in, 0x4000));
+    assert(fin);
+
+    /* Sent packets do not keep a copy of the data */
+    n_packets = 0;
+    n_paged_out = 0;
+    while ((packet_out = lsquic_send_ctl_next_packet_to_send(
+                                                    &tobjs.send_ctl, 0)))
+    {
+        lsquic_send_ctl_sent_packet(&tobjs.send_ctl, packet_out);
+        ++n_packets;
+        n_paged_out += !!(packet_out->po_flags & PO_PAGED_OUT);
+    }
+    /* Except the one that carries two STREAM frames: the data written up
+     * to the flow control limit and the data written after window update.
+     */
+    assert(n_packets > 1);
+    assert(n_paged_out == n_packets - 1);
+
+    /* The buffer is released once all of it is ACKed */
+    packet_out = TAILQ_LAST(&tobjs.send_ctl.sc_unacked_packets[PNS_APP],
+                                                            lsquic_packets_tailq);
+    assert(packet_out);
+    ack_packet(&tobjs.send_ctl, packet_out->po_packno);
+    assert(0 == n_released);
+    while ((packet_out = TAILQ_PREV(packet_out, lsquic_packets_tailq,
+                                                                po_next)))
+        ack_packet(&tobjs.send_ctl, packet_out->po_packno);
+    assert(1 == n_released);
+    assert(!lsquic_stream_has_src_regs(stream));
+
+    lsquic_stream_destroy(stream);
+    deinit_test_objs(&tobjs);
+
+    /* Buffers registered one after another are written out together */
+    init_test_objs(&tobjs, UINT_MAX, UINT_MAX, NULL);
+    stream = new_stream(&tobjs, 12345);
+    n_released = 0;
+    n = lsquic_stream_write_ref(stream, buf_in, 0x100, on_wref_release,
+                                                                &n_released);
+    assert(0x100 == n);
+    n = lsquic_stream_write_ref(stream, buf_in + 0x100, 0x100,
+                                            on_wref_release, &n_released);
+    assert(0x100 == n);
+    assert(0 == stream->tosend_off);
+    s = lsquic_stream_flush(stream);
+    assert(0 == s);
+    assert(0x200 == stream->tosend_off);
+    assert(!(stream->sm_qflags & SMQF_WRITE_REFS));
+    assert(1 == tobjs.send_ctl.sc_n_scheduled);
+    n = read_from_scheduled_packets(&tobjs.send_ctl, stream->id, buf_out,
+                                            sizeof(buf_out), 0, &fin, 1);
+    assert(0x200 == n);
+    assert(0 == memcmp(buf_out, buf_in, 0x200));
+    assert(0 == n_released);
+    /* Buffers that have been written out are released when stream is
+     * destroyed even if their contents have not been ACKed.
+     */
+    lsquic_stream_destroy(stream);
+    assert(2 == n_released);
+    deinit_test_objs(&tobjs);
+
+    /* Buffers that are not written out are released when stream is
+     * reset.
+     */
+    init_test_objs(&tobjs, UINT_MAX, UINT_MAX, NULL);
+    stream = new_stream_ext(&tobjs, 12345, 0x1000);
+    n_released = 0;
+    n = lsquic_stream_write_ref(stream, buf_in, 0x4000, on_wref_release,
+                                                                &n_released);
+    assert(0x4000 == n);
+    n = lsquic_stream_write_ref(stream, buf_in, 0x100, on_wref_release,
+                                                                &n_released);
+    assert(0x100 == n);
+    assert(0 == n_released);
+    lsquic_stream_maybe_reset(stream, 0, 1);
+    assert(1 == n_released);
+    lsquic_stream_destroy(stream);
+    assert(2 == n_released);
+    deinit_test_objs(&tobjs);
+}
+
+
+/* Test that data written from file can be read back after the packet
+ * carrying it is paged out.
+ */
+static void
+test_write_file (void)
+{
+    struct test_objs tobjs;
+    lsquic_stream_t *stream;
+    struct lsquic_packet_out *packet_out;
+    struct stream_frame stream_frame;
+    FILE *file;
+    ssize_t n;
+    size_t nw;
+    unsigned n_paged_out;
+    unsigned char buf_in[0x4000];
+    unsigned char buf_out[0x4000];
+    int fd, fin, len, s;
+
+    for (n = 0; n < (ssize_t) sizeof(buf_in); ++n)
+        buf_in[n] = 'A' + n % 26;
+    file = tmpfile();
+    assert(file);
+    nw = fwrite(buf_in, 1, sizeof(buf_in), file);
+    assert(nw == sizeof(buf_in));
+    s = fflush(file);
+    assert(0 == s);
+    fd = fileno(file);
+
+    init_test_objs(&tobjs, UINT_MAX, UINT_MAX, NULL);
+    stream = new_stream(&tobjs, 12345);
+
+    /* Short writes leave the tail to the next call.  Writes of contiguous
+     * file data are recorded as one region.
+     */
+    for (nw = 0; nw < 0x4000; nw += (size_t) n)
+    {
+        n = lsquic_stream_write_file(stream, fd, (off_t) nw, 0x4000 - nw);
+        assert(n > 0);
+    }
+    assert(TAILQ_FIRST(&stream->sm_src_regs)
+                == TAILQ_LAST(&stream->sm_src_regs, stream_src_regs));
+    assert(0x4000 == TAILQ_FIRST(&stream->sm_src_regs)->ssr_len);
+
+    /* Closing the file does not affect the stream.  Its descriptor is
+     * likely to be reused by the next file, whose contents are different.
+     */
+    fclose(file);
+    file = tmpfile();
+    assert(file);
+    memset(buf_out, 0, sizeof(buf_out));
+    nw = fwrite(buf_out, 1, sizeof(buf_out), file);
+    assert(nw == sizeof(buf_out));
+    s = fflush(file);
+    assert(0 == s);
+    fd = fileno(file);
+
+    lsquic_stream_flush(stream);
+    n = read_from_scheduled_packets(&tobjs.send_ctl, stream->id, buf_out,
+                                            sizeof(buf_out), 0, &fin, 0);
+    assert(0x4000 == n);
+    assert(0 == memcmp(buf_out, buf_in, 0x4000));
+
+    /* Pretend we sent the packets out: packet buffers are released */
+    n_paged_out = 0;
+    while ((packet_out = lsquic_send_ctl_next_packet_to_send(
+                                                    &tobjs.send_ctl, 0)))
+    {
+        lsquic_send_ctl_sent_packet(&tobjs.send_ctl, packet_out);
+        if (!(packet_out->po_flags & PO_PAGED_OUT))
+            continue;
+        ++n_paged_out;
+        assert(lsquic_packet_out_mem_used(packet_out)
+                                                < packet_out->po_n_alloc);
+
+        /* Retransmission reads the data back from file */
+        s = lsquic_packet_out_page_in(packet_out, &tobjs.eng_pub.enp_mm);
+        assert(0 == s);
+        assert(!(packet_out->po_flags & PO_PAGED_OUT));
+        len = tobjs.lconn.cn_pf->pf_parse_stream_frame(packet_out->po_data,
+                                    packet_out->po_data_sz, &stream_frame);
+        assert(len == (int) packet_out->po_data_sz);
+        assert(stream_frame.data_frame.df_offset
+                        + stream_frame.data_frame.df_size <= sizeof(buf_in));
+        assert(0 == memcmp(stream_frame.data_frame.df_data,
+                        buf_in + stream_frame.data_frame.df_offset,
+                        stream_frame.data_frame.df_size));
+        s = lsquic_packet_out_page_out(packet_out, &tobjs.eng_pub.enp_mm,
+                                                        tobjs.lconn.cn_pf);
+        assert(0 == s);
+    }
+    assert(n_paged_out > 0);
+
+    /* Once all data is ACKed, file region is dropped */
+    packet_out = TAILQ_FIRST(&tobjs.send_ctl.sc_unacked_packets[PNS_APP]);
+    assert(packet_out);
+    ack_packet(&tobjs.send_ctl, packet_out->po_packno);
+    assert(lsquic_stream_has_src_regs(stream));
+    while ((packet_out = TAILQ_NEXT(packet_out, po_next)))
+        ack_packet(&tobjs.send_ctl, packet_out->po_packno);
+    assert(!lsquic_stream_has_src_regs(stream));
+
+    /* Write too small to fill a packet is buffered */
+    lsquic_stream_window_update(stream, 0x8000);
+    n = lsquic_stream_write_file(stream, fd, 0x100, 10);
+    assert(10 == n);
+    assert(10 == stream->sm_n_buffered);
+    assert(lsquic_stream_has_src_regs(stream));
+
+    lsquic_stream_destroy(stream);
+    deinit_test_objs(&tobjs);
+    fclose(file);
+}
+
+
+/* Lost packets of a reset stream are dropped without being paged in: the
+ * data may no longer be available from its source.
+ */
+static void
+test_lost_after_reset (void)
+{
+    struct test_objs tobjs;
+    lsquic_stream_t *stream;
+    struct lsquic_packet_out *packet_out;
+    FILE *file;
+    ssize_t n;
+    size_t nw;
+    unsigned n_paged_out;
+    unsigned char buf_in[0x4000];
+    int fd, s;
+
+    init_buf(buf_in, sizeof(buf_in));
+    file = tmpfile();
+    assert(file);
+    nw = fwrite(buf_in, 1, sizeof(buf_in), file);
+    assert(nw == sizeof(buf_in));
+    s = fflush(file);
+    assert(0 == s);
+    fd = fileno(file);
+
+    init_test_objs(&tobjs, UINT_MAX, UINT_MAX, NULL);
+    stream = new_stream(&tobjs, 12345);
+    for (nw = 0; nw < sizeof(buf_in); nw += (size_t) n)
+    {
+        n = lsquic_stream_write_file(stream, fd, (off_t) nw,
+                                                    sizeof(buf_in) - nw);
+        assert(n > 0);
+    }
+    lsquic_stream_flush(stream);
+
+    n_paged_out = 0;
+    while ((packet_out = lsquic_send_ctl_next_packet_to_send(
+                                                    &tobjs.send_ctl, 0)))
+    {
+        lsquic_send_ctl_sent_packet(&tobjs.send_ctl, packet_out);
+        n_paged_out += !!(packet_out->po_flags & PO_PAGED_OUT);
+    }
+    assert(n_paged_out > 0);
+
+    lsquic_stream_maybe_reset(stream, 0, 1);
+    /* Reading data back would fail now */
+    s = ftruncate(fd, 0);
+    assert(0 == s);
+
+    s_n_internal_errors = 0;
+    lsquic_send_ctl_expire_all(&tobjs.send_ctl);
+    assert(!TAILQ_EMPTY(&tobjs.send_ctl.sc_lost_packets));
+    (void) lsquic_send_ctl_reschedule_packets(&tobjs.send_ctl);
+    assert(0 == s_n_internal_errors);
+    assert(TAILQ_EMPTY(&tobjs.send_ctl.sc_lost_packets));
+    /* Packets with other frames are resent, but without STREAM frames */
+    TAILQ_FOREACH(packet_out, &tobjs.send_ctl.sc_scheduled_packets, po_next)
+        assert(!(packet_out->po_frame_types & QUIC_FTBIT_STREAM));
+    assert(0 == stream->n_unacked);
+
+    lsquic_stream_destroy(stream);
+    deinit_test_objs(&tobjs);
+    fclose(file);
+}
+
+
 static void
 test_prio_conversion (void)
 {
@@ -1819,6 +2158,67 @@ test_read_in_middle (void)
 }
 
 
+/* Test that lent slices reference packet buffers and outlive the stream */
+static void
+test_lend (void)
+{
+    int s;
+    ssize_t nr;
+    unsigned n_slices, n_lent, n;
+    size_t off;
+    const char data[] = "BBB";
+    char buf[6];
+    struct test_objs tobjs;
+    stream_frame_t *frame;
+    lsquic_packet_in_t *packet_in;
+    struct lsquic_slice slices[4];
+
+    init_test_objs(&tobjs, 0x4000, 0x4000, NULL);
+
+    lsquic_stream_t *stream = new_stream(&tobjs, 123);
+
+    frame = new_frame_in(&tobjs, 0, 3, 0);
+    packet_in = frame->packet_in;
+    s = lsquic_stream_frame_in(stream, frame);
+    assert(0 == s);
+    /* Packet data not owned by the library must be copied */
+    frame = new_frame_in_ext(&tobjs, 3, 3, 1, &data[0]);
+    s = lsquic_stream_frame_in(stream, frame);
+    assert(0 == s);
+
+    n_lent = sizeof(slices) / sizeof(slices[0]);
+    nr = lsquic_stream_lend(stream, slices, &n_lent);
+    assert(6 == nr);
+    if (!(stream_ctor_flags & SCF_USE_DI_HASH))
+    {
+        assert(2 == n_lent);
+        assert(slices[0].handle == packet_in);
+        assert(slices[0].buf == packet_in->pi_data);
+        assert(slices[1].buf != (unsigned char *) data);
+    }
+
+    n_slices = sizeof(slices) / sizeof(slices[0]) - n_lent;
+    nr = lsquic_stream_lend(stream, slices + n_lent, &n_slices);
+    assert(0 == nr);
+    assert(0 == n_slices);
+
+    lsquic_stream_destroy(stream);
+
+    for (off = 0, n = 0; n < n_lent; ++n)
+    {
+        assert(off + slices[n].len <= sizeof(buf));
+        memcpy(buf + off, slices[n].buf, slices[n].len);
+        off += slices[n].len;
+        packet_in = slices[n].handle;
+        lsquic_packet_in_put(&tobjs.eng_pub.enp_mm, packet_in);
+    }
+    assert(6 == off);
+    assert(0 == memcmp(buf, "AAABBB", 6));
+
+    deinit_test_objs(&tobjs);
+}
+
+
 /* Test that connection flow control does not go past the max when both
  * connection limited and unlimited streams are used.
  */
@@ -3728,10 +4128,16 @@ main (int argc, char **argv)
 
     test_writev();
 
+    test_write_ref();
+    test_write_file();
+    test_lost_after_reset();
+
     test_prio_conversion();
 
     test_read_in_middle();
 
+    test_lend();
+
     test_conn_unlimited();
 
     test_flushing();